@@ -0,0 +1,68 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include <benchmark/benchmark.h>
+
+#include "../crypto/crypto.hpp"
+
+using namespace antinet_crypto;
+
+namespace {
+
+struct c_keys { ///< keys of 2 nodes, as the ones of tunserver (IDC)
+	c_multikeys_PAIR A, B;
+	c_keys() {
+		A.generate(e_crypto_system_type_X25519, 1);
+		B.generate(e_crypto_system_type_X25519, 1);
+	}
+};
+
+const c_keys & get_keys() { // generated once, not measured
+	static c_keys keys;
+	return keys;
+}
+
+} // namespace
+
+static void BM_crypto_tunnel_box_ab(benchmark::State & state) {
+	const auto & keys = get_keys();
+	c_crypto_tunnel AliceCT(keys.A, keys.B.m_pub, "Alice");
+	const std::string msg(state.range(0), 'm');
+	while (state.KeepRunning()) {
+		t_crypto_nonce nonce_used;
+		benchmark::DoNotOptimize( AliceCT.box_ab(msg, nonce_used) );
+	}
+	state.SetBytesProcessed( state.iterations() * msg.size() );
+}
+BENCHMARK(BM_crypto_tunnel_box_ab)->Arg(64)->Arg(512)->Arg(1280)->Arg(9000);
+
+static void BM_crypto_tunnel_unbox_ab(benchmark::State & state) {
+	const auto & keys = get_keys();
+	c_crypto_tunnel AliceCT(keys.A, keys.B.m_pub, "Alice");
+	c_crypto_tunnel BobCT(keys.B, keys.A.m_pub, "Bob");
+	const std::string msg(state.range(0), 'm');
+	t_crypto_nonce nonce_used;
+	const std::string boxed = AliceCT.box_ab(msg, nonce_used);
+	while (state.KeepRunning()) {
+		benchmark::DoNotOptimize( BobCT.unbox_ab(boxed, nonce_used) );
+	}
+	state.SetBytesProcessed( state.iterations() * msg.size() );
+}
+BENCHMARK(BM_crypto_tunnel_unbox_ab)->Arg(64)->Arg(512)->Arg(1280)->Arg(9000);
+
+static void BM_multikeys_pub_load_from_bin(benchmark::State & state) {
+	const std::string bin = get_keys().A.m_pub.serialize_bin();
+	while (state.KeepRunning()) {
+		c_multikeys_pub pub;
+		pub.load_from_bin(bin);
+		benchmark::DoNotOptimize(pub);
+	}
+}
+BENCHMARK(BM_multikeys_pub_load_from_bin);
+
+static void BM_multikeys_pub_get_ipv6_string_bin(benchmark::State & state) {
+	const auto & pub = get_keys().A.m_pub;
+	while (state.KeepRunning()) {
+		benchmark::DoNotOptimize( pub.get_ipv6_string_bin() );
+	}
+}
+BENCHMARK(BM_multikeys_pub_get_ipv6_string_bin);
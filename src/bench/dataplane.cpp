@@ -0,0 +1,128 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include <benchmark/benchmark.h>
+
+#include "../tunserver.hpp"
+#include "../trivialserialize.hpp"
+
+namespace {
+
+c_haship_addr make_hip(unsigned char last) {
+	c_haship_addr hip;
+	hip.at(0)=0xFD; hip.at(1)=0x42; hip.at(15)=last;
+	return hip;
+}
+
+std::string make_ipv6_packet(size_t size) { ///< IPv6 packet (as from TUN, without extra header) from fd42::1 to fd42::2
+	std::string packet(size, 0);
+	packet[0] = 0x60;
+	const auto src = make_hip(1), dst = make_hip(2);
+	std::copy( src.begin(), src.end(), packet.begin() + g_ipv6_rfc::header_position_of_src );
+	std::copy( dst.begin(), dst.end(), packet.begin() + g_ipv6_rfc::header_position_of_dst );
+	return packet;
+}
+
+class c_tunserver_bench : public c_tunserver { ///< gives access to parsing functions (static ones, no object is created)
+	public:
+		using c_tunserver::parse_tun_ip_src_dst;
+};
+
+class c_galaxy_node_no_peers : public c_galaxy_node { ///< for routing: node without direct peers, only learned routes
+	public:
+		void nodep2p_foreach_cmd( c_protocol::t_proto_cmd cmd, string_as_bin data ) override { UNUSED(cmd); UNUSED(data); }
+		const c_peering & get_peer_with_hip( c_haship_addr addr , bool require_pubkey ) override {
+			UNUSED(addr); UNUSED(require_pubkey);
+			_throw_error( expected_not_found() );
+		}
+};
+
+} // namespace
+
+// ------------------------------------------------------------------
+
+static void BM_parse_tun_ip_src_dst(benchmark::State & state) {
+	const std::string packet = make_ipv6_packet(1280);
+	while (state.KeepRunning()) {
+		auto src_dst = c_tunserver_bench::parse_tun_ip_src_dst(packet.data(), packet.size(), 0);
+		benchmark::DoNotOptimize(src_dst);
+	}
+}
+BENCHMARK(BM_parse_tun_ip_src_dst);
+
+static void BM_haship_addr_from_dot(benchmark::State & state) {
+	const std::string dot = "fd42:10a9:4318:509b:80ab:8042:6275:609b";
+	while (state.KeepRunning()) {
+		c_haship_addr addr( c_haship_addr::tag_constr_by_addr_dot() , dot );
+		benchmark::DoNotOptimize(addr);
+	}
+}
+BENCHMARK(BM_haship_addr_from_dot);
+
+static void BM_haship_addr_from_bin(benchmark::State & state) {
+	const std::string packet = make_ipv6_packet(64);
+	const t_bytes_view bin( packet.data() + g_ipv6_rfc::header_position_of_dst , g_ipv6_rfc::header_length_of_dst );
+	while (state.KeepRunning()) {
+		c_haship_addr addr( c_haship_addr::tag_constr_by_addr_bin() , bin );
+		benchmark::DoNotOptimize(addr);
+	}
+}
+BENCHMARK(BM_haship_addr_from_bin);
+
+// ------------------------------------------------------------------
+
+static void BM_trivialserialize_push(benchmark::State & state) {
+	const std::string blob(state.range(0), 'x');
+	std::vector<char> buffer( blob.size() + 64 );
+	while (state.KeepRunning()) {
+		trivialserialize::generator gen( trivialserialize::generator::tag_caller_must_keep_this_buffer_valid{} ,
+			buffer.data() , buffer.size() );
+		gen.push_byte_u(1);
+		gen.push_integer_u<2>(12345u);
+		gen.push_bytes_n_from_buff(16, blob.data());
+		gen.push_varstring(blob.data(), blob.size());
+		benchmark::DoNotOptimize(buffer.data());
+	}
+	state.SetBytesProcessed( state.iterations() * blob.size() );
+}
+BENCHMARK(BM_trivialserialize_push)->Arg(64)->Arg(1280);
+
+static void BM_trivialserialize_pop(benchmark::State & state) {
+	const std::string blob(state.range(0), 'x');
+	trivialserialize::generator gen(blob.size() + 64);
+	gen.push_byte_u(1);
+	gen.push_integer_u<2>(12345u);
+	gen.push_bytes_n_from_buff(16, blob.data());
+	gen.push_varstring(blob);
+	const std::string data = gen.str();
+	while (state.KeepRunning()) {
+		trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , data );
+		benchmark::DoNotOptimize( parser.pop_byte_u() );
+		benchmark::DoNotOptimize( parser.pop_integer_u<2,uint16_t>() );
+		benchmark::DoNotOptimize( parser.pop_bytes_n_view(16) );
+		benchmark::DoNotOptimize( parser.pop_varstring_view() );
+	}
+	state.SetBytesProcessed( state.iterations() * blob.size() );
+}
+BENCHMARK(BM_trivialserialize_pop)->Arg(64)->Arg(1280);
+
+// ------------------------------------------------------------------
+
+static void BM_routing_lookup(benchmark::State & state) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const int routes_count = state.range(0);
+	for (int i=0; i<routes_count; ++i) {
+		for (unsigned char path=0; path<2; ++path) {
+			routing.add_route_info_and_return( make_hip(i) ,
+				c_routing_manager::c_route_info( make_hip(200+path) , 2 , c_haship_pubkey() ) );
+		}
+	}
+	const c_routing_manager::c_route_reason reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet );
+	const auto dst = make_hip(routes_count/2);
+	c_routing_manager::t_flow_hash flow = 0;
+	while (state.KeepRunning()) {
+		const auto & route = routing.get_route_or_maybe_search(node, dst, reason, false, 0, ++flow);
+		benchmark::DoNotOptimize(route);
+	}
+}
+BENCHMARK(BM_routing_lookup)->Arg(1)->Arg(100)->Arg(200);
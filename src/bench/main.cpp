@@ -0,0 +1,19 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include <benchmark/benchmark.h>
+
+#include "../libs0.hpp"
+
+/***
+@file Microbenchmarks (bench.elf), using Google Benchmark.
+Run e.g.: ./bench.elf --benchmark_out=bench.json --benchmark_out_format=json
+or: make bench (that writes bench.json), see doc/hacking.md
+*/
+
+int main(int argc, char **argv) {
+	g_dbg_level_set(200, "Benchmarks: show only errors, logging would be measured too");
+	::benchmark::Initialize(&argc, argv);
+	if (::benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	::benchmark::RunSpecifiedBenchmarks();
+	return 0;
+}
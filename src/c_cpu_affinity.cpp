@@ -0,0 +1,110 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_cpu_affinity.hpp"
+#include "c_tnetdbg.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+constexpr int c_cpu_affinity::cpu_count_max;
+
+std::vector<int> c_cpu_affinity::parse_cpu_list(const std::string & text) {
+	std::vector<int> cpus;
+	std::istringstream iss(text);
+	std::string range;
+	while (std::getline(iss, range, ',')) {
+		const auto dash = range.find('-');
+		size_t pos_first = 0, pos_last = 0;
+		int first = -1, last = -1;
+		try {
+			first = std::stoi( range.substr(0, dash) , & pos_first );
+			last = (dash == std::string::npos) ? first : std::stoi( range.substr(dash + 1) , & pos_last );
+		} catch(const std::logic_error &) { } // checked below
+		const bool whole = (pos_first == range.substr(0, dash).size())
+			&& ((dash == std::string::npos) || (pos_last == range.substr(dash + 1).size()));
+		if ((!whole) || (first < 0) || (last < first) || (last >= cpu_count_max)) {
+			_throw_error( std::invalid_argument("Invalid CPU list: " + text) );
+		}
+		for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+	}
+	if (cpus.empty()) _throw_error( std::invalid_argument("Empty CPU list") );
+	return cpus;
+}
+
+#ifdef __linux__
+
+bool c_cpu_affinity::pin_this_thread(const std::vector<int> & cpus) {
+	cpu_set_t cpu_set;
+	CPU_ZERO(& cpu_set);
+	for (int cpu : cpus) CPU_SET(cpu, & cpu_set);
+	const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), & cpu_set);
+	if (error) {
+		_warn("Can not pin thread to CPUs: " << std::strerror(error));
+		return false;
+	}
+	return true;
+}
+
+int c_cpu_affinity::get_numa_node_of_cpu(int cpu) {
+	const std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	DIR * dir = opendir(path.c_str());
+	if (!dir) return -1;
+	int node = -1;
+	while (const dirent * entry = readdir(dir)) { // it has link "nodeN" to its node
+		if (std::strncmp(entry->d_name, "node", 4)) continue;
+		char * end = nullptr;
+		const long number = std::strtol(entry->d_name + 4, & end, 10);
+		if ((end != entry->d_name + 4) && (*end == '\0')) { node = static_cast<int>(number); break; }
+	}
+	closedir(dir);
+	return node;
+}
+
+int c_cpu_affinity::get_current_numa_node() {
+	unsigned int cpu = 0, node = 0;
+	if (syscall(SYS_getcpu, & cpu, & node, nullptr) != 0) return -1;
+	return static_cast<int>(node);
+}
+
+bool c_cpu_affinity::prefer_numa_node(void * addr, size_t size, int node) {
+	const size_t bits = 8 * sizeof(unsigned long);
+	if ((node < 0) || (static_cast<size_t>(node) >= bits)) return false; // one word of mask is enough for us
+	unsigned long node_mask = 1UL << node;
+	if (syscall(SYS_mbind, addr, size, MPOL_PREFERRED, & node_mask, bits, 0) != 0) { // e.g. kernel without NUMA
+		_dbg1("Can not place memory on NUMA node " << node << ": " << std::strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+#else
+
+bool c_cpu_affinity::pin_this_thread(const std::vector<int> & cpus) {
+	_UNUSED(cpus);
+	_warn("Pinning to CPUs is not supported on this system");
+	return false;
+}
+
+int c_cpu_affinity::get_numa_node_of_cpu(int cpu) { _UNUSED(cpu); return -1; }
+
+int c_cpu_affinity::get_current_numa_node() { return -1; }
+
+bool c_cpu_affinity::prefer_numa_node(void * addr, size_t size, int node) {
+	_UNUSED(addr); _UNUSED(size); _UNUSED(node);
+	return false;
+}
+
+#endif
+
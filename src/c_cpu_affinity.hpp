@@ -0,0 +1,35 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_cpu_affinity_hpp
+#define include_c_cpu_affinity_hpp
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/***
+@brief Placement of the data plane on CPUs [linux]: pin the thread of event loop to chosen CPUs (so it is not moved
+between them, and its caches stay warm), and keep its packet memory on the NUMA node of these CPUs.
+On other systems (or when kernel refuses) the functions do nothing and return false / -1.
+Uses raw syscalls and /sys, we do not need libnuma.
+*/
+class c_cpu_affinity final {
+	public:
+		constexpr static int cpu_count_max = 1024; ///< CPU numbers are below this (as CPU_SETSIZE of glibc)
+
+		/// parses list of CPUs like "2" or "2,3" or "0-3,8"
+		/// @throw std::invalid_argument if it is not valid
+		static std::vector<int> parse_cpu_list(const std::string & text);
+
+		static bool pin_this_thread(const std::vector<int> & cpus); ///< the calling thread (and threads it starts later)
+		static int get_numa_node_of_cpu(int cpu); ///< from /sys/devices/system/cpu/ ; -1 if not known
+		static int get_current_numa_node(); ///< node of CPU that runs us now; -1 if not known
+
+		/// pages of this memory (not touched yet) are taken from this node, if it has free ones
+		static bool prefer_numa_node(void * addr, size_t size, int node);
+};
+
+#endif
+
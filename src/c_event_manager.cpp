@@ -1,28 +1,66 @@
 #include "c_event_manager.hpp"
 #include "c_tnetdbg.hpp"
 
+#include <algorithm>
+
+c_event_manager::c_event_manager()
+:
+	m_busy_poll(0)
+{ }
+
+void c_event_manager::set_busy_poll(std::chrono::microseconds time) {
+	m_busy_poll = std::max( time , std::chrono::microseconds(0) );
+}
+
+bool c_event_manager::busy_poll(std::chrono::microseconds & timeout, const std::function<bool()> & poll_once) const {
+	if ((m_busy_poll.count() == 0) || (timeout.count() <= 0)) return false;
+	using std::chrono::steady_clock; // real time, also in simulation (that does not busy poll)
+	const auto start = steady_clock::now();
+	const auto spin_end = start + std::min( m_busy_poll , timeout );
+	steady_clock::time_point now;
+	do {
+		if (poll_once()) return true;
+		now = steady_clock::now();
+	} while (now < spin_end);
+	const auto spent = std::chrono::duration_cast<std::chrono::microseconds>( now - start );
+	timeout = std::max( timeout - spent , std::chrono::microseconds(0) );
+	return false;
+}
+
 #ifdef __linux__
 #include <limits>
 
 c_event_manager_linux::c_event_manager_linux(const c_tun_device_linux &tun_device, const c_udp_wrapper_linux &udp_wrapper)
 :
 	m_tun_fd(tun_device.m_tun_fd),
-	m_udp_socket(udp_wrapper.m_socket)
+	m_udp_socket(udp_wrapper.m_socket),
+	m_udp_device(udp_wrapper)
 {
+	FD_ZERO(& m_fd_set_write);
 }
 
-void c_event_manager_linux::wait_for_event() {
+void c_event_manager_linux::wait_for_event(std::chrono::microseconds timeout) {
 	_info("Selecting");
+	if (busy_poll( timeout , [this]() { return select_for( std::chrono::microseconds(0) ); } )) return;
+	select_for( timeout );
+}
+
+bool c_event_manager_linux::select_for(std::chrono::microseconds timeout) {
 	// set the wait for read events:
 	FD_ZERO(& m_fd_set_data);
 	FD_SET(m_udp_socket, &m_fd_set_data);
 	FD_SET(m_tun_fd, &m_fd_set_data);
+	FD_ZERO(& m_fd_set_write);
+	if (m_udp_device.is_send_blocked()) FD_SET(m_udp_socket, &m_fd_set_write);
 	auto fd_max = std::max(m_tun_fd, m_udp_socket);
 	_assert(fd_max < std::numeric_limits<decltype(fd_max)>::max() -1); // to be more safe, <= would be enough too
 	_assert(fd_max >= 1);
-	timeval timeout { 3 , 0 }; // http://pubs.opengroup.org/onlinepubs/007908775/xsh/systime.h.html
-	auto select_result = select( fd_max+1, &m_fd_set_data, nullptr, nullptr, & timeout); // <--- blocks
+	const auto timeout_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+	timeval timeout_tv { static_cast<time_t>(timeout_sec.count()) ,
+		static_cast<suseconds_t>((timeout - timeout_sec).count()) }; // http://pubs.opengroup.org/onlinepubs/007908775/xsh/systime.h.html
+	auto select_result = select( fd_max+1, &m_fd_set_data, &m_fd_set_write, nullptr, & timeout_tv); // <--- blocks
 	_assert(select_result >= 0);
+	return select_result > 0;
 }
 
 bool c_event_manager_linux::receive_udp_paket() {
@@ -33,6 +71,49 @@ bool c_event_manager_linux::get_tun_packet() {
 	return FD_ISSET(m_tun_fd, &m_fd_set_data);
 }
 
+bool c_event_manager_linux::udp_writable() {
+	return FD_ISSET(m_udp_socket, &m_fd_set_write);
+}
+
+#if IO_URING_AVAILABLE
+c_event_manager_uring::c_event_manager_uring(c_tun_device_linux &tun_device, c_udp_wrapper_linux &udp_wrapper)
+:
+	m_tun_device(tun_device),
+	m_udp_device(udp_wrapper),
+	m_queue( new c_io_uring_queue(tun_device.m_tun_fd, udp_wrapper.m_socket) )
+{
+	m_tun_device.m_io_queue = m_queue.get();
+	m_udp_device.m_io_queue = m_queue.get();
+}
+
+c_event_manager_uring::~c_event_manager_uring() {
+	if (m_tun_device.m_io_queue == m_queue.get()) m_tun_device.m_io_queue = nullptr; // (not if newer one took them over)
+	if (m_udp_device.m_io_queue == m_queue.get()) m_udp_device.m_io_queue = nullptr;
+}
+
+void c_event_manager_uring::wait_for_event(std::chrono::microseconds timeout) {
+	m_queue->set_udp_writable_wanted( m_udp_device.is_send_blocked() );
+	const auto poll_once = [this]() {
+		m_queue->wait( std::chrono::microseconds(0) );
+		return m_queue->has_tun() || m_queue->has_udp() || m_queue->is_udp_writable();
+	};
+	if (busy_poll( timeout , poll_once )) return;
+	m_queue->wait(timeout);
+}
+
+bool c_event_manager_uring::receive_udp_paket() {
+	return m_queue->has_udp();
+}
+
+bool c_event_manager_uring::get_tun_packet() {
+	return m_queue->has_tun();
+}
+
+bool c_event_manager_uring::udp_writable() {
+	return m_queue->is_udp_writable();
+}
+#endif // IO_URING_AVAILABLE
+
 #else
 
 c_event_manager_empty::c_event_manager_empty(const c_tun_device_empty &tun_device, const c_udp_wrapper_empty &udp_wrapper) {
@@ -40,7 +121,7 @@ c_event_manager_empty::c_event_manager_empty(const c_tun_device_empty &tun_devic
 	_UNUSED(udp_wrapper);
 }
 
-void c_event_manager_empty::wait_for_event() { }
+void c_event_manager_empty::wait_for_event(std::chrono::microseconds timeout) { _UNUSED(timeout); }
 bool c_event_manager_empty::receive_udp_paket() { return false; }
 bool c_event_manager_empty::get_tun_packet() { return false; }
 
@@ -56,7 +137,8 @@ c_event_manager_windows::c_event_manager_windows(c_tun_device_windows &tun_devic
 {
 }
 
-void c_event_manager_windows::wait_for_event() {
+void c_event_manager_windows::wait_for_event(std::chrono::microseconds timeout) {
+	_UNUSED(timeout);
 	// TODO !!!
 	// poll_one is not blocking function, possible 100% CPU usage
 	// TODO use one io_service ojbect
@@ -3,13 +3,32 @@
 
 #include "c_tun_device.hpp"
 #include "c_udp_wrapper.hpp"
+#include "c_io_uring.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
 
 class c_event_manager {
 	public:
+		c_event_manager();
 		virtual ~c_event_manager() = default;
-		virtual void wait_for_event() = 0;
+		virtual void wait_for_event(std::chrono::microseconds timeout) = 0; ///< blocks until some event, or until timeout
 		virtual bool receive_udp_paket() = 0;
 		virtual bool get_tun_packet() = 0;
+		/// after wait_for_event(): UDP socket has room again (it is waited for only while c_udp_wrapper::is_send_blocked())
+		virtual bool udp_writable() { return false; }
+
+		/// wait_for_event() first checks for events without blocking, again and again for this long (burns CPU, but event
+		/// is seen at once, without waking up the thread); then blocks as usual. 0 disables. Used by select and io_uring.
+		void set_busy_poll(std::chrono::microseconds time);
+
+	protected:
+		std::chrono::microseconds m_busy_poll;
+
+		/// the spin of busy poll: poll_once() checks for events without blocking (returns true if there is any); returns true
+		/// if an event came, else timeout is reduced by the time spent
+		bool busy_poll(std::chrono::microseconds & timeout, const std::function<bool()> & poll_once) const;
 };
 
 #ifdef __linux__
@@ -19,14 +38,41 @@ class c_udp_wrapper_linux;
 class c_event_manager_linux final : public c_event_manager {
 	public:
 		c_event_manager_linux(const c_tun_device_linux &tun_device, const c_udp_wrapper_linux &udp_wrapper);
-		void wait_for_event();
+		void wait_for_event(std::chrono::microseconds timeout);
 		bool receive_udp_paket();
 		bool get_tun_packet();
+		bool udp_writable() override;
 	private:
 		const int m_tun_fd;
 		const int m_udp_socket;
+		const c_udp_wrapper_linux & m_udp_device;
 		fd_set m_fd_set_data; ///< select events e.g. wait for UDP peering or TUN input
+		fd_set m_fd_set_write; ///< wait for room in UDP socket (when datagrams are queued)
+
+		bool select_for(std::chrono::microseconds timeout); ///< one select(); returns true if any fd is ready
+};
+
+#if IO_URING_AVAILABLE
+/**
+ * Waits and reads with io_uring (see c_io_uring_queue): reads of the devices are done by kernel in background, and
+ * the devices then take them from the queue (instead of read/recvmsg syscalls).
+ * Use it only after TUN is configured (reads start in constructor).
+ */
+class c_event_manager_uring final : public c_event_manager {
+	public:
+		/// @throw std::runtime_error if kernel can not do it, then use c_event_manager_linux
+		c_event_manager_uring(c_tun_device_linux &tun_device, c_udp_wrapper_linux &udp_wrapper);
+		~c_event_manager_uring() override; ///< devices read by themselves again (unless other c_event_manager_uring took them over)
+		void wait_for_event(std::chrono::microseconds timeout) override;
+		bool receive_udp_paket() override;
+		bool get_tun_packet() override;
+		bool udp_writable() override;
+	private:
+		c_tun_device_linux & m_tun_device;
+		c_udp_wrapper_linux & m_udp_device;
+		std::unique_ptr<c_io_uring_queue> m_queue;
 };
+#endif // IO_URING_AVAILABLE
 #else
 class c_tun_device_empty;
 class c_udp_wrapper_empty;
@@ -34,7 +80,7 @@ class c_event_manager_empty final : public c_event_manager {
 	public:
 		c_event_manager_empty() = default;
 		c_event_manager_empty(const c_tun_device_empty &tun_device, const c_udp_wrapper_empty &udp_wrapper);
-		void wait_for_event();
+		void wait_for_event(std::chrono::microseconds timeout);
 		bool receive_udp_paket();
 		bool get_tun_packet();
 };
@@ -49,7 +95,7 @@ class c_udp_wrapper_windows;
 class c_event_manager_windows final : public c_event_manager {
 public:
 	c_event_manager_windows(c_tun_device_windows &tun_device, c_udp_wrapper_windows &udp_wrapper);
-	void wait_for_event() override;
+	void wait_for_event(std::chrono::microseconds timeout) override;
 	bool receive_udp_paket() override;
 	bool get_tun_packet() override;
 private:
@@ -0,0 +1,138 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_flow_compression.hpp"
+
+constexpr unsigned int c_flow_tx::setups_to_send;
+constexpr size_t c_flow_tx::flows_max;
+constexpr size_t c_flow_rx::flows_max;
+
+namespace flow_compression {
+
+uint64_t nonce_get_counter(const t_flow_nonce & nonce) {
+	uint64_t counter = 0;
+	for (size_t i=nonce_counter_pos; i<nonce.size(); ++i) counter = (counter << 8) | nonce[i];
+	return counter;
+}
+
+void nonce_set_counter(t_flow_nonce & nonce, uint64_t counter) {
+	for (size_t i=nonce.size(); i-- > nonce_counter_pos; ) { nonce[i] = counter & 0xFF; counter >>= 8; }
+}
+
+bool nonce_same_prefix(const t_flow_nonce & a, const t_flow_nonce & b) {
+	return std::equal( a.begin() , a.begin() + nonce_counter_pos , b.begin() );
+}
+
+uint64_t counter_from_low16(uint64_t counter_last, uint16_t low) {
+	const uint64_t window = 0x10000;
+	uint64_t counter = (counter_last & ~(window-1)) | low;
+	if ((counter + window/2 <= counter_last) && (counter <= std::numeric_limits<uint64_t>::max() - window)) counter += window;
+	else if ((counter > counter_last + window/2) && (counter >= window)) counter -= window;
+	return counter;
+}
+
+} // namespace
+
+// ------------------------------------------------------------------
+
+c_flow_tx::c_flow_tx()
+	: m_enabled(false), m_id_next(1), m_use_counter(0)
+{ }
+
+c_flow_tx::t_frame_kind c_flow_tx::prepare(const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl,
+	const t_flow_nonce & nonce, t_flow_id & flow_id)
+{
+	using namespace flow_compression;
+	if (! m_enabled) return e_frame_full;
+	++m_use_counter;
+
+	auto key = std::make_pair(src_hip, dst_hip);
+	auto found = m_flow.find(key);
+	if (found == m_flow.end()) { // new flow
+		if (m_flow.size() >= flows_max) {
+			auto oldest = std::min_element( m_flow.begin() , m_flow.end() ,
+				[](const decltype(m_flow)::value_type & a, const decltype(m_flow)::value_type & b) { return a.second.m_last_use < b.second.m_last_use; } );
+			m_flow.erase(oldest);
+		}
+		t_flow_state state;
+		state.m_id = m_id_next;
+		m_id_next = (m_id_next == std::numeric_limits<t_flow_id>::max()) ? 1 : (m_id_next + 1); // 0 is never used
+		state.m_ttl = ttl;
+		state.m_nonce = nonce;
+		state.m_setups_sent = 0;
+		state.m_last_use = m_use_counter;
+		found = m_flow.emplace( key , state ).first;
+		_dbg1("New compressed flow id=" << state.m_id << " for " << src_hip << " -> " << dst_hip);
+	}
+	auto & state = found->second;
+	state.m_last_use = m_use_counter;
+	flow_id = state.m_id;
+
+	bool can_compact = (state.m_setups_sent >= setups_to_send) && (state.m_ttl == ttl) && nonce_same_prefix(state.m_nonce, nonce);
+	if (can_compact) { // receiver can find the counter only if it moves forward, and not too far
+		const uint64_t counter_last = nonce_get_counter(state.m_nonce), counter = nonce_get_counter(nonce);
+		can_compact = (counter > counter_last) && (counter - counter_last < 0x8000);
+	}
+	state.m_nonce = nonce;
+	if (can_compact) return e_frame_compact;
+
+	state.m_ttl = ttl;
+	if (state.m_setups_sent < setups_to_send) ++state.m_setups_sent;
+	return e_frame_setup;
+}
+
+void c_flow_tx::reset(t_flow_id flow_id) {
+	for (auto & flow : m_flow) {
+		if (flow.second.m_id == flow_id) {
+			_dbg1("Flow id=" << flow_id << " was reset by the receiver, will send setup again");
+			flow.second.m_setups_sent = 0;
+		}
+	}
+}
+
+void c_flow_tx::set_enabled(bool enabled) {
+	m_enabled = enabled;
+	if (! m_enabled) m_flow.clear(); // when enabled again, each flow starts with setup
+}
+
+size_t c_flow_tx::get_flows_count() const { return m_flow.size(); }
+
+// ------------------------------------------------------------------
+
+void c_flow_rx::on_setup(t_flow_id flow_id, const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl,
+	const t_flow_nonce & nonce)
+{
+	auto found = m_flow.find(flow_id);
+	if ((found == m_flow.end()) && (m_flow.size() >= flows_max)) {
+		_info("Too many compressed flows from this peer, forgetting all of them");
+		m_flow.clear(); // he will resync
+	}
+	auto & state = m_flow[flow_id];
+	state.m_src_hip = src_hip;
+	state.m_dst_hip = dst_hip;
+	state.m_ttl = ttl;
+	state.m_nonce = nonce;
+}
+
+bool c_flow_rx::decode(t_flow_id flow_id, uint16_t nonce_low, c_haship_addr & src_hip, c_haship_addr & dst_hip, unsigned char & ttl,
+	t_flow_nonce & nonce)
+{
+	using namespace flow_compression;
+	auto found = m_flow.find(flow_id);
+	if (found == m_flow.end()) return false;
+	auto & state = found->second;
+
+	const uint64_t counter_last = nonce_get_counter(state.m_nonce);
+	const uint64_t counter = counter_from_low16(counter_last, nonce_low);
+	nonce = state.m_nonce;
+	nonce_set_counter(nonce, counter);
+	if (counter > counter_last) nonce_set_counter(state.m_nonce, counter); // remember the highest one
+
+	src_hip = state.m_src_hip;
+	dst_hip = state.m_dst_hip;
+	ttl = state.m_ttl;
+	return true;
+}
+
+size_t c_flow_rx::get_flows_count() const { return m_flow.size(); }
+
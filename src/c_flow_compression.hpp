@@ -0,0 +1,97 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_flow_compression_hpp
+#define include_c_flow_compression_hpp
+
+#include "libs1.hpp"
+#include "haship.hpp"
+#include "protocol.hpp"
+
+/***
+@file Header compression of tunneled data, for one link (to one next hop).
+
+[protocol] The sender gives each flow (src HIP, dst HIP) a short flow id, and sends the full header with it in
+e_proto_cmd_tunneled_data_flow_setup: VERSION CMD FLOW_ID(2) SRC_HIP(16) DST_HIP(16) TTL NONCE(24) varstring(blob)
+then later packets are just e_proto_cmd_tunneled_data_flow: VERSION CMD FLOW_ID(2) NONCE_LOW(2) varstring(blob)
+where the rest of the nonce is implicit: its first 16 bytes are as in setup, and the last 8 bytes are a big-endian
+counter that is found nearest to the last one seen, from its low 16 bits.
+The receiver that does not know the flow (e.g. restarted, or lost the setups) answers with
+e_proto_cmd_tunneled_data_flow_reset: VERSION CMD FLOW_ID(2) and sender then again uses setup (resync).
+Flows are sent only to a peer whose frames are of c_protocol::version_min_compact_frames or newer (older nodes
+do not know these commands), and only if this is not turned off (c_tunserver::set_flow_compression).
+*/
+
+typedef uint16_t t_flow_id; ///< short id of flow, valid only on one link, in one direction
+typedef std::array<unsigned char, c_protocol::tunneled_data_nonce_size> t_flow_nonce; ///< full nonce in binary
+
+/// sending side of flow compression, one per next hop; enabled only for peers that can decode it (see c_peering_udp)
+class c_flow_tx {
+	public:
+		enum t_frame_kind {
+			e_frame_full, ///< send normal e_proto_cmd_tunneled_data
+			e_frame_setup, ///< send e_proto_cmd_tunneled_data_flow_setup
+			e_frame_compact, ///< send e_proto_cmd_tunneled_data_flow
+		};
+
+		constexpr static unsigned int setups_to_send = 3; ///< [protocol] send setup this many times, in case some are lost
+		constexpr static size_t flows_max = 4096; ///< forget least recently used flow above this
+
+		c_flow_tx();
+
+		/// how to send this packet of flow src->dst, sets flow_id if setup/compact
+		t_frame_kind prepare(const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl,
+			const t_flow_nonce & nonce, t_flow_id & flow_id);
+		void reset(t_flow_id flow_id); ///< receiver lost this flow, so use setup again
+
+		void set_enabled(bool enabled); ///< when disabled (the default), prepare() always says e_frame_full
+		size_t get_flows_count() const;
+
+	private:
+		struct t_flow_state {
+			t_flow_id m_id;
+			unsigned char m_ttl;
+			t_flow_nonce m_nonce; ///< last nonce sent in this flow
+			unsigned int m_setups_sent;
+			uint64_t m_last_use; ///< for LRU
+		};
+
+		bool m_enabled;
+		t_flow_id m_id_next;
+		uint64_t m_use_counter;
+		std::map< std::pair<c_haship_addr, c_haship_addr> , t_flow_state > m_flow; ///< by (src,dst)
+};
+
+/// receiving side of flow compression, one per peer that sends to us
+class c_flow_rx {
+	public:
+		constexpr static size_t flows_max = 4096; ///< do not let one peer make us remember more
+
+		void on_setup(t_flow_id flow_id, const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl,
+			const t_flow_nonce & nonce); ///< remember this flow (setup frame was received)
+		///! expand compact frame header into full one. Returns false if we do not know such flow (then ask for reset)
+		bool decode(t_flow_id flow_id, uint16_t nonce_low, c_haship_addr & src_hip, c_haship_addr & dst_hip, unsigned char & ttl,
+			t_flow_nonce & nonce);
+
+		size_t get_flows_count() const;
+
+	private:
+		struct t_flow_state {
+			c_haship_addr m_src_hip, m_dst_hip;
+			unsigned char m_ttl;
+			t_flow_nonce m_nonce; ///< the highest nonce seen in this flow
+		};
+		std::map< t_flow_id , t_flow_state > m_flow;
+};
+
+namespace flow_compression {
+	constexpr size_t nonce_counter_pos = 16; ///< [protocol] the last 8 bytes of nonce are the counter
+	uint64_t nonce_get_counter(const t_flow_nonce & nonce);
+	void nonce_set_counter(t_flow_nonce & nonce, uint64_t counter);
+	bool nonce_same_prefix(const t_flow_nonce & a, const t_flow_nonce & b);
+	uint64_t counter_from_low16(uint64_t counter_last, uint16_t low); ///< the counter nearest to counter_last that has such low 16 bits
+} // namespace
+
+#endif
+
@@ -0,0 +1,344 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_io_uring.hpp"
+
+#if IO_URING_AVAILABLE
+
+#include "c_tnetdbg.hpp"
+#include "c_cpu_affinity.hpp"
+#include "c_metrics.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+constexpr size_t c_io_uring_queue::slot_size;
+constexpr size_t c_io_uring_queue::tun_reads_count;
+constexpr size_t c_io_uring_queue::udp_buffers_count;
+
+namespace {
+
+template <typename T> T * ring_field(void * ring_mem, uint32_t offset) {
+	return reinterpret_cast<T*>( static_cast<char*>(ring_mem) + offset );
+}
+
+std::runtime_error make_errno_error(const std::string & what, int error) {
+	return std::runtime_error(what + ": " + std::strerror(error));
+}
+
+} // namespace
+
+c_io_uring::c_io_uring(unsigned int entries, unsigned int cq_entries)
+:
+	m_fd(-1), m_ring_mem(MAP_FAILED), m_ring_mem_size(0), m_sqes(nullptr), m_sqes_size(0)
+{
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = cq_entries;
+	m_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (m_fd < 0) _throw_error( make_errno_error("io_uring_setup", errno) );
+
+	const uint32_t features_needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG; // kernel 5.11
+	if ((params.features & features_needed) != features_needed) {
+		close(m_fd);
+		_throw_error( std::runtime_error("io_uring of this kernel is too old") );
+	}
+	m_ring_mem_size = std::max( params.sq_off.array + params.sq_entries * sizeof(unsigned int) ,
+		params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe) );
+	m_ring_mem = mmap(nullptr, m_ring_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+	m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	void * sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+	if ((m_ring_mem == MAP_FAILED) || (sqes == MAP_FAILED)) {
+		const int error = errno;
+		if (m_ring_mem != MAP_FAILED) munmap(m_ring_mem, m_ring_mem_size);
+		if (sqes != MAP_FAILED) munmap(sqes, m_sqes_size);
+		close(m_fd);
+		_throw_error( make_errno_error("io_uring mmap", error) );
+	}
+	m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+	m_sq_head = ring_field<unsigned int>(m_ring_mem, params.sq_off.head);
+	m_sq_tail = ring_field<unsigned int>(m_ring_mem, params.sq_off.tail);
+	m_sq_mask = * ring_field<unsigned int>(m_ring_mem, params.sq_off.ring_mask);
+	m_sq_entries = * ring_field<unsigned int>(m_ring_mem, params.sq_off.ring_entries);
+	m_sq_array = ring_field<unsigned int>(m_ring_mem, params.sq_off.array);
+	m_sq_tail_local = * m_sq_tail;
+	m_cq_head = ring_field<unsigned int>(m_ring_mem, params.cq_off.head);
+	m_cq_tail = ring_field<unsigned int>(m_ring_mem, params.cq_off.tail);
+	m_cq_mask = * ring_field<unsigned int>(m_ring_mem, params.cq_off.ring_mask);
+	m_cqes = ring_field<io_uring_cqe>(m_ring_mem, params.cq_off.cqes);
+}
+
+c_io_uring::~c_io_uring() {
+	munmap(m_sqes, m_sqes_size);
+	munmap(m_ring_mem, m_ring_mem_size);
+	close(m_fd); // kernel cancels what is still in progress
+}
+
+io_uring_sqe * c_io_uring::get_sqe() {
+	const unsigned int head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+	if (m_sq_tail_local - head >= m_sq_entries) return nullptr;
+	const unsigned int index = m_sq_tail_local & m_sq_mask;
+	io_uring_sqe * sqe = & m_sqes[index];
+	std::memset(sqe, 0, sizeof(*sqe));
+	m_sq_array[index] = index;
+	++m_sq_tail_local;
+	return sqe;
+}
+
+size_t c_io_uring::get_sqe_pending() const {
+	return m_sq_tail_local - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE); // kernel did not take them yet
+}
+
+void c_io_uring::enter(bool wait, std::chrono::microseconds timeout) {
+	const unsigned int to_submit = get_sqe_pending();
+	__atomic_store_n(m_sq_tail, m_sq_tail_local, __ATOMIC_RELEASE);
+	if ((!to_submit) && (!wait)) return;
+
+	const auto timeout_sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+	__kernel_timespec timeout_ts;
+	timeout_ts.tv_sec = timeout_sec.count();
+	timeout_ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout - timeout_sec).count();
+	io_uring_getevents_arg arg;
+	std::memset(&arg, 0, sizeof(arg));
+	arg.ts = reinterpret_cast<uint64_t>(&timeout_ts);
+
+	const unsigned int flags = wait ? (IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG) : 0;
+	const long int ret = syscall(__NR_io_uring_enter, m_fd, to_submit, wait ? 1 : 0, flags,
+		wait ? &arg : nullptr, wait ? sizeof(arg) : 0); // <--- blocks
+	if (ret < 0) {
+		const int error = errno;
+		if ((error != ETIME) && (error != EINTR) && (error != EAGAIN) && (error != EBUSY)) _throw_error( make_errno_error("io_uring_enter", error) );
+	}
+}
+
+void c_io_uring::take_completions(std::vector<t_completion> & out) {
+	unsigned int head = * m_cq_head; // only we write it
+	const unsigned int tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+	for ( ; head != tail ; ++head) {
+		const io_uring_cqe & cqe = m_cqes[head & m_cq_mask];
+		out.push_back( t_completion{ cqe.user_data , cqe.res , cqe.flags } );
+	}
+	__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+}
+
+int c_io_uring::register_any(unsigned int opcode, void * arg, unsigned int nr_args) {
+	const long int ret = syscall(__NR_io_uring_register, m_fd, opcode, arg, nr_args);
+	return (ret < 0) ? -errno : static_cast<int>(ret);
+}
+
+// ------------------------------------------------------------------
+
+c_io_uring_queue::c_io_uring_queue(int tun_fd, int udp_socket)
+:
+	m_tun_fd(tun_fd), m_udp_socket(udp_socket),
+	m_ring( new c_io_uring(64, 256) ), // CQ has room for completions of all buffers
+	m_pool(nullptr), m_pool_size( (tun_reads_count + udp_buffers_count) * slot_size ), m_tun_fixed(false),
+	m_buf_ring(nullptr), m_buf_ring_size( udp_buffers_count * sizeof(io_uring_buf) ), m_buf_ring_tail(0),
+	m_udp_armed(false), m_udp_writable_wanted(false), m_udp_writable_armed(false), m_udp_writable(false)
+{
+	void * pool = mmap(nullptr, m_pool_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void * buf_ring = mmap(nullptr, m_buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // page aligned
+	if ((pool == MAP_FAILED) || (buf_ring == MAP_FAILED)) {
+		if (pool != MAP_FAILED) munmap(pool, m_pool_size);
+		if (buf_ring != MAP_FAILED) munmap(buf_ring, m_buf_ring_size);
+		_throw_error( std::runtime_error("io_uring: can not allocate packet pool") );
+	}
+	m_pool = static_cast<unsigned char*>(pool);
+	m_buf_ring = static_cast<io_uring_buf_ring*>(buf_ring);
+	const int numa_node = c_cpu_affinity::get_current_numa_node(); // of the event loop, that will read packets from it
+	c_cpu_affinity::prefer_numa_node(m_pool, m_pool_size, numa_node); // before pages are touched (registered, below)
+	c_cpu_affinity::prefer_numa_node(m_buf_ring, m_buf_ring_size, numa_node);
+
+	try {
+		std::vector<iovec> tun_buffers;
+		for (size_t slot=0; slot<tun_reads_count; ++slot) tun_buffers.push_back( iovec{ get_slot(slot) , slot_size } );
+		const int register_result = m_ring->register_any(IORING_REGISTER_BUFFERS, tun_buffers.data(), tun_buffers.size());
+		m_tun_fixed = (register_result >= 0); // e.g. RLIMIT_MEMLOCK can forbid it, then plain reads are fine too
+		if (!m_tun_fixed) _note("io_uring: TUN buffers not registered: " << std::strerror(-register_result));
+
+		io_uring_buf_reg buf_reg;
+		std::memset(&buf_reg, 0, sizeof(buf_reg));
+		buf_reg.ring_addr = reinterpret_cast<uint64_t>(m_buf_ring);
+		buf_reg.ring_entries = udp_buffers_count;
+		buf_reg.bgid = 0;
+		const int buf_ring_result = m_ring->register_any(IORING_REGISTER_PBUF_RING, &buf_reg, 1); // kernel 5.19
+		if (buf_ring_result < 0) _throw_error( make_errno_error("io_uring: buffer ring", -buf_ring_result) );
+		for (size_t id=0; id<udp_buffers_count; ++id) give_udp_buffer(id);
+
+		std::memset(&m_udp_msg, 0, sizeof(m_udp_msg));
+		m_udp_msg.msg_namelen = (sizeof(sockaddr_in6) + 7) & ~size_t(7); // so the cmsg after it is aligned
+		m_udp_msg.msg_controllen = CMSG_SPACE(sizeof(int)); // UDP_GRO
+
+		for (size_t slot=0; slot<tun_reads_count; ++slot) m_tun_to_queue.push_back(slot);
+		prepare();
+		m_ring->enter(false, std::chrono::microseconds(0));
+		process_completions(); // bad request (e.g. multishot recvmsg of kernel older then 6.0) fails at once
+		if (!m_udp_armed) _throw_error( std::runtime_error("io_uring: multishot recvmsg not supported") );
+	} catch(...) {
+		m_ring.reset();
+		munmap(m_buf_ring, m_buf_ring_size);
+		munmap(m_pool, m_pool_size);
+		throw;
+	}
+	_note("io_uring: ready, TUN reads " << tun_reads_count << (m_tun_fixed ? " (registered buffers)" : "")
+		<< ", UDP buffers " << udp_buffers_count);
+}
+
+c_io_uring_queue::~c_io_uring_queue() {
+	m_ring.reset(); // no more reads into our memory
+	munmap(m_buf_ring, m_buf_ring_size);
+	munmap(m_pool, m_pool_size);
+}
+
+unsigned char * c_io_uring_queue::get_slot(size_t slot) const {
+	return m_pool + slot * slot_size;
+}
+
+void c_io_uring_queue::give_udp_buffer(uint16_t buffer_id) {
+	// not m_buf_ring->bufs[]: in C++ that flexible array (of kernel header) is not at offset 0, where kernel has it
+	io_uring_buf & buf = reinterpret_cast<io_uring_buf*>(m_buf_ring)[ m_buf_ring_tail & (udp_buffers_count - 1) ];
+	buf.addr = reinterpret_cast<uint64_t>( get_slot( tun_reads_count + buffer_id ) );
+	buf.len = slot_size;
+	buf.bid = buffer_id;
+	++m_buf_ring_tail;
+	__atomic_store_n(& m_buf_ring->tail, m_buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+void c_io_uring_queue::prepare() {
+	while (! m_tun_to_queue.empty()) {
+		io_uring_sqe * sqe = m_ring->get_sqe();
+		if (!sqe) return; // rest in next wait()
+		const size_t slot = m_tun_to_queue.front();
+		m_tun_to_queue.pop_front();
+		sqe->opcode = m_tun_fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->fd = m_tun_fd;
+		sqe->addr = reinterpret_cast<uint64_t>( get_slot(slot) );
+		sqe->len = slot_size;
+		sqe->off = static_cast<uint64_t>(-1); // current position (TUN has none)
+		if (m_tun_fixed) sqe->buf_index = slot;
+		sqe->user_data = (uint64_t(e_kind_tun) << 32) | slot;
+	}
+	if ((!m_udp_armed) && m_udp_ready.empty()) { // (re)arm when all buffers are back (e.g. it stopped as there were none)
+		io_uring_sqe * sqe = m_ring->get_sqe();
+		if (!sqe) return;
+		sqe->opcode = IORING_OP_RECVMSG;
+		sqe->fd = m_udp_socket;
+		sqe->addr = reinterpret_cast<uint64_t>( & m_udp_msg );
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = 0;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->user_data = uint64_t(e_kind_udp) << 32;
+		m_udp_armed = true;
+	}
+	if (m_udp_writable_wanted && (!m_udp_writable_armed)) {
+		io_uring_sqe * sqe = m_ring->get_sqe();
+		if (!sqe) return;
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = m_udp_socket;
+		sqe->poll32_events = POLLOUT;
+		sqe->user_data = uint64_t(e_kind_udp_writable) << 32;
+		m_udp_writable_armed = true;
+	}
+}
+
+void c_io_uring_queue::process_completions() {
+	m_completions.clear();
+	m_ring->take_completions(m_completions);
+	for (const auto & completion : m_completions) {
+		const uint64_t kind = completion.m_user_data >> 32;
+		const size_t slot = completion.m_user_data & 0xFFFFFFFF;
+		if (kind == e_kind_tun) {
+			if ((completion.m_res == -EAGAIN) || (completion.m_res == -EINTR)) m_tun_to_queue.push_back(slot);
+			else m_tun_ready.emplace_back(slot, completion.m_res);
+		}
+		else if (kind == e_kind_udp) {
+			if (! (completion.m_flags & IORING_CQE_F_MORE)) m_udp_armed = false; // e.g. no buffers left, or error
+			if (completion.m_flags & IORING_CQE_F_BUFFER) {
+				m_udp_ready.emplace_back(completion.m_flags >> IORING_CQE_BUFFER_SHIFT, completion.m_res);
+			}
+			else if (completion.m_res != -ENOBUFS) _dbg1("io_uring: UDP recvmsg error: " << std::strerror(-completion.m_res));
+		}
+		else if (kind == e_kind_udp_writable) {
+			m_udp_writable_armed = false;
+			if (completion.m_res > 0) m_udp_writable = true; // POLLOUT (or error, that the send will show)
+		}
+		else _warn("io_uring: unknown completion " << completion.m_user_data);
+	}
+}
+
+void c_io_uring_queue::wait(std::chrono::microseconds timeout) {
+	m_udp_writable = false;
+	process_completions(); // reads memory only
+	prepare();
+	const bool ready = has_tun() || has_udp() || m_udp_writable;
+	// with something to do, avoid the syscall while kernel still has most of TUN reads (they go in next wait)
+	if (ready && (m_ring->get_sqe_pending() < tun_reads_count / 2)) return;
+	m_ring->enter( (!ready) && (timeout.count() > 0) , timeout );
+	process_completions();
+}
+
+bool c_io_uring_queue::has_tun() const { return ! m_tun_ready.empty(); }
+
+bool c_io_uring_queue::has_udp() const { return ! m_udp_ready.empty(); }
+
+void c_io_uring_queue::set_udp_writable_wanted(bool wanted) { m_udp_writable_wanted = wanted; }
+
+bool c_io_uring_queue::is_udp_writable() const { return m_udp_writable; }
+
+ssize_t c_io_uring_queue::read_tun(void * buf, size_t count) {
+	if (m_tun_ready.empty()) { errno = EAGAIN; return -1; }
+	const auto ready = m_tun_ready.front();
+	m_tun_ready.pop_front();
+	m_tun_to_queue.push_back(ready.first); // after we copy it out; kernel gets it in next wait()
+	if (ready.second < 0) { errno = -ready.second; return -1; }
+	const size_t size = std::min(count, static_cast<size_t>(ready.second));
+	if (size < static_cast<size_t>(ready.second)) { // as read() would, but not silently
+		_warn("io_uring: TUN packet of " << ready.second << " octets does not fit buffer of " << count << ", it is cut");
+		c_metrics::get_instance().get_counter("galaxy_tun_read_truncated_total",
+			"TUN packets bigger than the read buffer; the rest of them was dropped").add(1);
+	}
+	std::memcpy(buf, get_slot(ready.first), size);
+	return size;
+}
+
+ssize_t c_io_uring_queue::recvmsg_udp(msghdr & msg) {
+	if (m_udp_ready.empty()) { errno = EAGAIN; return -1; }
+	const auto ready = m_udp_ready.front();
+	m_udp_ready.pop_front();
+	const uint16_t buffer_id = ready.first;
+	const unsigned char * data = get_slot(tun_reads_count + buffer_id);
+	// [linux] buffer has: io_uring_recvmsg_out, name (room of m_udp_msg.msg_namelen), control (room of its msg_controllen), payload
+	const size_t name_room = m_udp_msg.msg_namelen, control_room = m_udp_msg.msg_controllen;
+	const size_t header_size = sizeof(io_uring_recvmsg_out) + name_room + control_room;
+	if ((ready.second < 0) || (static_cast<size_t>(ready.second) < header_size)) {
+		give_udp_buffer(buffer_id);
+		errno = (ready.second < 0) ? -ready.second : EIO;
+		return -1;
+	}
+	io_uring_recvmsg_out out;
+	std::memcpy(&out, data, sizeof(out));
+
+	const size_t name_size = std::min<size_t>( { out.namelen , name_room , msg.msg_namelen } );
+	std::memcpy(msg.msg_name, data + sizeof(out), name_size);
+	msg.msg_namelen = std::min<size_t>(out.namelen, name_room);
+	const size_t control_size = std::min<size_t>( { out.controllen , control_room , msg.msg_controllen } );
+	std::memcpy(msg.msg_control, data + sizeof(out) + name_room, control_size);
+	msg.msg_controllen = control_size;
+	msg.msg_flags = out.flags;
+	const size_t payload_size = std::min<size_t>( out.payloadlen , ready.second - header_size );
+	const size_t size = std::min(payload_size, msg.msg_iov[0].iov_len);
+	std::memcpy(msg.msg_iov[0].iov_base, data + header_size, size);
+	give_udp_buffer(buffer_id);
+	return size;
+}
+
+#endif // IO_URING_AVAILABLE
+
@@ -0,0 +1,142 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_io_uring_hpp
+#define include_c_io_uring_hpp
+
+#if defined(__linux__) && defined(__has_include)
+	#if __has_include(<linux/io_uring.h>)
+		#include <linux/io_uring.h>
+	#endif
+#endif
+
+#ifdef IORING_RECV_MULTISHOT // headers of kernel 6.0+ (running kernel is checked at runtime)
+	#define IO_URING_AVAILABLE 1
+#else
+	#define IO_URING_AVAILABLE 0
+#endif
+
+#if IO_URING_AVAILABLE
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/***
+@brief Linux io_uring: submission and completion rings shared with kernel (used by raw syscalls, we do not use liburing).
+Only what c_io_uring_queue needs.
+*/
+class c_io_uring final {
+	public:
+		struct t_completion {
+			uint64_t m_user_data;
+			int32_t m_res; ///< result (size) of operation, or -errno
+			uint32_t m_flags; ///< IORING_CQE_F_*
+		};
+
+		/// @throw std::runtime_error if kernel has no io_uring (or not the features we need)
+		c_io_uring(unsigned int entries, unsigned int cq_entries);
+		~c_io_uring();
+		c_io_uring(const c_io_uring &) = delete;
+		c_io_uring & operator=(const c_io_uring &) = delete;
+
+		io_uring_sqe * get_sqe(); ///< zeroed entry to fill; it is given to kernel in next enter(); nullptr if ring is full
+		size_t get_sqe_pending() const; ///< how many entries are prepared, and not yet given to kernel
+
+		/// gives prepared entries to kernel, and (if wait) waits until there is a completion, or timeout
+		void enter(bool wait, std::chrono::microseconds timeout);
+		void take_completions(std::vector<t_completion> & out); ///< appends all completions that are ready (reads memory only)
+
+		int register_any(unsigned int opcode, void * arg, unsigned int nr_args); ///< io_uring_register(); returns -errno on error
+
+	private:
+		int m_fd;
+		void * m_ring_mem; ///< mmap of SQ and CQ rings (one mmap, IORING_FEAT_SINGLE_MMAP)
+		size_t m_ring_mem_size;
+		io_uring_sqe * m_sqes;
+		size_t m_sqes_size;
+
+		unsigned int * m_sq_head;
+		unsigned int * m_sq_tail;
+		unsigned int m_sq_mask;
+		unsigned int m_sq_entries;
+		unsigned int * m_sq_array;
+		unsigned int m_sq_tail_local; ///< our tail: entries up to it are prepared (and given to kernel up to *m_sq_tail)
+
+		unsigned int * m_cq_head;
+		unsigned int * m_cq_tail;
+		unsigned int m_cq_mask;
+		io_uring_cqe * m_cqes;
+};
+
+/***
+@brief Reads of TUN and UDP done by io_uring: kernel reads into our packet pool while we process other packets,
+and we take many results (completions) at once, so in steady state we do about one syscall per wait, not one per packet.
+- TUN: tun_reads_count reads are kept queued, each into own buffer (registered, if kernel allows).
+- UDP: one multishot recvmsg, that gives each datagram in one of udp_buffers_count provided buffers (buffer ring).
+Data is copied out in read_tun() / recvmsg_udp(), and the buffer goes back to kernel.
+*/
+class c_io_uring_queue final {
+	public:
+		constexpr static size_t slot_size = 65536 + 256; ///< packet of up to 64 KiB, with headers (PI, virtio, recvmsg_out, address, cmsg)
+		constexpr static size_t tun_reads_count = 8;
+		constexpr static size_t udp_buffers_count = 32; ///< power of 2 (buffer ring)
+
+		/// @throw std::runtime_error if kernel does not support what we need (then use c_event_manager_linux)
+		c_io_uring_queue(int tun_fd, int udp_socket);
+		~c_io_uring_queue();
+
+		void wait(std::chrono::microseconds timeout); ///< returns at once if something is ready already
+		bool has_tun() const;
+		bool has_udp() const;
+
+		void set_udp_writable_wanted(bool wanted); ///< also wait for room in UDP socket (e.g. it has queued datagrams)
+		bool is_udp_writable() const; ///< UDP socket had room, in last wait()
+
+		ssize_t read_tun(void * buf, size_t count); ///< takes next read from TUN, like read() (-1 and errno on error)
+		/// takes next datagram, like recvmsg() would give it: fills msg_name, msg_iov[0], msg_control and their sizes, msg_flags
+		ssize_t recvmsg_udp(msghdr & msg);
+
+	private:
+		enum t_kind : uint64_t { e_kind_tun = 1, e_kind_udp = 2, e_kind_udp_writable = 3 }; ///< in high bits of user_data, slot in low bits
+
+		const int m_tun_fd;
+		const int m_udp_socket;
+		std::unique_ptr<c_io_uring> m_ring; ///< closed first, before m_pool is freed
+
+		unsigned char * m_pool; ///< tun_reads_count + udp_buffers_count slots, of slot_size each
+		size_t m_pool_size;
+		bool m_tun_fixed; ///< are TUN slots registered buffers (IORING_OP_READ_FIXED)
+
+		io_uring_buf_ring * m_buf_ring; ///< UDP slots given to kernel
+		size_t m_buf_ring_size;
+		uint16_t m_buf_ring_tail;
+		msghdr m_udp_msg; ///< for multishot recvmsg: tells only how much room to keep for address and cmsg
+		bool m_udp_armed; ///< multishot recvmsg is active
+		bool m_udp_writable_wanted;
+		bool m_udp_writable_armed; ///< poll for POLLOUT is active
+		bool m_udp_writable;
+
+		std::deque<size_t> m_tun_to_queue; ///< TUN slots to read into again
+		std::deque<std::pair<size_t, int32_t>> m_tun_ready; ///< slot, result
+		std::deque<std::pair<size_t, int32_t>> m_udp_ready; ///< buffer id, result
+		std::vector<c_io_uring::t_completion> m_completions; ///< reused
+
+		unsigned char * get_slot(size_t slot) const; ///< UDP buffer id N is slot tun_reads_count+N
+		void prepare(); ///< queues TUN reads and arms UDP, as far as ring has room
+		void process_completions();
+		void give_udp_buffer(uint16_t buffer_id);
+};
+
+#endif // IO_URING_AVAILABLE
+
+#endif
+
@@ -50,6 +50,13 @@ void c_json_genconf::generate_galaxy_conf(const std::string &filename) {
 		conf_file << "\t// --- above --- insert the credentials from friends\n";
 		conf_file << "\t],\n";
 		conf_file << "\n";
+		conf_file << "\t// Limit of what each peer can send to us (protects CPU of this node, e.g. when relaying for others), 0 is no limit.\n";
+		conf_file << "\t// Burst is how much can come at once (0: as much as in one second). Change it at runtime by RPC command set_rate_limit.\n";
+		conf_file << "\t\"rateLimit\" : {\n";
+		conf_file << "\t\t\"packetsPerSecond\": 100000, \"packetsBurst\": 10000,\n";
+		conf_file << "\t\t\"bytesPerSecond\": 0, \"bytesBurst\": 0\n";
+		conf_file << "\t},\n";
+		conf_file << "\n";
 		conf_file << "\t// Private key. Your confidentiality and data integrity depend on this key, keep it SECRET!!!\n";
 		conf_file << "\t\"privateKeyType\": \"master-dh\",\n";
 		conf_file << "\t\"privateKey\": \"ed25519:1fffffffffffffffffffaaaaaaaaaaabbbbbbbbbbbbbbbbcccccccccccc11111\"\n";
@@ -92,7 +92,7 @@ void c_connect_to_load::get_peers(std::vector<t_peering_reference> &peer_refs) {
 	}
 }
 
-c_galaxyconf_load::c_galaxyconf_load(const std::string &filename) : m_filename(filename) {
+c_galaxyconf_load::c_galaxyconf_load(const std::string &filename) : m_filename(filename), m_rate_limit_loaded(false) {
 	try {
 		c_json_file_parser parser(filename);
 		m_root = parser.get_root();
@@ -105,6 +105,7 @@ c_galaxyconf_load::c_galaxyconf_load(const std::string &filename) : m_filename(f
 
 		auth_password_load();
 		connect_to_load();
+		rate_limit_load();
 
 	} catch (std::invalid_argument &err) {
 		_info("Fail to load " << m_filename <<  " configuration file." << err.what());
@@ -115,6 +116,11 @@ std::vector<t_peering_reference> c_galaxyconf_load::get_peer_references() {
 	return m_peer_references;
 }
 
+bool c_galaxyconf_load::get_rate_limit(t_rate_limit &rate_limit) const {
+	if (m_rate_limit_loaded) rate_limit = m_rate_limit;
+	return m_rate_limit_loaded;
+}
+
 t_my_keypair c_galaxyconf_load::my_keypair_load() {
 	std::string private_key_type = m_root.get("privateKeyType","").asString();
 	if(private_key_type == "") {
@@ -169,6 +175,20 @@ void c_galaxyconf_load::connect_to_load() {
 
 }
 
+void c_galaxyconf_load::rate_limit_load() {
+	const Json::Value rate_limit = m_root.get("rateLimit","");
+	if (! rate_limit.isObject()) return; // optional
+	m_rate_limit.m_packets_per_second = rate_limit.get("packetsPerSecond",0.0).asDouble();
+	m_rate_limit.m_packets_burst = rate_limit.get("packetsBurst",0.0).asDouble();
+	m_rate_limit.m_bytes_per_second = rate_limit.get("bytesPerSecond",0.0).asDouble();
+	m_rate_limit.m_bytes_burst = rate_limit.get("bytesBurst",0.0).asDouble();
+	if ((m_rate_limit.m_packets_per_second < 0) || (m_rate_limit.m_packets_burst < 0)
+		|| (m_rate_limit.m_bytes_per_second < 0) || (m_rate_limit.m_bytes_burst < 0)) {
+		_throw_error( std::invalid_argument("negative value in rateLimit in " + m_filename + " file") );
+	}
+	m_rate_limit_loaded = true;
+}
+
 // test - simple usage
 int json_test() {
 
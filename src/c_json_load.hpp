@@ -86,14 +86,18 @@ class c_galaxyconf_load {
 	c_galaxyconf_load (const c_galaxyconf_load &) = delete;
 
 	std::vector<t_peering_reference> get_peer_references ();
+	bool get_rate_limit (t_rate_limit &rate_limit) const; ///< from "rateLimit", false if it is not there
 
   private:
 	std::string m_filename;
 	Json::Value m_root;
 	std::vector<t_peering_reference> m_peer_references;
 	std::vector<t_auth_password> m_auth_passwords;
+	bool m_rate_limit_loaded;
+	t_rate_limit m_rate_limit;
 
 	t_my_keypair my_keypair_load ();
 	void auth_password_load ();
 	void connect_to_load ();
+	void rate_limit_load ();
 };
@@ -0,0 +1,108 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_keepalive.hpp"
+#include "c_tnetdbg.hpp"
+
+#include <algorithm>
+
+c_keepalive::t_config::t_config()
+:
+	m_interval_start( std::chrono::seconds(1) ), m_start_count(2),
+	m_interval_min( std::chrono::seconds(3) ), m_interval_max( std::chrono::seconds(25) ),
+	m_hello_refresh( std::chrono::seconds(120) ), m_hello_answer_min( std::chrono::seconds(2) ),
+	m_jitter(0.2)
+{ }
+
+c_keepalive::c_keepalive(uint32_t seed, const t_config & config)
+:
+	m_config(config), m_random(seed),
+	m_due( t_clock::time_point::min() ), m_due_planned( t_clock::time_point::min() ),
+	m_interval( config.m_interval_start ), m_polls(0), m_hellos_sent(0),
+	m_hello_wanted(false), m_ping_outstanding(false), m_received(false)
+{ }
+
+c_keepalive::t_action c_keepalive::poll(t_clock::time_point now, bool identity_known) {
+	if (now < m_due) return e_action_none;
+
+	if (now < m_due_planned) { // only to answer his hello, the plan stays
+		_check( m_hello_wanted );
+		m_hello_wanted = false;
+		m_due = m_due_planned;
+		m_ping_last = now; // a ping is sent with it too
+		m_ping_outstanding = true;
+		m_hello_last = now;
+		++m_hellos_sent;
+		return e_action_hello;
+	}
+
+	++m_polls;
+	const bool starting = (m_polls <= m_config.m_start_count);
+	const bool ping_lost = m_ping_outstanding && (! m_received);
+	if (starting) m_interval = m_config.m_interval_start;
+	else if (ping_lost || (! identity_known)) m_interval = m_config.m_interval_min;
+	else m_interval = std::max( m_config.m_interval_min , std::min( m_config.m_interval_max , m_interval * 2 ) ); // stable, back off
+
+	t_action action = e_action_ping;
+	if ((! identity_known) || m_hello_wanted || (m_hellos_sent < m_config.m_start_count)
+		|| (now - m_hello_last >= m_config.m_hello_refresh))
+	{
+		action = e_action_hello;
+	}
+	else if (m_received && (now - m_ping_last < m_config.m_interval_max)) action = e_action_none; // he is alive, no need to ask
+
+	if (action != e_action_none) {
+		m_ping_last = now;
+		m_ping_outstanding = true;
+	}
+	if (action == e_action_hello) {
+		m_hello_last = now;
+		++m_hellos_sent;
+	}
+	m_hello_wanted = false;
+	m_received = false;
+	m_due_planned = now + jittered( m_interval );
+	m_due = m_due_planned;
+	return action;
+}
+
+c_keepalive::t_clock::time_point c_keepalive::get_due_time() const { return m_due; }
+
+c_keepalive::t_clock::duration c_keepalive::get_interval() const { return m_interval; }
+
+void c_keepalive::on_received() { m_received = true; }
+
+void c_keepalive::on_ping_reply() { m_ping_outstanding = false; }
+
+void c_keepalive::on_ping_lost(t_clock::time_point now) {
+	m_received = false; // traffic from him before does not count, ask him now
+	m_due_planned = std::min( m_due_planned , now );
+	m_due = std::min( m_due , now );
+}
+
+void c_keepalive::on_hello_received(t_clock::time_point now) {
+	if (m_hellos_sent && (now - m_hello_last < m_config.m_hello_answer_min)) return; // he has ours already (or it is on the way)
+	m_hello_wanted = true;
+	m_due = std::min( m_due , now );
+}
+
+c_keepalive::t_clock::duration c_keepalive::jittered(t_clock::duration interval) {
+	if (m_config.m_jitter <= 0) return interval;
+	std::uniform_real_distribution<double> factor( 1 - m_config.m_jitter , 1 + m_config.m_jitter );
+	return std::chrono::duration_cast<t_clock::duration>( interval * factor(m_random) );
+}
+
+const char * c_keepalive::action_name(t_action action) {
+	switch (action) {
+		case e_action_none: return "none";
+		case e_action_ping: return "ping";
+		case e_action_hello: return "hello";
+	}
+	return "?";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_keepalive & obj) {
+	ostr << "keepalive{interval=" << std::chrono::duration_cast<std::chrono::milliseconds>( obj.m_interval ).count() << "ms"
+		<< " hellos=" << obj.m_hellos_sent << "}";
+	return ostr;
+}
+
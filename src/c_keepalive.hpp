@@ -0,0 +1,75 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_keepalive_hpp
+#define include_c_keepalive_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <random>
+
+/***
+@brief Decides when to send keepalive to one peer, and what: our full hello (public_hi with keys), or just a small ping.
+- hello is sent only till identities are established: while we do not have his pubkey, the first few times, when he
+  sent us his hello (e.g. he restarted and forgot ours), and rarely to refresh;
+- nothing is sent when he sent us any traffic recently (then the link is alive), except a ping now and then to measure the link;
+- the interval backs off (doubles) while the peer is stable, and is short again once our ping is not answered;
+  the caller can also say that a ping was lost (on_ping_lost()), then we ping again at once, so dead link is found soon;
+- each time is jittered, so that pings to many peers (and of many nodes started together) do not come in bursts.
+The caller polls it when get_due_time() comes.
+*/
+class c_keepalive final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		typedef enum { e_action_none, e_action_ping, e_action_hello } t_action; ///< hello is sent together with a ping
+
+		struct t_config {
+			t_clock::duration m_interval_start; ///< for the first (start_count) times
+			unsigned int m_start_count;
+			t_clock::duration m_interval_min; ///< when link is not confirmed (e.g. ping lost)
+			t_clock::duration m_interval_max; ///< the backoff stops here; should keep NAT mappings open
+			t_clock::duration m_hello_refresh; ///< send the hello again after this long anyway
+			t_clock::duration m_hello_answer_min; ///< answer his hello with ours, if we did not send it in this time
+			double m_jitter; ///< each interval is randomly changed by up to this part of it (e.g. 0.2 is +/- 20%)
+			t_config(); ///< the defaults
+		};
+
+		c_keepalive(uint32_t seed, const t_config & config = t_config()); ///< seed of jitter; is due at once
+
+		t_action poll(t_clock::time_point now, bool identity_known); ///< what to send now (when due), and plans the next time
+		t_clock::time_point get_due_time() const;
+		t_clock::duration get_interval() const; ///< current one (before jitter)
+
+		void on_received(); ///< he sent us something, so link is alive; cheap (does not read the clock)
+		void on_ping_reply(); ///< he answered our ping
+		void on_ping_lost(t_clock::time_point now); ///< our ping was not answered in time (c_link_quality::get_rto()): ping again at once
+		void on_hello_received(t_clock::time_point now); ///< he sent his hello; we will answer with ours soon
+
+		static const char * action_name(t_action action);
+
+	private:
+		t_config m_config;
+		std::minstd_rand m_random; ///< for jitter
+		t_clock::time_point m_due; ///< next poll() should be at this time
+		t_clock::time_point m_due_planned; ///< by the interval (m_due can be sooner, to answer his hello)
+		t_clock::duration m_interval; ///< current, it backs off
+		unsigned int m_polls; ///< how many times were we due
+		unsigned int m_hellos_sent;
+		t_clock::time_point m_hello_last; ///< when we sent hello (valid if m_hellos_sent)
+		t_clock::time_point m_ping_last; ///< when we sent ping (also with hello)
+		bool m_hello_wanted; ///< should answer his hello
+		bool m_ping_outstanding; ///< our last ping is not answered yet
+		bool m_received; ///< anything from him since last poll()
+
+		t_clock::duration jittered(t_clock::duration interval);
+
+		friend std::ostream & operator<<(std::ostream & ostr, const c_keepalive & obj);
+};
+
+std::ostream & operator<<(std::ostream & ostr, const c_keepalive & obj);
+
+#endif
+
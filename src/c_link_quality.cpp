@@ -0,0 +1,109 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_link_quality.hpp"
+
+#include <cmath>
+
+constexpr int c_link_quality::cost_per_hop;
+constexpr int c_link_quality::cost_max;
+constexpr size_t c_link_quality::pings_outstanding_max;
+constexpr unsigned int c_link_quality::lost_in_row_down;
+constexpr int c_link_quality::rto_min_ms;
+
+namespace {
+	const double ewma_rtt_alpha = 1./8; // RFC 6298
+	const double ewma_jitter_beta = 1./4; // RFC 6298
+	const double ewma_loss_alpha = 1./8;
+}
+
+c_link_quality::c_link_quality()
+	: m_seq_next(1), m_measured(false), m_rtt_ms(0), m_jitter_ms(0), m_loss(0), m_lost_in_row(0)
+	, m_ping_timeout( std::chrono::seconds(2) )
+{ }
+
+c_link_quality::t_ping_seq c_link_quality::on_ping_sent(t_clock::time_point now) {
+	on_timer(now);
+	while (m_outstanding.size() >= pings_outstanding_max) {
+		m_outstanding.pop_front();
+		add_loss_sample(true);
+	}
+
+	t_ping_seq seq = m_seq_next;
+	m_seq_next = (m_seq_next >= ping_seq_max) ? 1 : (m_seq_next + 1);
+	m_outstanding.emplace_back(seq, now);
+	return seq;
+}
+
+bool c_link_quality::on_ping_reply(t_ping_seq seq, t_clock::time_point sent_time, t_clock::time_point now) {
+	auto found = std::find_if( m_outstanding.begin() , m_outstanding.end() ,
+		[seq](const std::pair<t_ping_seq, t_clock::time_point> & ping) { return ping.first == seq; } );
+	if (found == m_outstanding.end()) { _dbg2("Ignoring not expected ping reply seq=" << seq); return false; }
+	if (found->second != sent_time) { _dbg2("Ignoring ping reply seq=" << seq << " with wrong timestamp"); return false; }
+	m_outstanding.erase(found);
+	add_loss_sample(false);
+
+	const double sample_ms = std::chrono::duration<double, std::milli>( now - sent_time ).count();
+	if (! m_measured) { // first sample, RFC 6298 2.2
+		m_rtt_ms = sample_ms;
+		m_jitter_ms = sample_ms / 2;
+		m_measured = true;
+	} else { // RFC 6298 2.3 (RTTVAR uses the old SRTT)
+		m_jitter_ms = (1-ewma_jitter_beta) * m_jitter_ms + ewma_jitter_beta * std::fabs( m_rtt_ms - sample_ms );
+		m_rtt_ms = (1-ewma_rtt_alpha) * m_rtt_ms + ewma_rtt_alpha * sample_ms;
+	}
+	_dbg1("Ping reply seq=" << seq << " rtt=" << sample_ms << " ms, now: " << (*this));
+	return true;
+}
+
+bool c_link_quality::on_timer(t_clock::time_point now) {
+	const auto rto = get_rto();
+	bool any = false;
+	while ( (! m_outstanding.empty()) && (m_outstanding.front().second + rto <= now) ) {
+		_dbg2("Ping seq=" << m_outstanding.front().first << " was not answered - counting as lost");
+		m_outstanding.pop_front();
+		add_loss_sample(true);
+		any = true;
+	}
+	return any;
+}
+
+c_link_quality::t_clock::time_point c_link_quality::get_due_time() const {
+	if (m_outstanding.empty()) return t_clock::time_point::max();
+	return m_outstanding.front().second + get_rto();
+}
+
+c_link_quality::t_clock::duration c_link_quality::get_rto() const {
+	if (! m_measured) return m_ping_timeout;
+	const double rto_ms = std::max( m_rtt_ms + 4 * m_jitter_ms , static_cast<double>(rto_min_ms) ); // RFC 6298 2.3
+	const auto rto = std::chrono::duration_cast<t_clock::duration>( std::chrono::duration<double, std::milli>( rto_ms ) );
+	return std::min( rto , m_ping_timeout );
+}
+
+void c_link_quality::add_loss_sample(bool lost) {
+	m_loss = (1-ewma_loss_alpha) * m_loss + ewma_loss_alpha * (lost ? 1 : 0);
+	m_lost_in_row = lost ? (m_lost_in_row + 1) : 0;
+}
+
+bool c_link_quality::is_measured() const { return m_measured; }
+double c_link_quality::get_rtt_ms() const { return m_rtt_ms; }
+double c_link_quality::get_jitter_ms() const { return m_jitter_ms; }
+double c_link_quality::get_loss() const { return m_loss; }
+bool c_link_quality::is_up() const { return m_lost_in_row < lost_in_row_down; }
+
+int c_link_quality::get_route_cost() const {
+	double cost = cost_per_hop;
+	if (m_measured) cost += (m_rtt_ms + 2*m_jitter_ms) / cost_per_rtt_ms_div;
+	cost /= ( 1 - std::min( m_loss , loss_max_considered ) ); // lossy link costs as if we would need to resend
+	return static_cast<int>( std::min( std::lround(cost) , static_cast<long>(cost_max) ) );
+}
+
+void c_link_quality::print(std::ostream & ostr) const {
+	ostr << "{link: ";
+	if (m_measured) ostr << "rtt=" << m_rtt_ms << "ms jitter=" << m_jitter_ms << "ms";
+	else ostr << "rtt=?";
+	ostr << " loss=" << m_loss << " cost=" << get_route_cost() << (is_up() ? "" : " DOWN") << "}";
+}
+
+std::ostream & operator<<(std::ostream & ostr, const c_link_quality & obj) { obj.print(ostr); return ostr; }
+
@@ -0,0 +1,73 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_link_quality_hpp
+#define include_c_link_quality_hpp
+
+#include "libs1.hpp"
+
+#include <chrono>
+#include <deque>
+
+/***
+@brief Estimates RTT, jitter and loss of a link to one peer, from our timestamped pings and his replies.
+RTT and jitter are EWMA like in RFC 6298 (SRTT, RTTVAR), loss is EWMA of "was this ping answered".
+The result is a composite route cost, used by c_routing_manager instead of just counting hops.
+Ping not answered within RTO (also as in RFC 6298, from SRTT and RTTVAR) is lost; the caller checks this when
+get_due_time() comes, so a dead link is found within lost_in_row_down RTOs if each lost ping is sent again at once.
+*/
+class c_link_quality {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+		typedef uint32_t t_ping_seq; ///< sequence number of our ping
+
+		constexpr static int cost_per_hop = 10; ///< [confroute] base cost of using any link (also cost of not yet measured link)
+		constexpr static int cost_per_rtt_ms_div = 10; ///< [confroute] each this many ms of (RTT + 2*jitter) cost one more
+		constexpr static double loss_max_considered = 0.9; ///< [confroute] loss above this is treated as this (so cost stays finite)
+		constexpr static int cost_max = 250; ///< cost is clamped to this (so it fits e.g. 1 byte on wire, with some room)
+
+		constexpr static size_t pings_outstanding_max = 16; ///< remember at most that many not-answered pings
+		constexpr static unsigned int lost_in_row_down = 3; ///< [confroute] that many pings lost in a row: link is down
+		constexpr static t_ping_seq ping_seq_max = 0x7FFFFFFF; ///< seq wraps after this
+		constexpr static int rto_min_ms = 200; ///< [confroute] ping is not counted as lost sooner (e.g. on LAN), like RTO min in Linux
+
+		c_link_quality();
+
+		///! we now send a ping. Returns seq to use in it. Pings not answered since at least ping_timeout are now counted as lost.
+		t_ping_seq on_ping_sent(t_clock::time_point now);
+		///! we got reply to ping seq, that we sent at sent_time. Returns false if it was not expected (e.g. late or duplicated) and was ignored
+		bool on_ping_reply(t_ping_seq seq, t_clock::time_point sent_time, t_clock::time_point now);
+		///! count pings not answered within get_rto() as lost; returns true if any was. Call it when get_due_time() comes
+		bool on_timer(t_clock::time_point now);
+		t_clock::time_point get_due_time() const; ///< when the oldest ping not answered yet will be lost, or max() if none is
+		t_clock::duration get_rto() const; ///< ping not answered for this long is lost: SRTT + 4*RTTVAR, at least rto_min_ms
+
+		bool is_measured() const; ///< did we get at least one RTT sample
+		double get_rtt_ms() const; ///< smoothed RTT (SRTT), in ms
+		double get_jitter_ms() const; ///< RTT variation (RTTVAR), in ms
+		double get_loss() const; ///< estimated loss ratio 0..1
+		int get_route_cost() const; ///< composite cost of using this link, in route cost units (see cost_per_hop)
+		bool is_up() const; ///< false once lost_in_row_down pings in a row were not answered, till one is answered
+
+		void print(std::ostream & ostr) const;
+
+	private:
+		void add_loss_sample(bool lost);
+
+		t_ping_seq m_seq_next; ///< seq of the next ping that we will send
+		std::deque< std::pair<t_ping_seq, t_clock::time_point> > m_outstanding; ///< pings not answered yet, oldest first
+
+		bool m_measured;
+		double m_rtt_ms; ///< SRTT
+		double m_jitter_ms; ///< RTTVAR
+		double m_loss; ///< EWMA of losses
+		unsigned int m_lost_in_row; ///< pings lost since the last answered one
+
+		t_clock::duration m_ping_timeout; ///< RTO till RTT is measured, and the biggest one
+};
+
+std::ostream & operator<<(std::ostream & ostr, const c_link_quality & obj);
+
+#endif
+
@@ -0,0 +1,229 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_metrics.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+constexpr size_t c_metric_counter::slots_count;
+constexpr int c_metric_histogram::sub_bucket_bits;
+constexpr int c_metric_histogram::sub_buckets_count;
+constexpr int c_metric_histogram::octaves_count;
+constexpr size_t c_metric_histogram::buckets_count;
+constexpr size_t c_metric_histogram::overflow_bucket;
+
+namespace {
+
+size_t get_thread_slot() { ///< the slot of c_metric_counter that this thread uses
+	static std::atomic<size_t> threads_count(0);
+	static thread_local const size_t slot = threads_count.fetch_add(1, std::memory_order_relaxed);
+	return slot;
+}
+
+std::string escape_label_value(const std::string & value) { ///< [protocol] as Prometheus text format wants
+	std::string ret;
+	for (char c : value) {
+		if (c == '\\') ret += "\\\\";
+		else if (c == '"') ret += "\\\"";
+		else if (c == '\n') ret += "\\n";
+		else ret += c;
+	}
+	return ret;
+}
+
+std::string escape_help(const std::string & help) {
+	std::string ret;
+	for (char c : help) {
+		if (c == '\\') ret += "\\\\";
+		else if (c == '\n') ret += "\\n";
+		else ret += c;
+	}
+	return ret;
+}
+
+std::string add_label(const std::string & labels_text, const std::string & label) { ///< e.g. {a="b"} + le="1" = {a="b",le="1"}
+	if (labels_text.empty()) return '{' + label + '}';
+	return labels_text.substr(0, labels_text.size() - 1) + ',' + label + '}';
+}
+
+std::string seconds_from_us(uint64_t us) {
+	std::ostringstream oss;
+	oss << (us / 1000000) << '.' << std::setw(6) << std::setfill('0') << (us % 1000000);
+	return oss.str();
+}
+
+} // namespace
+
+// ------------------------------------------------------------------
+
+c_metric_counter::c_metric_counter() {
+	for (auto & slot : m_slot) slot.m_value.store(0, std::memory_order_relaxed);
+}
+
+void c_metric_counter::add(uint64_t value) noexcept {
+	auto & slot = m_slot[ get_thread_slot() % slots_count ].m_value;
+	slot.fetch_add(value, std::memory_order_relaxed); // not contended (unless there are more threads then slots)
+}
+
+uint64_t c_metric_counter::get() const noexcept {
+	uint64_t ret = 0;
+	for (const auto & slot : m_slot) ret += slot.m_value.load(std::memory_order_relaxed);
+	return ret;
+}
+
+// ------------------------------------------------------------------
+
+c_metric_gauge::c_metric_gauge() : m_value(0) { }
+
+void c_metric_gauge::set(int64_t value) noexcept { m_value.store(value, std::memory_order_relaxed); }
+
+int64_t c_metric_gauge::get() const noexcept { return m_value.load(std::memory_order_relaxed); }
+
+// ------------------------------------------------------------------
+
+c_metric_histogram::c_metric_histogram() : m_count(0), m_sum_us(0) {
+	for (auto & bucket : m_bucket) bucket.store(0, std::memory_order_relaxed);
+}
+
+void c_metric_histogram::add(std::chrono::microseconds duration) noexcept {
+	const uint64_t value_us = std::max<std::chrono::microseconds::rep>(duration.count(), 0);
+	m_bucket[ get_bucket_index(value_us) ].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum_us.fetch_add(value_us, std::memory_order_relaxed);
+}
+
+size_t c_metric_histogram::get_bucket_index(uint64_t value_us) noexcept {
+	// bucket is: shift (how many low bits are ignored) and top (the value without them, from sub_buckets_count to 2x that)
+	if (value_us >> octaves_count) return overflow_bucket;
+	if (value_us < 2 * sub_buckets_count) return value_us; // shift = 0, exact values
+	const int octave = 63 - __builtin_clzll(value_us); // highest bit set
+	const int shift = octave - sub_bucket_bits;
+	return shift * sub_buckets_count + (value_us >> shift);
+}
+
+uint64_t c_metric_histogram::get_bucket_max(size_t index) noexcept {
+	if (index >= overflow_bucket) return std::numeric_limits<uint64_t>::max();
+	if (index < 2 * sub_buckets_count) return index;
+	const size_t shift = index / sub_buckets_count - 1;
+	const uint64_t top = index - shift * sub_buckets_count;
+	return ((top + 1) << shift) - 1;
+}
+
+uint64_t c_metric_histogram::get_bucket_count(size_t index) const noexcept {
+	return m_bucket.at(index).load(std::memory_order_relaxed);
+}
+
+uint64_t c_metric_histogram::get_count() const noexcept { return m_count.load(std::memory_order_relaxed); }
+
+uint64_t c_metric_histogram::get_sum_us() const noexcept { return m_sum_us.load(std::memory_order_relaxed); }
+
+// ------------------------------------------------------------------
+
+c_metrics & c_metrics::get_instance() {
+	static c_metrics instance;
+	return instance;
+}
+
+c_metrics::t_family & c_metrics::get_family(const std::string & name, const std::string & help, t_type type) {
+	auto found = m_family.find(name);
+	if (found == m_family.end()) {
+		t_family family;
+		family.m_type = type;
+		family.m_help = help;
+		found = m_family.emplace(name, std::move(family)).first;
+	}
+	if (found->second.m_type != type) throw std::invalid_argument("metric " + name + " already exists, as other type");
+	return found->second;
+}
+
+c_metric_counter & c_metrics::get_counter(const std::string & name, const std::string & help, const t_labels & labels) {
+	std::lock_guard<std::mutex> lg(m_mutex);
+	auto & metric = get_family(name, help, e_type_counter).m_counter[ labels_to_text(labels) ];
+	if (!metric) metric.reset(new c_metric_counter());
+	return *metric;
+}
+
+c_metric_gauge & c_metrics::get_gauge(const std::string & name, const std::string & help, const t_labels & labels) {
+	std::lock_guard<std::mutex> lg(m_mutex);
+	auto & metric = get_family(name, help, e_type_gauge).m_gauge[ labels_to_text(labels) ];
+	if (!metric) metric.reset(new c_metric_gauge());
+	return *metric;
+}
+
+c_metric_histogram & c_metrics::get_histogram(const std::string & name, const std::string & help, const t_labels & labels) {
+	std::lock_guard<std::mutex> lg(m_mutex);
+	auto & metric = get_family(name, help, e_type_histogram).m_histogram[ labels_to_text(labels) ];
+	if (!metric) metric.reset(new c_metric_histogram());
+	return *metric;
+}
+
+std::string c_metrics::labels_to_text(const t_labels & labels) {
+	if (labels.empty()) return std::string();
+	std::string ret = "{";
+	for (const auto & label : labels) {
+		if (ret.size() > 1) ret += ',';
+		ret += label.first + "=\"" + escape_label_value(label.second) + '"';
+	}
+	return ret + '}';
+}
+
+bool c_metrics::labels_text_has(const std::string & labels_text, const std::string & label) {
+	for (size_t pos = labels_text.find(label); pos != std::string::npos; pos = labels_text.find(label, pos + 1)) {
+		const size_t end = pos + label.size();
+		const bool starts = (pos > 0) && ((labels_text[pos-1] == '{') || (labels_text[pos-1] == ','));
+		const bool ends = (end < labels_text.size()) && ((labels_text[end] == '}') || (labels_text[end] == ','));
+		if (starts && ends) return true; // not just inside of other value
+	}
+	return false;
+}
+
+size_t c_metrics::remove_labeled(const std::string & label_name, const std::string & label_value) {
+	const std::string label = label_name + "=\"" + escape_label_value(label_value) + '"';
+	size_t removed = 0;
+	auto remove_from = [&](auto & metrics) {
+		for (auto it = metrics.begin(); it != metrics.end(); ) {
+			if (labels_text_has(it->first, label)) { it = metrics.erase(it); ++removed; }
+			else ++it;
+		}
+	};
+	std::lock_guard<std::mutex> lg(m_mutex);
+	for (auto & family_pair : m_family) {
+		remove_from( family_pair.second.m_counter );
+		remove_from( family_pair.second.m_gauge );
+		remove_from( family_pair.second.m_histogram );
+	}
+	return removed;
+}
+
+std::string c_metrics::export_prometheus() const {
+	std::ostringstream out;
+	std::lock_guard<std::mutex> lg(m_mutex);
+	for (const auto & family_pair : m_family) {
+		const std::string & name = family_pair.first;
+		const t_family & family = family_pair.second;
+		const char * type_name = (family.m_type == e_type_counter) ? "counter" : (family.m_type == e_type_gauge) ? "gauge" : "histogram";
+		out << "# HELP " << name << ' ' << escape_help(family.m_help) << '\n';
+		out << "# TYPE " << name << ' ' << type_name << '\n';
+		for (const auto & metric : family.m_counter) out << name << metric.first << ' ' << metric.second->get() << '\n';
+		for (const auto & metric : family.m_gauge) out << name << metric.first << ' ' << metric.second->get() << '\n';
+		for (const auto & metric : family.m_histogram) {
+			const c_metric_histogram & histogram = * metric.second;
+			uint64_t cumulative = 0;
+			for (size_t i=0; i<c_metric_histogram::overflow_bucket; ++i) {
+				cumulative += histogram.get_bucket_count(i);
+				const auto le = seconds_from_us( c_metric_histogram::get_bucket_max(i) + 1 ); // values are in whole us, rounded down
+				out << name << "_bucket" << add_label(metric.first, "le=\"" + le + '"') << ' ' << cumulative << '\n';
+			}
+			cumulative += histogram.get_bucket_count( c_metric_histogram::overflow_bucket );
+			const auto count = histogram.get_count(); // can be a bit more then cumulative, if some add() runs now
+			out << name << "_bucket" << add_label(metric.first, "le=\"+Inf\"") << ' ' << std::max(count, cumulative) << '\n';
+			out << name << "_sum" << metric.first << ' ' << seconds_from_us( histogram.get_sum_us() ) << '\n';
+			out << name << "_count" << metric.first << ' ' << std::max(count, cumulative) << '\n';
+		}
+	}
+	return out.str();
+}
+
@@ -0,0 +1,120 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_metrics_hpp
+#define include_c_metrics_hpp
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/***
+@brief Counter that any thread can add to cheaply: each thread adds to its own slot (on own cache line),
+so threads do not fight for one cache line; get() sums the slots (e.g. when exporting).
+*/
+class c_metric_counter final {
+	public:
+		c_metric_counter();
+		void add(uint64_t value = 1) noexcept;
+		uint64_t get() const noexcept;
+
+	private:
+		struct t_slot {
+			std::atomic<uint64_t> m_value;
+			char m_padding[64 - sizeof(std::atomic<uint64_t>)];
+		};
+		constexpr static size_t slots_count = 8; ///< threads share slots when there are more of them
+		std::array<t_slot, slots_count> m_slot;
+};
+
+/// value that is set (not added), e.g. number of peers
+class c_metric_gauge final {
+	public:
+		c_metric_gauge();
+		void set(int64_t value) noexcept;
+		int64_t get() const noexcept;
+	private:
+		std::atomic<int64_t> m_value;
+};
+
+/***
+@brief Histogram of durations in HDR style: buckets are log-linear (each power of 2 of microseconds is split into
+sub_buckets_count linear buckets), so relative error is bounded for any value from 1 us to about an hour,
+with fixed small memory. Bigger values are counted in overflow_bucket. Any thread can add.
+*/
+class c_metric_histogram final {
+	public:
+		constexpr static int sub_bucket_bits = 3; ///< so 8 buckets per power of 2 (error up to 12.5%)
+		constexpr static int sub_buckets_count = 1 << sub_bucket_bits;
+		constexpr static int octaves_count = 32; ///< values below 2^32 us (about 71 minutes) have own buckets
+		constexpr static size_t buckets_count = sub_buckets_count * (octaves_count - sub_bucket_bits + 1) + 1; ///< with overflow_bucket
+		constexpr static size_t overflow_bucket = buckets_count - 1; ///< the last one: values of 2^octaves_count us and more
+
+		c_metric_histogram();
+		void add(std::chrono::microseconds duration) noexcept;
+
+		static size_t get_bucket_index(uint64_t value_us) noexcept;
+		static uint64_t get_bucket_max(size_t index) noexcept; ///< biggest value (in us) that is counted in this bucket (max of uint64_t for overflow)
+
+		uint64_t get_bucket_count(size_t index) const noexcept; ///< not cumulative
+		uint64_t get_count() const noexcept;
+		uint64_t get_sum_us() const noexcept;
+
+	private:
+		std::array<std::atomic<uint64_t>, buckets_count> m_bucket;
+		std::atomic<uint64_t> m_count;
+		std::atomic<uint64_t> m_sum_us;
+};
+
+/***
+@brief Registry of all metrics of the program, exported in Prometheus text format (e.g. by RPC command "metrics").
+Metrics are named (and labeled) like in Prometheus: name of family, and labels that select one metric in it.
+Getting a metric takes a lock and a map lookup, so the caller should keep the returned reference (it stays valid as
+long as the registry), and then adding to it is cheap.
+*/
+class c_metrics final {
+	public:
+		typedef std::vector<std::pair<std::string, std::string>> t_labels; ///< label name and value, e.g. { {"peer","fd42::1"} }
+
+		static c_metrics & get_instance(); ///< the one of this process
+
+		/// @param help - description of the family (the first one given is used)
+		/// @throw std::invalid_argument if name is already used by other type of metric
+		c_metric_counter & get_counter(const std::string & name, const std::string & help, const t_labels & labels = t_labels());
+		c_metric_gauge & get_gauge(const std::string & name, const std::string & help, const t_labels & labels = t_labels());
+		c_metric_histogram & get_histogram(const std::string & name, const std::string & help, const t_labels & labels = t_labels());
+
+		/// deletes all metrics (of any family) that have this label, e.g. of a peer that is gone, so series do not pile up
+		/// references to them (as returned by get_*) must not be used anymore; returns how many were deleted
+		size_t remove_labeled(const std::string & label_name, const std::string & label_value);
+
+		std::string export_prometheus() const; ///< text format 0.0.4, histograms in seconds (overflow bucket only in +Inf)
+
+	private:
+		enum t_type { e_type_counter, e_type_gauge, e_type_histogram };
+		struct t_family {
+			t_type m_type;
+			std::string m_help;
+			std::map<std::string, std::unique_ptr<c_metric_counter>> m_counter; ///< labels text (as in export) => metric
+			std::map<std::string, std::unique_ptr<c_metric_gauge>> m_gauge;
+			std::map<std::string, std::unique_ptr<c_metric_histogram>> m_histogram;
+		};
+
+		t_family & get_family(const std::string & name, const std::string & help, t_type type); ///< must hold m_mutex
+
+		static std::string labels_to_text(const t_labels & labels); ///< e.g. {peer="x",reason="y"}, or empty
+		static bool labels_text_has(const std::string & labels_text, const std::string & label); ///< label is e.g. peer="x"
+
+		mutable std::mutex m_mutex;
+		std::map<std::string, t_family> m_family; ///< name => family; always lock m_mutex
+};
+
+#endif
+
@@ -0,0 +1,86 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_packet_aggregator.hpp"
+#include "trivialserialize.hpp"
+
+constexpr size_t c_packet_aggregator::header_size;
+constexpr size_t c_packet_aggregator::frame_header_size;
+constexpr size_t c_packet_aggregator::datagram_size_default;
+
+c_packet_aggregator::c_packet_aggregator()
+	: m_max_delay(t_clock::duration::zero()), m_datagram_size_max(datagram_size_default), m_frames_count(0)
+{ }
+
+void c_packet_aggregator::set_max_delay(t_clock::duration max_delay) {
+	if (max_delay < t_clock::duration::zero()) _throw_error( std::invalid_argument("Negative max delay of aggregation") );
+	m_max_delay = max_delay;
+}
+
+bool c_packet_aggregator::is_enabled() const {
+	return m_max_delay > t_clock::duration::zero();
+}
+
+void c_packet_aggregator::set_datagram_size_max(size_t size) {
+	if (size <= header_size + frame_header_size) _throw_error( std::invalid_argument("Too small datagram size for aggregation") );
+	m_datagram_size_max = size;
+}
+
+size_t c_packet_aggregator::get_datagram_size_max() const { return m_datagram_size_max; }
+
+bool c_packet_aggregator::add(const char * frame, size_t frame_size, t_clock::time_point now, std::string & out_ready) {
+	out_ready.clear();
+	if (! is_enabled()) return false;
+	const size_t frame_size_max = (m_datagram_size_max - header_size) / 2 - frame_header_size; // bigger ones gain nothing
+	if (frame_size > frame_size_max) return false;
+	if (frame_size < header_size) return false; // not a frame, let the normal path complain
+	if (static_cast<unsigned char>(frame[1]) == c_protocol::e_proto_cmd_aggregated) return false; // never nest them
+
+	if (m_datagram.size() + frame_header_size + frame_size > m_datagram_size_max) out_ready = flush();
+
+	if (m_datagram.empty()) {
+		m_datagram.reserve( m_datagram_size_max );
+		m_datagram += static_cast<char>( c_protocol::current_version );
+		m_datagram += static_cast<char>( c_protocol::e_proto_cmd_aggregated );
+		m_first_time = now;
+	}
+	m_datagram += static_cast<char>( (frame_size >> 8) & 0xFF ); // [protocol] LENGTH, big-endian like trivialserialize
+	m_datagram += static_cast<char>( frame_size & 0xFF );
+	m_datagram.append( frame , frame_size );
+	++m_frames_count;
+	return true;
+}
+
+bool c_packet_aggregator::is_pending() const { return m_frames_count > 0; }
+
+bool c_packet_aggregator::is_due(t_clock::time_point now) const {
+	return is_pending() && (now >= get_due_time());
+}
+
+c_packet_aggregator::t_clock::time_point c_packet_aggregator::get_due_time() const {
+	return m_first_time + m_max_delay;
+}
+
+std::string c_packet_aggregator::flush() {
+	std::string ret;
+	if (m_frames_count == 1) ret = m_datagram.substr( header_size + frame_header_size ); // just send it as normal frame
+	else if (m_frames_count > 1) ret = std::move(m_datagram);
+	m_datagram.clear();
+	m_frames_count = 0;
+	return ret;
+}
+
+std::vector<c_packet_aggregator::t_frame_view> c_packet_aggregator::split(const char * datagram, size_t datagram_size) {
+	trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , datagram , datagram_size );
+	parser.skip_bytes_n( header_size );
+	std::vector<t_frame_view> frames;
+	while (! parser.is_end()) {
+		const size_t frame_size = parser.pop_integer_u<2, size_t>();
+		const t_bytes_view frame = parser.pop_bytes_n_view( frame_size );
+		if ((frame.size() < header_size) || (static_cast<unsigned char>(frame[1]) == c_protocol::e_proto_cmd_aggregated)) {
+			_throw_error( std::invalid_argument("Invalid frame inside of aggregated datagram") );
+		}
+		frames.push_back( t_frame_view{ static_cast<size_t>( frame.data() - datagram ) , frame.size() } );
+	}
+	return frames;
+}
@@ -0,0 +1,63 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_packet_aggregator_hpp
+#define include_c_packet_aggregator_hpp
+
+#include "libs1.hpp"
+#include "protocol.hpp"
+
+#include <chrono>
+
+/***
+@file Packing of few small frames (e.g. tunneled data of DNS, TCP ACKs) that go to same next hop into one UDP datagram.
+
+[protocol] e_proto_cmd_aggregated: VERSION CMD then repeated { LENGTH(2) FRAME(LENGTH) }
+where each FRAME is a complete normal frame (starting with its own VERSION CMD), but never e_proto_cmd_aggregated again.
+A datagram with just one frame pending is sent as that frame, without this wrapping.
+*/
+
+/// collects frames for one next hop, until the datagram is full or the oldest frame waited max delay
+class c_packet_aggregator {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		constexpr static size_t header_size = c_protocol::version_size + c_protocol::cmd_size; ///< [protocol]
+		constexpr static size_t frame_header_size = 2; ///< [protocol] LENGTH before each frame
+		constexpr static size_t datagram_size_default = 1280 - 40 - 8; ///< IPv6 minimal MTU minus IPv6 and UDP headers
+
+		struct t_frame_view { ///< one frame inside of received datagram (not copied)
+			size_t m_offset; ///< from the start of the datagram
+			size_t m_size;
+		};
+
+		c_packet_aggregator();
+
+		void set_max_delay(t_clock::duration max_delay); ///< how long can first frame wait for others; zero disables aggregation
+		bool is_enabled() const;
+		void set_datagram_size_max(size_t size); ///< e.g. from path MTU
+		size_t get_datagram_size_max() const;
+
+		///! take frame to be sent later. Returns false if it should be sent alone now (caller should then flush() first,
+		///to keep the order). If it does not fit into pending datagram, then that one is moved to out_ready to be sent now.
+		bool add(const char * frame, size_t frame_size, t_clock::time_point now, std::string & out_ready);
+		bool is_pending() const; ///< are there any frames waiting
+		bool is_due(t_clock::time_point now) const; ///< should we send the pending ones already
+		t_clock::time_point get_due_time() const; ///< when pending frames must be sent, valid if is_pending()
+		std::string flush(); ///< returns the datagram to send (empty if nothing was pending)
+
+		///! the frames inside datagram of e_proto_cmd_aggregated, as views into it; throws on malformed data
+		static std::vector<t_frame_view> split(const char * datagram, size_t datagram_size);
+
+	private:
+		t_clock::duration m_max_delay;
+		size_t m_datagram_size_max;
+
+		std::string m_datagram; ///< the pending datagram, with header
+		size_t m_frames_count;
+		t_clock::time_point m_first_time; ///< when first pending frame was added
+};
+
+#endif
+
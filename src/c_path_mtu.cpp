@@ -0,0 +1,102 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_path_mtu.hpp"
+
+#include <algorithm>
+
+constexpr size_t c_path_mtu::size_base;
+constexpr size_t c_path_mtu::size_max_default;
+constexpr size_t c_path_mtu::size_step;
+constexpr unsigned int c_path_mtu::probe_tries;
+
+c_path_mtu::c_path_mtu(size_t size_max)
+:
+	m_probe_timeout( std::chrono::seconds(1) ), m_revalidate_interval( std::chrono::minutes(10) )
+{
+	set_size_max(size_max);
+}
+
+void c_path_mtu::set_size_max(size_t size_max) {
+	m_size_max = size_max;
+	m_good = size_base;
+	m_bad = m_size_max + 1;
+	m_searching = true;
+	m_confirming = false;
+	m_probe_size = 0;
+	m_probe_lost = 0;
+	m_due = t_clock::time_point::min(); // at once
+}
+
+size_t c_path_mtu::get_next_probe_size() const {
+	if (m_confirming) return m_good;
+	if (m_bad > m_size_max) return (m_size_max > m_good) ? m_size_max : 0; // optimistic: the biggest first
+	if (m_bad - m_good <= size_step) return 0;
+	return (m_good + m_bad) / 2;
+}
+
+bool c_path_mtu::get_probe(t_clock::time_point now, size_t & size) {
+	if (now < m_due) return false;
+	if (m_probe_size && (++m_probe_lost >= probe_tries)) probe_failed(); // else: the same size again
+	if (! m_probe_size) {
+		if (! m_searching) { // time to revalidate
+			m_searching = true;
+			m_confirming = (m_good > size_base);
+			m_bad = m_size_max + 1;
+		}
+		m_probe_size = get_next_probe_size();
+		m_probe_lost = 0;
+		if (! m_probe_size) { // found it
+			m_searching = false;
+			m_due = now + m_revalidate_interval;
+			return false;
+		}
+	}
+	size = m_probe_size;
+	m_due = now + m_probe_timeout;
+	return true;
+}
+
+bool c_path_mtu::probe_failed() {
+	const size_t size_before = get_size();
+	if (m_confirming) { // path got smaller, search again from the start
+		m_confirming = false;
+		m_bad = m_good;
+		m_good = size_base;
+	}
+	else m_bad = std::min( m_bad , m_probe_size );
+	m_probe_size = 0;
+	return get_size() != size_before;
+}
+
+bool c_path_mtu::on_probe_reply(size_t size, t_clock::time_point now) {
+	if ((size <= m_good) && (size != m_probe_size)) return false; // nothing new (e.g. late reply)
+	const size_t size_before = get_size();
+	m_good = std::max( m_good , std::min( size , m_size_max ) );
+	if (m_bad <= m_good) m_bad = m_size_max + 1; // path got bigger
+	if (size == m_probe_size) { // next one at once
+		m_probe_size = 0;
+		m_confirming = false;
+		m_due = now;
+	}
+	return get_size() != size_before;
+}
+
+bool c_path_mtu::on_probe_too_big(size_t size, t_clock::time_point now) {
+	if (size != m_probe_size) return false;
+	const bool changed = probe_failed();
+	m_due = now;
+	return changed;
+}
+
+size_t c_path_mtu::get_size() const { return m_good; }
+
+bool c_path_mtu::is_searching() const { return m_searching; }
+
+c_path_mtu::t_clock::time_point c_path_mtu::get_due_time() const { return m_due; }
+
+std::ostream & operator<<(std::ostream & ostr, const c_path_mtu & obj) {
+	ostr << "pmtu=" << obj.m_good;
+	if (obj.m_searching) ostr << "(searching)";
+	return ostr;
+}
+
@@ -0,0 +1,62 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_path_mtu_hpp
+#define include_c_path_mtu_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+/***
+@brief Path MTU of link to one peer: the biggest UDP datagram (payload) that gets to him not fragmented, found by probes
+(like DPLPMTUD of RFC 8899): datagrams sent with Don't Fragment, that he echoes back (padded pings).
+Binary search between confirmed size and the smallest size that failed, starting with size_max (most paths take it).
+Probe not answered probe_tries times means that size does not pass. Once found, it is checked again every
+revalidate_interval: first the found size (if it fails now, path got smaller - search again from size_base),
+then bigger ones (path could get bigger).
+The caller polls get_probe() when get_due_time() comes.
+*/
+class c_path_mtu final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		constexpr static size_t size_base = 1280 - 40 - 8; ///< IPv6 minimal MTU minus IPv6 and UDP headers: assumed to always pass
+		constexpr static size_t size_max_default = 1500 - 20 - 8; ///< Ethernet MTU minus IPv4 and UDP headers
+		constexpr static size_t size_step = 8; ///< search stops when the size is known this exactly
+		constexpr static unsigned int probe_tries = 3;
+
+		c_path_mtu(size_t size_max = size_max_default);
+		void set_size_max(size_t size_max); ///< biggest size to probe (e.g. size_base: do not probe at all); search starts again
+
+		bool get_probe(t_clock::time_point now, size_t & size); ///< should we send a probe now, and of what size
+		bool on_probe_reply(size_t size, t_clock::time_point now); ///< he echoed our probe; returns true if get_size() changed
+		bool on_probe_too_big(size_t size, t_clock::time_point now); ///< we could not even send it (e.g. bigger then our own link)
+
+		size_t get_size() const; ///< the biggest datagram that passes (at least size_base)
+		bool is_searching() const;
+		t_clock::time_point get_due_time() const;
+
+	private:
+		size_t m_size_max;
+		size_t m_good; ///< confirmed size
+		size_t m_bad; ///< smallest size that did not pass, or m_size_max+1
+		bool m_searching;
+		bool m_confirming; ///< first probe of revalidation: is m_good still good
+		size_t m_probe_size; ///< sent and not answered yet, or 0
+		unsigned int m_probe_lost; ///< how many times the probe of m_probe_size was not answered
+		t_clock::time_point m_due;
+		t_clock::duration m_probe_timeout; ///< probe not answered for this long is lost
+		t_clock::duration m_revalidate_interval;
+
+		size_t get_next_probe_size() const; ///< 0 if search is done
+		bool probe_failed(); ///< m_probe_size does not pass; returns true if get_size() changed
+
+		friend std::ostream & operator<<(std::ostream & ostr, const c_path_mtu & obj);
+};
+
+std::ostream & operator<<(std::ostream & ostr, const c_path_mtu & obj);
+
+#endif
+
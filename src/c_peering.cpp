@@ -7,6 +7,22 @@
 #include "protocol.hpp"
 
 #include "trivialserialize.hpp"
+#include "protocol_messages.hpp"
+#include "c_program_clock.hpp"
+
+namespace {
+
+c_metrics::t_labels get_peer_labels(const t_peering_reference & ref) {
+	return c_metrics::t_labels{ {"peer", STR(ref.haship_addr)} , {"addr", STR(ref.peering_addr)} };
+}
+
+uint32_t get_keepalive_seed(const c_haship_addr & hip) { // FNV-1a, so each peer has other jitter
+	uint32_t hash = 2166136261u;
+	for (auto byte : hip) hash = (hash ^ byte) * 16777619u;
+	return hash;
+}
+
+} // namespace
 
 // ------------------------------------------------------------------
 
@@ -30,14 +46,32 @@ c_peering::c_peering(const t_peering_reference & ref)
 	m_peering_addr(ref.peering_addr)
 	,m_haship_addr(ref.haship_addr)
 	,m_pubkey(nullptr) // unknown untill we e.g. download it; was: make_unique<c_haship_pubkey>(ref.pubkey))
-	,m_limit_points(100)
-{ }
+	,m_keepalive( get_keepalive_seed(ref.haship_addr) )
+	,m_protocol_version(0)
+	,m_metric_sent_packets( c_metrics::get_instance().get_counter("galaxy_peer_sent_packets_total",
+		"Frames sent to the peer", get_peer_labels(ref)) )
+	,m_metric_sent_bytes( c_metrics::get_instance().get_counter("galaxy_peer_sent_bytes_total",
+		"Bytes of frames sent to the peer", get_peer_labels(ref)) )
+	,m_metric_received_packets( c_metrics::get_instance().get_counter("galaxy_peer_received_packets_total",
+		"Frames received from the peer", get_peer_labels(ref)) )
+	,m_metric_received_bytes( c_metrics::get_instance().get_counter("galaxy_peer_received_bytes_total",
+		"Bytes of frames received from the peer", get_peer_labels(ref)) )
+	,m_metric_rate_limited( c_metrics::get_instance().get_counter("galaxy_peer_rate_limited_total",
+		"Datagrams from the peer dropped by his rate limit", get_peer_labels(ref)) )
+	,m_metric_path_mtu( c_metrics::get_instance().get_gauge("galaxy_peer_path_mtu_bytes",
+		"Biggest UDP datagram (payload) that gets to the peer not fragmented, as probed", get_peer_labels(ref)) )
+{
+	m_metric_path_mtu.set( m_path_mtu.get_size() );
+}
 
 void c_peering::print(ostream & ostr) const {
 	ostr << "peering{";
 	ostr << " peering-addr=" << m_peering_addr;
 	ostr << " hip=" << m_haship_addr;
 	ostr << " pub=" << to_debug(m_pubkey);
+	ostr << " " << m_link_quality;
+	ostr << " " << m_keepalive;
+	ostr << " " << m_path_mtu;
 	ostr << "}";
 }
 
@@ -58,35 +92,64 @@ void c_peering::set_pubkey( std::unique_ptr<c_haship_pubkey> && pubkey ) {
 
 bool c_peering::is_pubkey() const { return m_pubkey != nullptr; }
 
+void c_peering::set_rate_limit(const t_rate_limit & limit) {
+	const auto now = c_program_clock::now();
+	m_limit_points.set_rate(limit.m_packets_per_second, limit.m_packets_burst, now);
+	m_limit_bytes.set_rate(limit.m_bytes_per_second, limit.get_bytes_burst(), now);
+}
+
+bool c_peering::rate_limit_allow(size_t size) {
+	if ((! m_limit_points.is_limited()) && (! m_limit_bytes.is_limited())) return true; // usual case, without reading the clock
+	const auto now = c_program_clock::now();
+	if (m_limit_points.take(1, now)) {
+		if (m_limit_bytes.take(size, now)) return true;
+		m_limit_points.add(1); // not used after all
+	}
+	m_metric_rate_limited.add();
+	return false;
+}
+
 void c_peering::add_limit_points(long points) {
-	m_limit_points += points;
+	m_limit_points.add(points);
+}
+
+long c_peering::get_limit_points() const {
+	return static_cast<long>( m_limit_points.get_tokens() );
 }
 
-void c_peering::decrement_limit_points() {
-	m_limit_points--;
+const c_link_quality & c_peering::get_link_quality() const { return m_link_quality; }
+
+const c_path_mtu & c_peering::get_path_mtu() const { return m_path_mtu; }
+
+void c_peering::on_received(size_t size) {
+	m_keepalive.on_received();
+	m_metric_received_packets.add();
+	m_metric_received_bytes.add(size);
 }
 
-long c_peering::get_limit_points() {
-	return m_limit_points;
+void c_peering::set_protocol_version(int version) {
+	if (version == m_protocol_version) return; // usual case
+	_note("Peer " << m_haship_addr << " uses protocol version " << version << " (was " << m_protocol_version << ")");
+	m_protocol_version = version;
 }
 
-// ------------------------------------------------------------------
+int c_peering::get_protocol_version() const { return m_protocol_version; }
 
-#ifdef __linux__
-c_peering_udp::c_peering_udp(const t_peering_reference & ref, c_udp_wrapper_linux &udp_wrapper)
-:
-	c_peering(ref),
-	m_udp_wrapper(udp_wrapper)
-{ }
-#endif
+void c_peering::on_sent(size_t size) {
+	m_metric_sent_packets.add();
+	m_metric_sent_bytes.add(size);
+}
+
+// ------------------------------------------------------------------
 
-#if defined(_WIN32) || defined(__CYGWIN__)
-c_peering_udp::c_peering_udp(const t_peering_reference &ref, c_udp_wrapper_windows &udp_wrapper)
+c_peering_udp::c_peering_udp(const t_peering_reference & ref, c_udp_wrapper &udp_wrapper)
 :
 	c_peering(ref),
+	m_flow_compression(true),
+	m_aggregation_delay(0),
+	m_aggregated_flow(0),
 	m_udp_wrapper(udp_wrapper)
 { }
-#endif
 
 void c_peering_udp::send_data(const char * data, size_t data_size) {
 	UNUSED(data); UNUSED(data_size);
@@ -97,17 +160,67 @@ void c_peering_udp::send_data(const char * data, size_t data_size) {
 // TODO unify array types! string_as_bin , unique_ptr to new c-array, raw c-array in libproto etc
 
 void c_peering_udp::send_data_udp(const char * data, size_t data_size, int udp_socket,
-	c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used) {
+	c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used, c_send_scheduler::t_flow flow) {
 	_info("Send to peer (tunneled data) data: " << string_as_dbg(data,data_size).get() ); // TODO .get
 
-	trivialserialize::generator gen(data_size + 50);
-	gen.push_byte_u( c_protocol::current_version );
-	gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data );
-	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(src_hip) );
-	gen.push_bytes_n( g_ipv6_rfc::length_of_addr , to_binary_string(dst_hip) );
-	gen.push_byte_u( ttl );
-	gen.push_bytes_n( crypto_box_NONCEBYTES , nonce_used.get().to_binary() ); // TODO avoid conversion/copy
-	gen.push_varstring( std::string(data, data+data_size)  ); // TODO view_string
+	const std::string nonce_bin = nonce_used.get().to_binary(); // TODO avoid conversion/copy
+	t_flow_nonce nonce_flow;
+	_check( nonce_bin.size() == nonce_flow.size() );
+	std::copy( nonce_bin.begin() , nonce_bin.end() , nonce_flow.begin() );
+	t_flow_id flow_id = 0;
+	const auto frame_kind = m_flow_tx.prepare(src_hip, dst_hip, ttl, nonce_flow, flow_id);
+	_UNUSED(udp_socket);
+	this->send_data_udp_kind( frame_kind , flow_id , t_bytes_view( data , data_size ) , src_hip , dst_hip , ttl , nonce_flow , flow );
+}
+
+void c_peering_udp::send_data_udp_relayed(char * frame, size_t frame_size, const t_bytes_view & blob,
+	const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl, const t_flow_nonce & nonce, c_send_scheduler::t_flow flow)
+{
+	t_flow_id flow_id = 0;
+	const auto frame_kind = m_flow_tx.prepare(src_hip, dst_hip, ttl, nonce, flow_id);
+	if (frame_kind == c_flow_tx::e_frame_compact) { // [protocol] the same frame, only with our FLOW_ID (the nonce is the same)
+		trivialserialize::generator gen( trivialserialize::generator::tag_caller_must_keep_this_buffer_valid{} ,
+			frame + c_protocol::version_size + c_protocol::cmd_size , sizeof(t_flow_id) );
+		gen.push_integer_u<sizeof(t_flow_id)>( flow_id );
+		this->send_data_aggregated( frame , frame_size , flow );
+		return;
+	}
+	this->send_data_udp_kind( frame_kind , flow_id , blob , src_hip , dst_hip , ttl , nonce , flow ); // bigger header, so built again
+}
+
+void c_peering_udp::send_data_udp_kind(c_flow_tx::t_frame_kind frame_kind, t_flow_id flow_id, const t_bytes_view & blob,
+	const c_haship_addr & src_hip, const c_haship_addr & dst_hip, int ttl, const t_flow_nonce & nonce_flow, c_send_scheduler::t_flow flow)
+{
+	const t_bytes_view nonce_bin( reinterpret_cast<const char*>( nonce_flow.data() ) , nonce_flow.size() );
+	const t_bytes_view src_view( reinterpret_cast<const char*>( src_hip.data() ) , src_hip.size() );
+	const t_bytes_view dst_view( reinterpret_cast<const char*>( dst_hip.data() ) , dst_hip.size() );
+	auto generate_frame = [&](trivialserialize::generator & gen) {
+		gen.push_byte_u( c_protocol::current_version );
+		switch (frame_kind) { // [protocol] see protocol_messages.hpp
+			case c_flow_tx::e_frame_compact:
+				gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data_flow );
+				protocol_messages::tunneled_data_flow::encode( gen , protocol_messages::tunneled_data_flow::t_values(
+					flow_id , static_cast<uint16_t>( flow_compression::nonce_get_counter(nonce_flow) & 0xFFFF ) , blob ) );
+			break;
+			case c_flow_tx::e_frame_setup:
+				gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data_flow_setup );
+				protocol_messages::tunneled_data_flow_setup::encode( gen , protocol_messages::tunneled_data_flow_setup::t_values(
+					flow_id , src_view , dst_view , ttl , nonce_bin , blob ) );
+			break;
+			case c_flow_tx::e_frame_full:
+				gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data );
+				protocol_messages::tunneled_data::encode( gen , protocol_messages::tunneled_data::t_values(
+					src_view , dst_view , ttl , nonce_bin , blob ) );
+			break;
+		}
+	};
+	// measure, then write the frame into our reused buffer - so usually nothing is allocated here
+	trivialserialize::generator gen_measure( trivialserialize::generator::tag_measure_only{} );
+	generate_frame( gen_measure );
+	if (m_send_buffer.size() < gen_measure.get_size()) m_send_buffer.resize( gen_measure.get_size() );
+	trivialserialize::generator gen( trivialserialize::generator::tag_caller_must_keep_this_buffer_valid{} ,
+		m_send_buffer.data() , m_send_buffer.size() );
+	generate_frame( gen );
 
 /*
 	// TODONOW turn off this crypto (unless leave here for peer-to-peer auth only)
@@ -145,8 +258,7 @@ void c_peering_udp::send_data_udp(const char * data, size_t data_size, int udp_s
 	// TODO asserts!!!
 */
 
-	string protomsg = gen.str(); // TODO view_string
-	this->send_data_RAW_udp(protomsg.c_str(), protomsg.size(), udp_socket);
+	this->send_data_aggregated( m_send_buffer.data() , gen.get_size() , flow );
 }
 
 void c_peering_udp::send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, int udp_socket) {
@@ -155,10 +267,84 @@ void c_peering_udp::send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_
     raw.bytes += c_protocol::current_version;
     raw.bytes += cmd;
 	raw.bytes += bin.bytes;
-	this->send_data_RAW_udp(raw.bytes.c_str(), raw.bytes.size(), udp_socket);
+	this->on_sent(raw.bytes.size());
+	this->send_data_RAW_udp(raw.bytes.c_str(), raw.bytes.size(), udp_socket, c_send_scheduler::e_class_control, 0);
+}
+
+void c_peering_udp::flow_reset(t_flow_id flow_id) {
+	m_flow_tx.reset(flow_id);
+}
+
+void c_peering_udp::send_data_udp_frame(const char * data, size_t data_size, c_send_scheduler::t_flow flow) {
+	this->send_data_aggregated(data, data_size, flow);
+}
+
+void c_peering_udp::set_protocol_version(int version) {
+	if (version == m_protocol_version) return; // usual case
+	c_peering::set_protocol_version(version);
+	update_compact_frames();
+}
+
+void c_peering_udp::set_flow_compression(bool enabled) {
+	m_flow_compression = enabled;
+	update_compact_frames();
+}
+
+void c_peering_udp::set_aggregation_delay(c_packet_aggregator::t_clock::duration max_delay) {
+	m_aggregation_delay = max_delay;
+	update_compact_frames();
 }
 
-void c_peering_udp::send_data_RAW_udp(const char * data, size_t data_size, int udp_socket) {
+void c_peering_udp::update_compact_frames() {
+	const bool can_parse = m_protocol_version >= c_protocol::version_min_compact_frames;
+	m_flow_tx.set_enabled( can_parse && m_flow_compression );
+	const auto max_delay = can_parse ? m_aggregation_delay : c_packet_aggregator::t_clock::duration(0);
+	if (! max_delay.count()) { // disabling, so do not leave anything waiting
+		send_aggregated_datagram( m_aggregator.flush() , m_aggregated_flow );
+	}
+	m_aggregator.set_max_delay(max_delay);
+}
+
+void c_peering_udp::aggregation_flush_if_due(c_packet_aggregator::t_clock::time_point now) {
+	if (! m_aggregator.is_due(now)) return;
+	send_aggregated_datagram( m_aggregator.flush() , m_aggregated_flow );
+}
+
+void c_peering_udp::on_path_mtu_changed() {
+	send_aggregated_datagram( m_aggregator.flush() , m_aggregated_flow ); // it could be too big now
+	m_aggregator.set_datagram_size_max( m_path_mtu.get_size() );
+	m_metric_path_mtu.set( m_path_mtu.get_size() );
+}
+
+bool c_peering_udp::get_aggregation_due_time(c_packet_aggregator::t_clock::time_point & due) const {
+	if (! m_aggregator.is_pending()) return false;
+	due = m_aggregator.get_due_time();
+	return true;
+}
+
+void c_peering_udp::send_data_aggregated(const char * data, size_t data_size, c_send_scheduler::t_flow flow) {
+	this->on_sent(data_size);
+	std::string ready; // datagram that is full already
+	const bool was_pending = m_aggregator.is_pending();
+	if (m_aggregator.add(data, data_size, c_program_clock::now(), ready)) {
+		if (ready.size()) send_aggregated_datagram( ready , m_aggregated_flow ); // and this frame is first in the next one
+		if (ready.size() || (! was_pending)) m_aggregated_flow = flow;
+		return;
+	}
+	// send them before this one, and into the same flow queue (flows are queued apart), so its frames are not overtaken by it
+	send_aggregated_datagram( m_aggregator.flush() , flow );
+	this->send_data_RAW_udp(data, data_size, -1, c_send_scheduler::e_class_data, flow);
+}
+
+void c_peering_udp::send_aggregated_datagram(const std::string & datagram, c_send_scheduler::t_flow flow) {
+	if (datagram.empty()) return;
+	_dbg1("Sending aggregated datagram, size " << datagram.size() << " as flow " << flow);
+	this->send_data_RAW_udp(datagram.c_str(), datagram.size(), -1, c_send_scheduler::e_class_data, flow);
+}
+
+void c_peering_udp::send_data_RAW_udp(const char * data, size_t data_size, int udp_socket,
+	c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow)
+{
 	_UNUSED(udp_socket);
 	_info("UDP send to peer RAW. To IP: " << m_peering_addr <<
 		", RAW-DATA: " << to_debug_b(std::string(data,data_size)) );
@@ -166,11 +352,11 @@ void c_peering_udp::send_data_RAW_udp(const char * data, size_t data_size, int u
 	//#ifdef __linux__
 	switch (m_peering_addr.get_ip_type()) {
 		case c_ip46_addr::t_tag::tag_ipv4 : {
-			m_udp_wrapper.get().send_data(m_peering_addr, data, data_size);
+			m_udp_wrapper.get().send_data_scheduled(m_peering_addr, data, data_size, send_class, flow);
 		}
 		break;
 		case c_ip46_addr::t_tag::tag_ipv6 : {
-			m_udp_wrapper.get().send_data(m_peering_addr, data, data_size);
+			m_udp_wrapper.get().send_data_scheduled(m_peering_addr, data, data_size, send_class, flow);
 		}
 		break;
 		default: {
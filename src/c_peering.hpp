@@ -3,7 +3,6 @@
 #ifndef C_PEERING_H
 #define C_PEERING_H
 
-#include <atomic>
 
 #include "formats_ip.hpp"
 #include "c_ip46_addr.hpp"
@@ -12,6 +11,13 @@
 
 #include "crypto/crypto_basic.hpp"
 #include "c_udp_wrapper.hpp"
+#include "c_link_quality.hpp"
+#include "c_keepalive.hpp"
+#include "c_path_mtu.hpp"
+#include "c_token_bucket.hpp"
+#include "c_flow_compression.hpp"
+#include "c_packet_aggregator.hpp"
+#include "c_metrics.hpp"
 
 // TODO (later) make normal virtual functions (move UDP properties into class etc) once tests are done.
 
@@ -41,9 +47,17 @@ class c_peering { ///< An (mostly established) connection to peer
 
 		virtual void set_pubkey( std::unique_ptr<c_haship_pubkey> && pubkey ); ///< consume this pubkey and set as mine
 		bool is_pubkey() const; ///< do we have a valid pubkey set
-		void add_limit_points(long int points);
-		void decrement_limit_points();
-		long int get_limit_points();
+		void set_rate_limit(const t_rate_limit & limit); ///< of what he sends to us
+		/// can we take this datagram from him (then it is counted in his limit); if not, it is counted as dropped (see c_metrics)
+		bool rate_limit_allow(size_t size);
+		void add_limit_points(long int points); ///< extra packets that he can send (above his rate limit, if any)
+		long int get_limit_points() const; ///< packets that he can send now (if he is limited)
+
+		const c_link_quality & get_link_quality() const; ///< measured RTT/loss of link to this peer, and the resulting route cost
+		const c_path_mtu & get_path_mtu() const; ///< biggest datagram that gets to him not fragmented
+		void on_received(size_t size); ///< count a frame that we got from him (see c_metrics)
+		virtual void set_protocol_version(int version); ///< of the frames that he sends us, so we know what he can parse
+		int get_protocol_version() const; ///< 0 if we did not get anything from him yet
 
 		friend class c_tunserver;
 
@@ -51,34 +65,72 @@ class c_peering { ///< An (mostly established) connection to peer
 		c_ip46_addr	m_peering_addr; ///< peer physical address in socket format
 		c_haship_addr m_haship_addr; ///< peer haship address
 		unique_ptr<c_haship_pubkey> m_pubkey; ///< his pubkey (when we know it)
-		std::atomic<long int> m_limit_points; // decrement when send packet to this peer
+		c_token_bucket m_limit_points; ///< packets that he can send to us (checked on ingress, before any other work)
+		c_token_bucket m_limit_bytes; ///< bytes that he can send to us
+		c_link_quality m_link_quality; ///< updated from our pings to him
+		c_keepalive m_keepalive; ///< when to ping him (and when to send him our hello)
+		c_path_mtu m_path_mtu; ///< probed with padded pings
+		c_flow_rx m_flow_rx; ///< compressed flows that he sends to us
+		int m_protocol_version; ///< see set_protocol_version()
+
+		/// @name Metrics of this peer (in c_metrics), counted in frames (before aggregation, after splitting)
+		/// @{
+		c_metric_counter & m_metric_sent_packets;
+		c_metric_counter & m_metric_sent_bytes;
+		c_metric_counter & m_metric_received_packets;
+		c_metric_counter & m_metric_received_bytes;
+		c_metric_counter & m_metric_rate_limited; ///< datagrams from him dropped by his rate limit
+		c_metric_gauge & m_metric_path_mtu;
+		/// @}
+		void on_sent(size_t size);
 };
 
 ostream & operator<<(ostream & ostr, const c_peering & obj);
 
 class c_peering_udp : public c_peering { ///< An established connection to UDP peer
 	public:
-		#ifdef __linux__
-		c_peering_udp(const t_peering_reference & ref, c_udp_wrapper_linux &udp_wrapper);
-		#endif
-
-		#if defined(_WIN32) || defined(__CYGWIN__)
-		c_peering_udp(const t_peering_reference & ref, c_udp_wrapper_windows &udp_wrapper);
-		#endif
+		c_peering_udp(const t_peering_reference & ref, c_udp_wrapper &udp_wrapper);
 
 		virtual void send_data(const char * data, size_t data_size) override;
+		/// tunneled data, of given flow (e.g. c_routing_manager::t_flow_hash), for fair sharing of link in c_send_scheduler
 		virtual void send_data_udp(const char * data, size_t data_size, int udp_socket,
-			c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used);
-		virtual void send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, int udp_socket);
+			c_haship_addr src_hip, c_haship_addr dst_hip, int ttl, antinet_crypto::t_crypto_nonce nonce_used,
+			c_send_scheduler::t_flow flow);
+		virtual void send_data_udp_cmd(c_protocol::t_proto_cmd cmd, const string_as_bin & bin, int udp_socket); ///< as control (priority)
+		void send_data_udp_frame(const char * data, size_t data_size, c_send_scheduler::t_flow flow); ///< send already complete data frame (e.g. relayed one), as it is
+		///@brief relay e_proto_cmd_tunneled_data_flow frame (its header as decoded by c_flow_rx of the peer that sent it, ttl already
+		///decremented): if this flow is compressed to us too, then only FLOW_ID in frame is rewritten (in place), else it is built again
+		void send_data_udp_relayed(char * frame, size_t frame_size, const t_bytes_view & blob,
+			const c_haship_addr & src_hip, const c_haship_addr & dst_hip, unsigned char ttl, const t_flow_nonce & nonce,
+			c_send_scheduler::t_flow flow);
+		void flow_reset(t_flow_id flow_id); ///< he does not know this compressed flow of ours, resync it
+		virtual void set_protocol_version(int version) override; ///< also starts (or stops) compressed flows and aggregation to him
+		void set_flow_compression(bool enabled); ///< can we use compressed flows to him (if his version can decode them)
+
+		/// max wait for more small frames; zero sends each at once (as does older peer, that can not split them)
+		void set_aggregation_delay(c_packet_aggregator::t_clock::duration max_delay);
+		void aggregation_flush_if_due(c_packet_aggregator::t_clock::time_point now); ///< send the aggregated frames that waited long enough
+		bool get_aggregation_due_time(c_packet_aggregator::t_clock::time_point & due) const; ///< false if nothing is waiting
+		void on_path_mtu_changed(); ///< use the new m_path_mtu (size of aggregated datagrams)
 	private:
-
-		virtual void send_data_RAW_udp(const char * data, size_t data_size, int udp_socket); ///< direct write
-		#ifdef __linux__
-		std::reference_wrapper<c_udp_wrapper_linux> m_udp_wrapper; // TODO: sahred_ptr ?
-		#endif
-		#if defined(_WIN32) || defined(__CYGWIN__)
-		std::reference_wrapper<c_udp_wrapper_windows> m_udp_wrapper; // TODO: sahred_ptr ?
-		#endif
+		c_flow_tx m_flow_tx; ///< compressed flows that we send to him
+		bool m_flow_compression; ///< see set_flow_compression()
+		c_packet_aggregator m_aggregator; ///< small data frames waiting to be sent to him together
+		c_packet_aggregator::t_clock::duration m_aggregation_delay; ///< as set, used once his version can split the datagrams
+		c_send_scheduler::t_flow m_aggregated_flow; ///< flow of the first frame in m_aggregator: its datagram is queued as this flow
+		std::vector<char> m_send_buffer; ///< reused for building frames in send_data_udp()
+
+		/// build tunneled data frame of this kind (as m_flow_tx.prepare() said) in m_send_buffer and send it
+		void send_data_udp_kind(c_flow_tx::t_frame_kind frame_kind, t_flow_id flow_id, const t_bytes_view & blob,
+			const c_haship_addr & src_hip, const c_haship_addr & dst_hip, int ttl, const t_flow_nonce & nonce_flow,
+			c_send_scheduler::t_flow flow);
+		void send_data_aggregated(const char * data, size_t data_size, c_send_scheduler::t_flow flow); ///< data frame, via m_aggregator (or at once)
+		void send_aggregated_datagram(const std::string & datagram, c_send_scheduler::t_flow flow); ///< from m_aggregator, if not empty
+		void update_compact_frames(); ///< use flows and aggregation only as far as he can parse them (and we want to)
+
+		virtual void send_data_RAW_udp(const char * data, size_t data_size, int udp_socket,
+			c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow); ///< direct write
+		std::reference_wrapper<c_udp_wrapper> m_udp_wrapper; // TODO: sahred_ptr ?
 };
 
 #endif // C_PEERING_H
@@ -0,0 +1,26 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_program_clock.hpp"
+
+std::atomic<bool> c_program_clock::s_virtual{ false };
+std::atomic<c_program_clock::t_clock::rep> c_program_clock::s_virtual_time{ 0 };
+
+c_program_clock::t_clock::time_point c_program_clock::now() {
+	if (! s_virtual.load(std::memory_order_relaxed)) return t_clock::now();
+	return t_clock::time_point( t_clock::duration( s_virtual_time.load(std::memory_order_relaxed) ) );
+}
+
+void c_program_clock::set_virtual_time(t_clock::time_point time) {
+	s_virtual_time.store( time.time_since_epoch().count() , std::memory_order_relaxed );
+	s_virtual.store( true , std::memory_order_relaxed );
+}
+
+void c_program_clock::set_real_time() {
+	s_virtual.store( false , std::memory_order_relaxed );
+}
+
+bool c_program_clock::is_virtual_time() {
+	return s_virtual.load(std::memory_order_relaxed);
+}
+
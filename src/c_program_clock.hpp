@@ -0,0 +1,31 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_program_clock_hpp
+#define include_c_program_clock_hpp
+
+#include <atomic>
+#include <chrono>
+
+/***
+@brief The time as seen by the node logic (pings, routes, aggregation): normally just the steady_clock,
+but it can be switched to virtual time that the caller moves on its own, e.g. by the simulator.
+*/
+class c_program_clock {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		static t_clock::time_point now(); ///< the real or virtual time now
+
+		static void set_virtual_time(t_clock::time_point time); ///< from now on now() returns this time (till next call)
+		static void set_real_time(); ///< now() is again the real steady_clock
+		static bool is_virtual_time();
+
+	private:
+		static std::atomic<bool> s_virtual;
+		static std::atomic<t_clock::rep> s_virtual_time; ///< time_since_epoch in t_clock::duration units
+};
+
+#endif
+
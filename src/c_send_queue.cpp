@@ -0,0 +1,104 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_send_queue.hpp"
+
+#include <cmath>
+
+c_send_queue::t_limits::t_limits()
+:
+	m_packets_max(256), m_bytes_max(1024*1024), m_policy(e_drop_codel),
+	m_codel_target( std::chrono::milliseconds(5) ), m_codel_interval( std::chrono::milliseconds(100) )
+{ }
+
+c_send_queue::c_send_queue(const t_limits & limits)
+:
+	m_limits(limits), m_bytes(0), m_dropped_tail(0), m_dropped_codel(0),
+	m_dropping(false), m_drop_count(0), m_drop_count_last(0)
+{ }
+
+bool c_send_queue::push(std::string && data, uint16_t segment_size, t_clock::time_point now) {
+	if ((m_items.size() >= m_limits.m_packets_max) || (m_bytes + data.size() > m_limits.m_bytes_max)) {
+		++m_dropped_tail;
+		return false;
+	}
+	m_bytes += data.size();
+	m_items.push_back( t_item{ std::move(data) , segment_size , now } );
+	return true;
+}
+
+bool c_send_queue::codel_ok_to_drop(t_clock::time_point now) {
+	const auto sojourn = now - m_items.front().m_enqueue_time;
+	if ((sojourn < m_limits.m_codel_target) || (m_items.size() <= 1)) { // short delay, or it is just this one (not a standing queue)
+		m_first_above_time = t_clock::time_point();
+		return false;
+	}
+	if (m_first_above_time == t_clock::time_point()) {
+		m_first_above_time = now + m_limits.m_codel_interval;
+		return false;
+	}
+	return now >= m_first_above_time;
+}
+
+c_send_queue::t_clock::time_point c_send_queue::codel_control_law(t_clock::time_point t) const {
+	return t + std::chrono::duration_cast<t_clock::duration>( m_limits.m_codel_interval / std::sqrt( static_cast<double>(m_drop_count) ) );
+}
+
+void c_send_queue::drop_head() {
+	m_bytes -= m_items.front().m_data.size();
+	m_items.pop_front();
+	++m_dropped_codel;
+}
+
+const c_send_queue::t_item * c_send_queue::front(t_clock::time_point now) {
+	if (m_items.empty()) { m_dropping = false; return nullptr; }
+	if (m_limits.m_policy != e_drop_codel) return & m_items.front();
+
+	bool ok_to_drop = codel_ok_to_drop(now);
+	if (m_dropping) {
+		if (!ok_to_drop) m_dropping = false; // delay is fine again
+		while (m_dropping && (now >= m_drop_next)) { // drop faster and faster (interval / sqrt(count)), until delay is fine
+			drop_head();
+			++m_drop_count;
+			if (m_items.empty() || !codel_ok_to_drop(now)) m_dropping = false;
+			else m_drop_next = codel_control_law(m_drop_next);
+		}
+	}
+	else if (ok_to_drop) {
+		drop_head();
+		m_dropping = true;
+		const uint32_t delta = m_drop_count - m_drop_count_last; // recently dropping: start near the rate from then
+		m_drop_count = ((delta > 1) && (now - m_drop_next < 16 * m_limits.m_codel_interval)) ? delta : 1;
+		m_drop_next = codel_control_law(now);
+		m_drop_count_last = m_drop_count;
+	}
+	if (m_items.empty()) { m_dropping = false; return nullptr; }
+	return & m_items.front();
+}
+
+void c_send_queue::pop() {
+	m_bytes -= m_items.front().m_data.size();
+	m_items.pop_front();
+}
+
+size_t c_send_queue::split_front() {
+	if (! m_items.front().m_segment_size) return 0;
+	const t_item batch = std::move( m_items.front() );
+	m_items.pop_front();
+	size_t count = 0;
+	for (size_t pos = 0; pos < batch.m_data.size(); pos += batch.m_segment_size) { // the same bytes, so m_bytes is not changed
+		m_items.insert( m_items.begin() + count , t_item{ batch.m_data.substr(pos, batch.m_segment_size) , 0 , batch.m_enqueue_time } );
+		++count;
+	}
+	return count - 1;
+}
+
+bool c_send_queue::empty() const { return m_items.empty(); }
+
+size_t c_send_queue::size() const { return m_items.size(); }
+
+size_t c_send_queue::get_bytes() const { return m_bytes; }
+
+uint64_t c_send_queue::get_dropped_tail() const { return m_dropped_tail; }
+
+uint64_t c_send_queue::get_dropped_codel() const { return m_dropped_codel; }
+
@@ -0,0 +1,76 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_send_queue_hpp
+#define include_c_send_queue_hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/***
+@brief Datagrams to one destination that wait for room in the (non-blocking) socket, see c_udp_wrapper_linux.
+Bounded: when full, new datagrams are dropped (tail drop). With e_drop_codel it also drops from head, when datagrams
+wait too long (CoDel, RFC 8289: sojourn time over target for a whole interval), so a standing queue does not
+add latency to everything sent to that peer.
+*/
+class c_send_queue final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+		enum t_drop_policy { e_drop_tail, e_drop_codel };
+
+		struct t_limits {
+			size_t m_packets_max; ///< items (datagram, or GSO batch of them)
+			size_t m_bytes_max;
+			t_drop_policy m_policy;
+			t_clock::duration m_codel_target; ///< acceptable standing delay
+			t_clock::duration m_codel_interval; ///< about a round trip time
+			t_limits(); ///< the defaults: 256 items, 1 MiB, CoDel 5 ms / 100 ms
+		};
+
+		struct t_item {
+			std::string m_data;
+			uint16_t m_segment_size; ///< 0 for one datagram; else m_data has datagrams of this size (GSO), the last can be shorter
+			t_clock::time_point m_enqueue_time;
+		};
+
+		explicit c_send_queue(const t_limits & limits = t_limits());
+
+		bool push(std::string && data, uint16_t segment_size, t_clock::time_point now); ///< false if dropped (queue is full)
+		const t_item * front(t_clock::time_point now); ///< next one to send (after dropping by policy), or nullptr if empty
+		void pop(); ///< after front() was sent
+		/// front() GSO batch is replaced by its datagrams (still first, e.g. when GSO fails); returns how many items were added
+		size_t split_front();
+
+		bool empty() const;
+		size_t size() const;
+		size_t get_bytes() const;
+		uint64_t get_dropped_tail() const;
+		uint64_t get_dropped_codel() const;
+
+	private:
+		t_limits m_limits;
+		std::deque<t_item> m_items;
+		size_t m_bytes;
+		uint64_t m_dropped_tail;
+		uint64_t m_dropped_codel;
+
+		/// @name CoDel state
+		/// @{
+		bool m_dropping;
+		t_clock::time_point m_first_above_time; ///< when sojourn time will have been over target for an interval; epoch if not over
+		t_clock::time_point m_drop_next;
+		uint32_t m_drop_count;
+		uint32_t m_drop_count_last;
+		/// @}
+
+		bool codel_ok_to_drop(t_clock::time_point now); ///< looks at head (must not be empty)
+		t_clock::time_point codel_control_law(t_clock::time_point t) const;
+		void drop_head();
+};
+
+#endif
+
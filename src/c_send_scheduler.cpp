@@ -0,0 +1,192 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_send_scheduler.hpp"
+#include "c_tnetdbg.hpp"
+
+#include <cstring>
+
+constexpr size_t c_send_scheduler::class_count;
+
+c_send_scheduler::t_limits::t_limits()
+:
+	m_control_packets_max(64), m_quantum(1500)
+{ }
+
+c_send_scheduler::c_send_scheduler(const t_limits & limits)
+:
+	m_limits(limits), m_front_class(e_class_control)
+{
+	std::memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void c_send_scheduler::set_limits(const t_limits & limits) {
+	_check( limits.m_quantum > 0 );
+	m_limits = limits;
+}
+
+const c_send_scheduler::t_limits & c_send_scheduler::get_limits() const { return m_limits; }
+
+void c_send_scheduler::set_on_drop(t_on_drop on_drop) { m_on_drop = on_drop; }
+
+void c_send_scheduler::on_drop(const c_ip46_addr & address, t_class send_class, t_drop_reason reason, uint64_t count) {
+	if (reason == e_drop_tail) m_stats.m_dropped_tail[send_class] += count;
+	else m_stats.m_dropped_codel[send_class] += count;
+	if (m_on_drop) m_on_drop(address, send_class, reason, count);
+}
+
+bool c_send_scheduler::push(t_class send_class, const c_ip46_addr & address, t_flow flow,
+	std::string && data, uint16_t segment_size, t_clock::time_point now)
+{
+	const size_t size = data.size();
+	if (send_class == e_class_control) {
+		if (m_control.size() >= m_limits.m_control_packets_max) { on_drop(address, send_class, e_drop_tail, 1); return false; }
+		m_control.push_back( t_control_item{ address , c_send_queue::t_item{ std::move(data) , segment_size , now } } );
+	}
+	else {
+		auto destination_it = m_destinations.find(address);
+		const size_t packets = (destination_it == m_destinations.end()) ? 0 : destination_it->second.m_packets;
+		const size_t bytes = (destination_it == m_destinations.end()) ? 0 : destination_it->second.m_bytes;
+		if ((packets >= m_limits.m_data.m_packets_max) || (bytes + size > m_limits.m_data.m_bytes_max)) {
+			on_drop(address, send_class, e_drop_tail, 1);
+			return false;
+		}
+		if (destination_it == m_destinations.end()) { // starts with a full quantum, like in fq_codel
+			destination_it = m_destinations.emplace( address , t_destination{ t_flows() , {} , m_limits.m_quantum , 0 , 0 } ).first;
+			m_active.push_back(destination_it);
+		}
+		t_destination & destination = destination_it->second;
+		auto flow_it = destination.m_flows.find(flow);
+		if (flow_it == destination.m_flows.end()) {
+			flow_it = destination.m_flows.emplace( flow , t_flow_queue{ c_send_queue(m_limits.m_data) , m_limits.m_quantum } ).first;
+			destination.m_active.push_back(flow_it);
+		}
+		const bool pushed = flow_it->second.m_queue.push( std::move(data) , segment_size , now );
+		_check( pushed ); // limits of flow are the same as of whole destination
+		++destination.m_packets;
+		destination.m_bytes += size;
+	}
+	++m_stats.m_queued[send_class];
+	m_stats.m_queued_bytes[send_class] += size;
+	return true;
+}
+
+const c_send_queue::t_item * c_send_scheduler::destination_front(t_destinations::iterator destination_it, t_clock::time_point now) {
+	t_destination & destination = destination_it->second;
+	while (! destination.m_active.empty()) {
+		auto flow_it = destination.m_active.front();
+		t_flow_queue & flow = flow_it->second;
+		const size_t packets_before = flow.m_queue.size();
+		const size_t bytes_before = flow.m_queue.get_bytes();
+		const c_send_queue::t_item * item = flow.m_queue.front(now);
+		const size_t dropped = packets_before - flow.m_queue.size();
+		if (dropped) {
+			const size_t dropped_bytes = bytes_before - flow.m_queue.get_bytes();
+			destination.m_packets -= dropped;
+			destination.m_bytes -= dropped_bytes;
+			m_stats.m_queued[e_class_data] -= dropped;
+			m_stats.m_queued_bytes[e_class_data] -= dropped_bytes;
+			on_drop(destination_it->first, e_class_data, e_drop_codel, dropped);
+		}
+		if (item == nullptr) { // all of it was dropped
+			destination.m_flows.erase(flow_it);
+			destination.m_active.pop_front();
+			continue;
+		}
+		if (flow.m_deficit >= item->m_data.size()) return item;
+		flow.m_deficit += m_limits.m_quantum; // its turn ends, next round it can send more
+		destination.m_active.pop_front();
+		destination.m_active.push_back(flow_it);
+	}
+	return nullptr;
+}
+
+const c_send_queue::t_item * c_send_scheduler::front(t_clock::time_point now, c_ip46_addr & address) {
+	if (! m_control.empty()) { // strict priority
+		m_front_class = e_class_control;
+		address = m_control.front().m_address;
+		return & m_control.front().m_item;
+	}
+	while (! m_active.empty()) {
+		auto destination_it = m_active.front();
+		t_destination & destination = destination_it->second;
+		const c_send_queue::t_item * item = destination_front(destination_it, now);
+		if (item == nullptr) {
+			m_destinations.erase(destination_it);
+			m_active.pop_front();
+			continue;
+		}
+		if (destination.m_deficit >= item->m_data.size()) {
+			m_front_class = e_class_data;
+			address = destination_it->first;
+			return item;
+		}
+		destination.m_deficit += m_limits.m_quantum;
+		m_active.pop_front();
+		m_active.push_back(destination_it);
+	}
+	return nullptr;
+}
+
+void c_send_scheduler::pop() {
+	size_t size = 0;
+	if (m_front_class == e_class_control) {
+		_check( ! m_control.empty() );
+		size = m_control.front().m_item.m_data.size();
+		m_control.pop_front();
+	}
+	else {
+		_check( ! m_active.empty() );
+		auto destination_it = m_active.front();
+		t_destination & destination = destination_it->second;
+		auto flow_it = destination.m_active.front();
+		t_flow_queue & flow = flow_it->second;
+		size = flow.m_queue.get_bytes();
+		flow.m_queue.pop();
+		size -= flow.m_queue.get_bytes();
+		flow.m_deficit -= size;
+		destination.m_deficit -= size;
+		--destination.m_packets;
+		destination.m_bytes -= size;
+		if (flow.m_queue.empty()) {
+			destination.m_flows.erase(flow_it);
+			destination.m_active.pop_front();
+		}
+		if (destination.m_flows.empty()) {
+			m_destinations.erase(destination_it);
+			m_active.pop_front();
+		}
+	}
+	++m_stats.m_sent[m_front_class];
+	--m_stats.m_queued[m_front_class];
+	m_stats.m_queued_bytes[m_front_class] -= size;
+}
+
+void c_send_scheduler::split_front() {
+	if (m_front_class == e_class_control) return; // it is one datagram, GSO batches are only of data
+	_check( ! m_active.empty() );
+	t_destination & destination = m_active.front()->second;
+	const size_t added = destination.m_active.front()->second.m_queue.split_front();
+	destination.m_packets += added;
+	m_stats.m_queued[e_class_data] += added;
+}
+
+bool c_send_scheduler::empty() const { return m_control.empty() && m_active.empty(); }
+
+size_t c_send_scheduler::get_queued(t_class send_class) const { return m_stats.m_queued[send_class]; }
+
+const c_send_scheduler::t_stats & c_send_scheduler::get_stats() const { return m_stats; }
+
+const char * c_send_scheduler::class_name(t_class send_class) {
+	return (send_class == e_class_control) ? "control" : "data";
+}
+
+const char * c_send_scheduler::drop_reason_name(t_drop_reason reason) {
+	return (reason == e_drop_tail) ? "tail" : "codel";
+}
+
+bool c_send_scheduler::t_address_less::operator()(const c_ip46_addr & lhs, const c_ip46_addr & rhs) const {
+	if (lhs < rhs) return true;
+	if (rhs < lhs) return false;
+	return lhs.get_assign_port() < rhs.get_assign_port(); // c_ip46_addr compares only IP
+}
+
@@ -0,0 +1,106 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_send_scheduler_hpp
+#define include_c_send_scheduler_hpp
+
+#include "c_ip46_addr.hpp"
+#include "c_send_queue.hpp"
+
+#include <deque>
+#include <functional>
+#include <map>
+
+/***
+@brief Datagrams that wait to be sent (for room in the UDP socket), and the order in which they go, see c_udp_wrapper_linux.
+- e_class_control (e.g. public_hi, findhip query/reply, pings) has strict priority: it goes before any data,
+so route replies and hellos are not late because of bulk data (what would cause route timeouts).
+It is one FIFO for all destinations, and only tail drop.
+- e_class_data is shared fairly with deficit round robin (DRR): between destinations (peers), and inside one destination
+between flows (e.g. c_routing_manager::t_flow_hash), each round each can send up to quantum bytes.
+Each flow has own c_send_queue (so with CoDel, like fq_codel), and all flows of a destination together are limited
+by m_data.m_packets_max and m_data.m_bytes_max (over it: tail drop).
+*/
+class c_send_scheduler final {
+	public:
+		typedef c_send_queue::t_clock t_clock;
+		typedef uint32_t t_flow; ///< any stable hash of flow; e.g. 0 for datagrams with frames of many flows
+		enum t_class { e_class_control, e_class_data }; ///< from highest priority
+		constexpr static size_t class_count = 2;
+		enum t_drop_reason { e_drop_tail, e_drop_codel };
+
+		struct t_limits {
+			c_send_queue::t_limits m_data; ///< for data to one destination (items and bytes: of all its flows), and drop policy
+			size_t m_control_packets_max; ///< control items waiting (to all destinations)
+			size_t m_quantum; ///< bytes that a destination (and a flow in it) can send in one round of DRR
+			t_limits(); ///< the defaults: data like c_send_queue::t_limits, 64 control items, quantum 1500
+		};
+
+		struct t_stats { ///< counted in items (datagram, or GSO batch of them), by t_class
+			uint64_t m_sent[class_count]; ///< that waited here, and then were sent
+			uint64_t m_dropped_tail[class_count];
+			uint64_t m_dropped_codel[class_count];
+			size_t m_queued[class_count]; ///< waiting now
+			size_t m_queued_bytes[class_count];
+		};
+
+		/// called for dropped items: destination, class, reason, how many
+		typedef std::function<void(const c_ip46_addr &, t_class, t_drop_reason, uint64_t)> t_on_drop;
+
+		explicit c_send_scheduler(const t_limits & limits = t_limits());
+		void set_limits(const t_limits & limits); ///< data limits are used for flows created from now on
+		const t_limits & get_limits() const;
+		void set_on_drop(t_on_drop on_drop); ///< e.g. to count drops of each destination
+
+		/// false if dropped (queue is full); for segment_size see c_send_queue::t_item
+		bool push(t_class send_class, const c_ip46_addr & address, t_flow flow,
+			std::string && data, uint16_t segment_size, t_clock::time_point now);
+		/// next one to send (after drops by policy), and its destination; or nullptr if none. It stays there until pop()
+		const c_send_queue::t_item * front(t_clock::time_point now, c_ip46_addr & address);
+		void pop(); ///< after front() was sent
+		void split_front(); ///< front() GSO batch (of data) is replaced by its datagrams, still first (e.g. GSO to it failed)
+
+		bool empty() const;
+		size_t get_queued(t_class send_class) const; ///< items waiting in this class
+		const t_stats & get_stats() const;
+
+		static const char * class_name(t_class send_class); ///< e.g. for labels of metrics
+		static const char * drop_reason_name(t_drop_reason reason);
+
+		struct t_address_less { bool operator()(const c_ip46_addr & lhs, const c_ip46_addr & rhs) const; }; ///< IP, then port
+
+	private:
+		struct t_control_item {
+			c_ip46_addr m_address;
+			c_send_queue::t_item m_item;
+		};
+		struct t_flow_queue {
+			c_send_queue m_queue;
+			size_t m_deficit; ///< bytes it can still send in this round
+		};
+		typedef std::map<t_flow, t_flow_queue> t_flows;
+		struct t_destination {
+			t_flows m_flows; ///< only flows that have items
+			std::deque<t_flows::iterator> m_active; ///< the same flows, in order of DRR
+			size_t m_deficit;
+			size_t m_packets; ///< of all its flows
+			size_t m_bytes;
+		};
+		typedef std::map<c_ip46_addr, t_destination, t_address_less> t_destinations;
+
+		t_limits m_limits;
+		t_on_drop m_on_drop;
+		t_stats m_stats;
+		std::deque<t_control_item> m_control;
+		t_destinations m_destinations; ///< only destinations that have data items
+		std::deque<t_destinations::iterator> m_active; ///< the same destinations, in order of DRR
+		t_class m_front_class; ///< of what front() returned
+
+		/// DRR between flows of this destination; drops (CoDel) from them; nullptr if all are empty
+		const c_send_queue::t_item * destination_front(t_destinations::iterator destination_it, t_clock::time_point now);
+		void on_drop(const c_ip46_addr & address, t_class send_class, t_drop_reason reason, uint64_t count);
+};
+
+#endif
+
@@ -0,0 +1,61 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_token_bucket.hpp"
+
+#include <algorithm>
+
+c_token_bucket::c_token_bucket()
+:
+	m_rate(0), m_burst(0), m_tokens(0)
+{ }
+
+void c_token_bucket::set_rate(double rate, double burst, t_clock::time_point now) {
+	m_rate = std::max(rate, 0.);
+	m_burst = std::max( (burst > 0) ? burst : m_rate , 1. ); // burst 0 is one second of rate; at least one use must fit
+	m_tokens = m_burst;
+	m_last = now;
+}
+
+bool c_token_bucket::is_limited() const { return m_rate > 0; }
+
+void c_token_bucket::refill(t_clock::time_point now) {
+	if (now <= m_last) return;
+	const double seconds = std::chrono::duration<double>(now - m_last).count();
+	m_last = now;
+	if (m_tokens < m_burst) m_tokens = std::min( m_burst , m_tokens + seconds * m_rate ); // extra ones above burst are not lost
+}
+
+bool c_token_bucket::take(double tokens, t_clock::time_point now) {
+	if (! is_limited()) return true;
+	refill(now);
+	if (m_tokens < tokens) return false;
+	m_tokens -= tokens;
+	return true;
+}
+
+void c_token_bucket::add(double tokens) { m_tokens += tokens; }
+
+double c_token_bucket::get_tokens() const { return m_tokens; }
+
+// ------------------------------------------------------------------
+
+constexpr double t_rate_limit::bytes_burst_min;
+
+t_rate_limit::t_rate_limit()
+:
+	m_packets_per_second(0), m_packets_burst(0), m_bytes_per_second(0), m_bytes_burst(0)
+{ }
+
+double t_rate_limit::get_bytes_burst() const {
+	return std::max( (m_bytes_burst > 0) ? m_bytes_burst : m_bytes_per_second , bytes_burst_min );
+}
+
+std::ostream & operator<<(std::ostream & ostr, const t_rate_limit & obj) {
+	if (obj.m_packets_per_second > 0) ostr << obj.m_packets_per_second << " packets/s (burst " << obj.m_packets_burst << ")";
+	else ostr << "any packets/s";
+	ostr << ", ";
+	if (obj.m_bytes_per_second > 0) ostr << obj.m_bytes_per_second << " bytes/s (burst " << obj.m_bytes_burst << ")";
+	else ostr << "any bytes/s";
+	return ostr;
+}
+
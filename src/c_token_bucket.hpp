@@ -0,0 +1,53 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_token_bucket_hpp
+#define include_c_token_bucket_hpp
+
+#include <chrono>
+#include <ostream>
+
+/***
+@brief Rate limit: tokens come at given rate (per second), and wait in the bucket up to burst; each use takes some.
+Rate 0 is no limit (then it does not even look at the time).
+Extra tokens can be given by add() (e.g. from RPC), they are kept even above burst, till used.
+*/
+class c_token_bucket final {
+	public:
+		typedef std::chrono::steady_clock t_clock;
+
+		c_token_bucket(); ///< no limit
+
+		void set_rate(double rate, double burst, t_clock::time_point now); ///< starts full; burst 0 is one second of rate
+		bool is_limited() const;
+		bool take(double tokens, t_clock::time_point now); ///< false if there are not enough of them (then nothing is taken)
+		void add(double tokens); ///< extra ones (can be negative, to take them)
+		double get_tokens() const; ///< as of last take()
+
+	private:
+		double m_rate; ///< tokens per second
+		double m_burst;
+		double m_tokens;
+		t_clock::time_point m_last; ///< when m_tokens were counted
+
+		void refill(t_clock::time_point now);
+};
+
+/// limits of traffic that one peer sends to us (see c_peering::rate_limit_allow()); 0 is no limit
+struct t_rate_limit {
+	constexpr static double bytes_burst_min = 65536; ///< burst of bytes must fit the biggest datagram, or it would drop all of them forever
+
+	double m_packets_per_second;
+	double m_packets_burst;
+	double m_bytes_per_second;
+	double m_bytes_burst;
+	t_rate_limit(); ///< no limit
+
+	double get_bytes_burst() const; ///< burst of bytes that is used: as set (0 is one second of rate), but at least bytes_burst_min
+};
+
+std::ostream & operator<<(std::ostream & ostr, const t_rate_limit & obj);
+
+#endif
+
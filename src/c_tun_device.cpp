@@ -8,32 +8,115 @@
 #include <linux/if_tun.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
 #include "c_tnetdbg.hpp"
+#include "c_tun_offload.hpp"
+#include "c_io_uring.hpp"
 #include "../depends/cjdns-code/NetPlatform.h"
 #include "cpputils.hpp"
+#include "haship.hpp"
+
+namespace {
+
+/// [protocol] struct virtio_net_hdr of linux/virtio_net.h (that header can not be included in C++, it has a field named "class")
+struct t_virtio_net_hdr {
+	uint8_t flags;
+	uint8_t gso_type;
+	uint16_t hdr_len; ///< all fields in host order (legacy virtio, the default of TUN)
+	uint16_t gso_size;
+	uint16_t csum_start;
+	uint16_t csum_offset;
+};
+const uint8_t virtio_net_hdr_f_needs_csum = 1;
+const uint8_t virtio_net_hdr_gso_none = 0;
+const uint8_t virtio_net_hdr_gso_tcpv6 = 4;
+const uint8_t virtio_net_hdr_gso_ecn = 0x80;
+
+const size_t tun_pi_size = g_tuntap::TUN_with_PI::header_position_of_ipv6; ///< [protocol] struct tun_pi, before virtio_net_hdr
+const size_t vnet_hdr_size = sizeof(t_virtio_net_hdr); ///< the default size (we do not change it with TUNSETVNETHDRSZ)
+static_assert(sizeof(t_virtio_net_hdr) == 10, "virtio_net_hdr must be 10 octets");
+
+} // namespace
+
 c_tun_device_linux::c_tun_device_linux()
 :
 	m_tun_fd(open("/dev/net/tun", O_RDWR))
+	,m_offload_requested(false)
+	,m_vnet_hdr(false)
+	,m_mtu(0)
+	,m_io_queue(nullptr)
 {
 	assert(! (m_tun_fd<0) ); // TODO throw?
 }
 
+void c_tun_device_linux::set_offload(bool enabled) {
+	m_offload_requested = enabled;
+}
+
 void c_tun_device_linux::set_ipv6_address
 	(const std::array<uint8_t, 16> &binary_address, int prefixLen) {
 	as_zerofill< ifreq > ifr; // the if request
 	ifr.ifr_flags = IFF_TUN; // || IFF_MULTI_QUEUE; TODO
+	if (m_offload_requested) ifr.ifr_flags |= IFF_VNET_HDR;
 	strncpy(ifr.ifr_name, "galaxy%d", IFNAMSIZ);
 	auto errcode_ioctl =  ioctl(m_tun_fd, TUNSETIFF, static_cast<void *>(&ifr));
 	if (errcode_ioctl < 0) _throw_error( std::runtime_error("ioctl error") );
+	attach_filter();
+	if (m_offload_requested) {
+		m_vnet_hdr = true;
+		m_read_buffer.resize( tun_pi_size + vnet_hdr_size + 65536 );
+		// kernel will give us TCP packets up to 64 KiB (we cut them in read_offloaded), and will not compute checksums
+		const unsigned long offloads = TUN_F_CSUM | TUN_F_TSO6; // unsigned long, as kernel reads the ioctl argument
+		if (ioctl(m_tun_fd, TUNSETOFFLOAD, offloads) < 0) {
+			_warn("Can not enable TUN offloads (TUNSETOFFLOAD), errno=" << errno << "; packets will be normal size");
+		} else _note("TUN offloads enabled: checksum, TSO6");
+	}
 	assert(binary_address[0] == 0xFD);
 	assert(binary_address[1] == 0x42);
 	NetPlatform_addAddress(ifr.ifr_name, binary_address.data(), prefixLen, Sockaddr_AF_INET6);
+	m_ifname = ifr.ifr_name; // as chosen by kernel
+	if (m_mtu) set_mtu(m_mtu);
+}
+
+std::vector<sock_filter> c_tun_device_linux::get_filter_galaxy_only() {
+	return {
+		BPF_STMT( BPF_LD | BPF_B | BPF_ABS , 0 ), // IP version
+		BPF_STMT( BPF_ALU | BPF_AND | BPF_K , 0xF0 ),
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K , 0x60 , 0 , 3 ), // else drop
+		BPF_STMT( BPF_LD | BPF_H | BPF_ABS , 24 ), // first 2 octets of IPv6 destination (too short packet is dropped)
+		BPF_JUMP( BPF_JMP | BPF_JEQ | BPF_K , 0xFD42 , 0 , 1 ),
+		BPF_STMT( BPF_RET | BPF_K , 0xFFFFFFFF ), // pass it whole
+		BPF_STMT( BPF_RET | BPF_K , 0 ), // drop
+	};
+}
+
+void c_tun_device_linux::attach_filter() {
+	auto filter = get_filter_galaxy_only();
+	sock_fprog program;
+	program.len = static_cast<unsigned short>( filter.size() );
+	program.filter = filter.data();
+	if (ioctl(m_tun_fd, TUNATTACHFILTER, &program) < 0) { // kernel copies the program
+		_warn("Can not attach filter to TUN (TUNATTACHFILTER), errno=" << errno << "; other packets are dropped after reading them");
+	} else _info("TUN filter attached: only packets to galaxy addresses are read");
 }
 
 void c_tun_device_linux::set_mtu(uint32_t mtu) {
-	_UNUSED(mtu);
-	_NOTREADY();
+	m_mtu = mtu;
+	if (m_ifname.empty()) return; // will be set once device is created
+	_note("Setting MTU of " << m_ifname << " to " << mtu);
+	const int sock = socket(AF_INET, SOCK_DGRAM, 0); // any socket can be used for ioctl of interface
+	if (sock < 0) { _warn("Can not set MTU of " << m_ifname << ": can not open socket, errno=" << errno); return; }
+	ifreq ifr;
+	std::memset(&ifr, 0, sizeof(ifr));
+	std::strncpy(ifr.ifr_name, m_ifname.c_str(), IFNAMSIZ - 1);
+	ifr.ifr_mtu = static_cast<int>(mtu);
+	if (ioctl(sock, SIOCSIFMTU, &ifr) < 0) _warn("Can not set MTU of " << m_ifname << " to " << mtu << " (SIOCSIFMTU), errno=" << errno);
+	close(sock);
 }
 
 bool c_tun_device_linux::incomming_message_form_tun() {
@@ -48,14 +131,70 @@ bool c_tun_device_linux::incomming_message_form_tun() {
 }
 
 size_t c_tun_device_linux::read_from_tun(void *buf, size_t count) { // TODO throw if error
-	ssize_t ret = read(m_tun_fd, buf, count); // <-- read data from TUN
+	if (m_vnet_hdr) return read_offloaded(buf, count);
+	ssize_t ret = read_raw(buf, count); // <-- read data from TUN
 	if (ret == -1) _throw_error( std::runtime_error("Read from tun error") );
 	assert (ret >= 0);
 	return static_cast<size_t>(ret);
 }
 
+ssize_t c_tun_device_linux::read_raw(void *buf, size_t count) {
+	#if IO_URING_AVAILABLE
+		if (m_io_queue) return m_io_queue->read_tun(buf, count);
+	#endif
+	return read(m_tun_fd, buf, count);
+}
+
+bool c_tun_device_linux::is_read_pending() const {
+	return ! m_read_pending.empty();
+}
+
+size_t c_tun_device_linux::read_offloaded(void *buf, size_t count) {
+	if (m_read_pending.empty()) {
+		ssize_t ret = read_raw(m_read_buffer.data(), m_read_buffer.size()); // <-- read data from TUN
+		if (ret == -1) _throw_error( std::runtime_error("Read from tun error") );
+		const size_t size = static_cast<size_t>(ret);
+		if (size < tun_pi_size + vnet_hdr_size) _throw_error( std::runtime_error("Read from tun: too short for headers") );
+		t_virtio_net_hdr hdr;
+		std::memcpy(&hdr, m_read_buffer.data() + tun_pi_size, vnet_hdr_size);
+		unsigned char * packet = reinterpret_cast<unsigned char*>( m_read_buffer.data() ) + tun_pi_size + vnet_hdr_size;
+		const size_t packet_size = size - tun_pi_size - vnet_hdr_size;
+		const std::string pi( m_read_buffer.data(), tun_pi_size );
+		const auto gso_type = hdr.gso_type & ~virtio_net_hdr_gso_ecn;
+		if (gso_type == virtio_net_hdr_gso_tcpv6) { // super-packet: cut it into normal packets, as a NIC would
+			const size_t tcp_pos = (hdr.flags & virtio_net_hdr_f_needs_csum) ? hdr.csum_start : c_tun_offload::ipv6_header_size;
+			auto segments = c_tun_offload::segment_tcp6(packet, packet_size, tcp_pos, hdr.gso_size);
+			_dbg1("TUN super-packet of " << packet_size << " octets cut into " << segments.size() << " packets, mss=" << hdr.gso_size);
+			for (auto & segment : segments) m_read_pending.push_back( pi + segment );
+		} else {
+			if (gso_type != virtio_net_hdr_gso_none) _throw_error( std::runtime_error("Read from tun: not supported GSO type") ); // not enabled
+			if (hdr.flags & virtio_net_hdr_f_needs_csum) c_tun_offload::complete_checksum(packet, packet_size, hdr.csum_start, hdr.csum_offset);
+			std::memmove(packet - tun_pi_size, m_read_buffer.data(), tun_pi_size); // PI right before packet, then return both
+			const size_t copy_size = std::min(count, tun_pi_size + packet_size);
+			std::memcpy(buf, packet - tun_pi_size, copy_size);
+			return copy_size;
+		}
+	}
+	const std::string & packet = m_read_pending.front();
+	const size_t copy_size = std::min(count, packet.size());
+	std::memcpy(buf, packet.data(), copy_size);
+	m_read_pending.pop_front();
+	return copy_size;
+}
+
 size_t c_tun_device_linux::write_to_tun(const void *buf, size_t count) { // TODO throw if error
-	auto ret = write(m_tun_fd, buf, count);
+	ssize_t ret = -1;
+	if (m_vnet_hdr) { // the same packet, with "no offloads" virtio_net_hdr between PI and the packet
+		if (count < tun_pi_size) _throw_error( std::runtime_error("Write to tun: too short") );
+		t_virtio_net_hdr hdr;
+		std::memset(&hdr, 0, sizeof(hdr)); // virtio_net_hdr_gso_none, checksum is complete
+		iovec iov[3];
+		iov[0].iov_base = const_cast<void*>(buf);  iov[0].iov_len = tun_pi_size;
+		iov[1].iov_base = &hdr;  iov[1].iov_len = vnet_hdr_size;
+		iov[2].iov_base = static_cast<char*>(const_cast<void*>(buf)) + tun_pi_size;  iov[2].iov_len = count - tun_pi_size;
+		ret = writev(m_tun_fd, iov, 3);
+		if (ret >= static_cast<ssize_t>(vnet_hdr_size)) ret -= vnet_hdr_size; // caller wrote count, without our header
+	} else ret = write(m_tun_fd, buf, count);
 	if (ret == -1) _throw_error( std::runtime_error("Write to tun error") );
 	assert (ret >= 0);
 	return static_cast<size_t>(ret);
@@ -3,7 +3,9 @@
 #define C_TUN_DEVICE_HPP
 
 #include <array>
+#include <deque>
 #include <string>
+#include <vector>
 #include "c_event_manager.hpp"
 
 /**
@@ -15,16 +17,24 @@ class c_tun_device {
 		virtual ~c_tun_device() = default;
 		virtual void set_ipv6_address
 			(const std::array<uint8_t, 16> &binary_address, int prefixLen) = 0;
-		virtual void set_mtu(uint32_t mtu) = 0;
+		virtual void set_mtu(uint32_t mtu) = 0; ///< of IPv6 packets (without our TUN headers); can be called before set_ipv6_address
 		virtual bool incomming_message_form_tun() = 0; ///< returns true if tun is readry for read
 		virtual size_t read_from_tun(void *buf, size_t count) = 0;
 		virtual size_t write_to_tun(const void *buf, size_t count) = 0;
+		/// ask for offloads (big TCP packets, checksums left to us) if this device can do them; call before set_ipv6_address
+		virtual void set_offload(bool enabled) { (void)enabled; }
+		virtual bool is_read_pending() const { return false; } ///< read_from_tun() has data now, without waiting for the device
 };
 
 #ifdef __linux__
 
+#include <linux/filter.h>
+
+class c_io_uring_queue;
+
 class c_tun_device_linux final : public c_tun_device {
 	friend class c_event_manager_linux;
+	friend class c_event_manager_uring;
 	public:
 		c_tun_device_linux();
 		void set_ipv6_address
@@ -33,15 +43,34 @@ class c_tun_device_linux final : public c_tun_device {
 		bool incomming_message_form_tun() override;
 		size_t read_from_tun(void *buf, size_t count) override;
 		size_t write_to_tun(const void *buf, size_t count) override;
+		void set_offload(bool enabled) override;
+		bool is_read_pending() const override;
+
+		/// [linux] classic BPF program, that passes only IPv6 packets to galaxy addresses (fd42::/16, as addr_is_galaxy);
+		/// it sees the packet from IPv6 header (kernel runs it before adding PI and virtio_net_hdr)
+		static std::vector<sock_filter> get_filter_galaxy_only();
 
 	private:
 		const int m_tun_fd;
+		bool m_offload_requested; ///< see set_offload()
+		bool m_vnet_hdr; ///< device was created with IFF_VNET_HDR: each packet has virtio_net_hdr (after the PI header)
+		std::string m_ifname; ///< name of device that we created (e.g. galaxy0), empty before set_ipv6_address
+		uint32_t m_mtu; ///< set_mtu() to be done, or done; 0 is the default of device
+		std::vector<char> m_read_buffer; ///< for reading with m_vnet_hdr: PI, virtio_net_hdr, and packet of up to 64 KiB
+		std::deque<std::string> m_read_pending; ///< packets (with PI header) cut from a TCP super-packet, to be returned by read_from_tun()
+		c_io_uring_queue * m_io_queue; ///< if not null, it reads TUN for us (set by c_event_manager_uring)
+
+		/// kernel drops packets that are not for galaxy (e.g. multicast of router solicitation) and does not wake us for them;
+		/// if it can not, they are dropped after read as before
+		void attach_filter();
+		size_t read_offloaded(void *buf, size_t count); ///< read_from_tun() when m_vnet_hdr
+		ssize_t read_raw(void *buf, size_t count); ///< read() of the TUN, or the read done already by m_io_queue
 };
 
 #endif // __linux__
 
 #if defined(_WIN32) || defined(__CYGWIN__)
-
+
 #include "c_tun_device.hpp"
 #include "c_ndp.hpp"
 #include <array>
@@ -0,0 +1,128 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_tun_offload.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+constexpr size_t c_tun_offload::ipv6_header_size;
+
+namespace {
+
+const size_t tcp_pos_seq = 4; ///< [protocol] TCP header
+const size_t tcp_pos_data_offset = 12;
+const size_t tcp_pos_flags = 13;
+const size_t tcp_pos_checksum = 16;
+const size_t tcp_header_size_min = 20;
+const unsigned char tcp_flag_fin = 0x01, tcp_flag_psh = 0x08, tcp_flag_cwr = 0x80;
+const unsigned char ip_proto_tcp = 6;
+const unsigned char ip_proto_icmp6 = 58;
+const unsigned char icmp6_type_packet_too_big = 2; ///< [protocol] ICMPv6: TYPE CODE CHECKSUM(2) MTU(4), then the packet
+const unsigned char icmp6_type_info_min = 128; ///< types below are errors
+const size_t icmp6_header_size = 8;
+const size_t ipv6_mtu_min = 1280;
+
+uint32_t read_u32(const unsigned char * data) {
+	return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+void write_u32(unsigned char * data, uint32_t value) {
+	data[0] = value >> 24;  data[1] = value >> 16;  data[2] = value >> 8;  data[3] = value;
+}
+
+void write_u16(unsigned char * data, uint16_t value) {
+	data[0] = value >> 8;  data[1] = value;
+}
+
+} // namespace
+
+uint32_t c_tun_offload::checksum_add(uint32_t sum, const unsigned char * data, size_t size) {
+	size_t i = 0;
+	for ( ; i + 1 < size ; i += 2) {
+		sum += (uint32_t(data[i]) << 8) | data[i+1];
+		if (sum & 0x80000000) sum = (sum & 0xFFFF) + (sum >> 16); // fold early, so it never overflows
+	}
+	if (i < size) sum += uint32_t(data[i]) << 8; // odd octet is padded with zero
+	return sum;
+}
+
+uint16_t c_tun_offload::checksum_fold(uint32_t sum) {
+	while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+	return static_cast<uint16_t>(~sum);
+}
+
+void c_tun_offload::complete_checksum(unsigned char * packet, size_t size, size_t csum_start, size_t csum_offset) {
+	if ((csum_start > size) || (csum_offset + 2 > size - csum_start)) throw std::invalid_argument("checksum position outside of packet");
+	const uint16_t checksum = checksum_fold( checksum_add(0, packet + csum_start, size - csum_start) );
+	write_u16(packet + csum_start + csum_offset, checksum);
+}
+
+void c_tun_offload::set_tcp6_checksum(unsigned char * packet, size_t size, size_t tcp_pos) {
+	const size_t tcp_size = size - tcp_pos;
+	unsigned char pseudo_tail[8] = { // [protocol] IPv6 pseudo header, after the addresses: upper-layer length, zeros, next header
+		static_cast<unsigned char>(tcp_size >> 24), static_cast<unsigned char>(tcp_size >> 16),
+		static_cast<unsigned char>(tcp_size >> 8), static_cast<unsigned char>(tcp_size), 0, 0, 0, ip_proto_tcp };
+	write_u16(packet + tcp_pos + tcp_pos_checksum, 0);
+	uint32_t sum = checksum_add(0, packet + 8, 32); // src and dst address
+	sum = checksum_add(sum, pseudo_tail, sizeof(pseudo_tail));
+	sum = checksum_add(sum, packet + tcp_pos, tcp_size);
+	write_u16(packet + tcp_pos + tcp_pos_checksum, checksum_fold(sum));
+}
+
+std::vector<std::string> c_tun_offload::segment_tcp6(const unsigned char * packet, size_t size, size_t tcp_pos, size_t mss) {
+	if ((tcp_pos < ipv6_header_size) || (tcp_pos + tcp_header_size_min > size)) throw std::invalid_argument("no TCP header");
+	if ((packet[0] >> 4) != 6) throw std::invalid_argument("not IPv6");
+	const size_t headers_size = tcp_pos + (packet[tcp_pos + tcp_pos_data_offset] >> 4) * 4;
+	if ((headers_size < tcp_pos + tcp_header_size_min) || (headers_size > size)) throw std::invalid_argument("bad TCP header");
+	if (mss == 0) throw std::invalid_argument("mss is 0");
+
+	const size_t data_size = size - headers_size;
+	const uint32_t seq = read_u32(packet + tcp_pos + tcp_pos_seq);
+	const unsigned char flags = packet[tcp_pos + tcp_pos_flags];
+	std::vector<std::string> ret;
+	ret.reserve( data_size / mss + 1 );
+	for (size_t pos = 0; (pos < data_size) || (pos == 0); pos += mss) { // at least one (e.g. no data at all)
+		const size_t part_size = std::min(mss, data_size - pos);
+		const bool first = (pos == 0), last = (pos + part_size >= data_size);
+		std::string segment( reinterpret_cast<const char*>(packet) , headers_size );
+		segment.append( reinterpret_cast<const char*>(packet) + headers_size + pos , part_size );
+		unsigned char * out = reinterpret_cast<unsigned char*>( & segment[0] );
+		write_u16(out + 4, segment.size() - ipv6_header_size); // [protocol] IPv6 payload length
+		write_u32(out + tcp_pos + tcp_pos_seq, seq + static_cast<uint32_t>(pos));
+		unsigned char segment_flags = flags;
+		if (!last) segment_flags &= ~(tcp_flag_fin | tcp_flag_psh);
+		if (!first) segment_flags &= ~tcp_flag_cwr;
+		out[tcp_pos + tcp_pos_flags] = segment_flags;
+		set_tcp6_checksum(out, segment.size(), tcp_pos);
+		ret.push_back( std::move(segment) );
+		if (last) break;
+	}
+	return ret;
+}
+
+std::string c_tun_offload::packet_too_big6(const unsigned char * packet, size_t size, uint32_t mtu) {
+	if ((size < ipv6_header_size) || ((packet[0] >> 4) != 6)) return "";
+	if ((packet[6] == ip_proto_icmp6) && (size > ipv6_header_size) && (packet[ipv6_header_size] < icmp6_type_info_min)) return "";
+	const size_t quoted_size = std::min( size , ipv6_mtu_min - ipv6_header_size - icmp6_header_size );
+	const size_t icmp_size = icmp6_header_size + quoted_size;
+	std::string reply(ipv6_header_size + icmp_size, '\0');
+	auto out = reinterpret_cast<unsigned char*>(& reply[0]);
+	out[0] = 0x60;
+	write_u16(out + 4, static_cast<uint16_t>(icmp_size));
+	out[6] = ip_proto_icmp6;
+	out[7] = 64; // hop limit
+	std::copy(packet + 24, packet + 40, out + 8); // from his destination
+	std::copy(packet + 8, packet + 24, out + 24); // to him
+	unsigned char * icmp = out + ipv6_header_size;
+	icmp[0] = icmp6_type_packet_too_big;
+	write_u32(icmp + 4, mtu);
+	std::copy(packet, packet + quoted_size, icmp + icmp6_header_size);
+	const unsigned char pseudo_tail[8] = { 0, 0, static_cast<unsigned char>(icmp_size >> 8), static_cast<unsigned char>(icmp_size),
+		0, 0, 0, ip_proto_icmp6 }; // [protocol] IPv6 pseudo header, after the addresses
+	uint32_t sum = checksum_add(0, out + 8, 32);
+	sum = checksum_add(sum, pseudo_tail, sizeof(pseudo_tail));
+	sum = checksum_add(sum, icmp, icmp_size);
+	write_u16(icmp + 2, checksum_fold(sum));
+	return reply;
+}
+
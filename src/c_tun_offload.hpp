@@ -0,0 +1,54 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_tun_offload_hpp
+#define include_c_tun_offload_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/***
+@brief What we must do ourselves when the TUN device gives us offloaded packets (IFF_VNET_HDR, see c_tun_device_linux):
+complete the partial checksum, and split a TCP super-packet (TSO/GSO) into packets of MSS, like a NIC would.
+And the ICMPv6 Packet Too Big, that a router would send, for a packet that does not fit our path MTU.
+Works on IPv6 packets (the IPv6 header at offset 0).
+*/
+class c_tun_offload final {
+	public:
+		constexpr static size_t ipv6_header_size = 40;
+
+		/// one's complement sum of data (big endian 16 bit words), added to sum (not folded, not negated)
+		static uint32_t checksum_add(uint32_t sum, const unsigned char * data, size_t size);
+		static uint16_t checksum_fold(uint32_t sum); ///< folded to 16 bits, and negated (ready to write)
+
+		/**
+		 * Finish checksum that kernel left partial (VIRTIO_NET_HDR_F_NEEDS_CSUM): the field at csum_start+csum_offset has
+		 * the sum of pseudo header, and we add data from csum_start to the end.
+		 * @throw std::invalid_argument if positions are outside of packet
+		 */
+		static void complete_checksum(unsigned char * packet, size_t size, size_t csum_start, size_t csum_offset);
+
+		/**
+		 * Split TCP over IPv6 super-packet into packets with at most mss octets of TCP data each: headers are copied,
+		 * then fixed: IPv6 payload length, TCP sequence number, flags (FIN and PSH only in the last one, CWR only in the
+		 * first one), and TCP checksum (computed whole, the one in packet is ignored).
+		 * @param tcp_pos - position of TCP header (after IPv6 header and its extension headers)
+		 * @throw std::invalid_argument if packet is not valid
+		 */
+		static std::vector<std::string> segment_tcp6(const unsigned char * packet, size_t size, size_t tcp_pos, size_t mss);
+
+		static void set_tcp6_checksum(unsigned char * packet, size_t size, size_t tcp_pos); ///< compute it whole
+
+		/**
+		 * ICMPv6 Packet Too Big (RFC 4443 3.2) for this packet, to be written back to TUN, so the sender uses smaller packets.
+		 * It comes from the destination of the packet (as from the end of our link) and has as much of the packet as fits
+		 * in 1280 octets. Empty if none should be sent: not IPv6, or an ICMPv6 error itself (RFC 4443 2.4).
+		 */
+		static std::string packet_too_big6(const unsigned char * packet, size_t size, uint32_t mtu);
+};
+
+#endif
+
@@ -1,12 +1,66 @@
 #include "c_udp_wrapper.hpp"
 #include "c_tnetdbg.hpp"
+#include "c_io_uring.hpp"
 
 #ifdef __linux__
+#include "c_metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <netinet/udp.h>
+#include <sstream>
+#include <unistd.h>
+
+#ifndef SOL_UDP
+	#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+	#define UDP_SEGMENT 103 // [linux] from linux/udp.h, for headers older then kernel 4.18 (we check support at runtime)
+#endif
+#ifndef UDP_GRO
+	#define UDP_GRO 104 // [linux] kernel 5.0
+#endif
+
+constexpr size_t c_udp_wrapper_linux::gso_segments_max;
+constexpr size_t c_udp_wrapper_linux::gso_size_max;
+
 c_udp_wrapper_linux::c_udp_wrapper_linux(const int listen_port)
 :
-	m_socket(socket(AF_INET, SOCK_DGRAM, 0))
+	m_socket(socket(AF_INET, SOCK_DGRAM, 0)),
+	m_gso_enabled(false),
+	m_gso_flow(0),
+	m_gso_segment_size(0),
+	m_gso_segments(0),
+	m_gro_enabled(false),
+	m_gro_pos(0),
+	m_gro_segment_size(0),
+	m_pmtu_discover(-1),
+	m_io_queue(nullptr)
 {
+	auto & metrics = c_metrics::get_instance();
+	for (size_t i = 0; i < c_send_scheduler::class_count; ++i) {
+		const c_metrics::t_labels labels{ {"class", c_send_scheduler::class_name( static_cast<c_send_scheduler::t_class>(i) )} };
+		m_metric_send_queued[i] = & metrics.get_gauge("galaxy_send_queue_packets",
+			"Datagrams (or GSO batches) waiting in send queues for room in UDP socket", labels);
+		m_metric_send_scheduled[i] = & metrics.get_counter("galaxy_send_queue_sent_total",
+			"Datagrams (or GSO batches) sent after waiting in send queues", labels);
+	}
+	m_send_scheduler.set_on_drop( [](const c_ip46_addr & address, c_send_scheduler::t_class send_class,
+		c_send_scheduler::t_drop_reason reason, uint64_t count)
+	{
+		std::ostringstream addr_text;
+		addr_text << address;
+		c_metrics::get_instance().get_counter("galaxy_send_queue_dropped_total",
+			"Datagrams dropped from send queues (UDP socket had no room), by destination, class and reason",
+			{ {"addr", addr_text.str()} , {"class", c_send_scheduler::class_name(send_class)} ,
+				{"reason", c_send_scheduler::drop_reason_name(reason)} }).add(count);
+	} );
+
 	_assert(m_socket >= 0);
+	const int fcntl_result = fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK); // full socket must not stop the event loop
+	_assert(fcntl_result == 0);
 	c_ip46_addr address_for_sock = c_ip46_addr::any_on_port(listen_port);
 	int bind_result = -1;
 	if (address_for_sock.get_ip_type() == c_ip46_addr::t_tag::tag_ipv4) {
@@ -19,28 +73,263 @@ c_udp_wrapper_linux::c_udp_wrapper_linux(const int listen_port)
 	}
 		_assert( bind_result >= 0 ); // TODO change to except
 		_assert(address_for_sock.get_ip_type() != c_ip46_addr::t_tag::tag_none);
+
+	int gso_size = 0; // probe: kernel knows this option (then sendmsg() can use it)
+	socklen_t gso_size_len = sizeof(gso_size);
+	m_gso_enabled = (getsockopt(m_socket, SOL_UDP, UDP_SEGMENT, &gso_size, &gso_size_len) == 0);
+	const int gro_on = 1;
+	m_gro_enabled = (setsockopt(m_socket, SOL_UDP, UDP_GRO, &gro_on, sizeof(gro_on)) == 0);
+	_info("UDP segmentation offload: GSO " << (m_gso_enabled ? "on" : "not supported")
+		<< ", GRO " << (m_gro_enabled ? "on" : "not supported"));
+	socklen_t pmtu_discover_len = sizeof(m_pmtu_discover);
+	if (getsockopt(m_socket, IPPROTO_IP, IP_MTU_DISCOVER, &m_pmtu_discover, &pmtu_discover_len) != 0) m_pmtu_discover = -1;
+}
+
+c_udp_wrapper_linux::~c_udp_wrapper_linux() {
+	flush();
+	close(m_socket);
 }
 
 void c_udp_wrapper_linux::send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) {
+	send_data_scheduled(dst_address, data, size_of_data, c_send_scheduler::e_class_data, 0);
+}
+
+void c_udp_wrapper_linux::send_data_scheduled(const c_ip46_addr &dst_address, const void *data, size_t size_of_data,
+	c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow)
+{
+	if ((send_class == c_send_scheduler::e_class_control) || (! is_gso_enabled_to(dst_address))) { // control does not wait for data kept for GSO
+		transmit(dst_address, static_cast<const char*>(data), size_of_data, 0, send_class, flow);
+		return;
+	}
+	if (m_gso_segments) { // can it join the kept ones?
+		const bool fits = (dst_address == m_gso_address) && (dst_address.get_assign_port() == m_gso_address.get_assign_port())
+			&& (flow == m_gso_flow)
+			&& (size_of_data <= m_gso_segment_size)
+			&& (m_gso_segments < gso_segments_max) && (m_gso_buffer.size() + size_of_data <= gso_size_max);
+		if (!fits) flush();
+	}
+	if (!m_gso_segments) {
+		m_gso_address = dst_address;
+		m_gso_flow = flow;
+		m_gso_segment_size = size_of_data;
+	}
+	m_gso_buffer.append( static_cast<const char*>(data) , size_of_data );
+	++m_gso_segments;
+	if (size_of_data < m_gso_segment_size) flush(); // shorter one must be the last
+}
+
+bool c_udp_wrapper_linux::send_data_unfragmented(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) {
+	if (! can_send_unfragmented()) return c_udp_wrapper::send_data_unfragmented(dst_address, data, size_of_data);
+	// [linux] PROBE: Don't Fragment, and ignore the path MTU that kernel knows (we check it on our own); only for this datagram
+	const int probe = IP_PMTUDISC_PROBE;
+	if (setsockopt(m_socket, IPPROTO_IP, IP_MTU_DISCOVER, &probe, sizeof(probe)) != 0) return true; // as lost
+	const auto result = send_now(dst_address, static_cast<const char*>(data), size_of_data, 0);
+	setsockopt(m_socket, IPPROTO_IP, IP_MTU_DISCOVER, &m_pmtu_discover, sizeof(m_pmtu_discover));
+	return result != e_send_too_big;
+}
+
+bool c_udp_wrapper_linux::can_send_unfragmented() const { return m_pmtu_discover >= 0; }
+
+bool c_udp_wrapper_linux::is_send_pending() const { return m_gso_segments != 0; }
+
+void c_udp_wrapper_linux::flush() {
+	if (m_gso_segments) {
+		const uint16_t segment_size = (m_gso_segments == 1) ? 0 : m_gso_segment_size;
+		transmit(m_gso_address, m_gso_buffer.data(), m_gso_buffer.size(), segment_size, c_send_scheduler::e_class_data, m_gso_flow);
+		m_gso_buffer.clear();
+		m_gso_segments = 0;
+	}
+	drain();
+}
+
+c_udp_wrapper_linux::t_send_result c_udp_wrapper_linux::send_now(const c_ip46_addr &dst_address, const char *data,
+	size_t size_of_data, uint16_t segment_size)
+{
 	auto dst_ip4 = dst_address.get_ip4(); // ip of proper type, as local variable
-	sendto(m_socket, data, size_of_data, 0, reinterpret_cast<sockaddr*>(&dst_ip4), sizeof(sockaddr_in));
+	iovec iov{ const_cast<char*>(data) , size_of_data };
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	std::memset(control, 0, sizeof(control));
+	msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &dst_ip4;
+	msg.msg_namelen = sizeof(dst_ip4);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (segment_size) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+		std::memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+	}
+	if (sendmsg(m_socket, &msg, 0) >= 0) return e_send_ok;
+	const int error = errno;
+	if ((error == EAGAIN) || (error == EWOULDBLOCK) || (error == ENOBUFS)) return e_send_blocked; // no room in socket now
+	if (segment_size && ((error == EIO) || (error == EINVAL) || (error == ENOPROTOOPT) || (error == EOPNOTSUPP))) {
+		_note("UDP GSO send to " << dst_address << " failed (" << std::strerror(error) << "), turning GSO off for this destination");
+		return e_send_gso_unsupported;
+	}
+	if (error == EMSGSIZE) { _dbg1("UDP send failed: datagram of " << size_of_data << " octets is too big"); return e_send_too_big; }
+	_dbg1("UDP send failed: " << std::strerror(error)); // like sendto() errors: datagrams are lost
+	return e_send_failed;
+}
+
+void c_udp_wrapper_linux::send_gso_unsupported(const c_ip46_addr &dst_address, const char *data, size_t size_of_data,
+	uint16_t segment_size, c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow)
+{
+	m_gso_failed_address.insert(dst_address);
+	for (size_t pos = 0; pos < size_of_data; pos += segment_size) {
+		transmit(dst_address, data + pos, std::min<size_t>(segment_size, size_of_data - pos), 0, send_class, flow);
+	}
+}
+
+void c_udp_wrapper_linux::transmit(const c_ip46_addr &dst_address, const char *data, size_t size_of_data, uint16_t segment_size,
+	c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow)
+{
+	const bool others_wait = (send_class == c_send_scheduler::e_class_control)
+		? (m_send_scheduler.get_queued(c_send_scheduler::e_class_control) != 0) // control goes before waiting data
+		: (! m_send_scheduler.empty());
+	if (! others_wait) { // try to send now
+		const auto result = send_now(dst_address, data, size_of_data, segment_size);
+		if (result == e_send_gso_unsupported) send_gso_unsupported(dst_address, data, size_of_data, segment_size, send_class, flow);
+		if (result != e_send_blocked) return;
+		_dbg1("UDP socket has no room, queueing datagrams (" << c_send_scheduler::class_name(send_class) << ") to " << dst_address);
+	}
+	m_send_scheduler.push(send_class, dst_address, flow, std::string(data, size_of_data), segment_size, c_send_scheduler::t_clock::now());
+	update_send_metrics();
+}
+
+void c_udp_wrapper_linux::drain() {
+	if (m_send_scheduler.empty()) return;
+	const auto now = c_send_scheduler::t_clock::now();
+	const auto & stats = m_send_scheduler.get_stats();
+	uint64_t sent_before[c_send_scheduler::class_count];
+	std::copy( std::begin(stats.m_sent) , std::end(stats.m_sent) , std::begin(sent_before) );
+	c_ip46_addr address;
+	while (const c_send_queue::t_item * item = m_send_scheduler.front(now, address)) {
+		const auto result = send_now(address, item->m_data.data(), item->m_data.size(), item->m_segment_size);
+		if (result == e_send_blocked) break; // it stays first, for next time
+		if (result == e_send_gso_unsupported) { // rare: then its datagrams go one by one, first of all (what socket can not take waits)
+			m_gso_failed_address.insert(address);
+			m_send_scheduler.split_front();
+			continue;
+		}
+		m_send_scheduler.pop();
+	}
+	for (size_t i = 0; i < c_send_scheduler::class_count; ++i) m_metric_send_scheduled[i]->add( stats.m_sent[i] - sent_before[i] );
+	update_send_metrics();
+}
+
+void c_udp_wrapper_linux::update_send_metrics() {
+	const auto & stats = m_send_scheduler.get_stats();
+	for (size_t i = 0; i < c_send_scheduler::class_count; ++i) {
+		m_metric_send_queued[i]->set( stats.m_queued[i] );
+	}
+}
+
+bool c_udp_wrapper_linux::is_send_blocked() const { return ! m_send_scheduler.empty(); }
+
+void c_udp_wrapper_linux::set_send_scheduler_limits(const c_send_scheduler::t_limits & limits) { m_send_scheduler.set_limits(limits); }
+
+const c_send_scheduler::t_stats & c_udp_wrapper_linux::get_send_scheduler_stats() const { return m_send_scheduler.get_stats(); }
+
+void c_udp_wrapper_linux::set_send_buffer_size(int size) {
+	if (size <= 0) return;
+	if (setsockopt(m_socket, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) != 0) {
+		_warn("Can not set UDP send buffer to " << size << " bytes: " << std::strerror(errno));
+	}
+}
+
+void c_udp_wrapper_linux::set_busy_poll(int time_us) {
+	if (time_us <= 0) return;
+	#ifdef SO_BUSY_POLL
+		if (setsockopt(m_socket, SOL_SOCKET, SO_BUSY_POLL, &time_us, sizeof(time_us)) != 0) {
+			_warn("Can not set busy poll of UDP socket to " << time_us << " us: " << std::strerror(errno));
+		}
+	#else
+		_warn("Busy poll of UDP socket is not supported by this build");
+	#endif
 }
 
 size_t c_udp_wrapper_linux::receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) {
+	if (is_receive_pending()) { // next one from coalesced buffer
+		const size_t size = std::min( m_gro_segment_size , m_gro_buffer.size() - m_gro_pos );
+		_check( size <= data_buf_size );
+		std::memcpy(data_buf, m_gro_buffer.data() + m_gro_pos, size);
+		m_gro_pos += size;
+		from_address = m_gro_address;
+		return size;
+	}
+
 	sockaddr_in6 from_addr_raw; // peering address of peer (socket sender), raw format
-	socklen_t from_addr_raw_size = sizeof(from_addr_raw); // ^ size of it
-	auto size_read = recvfrom(m_socket, data_buf, data_buf_size, 0, reinterpret_cast<sockaddr*>( & from_addr_raw), & from_addr_raw_size);
+	iovec iov{ data_buf , data_buf_size };
+	char control[CMSG_SPACE(sizeof(int))];
+	msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &from_addr_raw;
+	msg.msg_namelen = sizeof(from_addr_raw);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	#if IO_URING_AVAILABLE
+		auto size_read = m_io_queue ? m_io_queue->recvmsg_udp(msg) : recvmsg(m_socket, &msg, 0);
+	#else
+		auto size_read = recvmsg(m_socket, &msg, 0);
+	#endif
+	if (size_read < 0) return 0; // ignored like empty datagram
+	from_address = address_from_raw(from_addr_raw, msg.msg_namelen);
+
+	int segment_size = 0; // [linux] with UDP_GRO, buffer can have few datagrams, each of this size (but the last one)
+	for (cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) std::memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+	}
+	if ((segment_size > 0) && (static_cast<size_t>(size_read) > static_cast<size_t>(segment_size))) {
+		_dbg1("UDP GRO: got " << size_read << " bytes as datagrams of " << segment_size);
+		m_gro_buffer.assign( static_cast<const char*>(data_buf) + segment_size , size_read - segment_size );
+		m_gro_pos = 0;
+		m_gro_segment_size = segment_size;
+		m_gro_address = from_address;
+		return segment_size;
+	}
+	return size_read;
+}
+
+bool c_udp_wrapper_linux::is_receive_pending() const { return m_gro_pos < m_gro_buffer.size(); }
+
+c_ip46_addr c_udp_wrapper_linux::address_from_raw(const sockaddr_in6 &from_addr_raw, socklen_t from_addr_raw_size) {
+	c_ip46_addr from_address;
 	if (from_addr_raw_size == sizeof(sockaddr_in6)) { // the message arrive from IP pasted into sockaddr_in6 format
 		_erro("NOT IMPLEMENTED yet - recognizing IP of ipv6 peer"); // peeripv6-TODO(r)(easy)
 		// trivial
 	}
 	else if (from_addr_raw_size == sizeof(sockaddr_in)) { // the message arrive from IP pasted into sockaddr_in (ipv4) format
-		sockaddr_in addr = * reinterpret_cast<sockaddr_in*>(& from_addr_raw); // mem-cast-TODO(p) confirm reinterpret
+		sockaddr_in addr = * reinterpret_cast<const sockaddr_in*>(& from_addr_raw); // mem-cast-TODO(p) confirm reinterpret
 		from_address.set_ip4(addr);
 	} else {
 		_throw_error( std::runtime_error("Data arrived from unknown socket address type") );
 	}
-	return size_read;
+	return from_address;
+}
+
+bool c_udp_wrapper_linux::is_gso_enabled() const { return m_gso_enabled; }
+
+bool c_udp_wrapper_linux::is_gso_enabled_to(const c_ip46_addr & dst_address) const {
+	if (! m_gso_enabled) return false;
+	return m_gso_failed_address.empty() || (m_gso_failed_address.count(dst_address) == 0); // usually it is empty
+}
+
+bool c_udp_wrapper_linux::is_gro_enabled() const { return m_gro_enabled; }
+
+void c_udp_wrapper_linux::set_gso_enabled(bool enabled) {
+	flush();
+	if (!enabled) { m_gso_enabled = false; return; }
+	m_gso_failed_address.clear();
+	int gso_size = 0;
+	socklen_t gso_size_len = sizeof(gso_size);
+	m_gso_enabled = (getsockopt(m_socket, SOL_UDP, UDP_SEGMENT, &gso_size, &gso_size_len) == 0);
 }
 
 int c_udp_wrapper_linux::get_socket() {
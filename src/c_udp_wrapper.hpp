@@ -4,25 +4,129 @@
 
 #include "c_ip46_addr.hpp" // TODO make portable
 #include "c_event_manager.hpp"
+#include "c_send_scheduler.hpp"
+
+#include <set>
+#include <string>
+
+class c_metric_counter;
+class c_metric_gauge;
 
 class c_udp_wrapper {
 	public:
 		virtual ~c_udp_wrapper() = default;
+		/// sends the datagram, now or at latest in flush() (in order, also with other send_data() calls)
 		virtual void send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) = 0;
+		/// like send_data(), but when datagrams must wait, they are sent in order of c_send_scheduler: control before data,
+		/// and data fairly between destinations and flows. By default (no queues) it is just send_data()
+		virtual void send_data_scheduled(const c_ip46_addr &dst_address, const void *data, size_t size_of_data,
+			c_send_scheduler::t_class /*send_class*/, c_send_scheduler::t_flow /*flow*/) { send_data(dst_address, data, size_of_data); }
+		///! sends the datagram now, not fragmented (Don't Fragment, e.g. probe of path MTU, see c_path_mtu), not waiting in
+		///any queue (if socket has no room, it is lost). Returns false if it is too big for our own link.
+		///Only if can_send_unfragmented(), else it is just send_data()
+		virtual bool send_data_unfragmented(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) {
+			send_data(dst_address, data, size_of_data);
+			return true;
+		}
+		virtual bool can_send_unfragmented() const { return false; }
 		virtual size_t
 			receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) = 0;
+
+		virtual bool is_send_pending() const { return false; } ///< does send_data() keep some datagrams to send them together
+		virtual void flush() { } ///< sends all datagrams kept by send_data(); call it before waiting for events
+		///! are there received datagrams already (e.g. rest of coalesced ones), that receive_data() will return without waiting
+		virtual bool is_receive_pending() const { return false; }
+		///! do datagrams wait for room in the socket: then wait also for it being writable (c_event_manager::udp_writable())
+		///and call flush()
+		virtual bool is_send_blocked() const { return false; }
 };
 
 #ifdef __linux__
+class c_io_uring_queue;
+
+/**
+ * UDP socket of Linux. When kernel supports it (checked at runtime) it uses segmentation offload:
+ * - GSO (UDP_SEGMENT): consecutive datagrams of same size to same address are kept, and then sent by one sendmsg()
+ *   as one buffer that kernel (or NIC) splits into datagrams again. The last one can be shorter and ends the batch.
+ * - GRO (UDP_GRO): kernel can give us few received datagrams (from same sender, of same size) in one buffer,
+ *   receive_data() then returns them one by one.
+ * When sending with GSO fails (e.g. no checksum offload on the route) that batch is sent one by one, and so is all later
+ * traffic to that destination (other destinations still use GSO).
+ *
+ * The socket is non-blocking: when it has no room, datagrams wait in c_send_scheduler (bounded queues of each destination
+ * and flow, with drop policy), and flush() sends them once the socket is writable again: control datagrams first, then
+ * data shared fairly between destinations (peers) and their flows. So a congested peer fills (and drops from) only its own
+ * queue, and never blocks the event loop. While anything waits, new datagrams wait too (control ones only behind control).
+ * To have the queueing done here (and not in kernel, where all is FIFO) make the socket buffer small (set_send_buffer_size).
+ */
 class c_udp_wrapper_linux final : public c_udp_wrapper {
 	friend class c_event_manager_linux;
+	friend class c_event_manager_uring;
 	public:
+		constexpr static size_t gso_segments_max = 64; ///< UDP_MAX_SEGMENTS of older kernels
+		constexpr static size_t gso_size_max = 65000; ///< max size of all datagrams sent together (fits in IPv4 UDP datagram)
+
 		c_udp_wrapper_linux(const int listen_port);
+		~c_udp_wrapper_linux() override; ///< sends what is kept, and closes the socket
 		void send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) override;
+		void send_data_scheduled(const c_ip46_addr &dst_address, const void *data, size_t size_of_data,
+			c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow) override;
+		bool send_data_unfragmented(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) override;
+		bool can_send_unfragmented() const override;
 		size_t receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) override;
+		bool is_send_pending() const override;
+		void flush() override;
+		bool is_receive_pending() const override;
+		bool is_send_blocked() const override;
 		int get_socket(); // TODO remove this
+
+		void set_send_scheduler_limits(const c_send_scheduler::t_limits & limits); ///< data limits: for queues created from now on
+		const c_send_scheduler::t_stats & get_send_scheduler_stats() const;
+		void set_send_buffer_size(int size); ///< SO_SNDBUF of the socket in bytes (kernel doubles it), 0 leaves the default
+		/// SO_BUSY_POLL: receive (when there is nothing yet) polls the NIC queue for this many us; more then the sysctl
+		/// net.core.busy_read needs CAP_NET_ADMIN
+		void set_busy_poll(int time_us);
+
+		bool is_gso_enabled() const;
+		bool is_gso_enabled_to(const c_ip46_addr & dst_address) const; ///< enabled, and it did not fail to this destination
+		bool is_gro_enabled() const;
+		void set_gso_enabled(bool enabled); ///< e.g. to turn it off (it can be turned on only if kernel supports it; then also to all destinations)
 	private:
 		const int m_socket;
+
+		bool m_gso_enabled; ///< supported and not turned off
+		c_ip46_addr m_gso_address; ///< where the kept datagrams go
+		c_send_scheduler::t_flow m_gso_flow; ///< of which flow they are (all of them)
+		size_t m_gso_segment_size; ///< size of the kept datagrams (all but the last one)
+		size_t m_gso_segments; ///< how many are kept
+		std::string m_gso_buffer; ///< the kept datagrams, one after another
+		std::set<c_ip46_addr, c_send_scheduler::t_address_less> m_gso_failed_address; ///< GSO to them failed, so it is not used for them
+
+		bool m_gro_enabled;
+		std::string m_gro_buffer; ///< rest of received coalesced datagrams, not yet returned by receive_data()
+		size_t m_gro_pos; ///< next datagram in m_gro_buffer
+		size_t m_gro_segment_size;
+		c_ip46_addr m_gro_address; ///< from where they came
+
+		int m_pmtu_discover; ///< IP_MTU_DISCOVER of socket, -1 if it can not be read (then can not send unfragmented)
+
+		c_io_uring_queue * m_io_queue; ///< if not null, it receives for us (set by c_event_manager_uring)
+
+		c_send_scheduler m_send_scheduler; ///< datagrams waiting for room in the socket
+		c_metric_gauge * m_metric_send_queued[c_send_scheduler::class_count];
+		c_metric_counter * m_metric_send_scheduled[c_send_scheduler::class_count];
+
+		enum t_send_result { e_send_ok, e_send_blocked, e_send_failed, e_send_gso_unsupported, e_send_too_big };
+		/// one sendmsg() (with UDP_SEGMENT if segment_size); e_send_failed is a lost datagram, like sendto() errors were
+		t_send_result send_now(const c_ip46_addr &dst_address, const char *data, size_t size_of_data, uint16_t segment_size);
+		/// sends now, or queues it (when others wait already - of this or higher class, or socket has no room)
+		void transmit(const c_ip46_addr &dst_address, const char *data, size_t size_of_data, uint16_t segment_size,
+			c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow);
+		void drain(); ///< sends queued datagrams, in order of the scheduler, while socket has room
+		void send_gso_unsupported(const c_ip46_addr &dst_address, const char *data, size_t size_of_data, uint16_t segment_size,
+			c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow); ///< turns GSO off to this destination, sends one by one
+		void update_send_metrics();
+		c_ip46_addr address_from_raw(const sockaddr_in6 &from_addr_raw, socklen_t from_addr_raw_size);
 };
 
 #else
@@ -105,13 +105,11 @@ bool c_multisign::cryptosystem_sign_allowed(t_crypto_system_type crypto_system)
 	return false;
 }
 
-string c_multisign::serialize_bin() const {
-	trivialserialize::generator gen(100);
+void c_multisign::serialize_bin_into(trivialserialize::generator & gen) const {
 	gen.push_byte_u(antinet_crypto::e_crypto_system_type_Ed25519);
 	gen.push_vector_string(get_signature_vec(antinet_crypto::e_crypto_system_type_Ed25519));
 	gen.push_byte_u(antinet_crypto::e_crypto_system_type_NTRU_sign);
 	gen.push_vector_string(get_signature_vec(antinet_crypto::e_crypto_system_type_NTRU_sign));
-	return gen.str();
 }
 
 void c_multisign::load_from_bin(const string &data) {
@@ -155,18 +153,17 @@ string c_multikeys_pub::get_ipv6_string_hex() const {
 }
 
 string c_multikeys_pub::get_ipv6_string_hexdot() const {
-	std::string hex_str = this->get_ipv6_string_hex();
+	const std::string bin = get_ipv6_string_bin();
+	// groups of 2 octets as 4 hex chars, joined by ':'
 	std::string hexdot_str;
-	for (size_t i = 0; i < hex_str.size(); ++i ) {
-		hexdot_str += hex_str[i];
-		if (i != 0
-			&& i+1 != hex_str.size()
-			&& ((i+1) % 4) == 0) {
-
-			hexdot_str += ":";
-		}
+	hexdot_str.reserve( bin.size()*2 + bin.size()/2 );
+	char group[4];
+	for (size_t i = 0; i < bin.size(); i += 2) {
+		const size_t octets = std::min<size_t>(2, bin.size()-i);
+		hex_encode( bin.data()+i , octets , group );
+		if (i != 0) hexdot_str += ':';
+		hexdot_str.append( group , octets*2 );
 	}
-
 	return hexdot_str;
 }
 
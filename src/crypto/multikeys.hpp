@@ -24,6 +24,8 @@
 
 #include "crypto_basic.hpp"
 
+namespace trivialserialize { class generator; }
+
 
 namespace antinet_crypto {
 
@@ -83,6 +85,8 @@ class c_multicryptostrings : public c_crypto_system {
 		/** Returns a string with all our data serialized, see load_from_bin() for details
 		 */
 		virtual std::string serialize_bin() const;
+		/// writes the same data as serialize_bin() into gen (e.g. to just measure it, or into caller's buffer)
+		virtual void serialize_bin_into(trivialserialize::generator & gen) const;
 
 		/** Set this object to data loaded from string from serialize_bin().
 		 * Will delete any prior data in this object.
@@ -138,7 +142,7 @@ class c_multisign : public c_multicryptostrings< std::string > {
 		 */
 		static bool cryptosystem_sign_allowed (t_crypto_system_type crypto_system);
 
-		std::string serialize_bin () const override;
+		void serialize_bin_into (trivialserialize::generator & gen) const override;
 		void load_from_bin (const std::string & data) override;
 };
 
@@ -146,7 +146,15 @@ Serialized pubkeys: [(104)[
 
 template <typename TKey>
 std::string c_multicryptostrings<TKey>::serialize_bin() const { ///< returns a string with all our data serialized, to a binary format
-	trivialserialize::generator gen(100);
+	trivialserialize::generator gen_measure( trivialserialize::generator::tag_measure_only{} );
+	serialize_bin_into( gen_measure );
+	trivialserialize::generator gen( gen_measure.get_size() ); // reserve exact size, so the keys are not reallocated while growing
+	serialize_bin_into( gen );
+	return gen.str_move();
+}
+
+template <typename TKey>
+void c_multicryptostrings<TKey>::serialize_bin_into(trivialserialize::generator & gen) const {
 	gen.push_bytes_n(3,"GMK"); // magic marker - GMK - "Galaxy MultiKey"
 	gen.push_byte_u( (char) 'a' ); // version of this map. '$' will be development, and then use 'a','b',... for stable formats
 	gen.push_byte_u( m_crypto_use ); // marker is it open or secret
@@ -163,7 +171,6 @@ std::string c_multicryptostrings<TKey>::serialize_bin() const { ///< returns a s
 		}
 	}
 	assert(used_types_check == used_types); // we written same amount of keys as we previously counted
-	return gen.str();
 }
 
 template <typename TKey>
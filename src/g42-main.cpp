@@ -15,6 +15,7 @@
 
 #include "c_json_genconf.hpp"
 #include "c_json_load.hpp"
+#include "c_cpu_affinity.hpp"
 
 
 namespace developer_tests {
@@ -215,6 +216,7 @@ bool run_mode_developer_main(boost::program_options::variables_map & argm) {
 					("gen_key_bench",			"crypto benchmark")
 					("crypto_stream_bench",		"crypto stream benchmark")
 					("ct_bench",				"crypto tunel benchmark")
+					("hex_bench",				"hex and debug printing benchmark")
 					("route_dij",				"dijkstra test")
 					("route",					"current best routing (could be equal to some other test)")
 					("debug",					"some of the debug/logging functions")
@@ -243,6 +245,7 @@ bool run_mode_developer_main(boost::program_options::variables_map & argm) {
 	if (demoname=="gen_key_bench") { antinet_crypto::generate_keypairs_benchmark(2);  return false; }
 	if (demoname=="crypto_stream_bench") { antinet_crypto::stream_encrypt_benchmark(2); return false; }
 	if (demoname=="ct_bench") { antinet_crypto::multi_key_sign_generation_benchmark(2); return false; }
+	if (demoname=="hex_bench") { hex_benchmark(2); return false; }
 	if (demoname=="route_dij") { return developer_tests::wip_galaxy_route_doublestar(argm); }
 	if (demoname=="route"    ) { return developer_tests::wip_galaxy_route_doublestar(argm); }
 	if (demoname=="rpc") { rpc_demo(); return false; }
@@ -337,6 +340,38 @@ int main(int argc, char **argv) {
 			// ("K", po::value<int>()->required(), "number that sets your virtual IP address for now, 0-255")
 			("myname", po::value<std::string>()->default_value(config_default_myname) ,
 						"a readable name of your node (e.g. for debug)")
+			("aggregate-delay-us", po::value<int>()->default_value(0) ,
+						"pack small data packets going to same peer into one UDP datagram, waiting at most this many microseconds"
+						" for more of them (e.g. 100-500); 0 disables")
+			("flow-compression", po::value<int>()->default_value(1) ,
+						"send short headers (flow id) in tunneled data to peers that can decode them (of protocol version 2+),"
+						" instead of both HIP addresses and nonce in each packet; 0 disables")
+			("send-queue-packets", po::value<int>()->default_value(256) ,
+						"when UDP socket is full, data datagrams to each peer wait in its own queue of at most this many")
+			("send-queue-drop", po::value<std::string>()->default_value("codel") ,
+						"how the queue of a peer drops datagrams: \"tail\" (only when full) or \"codel\" (also when they wait too long)")
+			("send-queue-control-packets", po::value<int>()->default_value(64) ,
+						"control datagrams (hello, route search, ping) that wait at most, they are sent before any data")
+			("send-queue-quantum", po::value<int>()->default_value(1500) ,
+						"bytes that each peer (and each flow to it) sends in its turn, when they share the link fairly")
+			("udp-send-buffer", po::value<int>()->default_value(0) ,
+						"size of UDP socket send buffer (bytes); smaller (e.g. 65536) makes datagrams wait in our queues, where"
+						" control goes first and peers share fairly, and not in kernel; 0 is the system default")
+			("path-mtu-max", po::value<int>()->default_value(1472) ,
+						"find the biggest UDP datagram (bytes) that gets to each peer not fragmented, probing up to this size,"
+						" and set MTU of the virtual network card (TUN) to fit it; 1232 or less disables probing (Linux)")
+			("io-uring", "wait for and read packets (from TUN and UDP) with io_uring, which saves syscalls (Linux 6.0+);"
+						" if it is not available then select() is used as usual")
+			("cpu", po::value<std::string>() ,
+						"run the event loop (that forwards all packets) only on these CPUs, e.g. \"3\" or \"2,3\" or \"2-5\", and"
+						" keep its packet memory on their NUMA node; best with CPUs that nothing else uses (isolcpus) (Linux)")
+			("busy-poll-us", po::value<int>()->default_value(0) ,
+						"before each wait for packets, check for them without sleeping for this many microseconds (e.g. 50),"
+						" also SO_BUSY_POLL of UDP socket: lower latency, but it burns a CPU; 0 disables (Linux)")
+			("tun-offload", "let kernel give us TCP packets of up to 64 KiB (without checksum) from the virtual network card (TUN),"
+						" we cut them to normal packets; this saves reading many small packets (Linux)")
+			("rpc-port", po::value<int>()->default_value(0) ,
+						"listen for RPC commands (e.g. \"metrics\", in Prometheus text format) on this TCP port; 0 disables")
 			("gen-config", "COMMAND: Generate default .conf files:\n-galaxy.conf\n-connect_from.my.conf\n-connect_to.my.conf"
 						   "\n-connect_to.seed.conf\n*** this could overwrite your actual configurations ***")
 
@@ -617,6 +652,8 @@ int main(int argc, char **argv) {
 				std::string conf = argm["config"].as<std::string>();
 				c_galaxyconf_load galaxyconf(conf);
 				auto peer_refs = galaxyconf.get_peer_references();
+				t_rate_limit rate_limit;
+				if (galaxyconf.get_rate_limit(rate_limit)) myserver.set_rate_limit(rate_limit);
 				_info("Will add peer(s) from config file, count: " << peer_refs.size());
 				for(auto &ref : peer_refs) {
 					myserver.add_peer(ref);
@@ -675,6 +712,52 @@ int main(int argc, char **argv) {
 			string my_name = config_default_myname;
 			if (argm.count("myname")) my_name = argm["myname"].as<string>();
 			myserver.set_my_name(my_name);
+			if (argm.count("aggregate-delay-us")) {
+				const int aggregate_delay = argm["aggregate-delay-us"].as<int>();
+				if (aggregate_delay < 0) { _erro("Option --aggregate-delay-us can not be negative"); return 1; }
+				myserver.set_aggregation_delay( std::chrono::microseconds( aggregate_delay ) );
+			}
+			if (argm.count("flow-compression")) myserver.set_flow_compression( argm["flow-compression"].as<int>() != 0 );
+			{
+				c_send_scheduler::t_limits send_queue_limits;
+				const int send_queue_packets = argm["send-queue-packets"].as<int>();
+				const std::string send_queue_drop = argm["send-queue-drop"].as<std::string>();
+				const int send_queue_control_packets = argm["send-queue-control-packets"].as<int>();
+				const int send_queue_quantum = argm["send-queue-quantum"].as<int>();
+				const int udp_send_buffer = argm["udp-send-buffer"].as<int>();
+				if (send_queue_packets < 1) { _erro("Option --send-queue-packets must be at least 1"); return 1; }
+				if ((send_queue_drop != "tail") && (send_queue_drop != "codel")) { _erro("Option --send-queue-drop must be tail or codel"); return 1; }
+				if (send_queue_control_packets < 1) { _erro("Option --send-queue-control-packets must be at least 1"); return 1; }
+				if (send_queue_quantum < 1) { _erro("Option --send-queue-quantum must be at least 1"); return 1; }
+				if (udp_send_buffer < 0) { _erro("Option --udp-send-buffer can not be negative"); return 1; }
+				send_queue_limits.m_data.m_packets_max = send_queue_packets;
+				send_queue_limits.m_data.m_policy = (send_queue_drop == "tail") ? c_send_queue::e_drop_tail : c_send_queue::e_drop_codel;
+				send_queue_limits.m_control_packets_max = send_queue_control_packets;
+				send_queue_limits.m_quantum = send_queue_quantum;
+				myserver.set_send_scheduler_limits(send_queue_limits, udp_send_buffer);
+			}
+			{
+				const int path_mtu_max = argm["path-mtu-max"].as<int>();
+				if ((path_mtu_max < 0) || (path_mtu_max > 65507)) { _erro("Option --path-mtu-max must be 0..65507"); return 1; }
+				myserver.set_path_mtu_max( path_mtu_max );
+			}
+			if (argm.count("io-uring")) myserver.set_io_uring(true);
+			if (argm.count("cpu")) {
+				try {
+					myserver.set_event_loop_cpus( c_cpu_affinity::parse_cpu_list( argm["cpu"].as<std::string>() ) );
+				} catch(const std::invalid_argument & ex) { _erro("Option --cpu: " << ex.what()); return 1; }
+			}
+			{
+				const int busy_poll = argm["busy-poll-us"].as<int>();
+				if (busy_poll < 0) { _erro("Option --busy-poll-us can not be negative"); return 1; }
+				if (busy_poll) myserver.set_busy_poll( std::chrono::microseconds( busy_poll ) );
+			}
+			if (argm.count("tun-offload")) myserver.set_tun_offload(true);
+			if (argm.count("rpc-port") && argm["rpc-port"].as<int>()) {
+				const int rpc_port = argm["rpc-port"].as<int>();
+				if ((rpc_port < 0) || (rpc_port > 65535)) { _erro("Option --rpc-port must be 0..65535"); return 1; }
+				myserver.start_rpc_server( rpc_port );
+			}
 			ui::action_info_ok("Your hash-IPv6 address is: " + myserver.get_my_ipv6_nice());
 
 			_info("Configuring my peers references (keys):");
@@ -42,9 +42,9 @@ c_haship_addr::c_haship_addr(tag_constr_by_addr_dot, const t_ipv6dot & addr_stri
 	_dbg1("Parsed bytes addr  :" << *this);
 }
 
-c_haship_addr::c_haship_addr(tag_constr_by_addr_bin, const t_ipv6bin & data ) {
+c_haship_addr::c_haship_addr(tag_constr_by_addr_bin, t_bytes_view data ) {
 	if (! ( this->size() == data.size() ) ) {
-		ostringstream oss; oss << "Trying to set hip address from binary data " << to_debug_b(data);
+		ostringstream oss; oss << "Trying to set hip address from binary data " << to_debug_b(data.to_string());
 		_throw_error( std::runtime_error(oss.str()) );
 	}
 	for (size_t i=0; i<this->size(); ++i) this->at(i) = data.at(i);
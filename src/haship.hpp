@@ -57,7 +57,7 @@ struct c_haship_addr : public std::array<unsigned char, g_haship_addr_size> {
 	///! create the IP address from a string (as dot/colon IP notation)
 	c_haship_addr(tag_constr_by_addr_dot x, const t_ipv6dot & addr_string);
 	///! create the IP address from binary serialization of the IP address
-	c_haship_addr(tag_constr_by_addr_bin x, const t_ipv6bin & data );
+	c_haship_addr(tag_constr_by_addr_bin x, t_bytes_view data ); ///< e.g. t_ipv6bin, or directly from parsed packet
 
 	void print(ostream &ostr) const;
 };
@@ -13,3 +13,17 @@ bool c_protocol::command_is_valid_from_unknown_peer( c_protocol::t_proto_cmd cmd
 	return false;
 }
 
+bool c_protocol::command_is_valid_in_version( c_protocol::t_proto_cmd cmd , int version ) {
+	if ((version < version_min_accepted) || (version > current_version)) return false;
+	if ((cmd == e_proto_cmd_findhip_query) || (cmd == e_proto_cmd_findhip_reply)) return version >= 2; // format changed in version 2
+	switch (cmd) { // new in version 2
+		case e_proto_cmd_tunneled_data_flow_setup:
+		case e_proto_cmd_tunneled_data_flow:
+		case e_proto_cmd_tunneled_data_flow_reset:
+		case e_proto_cmd_aggregated:
+			return version >= version_min_compact_frames;
+		default: break;
+	}
+	return true;
+}
+
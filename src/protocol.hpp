@@ -8,15 +8,36 @@
 
 class c_protocol { 
 	public:
-		constexpr static unsigned char current_version = 1;
+		constexpr static unsigned char current_version = 2;
+		constexpr static unsigned char version_min_accepted = 1; ///< frames of older nodes that we still understand (see command_is_valid_in_version)
+		/// peer that sends us frames of this version (or newer) can decode compressed flows and aggregated datagrams, so we use them to him
+		constexpr static unsigned char version_min_compact_frames = 2;
+		/// peer of this version (or newer) answers public ping, also padded probes of path MTU (version 1 nodes ignored it)
+		constexpr static unsigned char version_min_ping_reply = 2;
 
 		constexpr static unsigned char version_size = 1;
 		constexpr static unsigned char cmd_size = 1;
 		constexpr static unsigned char ttl_size = 1; // size of TTL header
 
+		/// [protocol] e_proto_cmd_public_ping_request and reply: VERSION CMD SEQ(4) TIMESTAMP_US(8); only probes of path MTU (SEQ 0)
+		/// are padded to bigger size, and only peers get them echoed whole
+		constexpr static unsigned char public_ping_size = version_size + cmd_size + 4 + 8;
+
 		constexpr static unsigned char ttl_max_value_ever = 200; // no value bigger then that can ever appear, it would be low level error to let that happen
 		constexpr static unsigned char ttl_max_accepted = 5; // how high can be the TTL requested by others that we can [normally?] accept
 
+		// [protocol] fixed header of e_proto_cmd_tunneled_data: VERSION CMD SRC_HIP(16) DST_HIP(16) TTL NONCE(24), then varstring with the blob
+		constexpr static unsigned char tunneled_data_pos_src = 2;
+		constexpr static unsigned char tunneled_data_pos_dst = tunneled_data_pos_src + 16;
+		constexpr static unsigned char tunneled_data_pos_ttl = tunneled_data_pos_dst + 16;
+		constexpr static unsigned char tunneled_data_pos_nonce = tunneled_data_pos_ttl + ttl_size;
+		constexpr static unsigned char tunneled_data_nonce_size = 24; // crypto_box_NONCEBYTES
+		constexpr static unsigned char tunneled_data_header_size = tunneled_data_pos_nonce + tunneled_data_nonce_size; // before the varstring
+		/// datagram with tunneled data is bigger then the (encrypted) TUN packet in it at most by this much: the header of
+		/// e_proto_cmd_tunneled_data_flow_setup (the biggest one, FLOW_ID(2) more), size of blob (uvarint of 3 octets
+		/// for 253..65535), and crypto_box_MACBYTES added by encryption (c_stream::box)
+		constexpr static unsigned char tunneled_data_overhead = tunneled_data_header_size + 2 + 3 + 16;
+
 /*
 Proxy format - the data to be sent on wire to peer:
 
@@ -26,6 +47,10 @@ Proxy format - the data to be sent on wire to peer:
 Protocol versions:
 version 0 - not used
 version 1 - (experimental) protocol
+version 2 - findhip query and reply are encoded by protocol_messages.hpp (version 1 had ';' delimited fields);
+            new commands: 6 tunneled_data_flow_setup, 7 tunneled_data_flow, 8 tunneled_data_flow_reset (c_flow_compression.hpp)
+            and 9 aggregated (c_packet_aggregator.hpp); these are sent only to peers of version 2+ (version_min_compact_frames);
+            commands 0-5 are the same as in version 1
 
 */
 
@@ -36,11 +61,16 @@ typedef enum {
 	e_proto_cmd_public_hi = 3, // simple public peering
 	e_proto_cmd_public_ping_request = 4, // simple public ping to the peer
 	e_proto_cmd_public_ping_reply = 5, // simple public ping to the peer
+	e_proto_cmd_tunneled_data_flow_setup = 6, // tunneled data, with full header, that also sets up a compressed flow (c_flow_compression.hpp)
+	e_proto_cmd_tunneled_data_flow = 7, // tunneled data, with compressed header of known flow
+	e_proto_cmd_tunneled_data_flow_reset = 8, // we do not know this compressed flow, send setup again please
+	e_proto_cmd_aggregated = 9, // few small frames packed in one datagram (c_packet_aggregator.hpp)
 	e_proto_cmd_findhip_query = 10, // searching HIP - query
 	e_proto_cmd_findhip_reply = 11, // searching HIP - reply
 } t_proto_cmd ;
 
 static bool command_is_valid_from_unknown_peer( t_proto_cmd cmd ); ///< is this command one that can come from an unknown peer (without any HIP and CA)
+static bool command_is_valid_in_version( t_proto_cmd cmd , int version ); ///< can we parse this command when sent with this protocol version
 
 
 };
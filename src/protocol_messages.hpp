@@ -0,0 +1,63 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#pragma once
+#ifndef include_protocol_messages_hpp
+#define include_protocol_messages_hpp
+
+#include "protocol.hpp"
+#include "trivialserialize_schema.hpp"
+
+/***
+@file [protocol] The wire format of messages (after the VERSION CMD header), see trivialserialize_schema.hpp
+*/
+
+namespace protocol_messages {
+
+using trivialserialize::schema::message;
+using trivialserialize::schema::field_u;
+using trivialserialize::schema::field_bytes;
+using trivialserialize::schema::field_varstring;
+
+constexpr size_t hip_size = 16; ///< g_haship_addr_size
+constexpr size_t varstring_size_max = 65507 - 64; ///< for strings that must fit in one UDP datagram together with other fields
+
+/// [protocol] e_proto_cmd_findhip_query: HIP(16) TTL
+struct findhip_query : message< field_bytes<hip_size> , field_u<1> > {
+	enum { e_hip , e_ttl };
+};
+
+/// [protocol] e_proto_cmd_findhip_reply: TTL COST GOAL_HIP(16) varstring(pubkey of goal)
+struct findhip_reply : message< field_u<1> , field_u<1> , field_bytes<hip_size> , field_varstring<varstring_size_max> > {
+	enum { e_ttl , e_cost , e_goal_hip , e_pubkey };
+};
+
+/// [protocol] e_proto_cmd_tunneled_data: SRC_HIP(16) DST_HIP(16) TTL NONCE(24) varstring(blob)
+struct tunneled_data : message< field_bytes<hip_size> , field_bytes<hip_size> , field_u<1> ,
+	field_bytes<c_protocol::tunneled_data_nonce_size> , field_varstring<varstring_size_max> >
+{
+	enum { e_src_hip , e_dst_hip , e_ttl , e_nonce , e_blob };
+};
+
+/// [protocol] e_proto_cmd_tunneled_data_flow_setup: FLOW_ID(2) and then as tunneled_data, see c_flow_compression.hpp
+struct tunneled_data_flow_setup : message< field_u<2> , field_bytes<hip_size> , field_bytes<hip_size> , field_u<1> ,
+	field_bytes<c_protocol::tunneled_data_nonce_size> , field_varstring<varstring_size_max> >
+{
+	enum { e_flow_id , e_src_hip , e_dst_hip , e_ttl , e_nonce , e_blob };
+};
+
+/// [protocol] e_proto_cmd_tunneled_data_flow: FLOW_ID(2) NONCE_LOW(2) varstring(blob)
+struct tunneled_data_flow : message< field_u<2> , field_u<2> , field_varstring<varstring_size_max> > {
+	enum { e_flow_id , e_nonce_low , e_blob };
+};
+
+/// [protocol] e_proto_cmd_tunneled_data_flow_reset: FLOW_ID(2)
+struct tunneled_data_flow_reset : message< field_u<2> > {
+	enum { e_flow_id };
+};
+
+static_assert( tunneled_data::size_min == c_protocol::tunneled_data_header_size - 2 + 1 , "Fast path offsets in c_protocol must match");
+
+} // namespace
+
+#endif
+
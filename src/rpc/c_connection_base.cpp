@@ -2,6 +2,8 @@
 
 #include "c_connection_base.hpp"
 
+constexpr size_t c_network_message::data_size_max;
+
 c_network_message::c_network_message()
 :
 	address_ip(),
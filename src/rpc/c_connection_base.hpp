@@ -3,6 +3,8 @@
 #ifndef C_CONNECTION_BASE_H
 #define C_CONNECTION_BASE_H
 
+#include <chrono>
+#include <cstddef>
 #include <string>
 
 /**
@@ -13,6 +15,7 @@ class c_network_message {
 		c_network_message();
 		c_network_message(c_network_message &&) = default;
 		c_network_message& operator = (c_network_message &&) = default;
+		constexpr static size_t data_size_max = 16 * 1024 * 1024; ///< [protocol] bigger frame is refused (its connection is closed)
 		// TODO remove address_ip and port, create one field
 		std::string address_ip;
 		unsigned short port;
@@ -36,6 +39,18 @@ class c_connection_base {
 		 */
 		virtual c_network_message receive() = 0;
 
+		/**
+		 * As receive(), but if no data was received yet then waits for it, at most timeout (or until wakeup_receive())
+		 * @returns empty message if error or no data received
+		 * Exception safety: Strong exception guarantee
+		 */
+		virtual c_network_message receive_wait(std::chrono::milliseconds timeout) = 0;
+
+		/**
+		 * Can be called from any thread, makes the receive_wait() return now (e.g. to stop the thread that waits in it)
+		 */
+		virtual void wakeup_receive() = 0;
+
 		virtual ~c_connection_base() = default;
 };
 
@@ -0,0 +1,107 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#ifndef NETWORKLIB_MPSC_QUEUE
+#define NETWORKLIB_MPSC_QUEUE
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <utility>
+
+/**
+ * @brief Queue with many producers (any threads) and one consumer thread.
+ * push() and try_pop() do not lock (linked list of D. Vyukov: producers exchange the head, consumer owns the tail).
+ * The consumer can also sleep in pop_wait(); then push() takes the mutex only to wake it up, so when consumer is busy
+ * (or just polls) nobody locks anything.
+ */
+template <typename T>
+class c_mpsc_queue {
+	public:
+		c_mpsc_queue()
+		:
+			m_head(new t_node()), // the stub
+			m_tail(m_head.load()),
+			m_waiting(false),
+			m_wakeup(false)
+		{ }
+
+		c_mpsc_queue(const c_mpsc_queue &) = delete;
+		c_mpsc_queue& operator = (const c_mpsc_queue &) = delete;
+
+		~c_mpsc_queue() {
+			T value;
+			while (try_pop(value)) { }
+			delete m_tail;
+		}
+
+		/// from any thread
+		void push(T &&value) {
+			t_node * node = new t_node(std::move(value));
+			t_node * prev = m_head.exchange(node, std::memory_order_acq_rel);
+			prev->m_next.store(node, std::memory_order_release); // now consumer can see it
+			std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the one in pop_wait(), see there
+			if (m_waiting.load(std::memory_order_relaxed)) {
+				{ std::lock_guard<std::mutex> lg(m_wait_mutex); } // consumer is not between checking and sleeping now
+				m_wait_cv.notify_one();
+			}
+		}
+
+		/// only from the consumer thread. Returns false if empty (also if some push() is not completed yet)
+		bool try_pop(T &value) {
+			t_node * tail = m_tail;
+			t_node * next = tail->m_next.load(std::memory_order_acquire);
+			if (next == nullptr) return false;
+			value = std::move(next->m_value);
+			m_tail = next; // next is now the stub (its value is moved out)
+			delete tail;
+			return true;
+		}
+
+		/// only from the consumer thread. Waits at most timeout for value; returns false if there was none (or wakeup())
+		template <class Rep, class Period>
+		bool pop_wait(T &value, std::chrono::duration<Rep, Period> timeout) {
+			if (try_pop(value)) return true;
+			std::unique_lock<std::mutex> lg(m_wait_mutex);
+			m_waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst); // so either we see the push, or push sees m_waiting
+			m_wait_cv.wait_for(lg, timeout, [this]{ return is_pending() || m_wakeup; });
+			m_waiting.store(false, std::memory_order_relaxed);
+			m_wakeup = false;
+			lg.unlock();
+			return try_pop(value);
+		}
+
+		/// from any thread: the pop_wait() that waits now (or the next one) returns at once
+		void wakeup() {
+			{
+				std::lock_guard<std::mutex> lg(m_wait_mutex);
+				m_wakeup = true;
+			}
+			m_wait_cv.notify_one();
+		}
+
+		/// only from the consumer thread
+		bool empty() const { return ! is_pending(); }
+
+	private:
+		struct t_node {
+			t_node() : m_next(nullptr), m_value() { }
+			explicit t_node(T &&value) : m_next(nullptr), m_value(std::move(value)) { }
+			std::atomic<t_node*> m_next;
+			T m_value;
+		};
+
+		bool is_pending() const { return m_tail->m_next.load(std::memory_order_acquire) != nullptr; }
+
+		std::atomic<t_node*> m_head; ///< last pushed; producers exchange it
+		t_node * m_tail; ///< stub before the oldest value; only the consumer uses it
+
+		std::atomic<bool> m_waiting; ///< consumer sleeps (or is going to) in pop_wait()
+		bool m_wakeup; ///< wakeup() was called; guarded by m_wait_mutex
+		std::mutex m_wait_mutex;
+		std::condition_variable m_wait_cv;
+};
+
+#endif
+
@@ -0,0 +1,270 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "c_rpc_client.hpp"
+#include "c_connection_base.hpp"
+
+#include <functional>
+
+using namespace boost::asio;
+using namespace asio_node;
+
+namespace {
+
+std::string make_frame(const std::string &data) { ///< [protocol] size (4 bytes, as uint32_t) and data, as in c_connection::send()
+	const uint32_t size = data.size();
+	std::string frame(reinterpret_cast<const char *>(&size), sizeof(size));
+	frame += data;
+	return frame;
+}
+
+} // namespace
+
+std::shared_ptr<c_rpc_io_service> c_rpc_io_service::get() {
+	static std::mutex mtx;
+	static std::weak_ptr<c_rpc_io_service> shared;
+	std::lock_guard<std::mutex> lg(mtx);
+	auto ret = shared.lock();
+	if (!ret) {
+		ret = std::make_shared<c_rpc_io_service>();
+		shared = ret;
+	}
+	return ret;
+}
+
+c_rpc_io_service::c_rpc_io_service()
+:
+	m_io_service(),
+	m_work(std::make_unique<io_service::work>(m_io_service)),
+	m_thread([this]() { m_io_service.run(); })
+{ }
+
+c_rpc_io_service::~c_rpc_io_service() {
+	m_work.reset(); // run() ends when all handlers are done (connections are closed by then)
+	m_thread.join();
+}
+
+io_service & c_rpc_io_service::get_io_service() { return m_io_service; }
+
+/************************************************************/
+
+c_rpc_client::c_rpc_client()
+:
+	m_io_service(c_rpc_io_service::get()),
+	m_request_id(0),
+	m_pool_mtx(),
+	m_pool()
+{ }
+
+c_rpc_client::~c_rpc_client() {
+	std::lock_guard<std::mutex> lg(m_pool_mtx);
+	for (auto &connection : m_pool) connection.second->close();
+}
+
+std::future<std::string> c_rpc_client::call(const std::string &addr, unsigned short port,
+	const std::string &command, const std::string &arguments)
+{
+	auto connection = get_connection(addr, port);
+	const t_request_id id = ++m_request_id;
+	auto reply = connection->expect_reply(id);
+	connection->send( '#' + std::to_string(id) + ';' + command + ';' + arguments );
+	return reply;
+}
+
+std::vector<std::future<rpc_binary::t_args>> c_rpc_client::call_batch(const std::string &addr, unsigned short port,
+	const std::vector<t_call> &calls)
+{
+	auto connection = get_connection(addr, port);
+	std::vector<rpc_binary::t_request> requests;
+	std::vector<std::future<rpc_binary::t_args>> replies;
+	for (const auto &call : calls) {
+		const t_request_id id = ++m_request_id;
+		replies.push_back( connection->expect_binary_reply(id, call.m_on_partial) );
+		requests.push_back( rpc_binary::t_request{ id, call.m_command, call.m_args } );
+	}
+	connection->send( rpc_binary::encode_requests(requests) );
+	return replies;
+}
+
+std::future<rpc_binary::t_args> c_rpc_client::call_typed(const std::string &addr, unsigned short port,
+	const std::string &command, const rpc_binary::t_args &arguments, t_partial_handler on_partial)
+{
+	auto replies = call_batch(addr, port, std::vector<t_call>{ t_call{ command, arguments, on_partial } });
+	return std::move(replies.at(0));
+}
+
+void c_rpc_client::send(const std::string &addr, unsigned short port, const std::string &command, const std::string &arguments) {
+	get_connection(addr, port)->send( command + ';' + arguments );
+}
+
+size_t c_rpc_client::get_connection_count() {
+	std::lock_guard<std::mutex> lg(m_pool_mtx);
+	size_t count = 0;
+	for (const auto &connection : m_pool) if (!connection.second->is_broken()) ++count;
+	return count;
+}
+
+std::shared_ptr<c_rpc_client_connection> c_rpc_client::get_connection(const std::string &addr, unsigned short port) {
+	ip::tcp::endpoint endpoint(ip::address::from_string(addr), port); // IPv4 or IPv6; throw "Invalid argument"
+	std::lock_guard<std::mutex> lg(m_pool_mtx);
+	auto found = m_pool.find(endpoint);
+	if ((found != m_pool.end()) && (!found->second->is_broken())) return found->second;
+	auto connection = std::make_shared<c_rpc_client_connection>(m_io_service->get_io_service(), endpoint); // new or reconnect; can throw
+	connection->start();
+	m_pool[endpoint] = connection;
+	return connection;
+}
+
+/************************************************************/
+
+c_rpc_client_connection::c_rpc_client_connection(io_service &io_service, const ip::tcp::endpoint &endpoint)
+:
+	m_io_service(io_service),
+	m_socket(io_service),
+	m_broken(false),
+	m_write_queue(),
+	m_read_size(0),
+	m_read_data(),
+	m_pending_mtx(),
+	m_pending(),
+	m_pending_binary()
+{
+	m_socket.connect(endpoint);
+	m_socket.set_option(ip::tcp::no_delay(true));
+}
+
+void c_rpc_client_connection::start() {
+	auto self = shared_from_this();
+	m_io_service.post([self]() { self->read_size(); });
+}
+
+void c_rpc_client_connection::send(std::string &&data) {
+	auto self = shared_from_this();
+	auto frame = std::make_shared<std::string>(make_frame(data));
+	m_io_service.post([self, frame]() {
+		if (self->m_broken) return; // its reply (if any) was already failed
+		self->m_write_queue.push_back(std::move(*frame));
+		if (self->m_write_queue.size() == 1) self->write_front(); // else it waits for the one being written
+	});
+}
+
+std::future<std::string> c_rpc_client_connection::expect_reply(c_rpc_client::t_request_id id) {
+	std::lock_guard<std::mutex> lg(m_pending_mtx);
+	std::promise<std::string> &promise = m_pending[id];
+	auto future = promise.get_future();
+	if (m_broken) {
+		promise.set_exception(std::make_exception_ptr(std::runtime_error("RPC connection is closed")));
+		m_pending.erase(id);
+	}
+	return future;
+}
+
+std::future<rpc_binary::t_args> c_rpc_client_connection::expect_binary_reply(c_rpc_client::t_request_id id,
+	c_rpc_client::t_partial_handler on_partial)
+{
+	std::lock_guard<std::mutex> lg(m_pending_mtx);
+	t_pending_binary &pending = m_pending_binary[id];
+	pending.m_on_partial = on_partial;
+	auto future = pending.m_promise.get_future();
+	if (m_broken) {
+		pending.m_promise.set_exception(std::make_exception_ptr(std::runtime_error("RPC connection is closed")));
+		m_pending_binary.erase(id);
+	}
+	return future;
+}
+
+void c_rpc_client_connection::close() {
+	auto self = shared_from_this();
+	m_io_service.post([self]() { self->fail("RPC connection closed"); });
+}
+
+bool c_rpc_client_connection::is_broken() const { return m_broken; }
+
+void c_rpc_client_connection::write_front() {
+	auto self = shared_from_this();
+	const std::string &frame = m_write_queue.front(); // stays valid (deque) untill we pop it
+	async_write(m_socket, buffer(frame.data(), frame.size()), [self](const boost::system::error_code &error, size_t) {
+		if (error && !self->m_broken) self->fail("RPC write failed: " + error.message());
+		if (self->m_broken) { self->m_write_queue.clear(); return; } // (frame was in use by this write till now)
+		self->m_write_queue.pop_front();
+		if (!self->m_write_queue.empty()) self->write_front();
+	});
+}
+
+void c_rpc_client_connection::read_size() {
+	auto self = shared_from_this();
+	async_read(m_socket, buffer(&m_read_size, sizeof(m_read_size)), [self](const boost::system::error_code &error, size_t) {
+		if (error) { self->fail("RPC read failed: " + error.message()); return; }
+		if (self->m_read_size > c_network_message::data_size_max) { // do not trust the size: we would allocate it
+			self->fail("RPC reply of " + std::to_string(self->m_read_size) + " bytes is too big");
+			return;
+		}
+		self->read_data();
+	});
+}
+
+void c_rpc_client_connection::read_data() {
+	auto self = shared_from_this();
+	m_read_data.resize(m_read_size);
+	async_read(m_socket, buffer(&m_read_data[0], m_read_data.size()), [self](const boost::system::error_code &error, size_t) {
+		if (error) { self->fail("RPC read failed: " + error.message()); return; }
+		self->on_reply(self->m_read_data);
+		self->read_size();
+	});
+}
+
+void c_rpc_client_connection::on_reply(const std::string &frame) {
+	if (rpc_binary::is_binary_frame(frame)) { on_binary_reply(frame); return; }
+	// [protocol] "#ID;result"
+	const auto pos = frame.find(';');
+	if ((frame.size() < 2) || (frame.at(0) != '#') || (pos == std::string::npos)) {
+		_dbg1("RPC client: ignoring frame that is not a reply");
+		return;
+	}
+	c_rpc_client::t_request_id id = 0;
+	try { id = std::stoull(frame.substr(1, pos - 1)); }
+	catch (const std::exception &) { _dbg1("RPC client: invalid reply id"); return; }
+
+	std::lock_guard<std::mutex> lg(m_pending_mtx);
+	auto found = m_pending.find(id);
+	if (found == m_pending.end()) { _dbg1("RPC client: reply to unknown request " << id); return; }
+	found->second.set_value(frame.substr(pos + 1));
+	m_pending.erase(found);
+}
+
+void c_rpc_client_connection::on_binary_reply(const std::string &frame) {
+	std::vector<rpc_binary::t_response> responses;
+	try {
+		responses = rpc_binary::decode_responses(frame);
+	} catch (const std::exception &err) {
+		_dbg1("RPC client: ignoring bad binary frame: " << err.what());
+		return;
+	}
+	for (auto &response : responses) {
+		c_rpc_client::t_partial_handler on_partial;
+		{
+			std::lock_guard<std::mutex> lg(m_pending_mtx);
+			auto found = m_pending_binary.find(response.m_id);
+			if (found == m_pending_binary.end()) { _dbg1("RPC client: reply to unknown request " << response.m_id); continue; }
+			if (response.m_status == rpc_binary::e_status_partial) on_partial = found->second.m_on_partial; // run below, without lock
+			else {
+				if (response.m_status == rpc_binary::e_status_done) found->second.m_promise.set_value(std::move(response.m_values));
+				else found->second.m_promise.set_exception(std::make_exception_ptr(std::runtime_error(rpc_binary::to_text(response.m_values))));
+				m_pending_binary.erase(found);
+			}
+		}
+		if (on_partial) on_partial(response.m_values);
+	}
+}
+
+void c_rpc_client_connection::fail(const std::string &reason) {
+	_dbg1("RPC client connection: " << reason);
+	m_broken = true;
+	boost::system::error_code ignored;
+	m_socket.close(ignored); // write in progress (if any) ends with error, and clears m_write_queue
+	std::lock_guard<std::mutex> lg(m_pending_mtx);
+	for (auto &pending : m_pending) pending.second.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+	m_pending.clear();
+	for (auto &pending : m_pending_binary) pending.second.m_promise.set_exception(std::make_exception_ptr(std::runtime_error(reason)));
+	m_pending_binary.clear();
+}
+
@@ -0,0 +1,132 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#ifndef C_RPC_CLIENT_H
+#define C_RPC_CLIENT_H
+
+#include "../libs0.hpp"
+#include "rpc_binary.hpp"
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace asio_node {
+
+/**
+ * @brief One io_service with one thread, shared by all RPC clients of this process.
+ * It exists while anyone holds it (see get()).
+ */
+class c_rpc_io_service final {
+	public:
+		static std::shared_ptr<c_rpc_io_service> get(); ///< the shared one (created if needed)
+		~c_rpc_io_service();
+		boost::asio::io_service & get_io_service();
+
+		c_rpc_io_service(); ///< use get()
+	private:
+		boost::asio::io_service m_io_service;
+		std::unique_ptr<boost::asio::io_service::work> m_work;
+		std::thread m_thread;
+};
+
+class c_rpc_client_connection;
+
+/**
+ * @brief Client for c_rpc_server, that keeps its TCP connections (one per endpoint) and sends many requests
+ * on them without waiting for replies. Replies are matched to requests by request id. Thread safe.
+ * [protocol] request is "#ID;command;arguments", reply is "#ID;result" (see c_rpc_server)
+ * or binary frame with batch of typed requests, replied by typed responses (see rpc_binary)
+ */
+class c_rpc_client final {
+	public:
+		typedef uint64_t t_request_id;
+		typedef std::function<void(const rpc_binary::t_args &)> t_partial_handler; ///< gets the parts of streamed result
+
+		struct t_call { ///< one typed request
+			std::string m_command;
+			rpc_binary::t_args m_args;
+			t_partial_handler m_on_partial; ///< can be empty; called in the io thread (so it should be quick)
+		};
+
+		c_rpc_client();
+		~c_rpc_client(); ///< closes connections; calls not replied yet get exception
+
+		/**
+		 * Sends request, returns at once (connects first, if there is no connection to that endpoint yet).
+		 * addr is IPv4 or IPv6 address (e.g. "127.0.0.1" or "::1").
+		 * @returns future of reply data (e.g. "1" if function returned true), or of exception if connection was lost
+		 * @throw on invalid address or when connection can not be made
+		 */
+		std::future<std::string> call(const std::string &addr, unsigned short port,
+			const std::string &command, const std::string &arguments);
+		/**
+		 * Sends all the calls in one binary frame. Each future gets the last part of result, the parts before it are given
+		 * to m_on_partial of that call (in order). Future gets exception if function failed (what() is its error) or if
+		 * connection was lost.
+		 * @throw as call()
+		 */
+		std::vector<std::future<rpc_binary::t_args>> call_batch(const std::string &addr, unsigned short port,
+			const std::vector<t_call> &calls);
+		/// as call_batch() with one call
+		std::future<rpc_binary::t_args> call_typed(const std::string &addr, unsigned short port,
+			const std::string &command, const rpc_binary::t_args &arguments, t_partial_handler on_partial = t_partial_handler());
+		/// as call() but in old format without id, so there is no reply
+		void send(const std::string &addr, unsigned short port, const std::string &command, const std::string &arguments);
+
+		size_t get_connection_count(); ///< open connections in the pool
+
+	private:
+		std::shared_ptr<c_rpc_io_service> m_io_service;
+		std::atomic<t_request_id> m_request_id; ///< last used
+		std::mutex m_pool_mtx;
+		std::map<boost::asio::ip::tcp::endpoint, std::shared_ptr<c_rpc_client_connection>> m_pool; ///< always lock m_pool_mtx
+
+		std::shared_ptr<c_rpc_client_connection> get_connection(const std::string &addr, unsigned short port);
+};
+
+/// one TCP connection of c_rpc_client. Socket is used only in the thread of c_rpc_io_service
+class c_rpc_client_connection final : public std::enable_shared_from_this<c_rpc_client_connection> {
+	public:
+		c_rpc_client_connection(boost::asio::io_service &io_service, const boost::asio::ip::tcp::endpoint &endpoint); ///< connects
+		void start(); ///< start reading replies
+		void send(std::string &&data); ///< any thread
+		std::future<std::string> expect_reply(c_rpc_client::t_request_id id); ///< any thread, before sending the request
+		/// as expect_reply(), for binary request
+		std::future<rpc_binary::t_args> expect_binary_reply(c_rpc_client::t_request_id id, c_rpc_client::t_partial_handler on_partial);
+		void close(); ///< any thread
+		bool is_broken() const; ///< closed or failed, do not use it any more
+
+	private:
+		boost::asio::io_service & m_io_service;
+		boost::asio::ip::tcp::socket m_socket;
+		std::atomic<bool> m_broken;
+
+		std::deque<std::string> m_write_queue; ///< frames, front() is being written now (used in io thread only)
+		uint32_t m_read_size;
+		std::string m_read_data;
+
+		std::mutex m_pending_mtx;
+		std::map<c_rpc_client::t_request_id, std::promise<std::string>> m_pending; ///< waiting for reply; always lock m_pending_mtx
+		struct t_pending_binary {
+			std::promise<rpc_binary::t_args> m_promise;
+			c_rpc_client::t_partial_handler m_on_partial;
+		};
+		std::map<c_rpc_client::t_request_id, t_pending_binary> m_pending_binary; ///< as m_pending, for binary requests
+
+		void write_front();
+		void read_size();
+		void read_data();
+		void on_reply(const std::string &frame);
+		void on_binary_reply(const std::string &frame);
+		void fail(const std::string &reason); ///< close and fail all pending replies
+};
+
+} // namespace
+
+#endif // C_RPC_CLIENT_H
+
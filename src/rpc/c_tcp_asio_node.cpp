@@ -13,9 +13,10 @@ c_tcp_asio_node::c_tcp_asio_node(unsigned int port)
 	m_stop_flag(false),
 	m_ioservice(),
 	m_recv_queue(),
-	m_acceptor(m_ioservice, ip::tcp::endpoint(ip::tcp::v4(), port)),
+	m_acceptor(m_ioservice),
 	m_socket_accept(m_ioservice)
 {
+	listen(port);
 	_dbg_mtx("c_tcp_asio_node constructor");
 	unsigned int number_of_threads = std::thread::hardware_concurrency();
 	if (number_of_threads == 0) number_of_threads = 1;
@@ -37,6 +38,23 @@ c_tcp_asio_node::c_tcp_asio_node(unsigned int port)
 	m_acceptor.async_accept(m_socket_accept, std::bind(&c_tcp_asio_node::accept_handler, this, std::placeholders::_1));
 }
 
+void c_tcp_asio_node::listen(unsigned int port) {
+	boost::system::error_code error;
+	m_acceptor.open(ip::tcp::v6(), error); // IPv6 and IPv4 (as v4-mapped addresses) on one socket
+	if (!error) m_acceptor.set_option(ip::v6_only(false), error);
+	if (!error) m_acceptor.set_option(socket_base::reuse_address(true), error);
+	if (!error) m_acceptor.bind(ip::tcp::endpoint(ip::tcp::v6(), port), error);
+	if (error) { // e.g. IPv6 is disabled in the system
+		_dbg_mtx("can not listen on IPv6: " << error.message());
+		boost::system::error_code ignored;
+		m_acceptor.close(ignored);
+		m_acceptor.open(ip::tcp::v4()); // throw
+		m_acceptor.set_option(socket_base::reuse_address(true));
+		m_acceptor.bind(ip::tcp::endpoint(ip::tcp::v4(), port));
+	}
+	m_acceptor.listen();
+}
+
 c_tcp_asio_node::~c_tcp_asio_node() {
 	_dbg_mtx(this << " c_tcp_asio_node destructor");
 	m_stop_flag = true;
@@ -50,7 +68,7 @@ c_tcp_asio_node::~c_tcp_asio_node() {
 
 void c_tcp_asio_node::send(c_network_message && message) {
 	c_network_message msg(std::move(message)); // consume message
-	ip::address_v4 ip_addr = ip::address_v4::from_string(msg.address_ip); // throw "Invalid argument"
+	ip::address ip_addr = ip::address::from_string(msg.address_ip); // IPv4 or IPv6; throw "Invalid argument"
 	ip::tcp::endpoint endpoint(ip_addr, msg.port); // generate endpoint from message
 
 	std::lock_guard<std::mutex> lg(m_connection_map_mtx);
@@ -64,15 +82,20 @@ void c_tcp_asio_node::send(c_network_message && message) {
 
 c_network_message c_tcp_asio_node::receive() {
 	c_network_message message;
-	std::lock_guard<std::recursive_mutex> lg(m_recv_queue.get_mutex());
-	// if incomming queue is empty returns empty message
-	if (m_recv_queue.empty()) {
-		return message;
-	}
-	message = m_recv_queue.pop();
+	m_recv_queue.try_pop(message); // if incomming queue is empty returns empty message
+	return message;
+}
+
+c_network_message c_tcp_asio_node::receive_wait(std::chrono::milliseconds timeout) {
+	c_network_message message;
+	m_recv_queue.pop_wait(message, timeout);
 	return message;
 }
 
+void c_tcp_asio_node::wakeup_receive() {
+	m_recv_queue.wakeup();
+}
+
 
 void c_tcp_asio_node::accept_handler(const boost::system::error_code &error) {
 	_dbg_mtx("accept handler");
@@ -97,8 +120,7 @@ c_connection::c_connection(c_tcp_asio_node &node, const boost::asio::ip::tcp::en
 :
 	m_tcp_node(node),
 	m_socket(node.m_ioservice),
-	m_streambuff(),
-	m_ostream(&m_streambuff),
+	m_write_queue(),
 	m_read_size(),
 	m_streambuff_in()
 {
@@ -116,8 +138,7 @@ c_connection::c_connection(c_tcp_asio_node &node, ip::tcp::socket && socket)
 :
 	m_tcp_node(node),
 	m_socket(std::move(socket)),
-	m_streambuff(),
-	m_ostream(&m_streambuff),
+	m_write_queue(),
 	m_read_size(),
 	m_streambuff_in()
 {
@@ -143,27 +164,30 @@ void c_connection::send(std::string && message) {
 	_dbg_mtx("msg.size() = " << msg.size());
 	_dbg_mtx("size_of_message = " << size_of_message);
 	assert(msg.size() == size_of_message);
-	std::unique_lock<std::mutex> lg(m_streambuff_mtx);
-	m_ostream.write(reinterpret_cast<const char *>(&size_of_message), sizeof(size_of_message)); ///< write size of message (4 bytes)
-	m_ostream.write(msg.data(), msg.size()); ///< write message
-	lg.unlock();
-	m_socket.async_write_some(buffer(m_streambuff.data(), m_streambuff.size()),
+	std::string frame(reinterpret_cast<const char *>(&size_of_message), sizeof(size_of_message)); ///< size of message (4 bytes)
+	frame += msg; ///< message
+	std::lock_guard<std::mutex> lg(m_write_queue_mtx);
+	m_write_queue.push_back(std::move(frame));
+	if (m_write_queue.size() == 1) write_front(); // else the write_handler will continue with it
+}
+
+void c_connection::write_front() {
+	const std::string &frame = m_write_queue.front(); // stays valid (deque) untill write_handler pops it
+	async_write(m_socket, buffer(frame.data(), frame.size()),
 							std::bind(&c_connection::write_handler, this, std::placeholders::_1, std::placeholders::_2));
 }
 
 void c_connection::write_handler(const boost::system::error_code &error, std::size_t length) {
+	UNUSED(length);
 	_dbg_mtx("write " << length << " bytes");
 	if (error) { // error
 		_dbg_mtx("error: " << error.message());
 		delete_me();
 		return;
 	}
-	std::lock_guard<std::mutex> lg(m_streambuff_mtx);
-	m_streambuff.consume(length); // remove sended data from stream
-	if (m_streambuff.size() > 0) { ///< if sen buffer is not empty continue sending
-		m_socket.async_write_some(buffer(m_streambuff.data(), m_streambuff.size()),
-							std::bind(&c_connection::write_handler, this, std::placeholders::_1, std::placeholders::_2));
-	}
+	std::lock_guard<std::mutex> lg(m_write_queue_mtx);
+	m_write_queue.pop_front(); // async_write sent all of it
+	if (! m_write_queue.empty()) write_front(); ///< if send queue is not empty continue sending
 	_dbg_mtx("end");
 }
 
@@ -177,6 +201,11 @@ void c_connection::read_size_handler(const boost::system::error_code &error, siz
 		return;
 	}
 	assert(m_read_size > 0);
+	if (m_read_size > c_network_message::data_size_max) {
+		_dbg_mtx("frame of " << m_read_size << " bytes is too big");
+		delete_me();
+		return;
+	}
 
 	_dbg_mtx("wait for " << m_read_size << " bytes");
 	async_read(m_socket, m_streambuff_in,
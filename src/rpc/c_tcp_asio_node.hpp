@@ -4,10 +4,11 @@
 #define C_TCP_ASIO_NODE_H
 
 #include "c_connection_base.hpp"
-#include "c_locked_queue.hpp"
+#include "c_mpsc_queue.hpp"
 #include "../libs0.hpp"
 
 #include <atomic>
+#include <deque>
 #include <boost/asio.hpp>
 #include <map>
 #include <memory>
@@ -34,12 +35,14 @@ class c_tcp_asio_node final : public c_connection_base
 		c_tcp_asio_node(unsigned int port);
 		~c_tcp_asio_node();
 		void send(c_network_message && message) override;
-		c_network_message receive() override;
+		c_network_message receive() override; ///< receive() and receive_wait() must be called from one thread only
+		c_network_message receive_wait(std::chrono::milliseconds timeout) override;
+		void wakeup_receive() override;
 	private:
 		std::vector<std::unique_ptr<std::thread>> m_asio_threads;
 		std::atomic<bool> m_stop_flag; // TODO atomic_flag?
 		boost::asio::io_service m_ioservice;
-		c_locked_queue<c_network_message> m_recv_queue; ///< queue for incomming message
+		c_mpsc_queue<c_network_message> m_recv_queue; ///< queue for incomming message, pushed from any of m_asio_threads
 
 		std::mutex m_connection_map_mtx;
 		std::map<boost::asio::ip::tcp::endpoint, std::unique_ptr<c_connection>> m_connection_map; ///< always use m_connection_map_mtx !!!
@@ -47,6 +50,7 @@ class c_tcp_asio_node final : public c_connection_base
 		boost::asio::ip::tcp::acceptor m_acceptor;
 		boost::asio::ip::tcp::socket m_socket_accept;
 
+		void listen(unsigned int port); ///< on IPv6 and IPv4, or on IPv4 only if system has no IPv6
 		void accept_handler(const boost::system::error_code& error);
 };
 
@@ -71,10 +75,10 @@ class c_connection final {
 		std::reference_wrapper<c_tcp_asio_node> m_tcp_node;
 		boost::asio::ip::tcp::socket m_socket;
 
-		std::mutex m_streambuff_mtx;
-		boost::asio::streambuf m_streambuff; ///< always lock m_streambuff_mtx before use
-		std::ostream m_ostream; ///< always lock m_streambuff_mtx before use
+		std::mutex m_write_queue_mtx;
+		std::deque<std::string> m_write_queue; ///< frames to send, front() is being written now; always lock m_write_queue_mtx before use
 
+		void write_front(); ///< start writing m_write_queue.front()
 		void write_handler(const boost::system::error_code &error, size_t length);
 
 		uint32_t m_read_size;
@@ -6,17 +6,9 @@
 using namespace asio_node;
 
 void send_tcp_msg(const std::string &msg, const std::string addr, int port) {
-	using namespace asio_node;
-
-	// note: tcp_asio_node can both sending and recieving messeges
-	std::unique_ptr<c_connection_base> sender_node(new c_tcp_asio_node(19000));
-
-	c_network_message message;
-	message.address_ip = addr;
-	message.port = port;
-	message.data = msg;
-
-	sender_node->send(std::move(message));
+	static c_rpc_client client; // keeps the connections for next messages
+	const auto pos = msg.find(';');
+	client.send(addr, port, msg.substr(0, pos), (pos == std::string::npos) ? std::string() : msg.substr(pos + 1));
 }
 
 void rpc_demo() {
@@ -35,46 +27,162 @@ try {
 }
 }
 
+c_rpc_reply_stream::c_rpc_reply_stream(std::function<void(const rpc_binary::t_args &)> send_partial)
+:
+	m_send_partial(send_partial)
+{ }
+
+void c_rpc_reply_stream::send_partial(const rpc_binary::t_args &values) {
+	m_send_partial(values);
+}
+
 void c_rpc_server::main_loop() {
 	assert(m_stop_flag == false);
 	while (!m_stop_flag) {
-		auto message = m_connection_node->receive();
-		if (!message.data.empty()) { // get RPC request
-			auto it = std::find(message.data.begin(), message.data.end(), ';');
-			if (it == message.data.end()) continue; // bad packet format (not found ';')
-			*it = ' '; // remove first ';' character
-			std::istringstream iss(message.data);
-			std::string command, arguments;
-			iss >> command;
-			iss >> arguments;
-			std::lock_guard<std::mutex> lg(m_command_map_mtx);
-			if(m_command_map.find(command) != m_command_map.end()) { // found commend function in map
-				m_command_map.at(command)(arguments); // call command function
-			}
-			else {
-				_dbg1("not found function " << command);
-			}
+		auto message = m_connection_node->receive_wait(std::chrono::seconds(1)); // the destructor wakes us up sooner
+		if (message.data.empty()) continue;
+		if (rpc_binary::is_binary_frame(message.data)) handle_binary(message);
+		else handle_text(std::move(message));
+	}
+}
+
+void c_rpc_server::handle_text(c_network_message &&message) {
+	std::string request_id; // [protocol] optional "#ID;" in front: then we send reply "#ID;result"
+	if (message.data.at(0) == '#') {
+		const auto pos = message.data.find(';');
+		if (pos == std::string::npos) return; // bad packet format
+		request_id = message.data.substr(1, pos - 1);
+		message.data.erase(0, pos + 1);
+	}
+	const auto pos = message.data.find(';');
+	if (pos == std::string::npos) return; // bad packet format (not found ';')
+	const std::string command = message.data.substr(0, pos);
+	const std::string arguments = message.data.substr(pos + 1); // all the rest, as it is
+	auto function = find_function(command);
+	if (!function) {
+		_dbg1("not found function " << command);
+		if (!request_id.empty()) send_reply(message.address_ip, message.port, request_id, "!unknown command");
+		return;
+	}
+	const std::string address_ip = message.address_ip;
+	const unsigned short port = message.port;
+	m_handler_service.post([this, function, arguments, request_id, address_ip, port]() {
+		rpc_binary::t_args values; // text reply has no parts, so we collect them
+		c_rpc_reply_stream reply([&values](const rpc_binary::t_args &part) { values.insert(values.end(), part.begin(), part.end()); });
+		std::string result;
+		try {
+			const auto last = function(rpc_binary::t_args{ rpc_binary::t_value(arguments) }, reply); // call command function
+			values.insert(values.end(), last.begin(), last.end());
+			result = rpc_binary::to_text(values);
+		} catch (const std::exception &err) {
+			_warn("RPC function failed: " << err.what());
+			result = std::string("!") + err.what();
+		}
+		if (!request_id.empty()) send_reply(address_ip, port, request_id, result);
+	});
+}
+
+void c_rpc_server::handle_binary(const c_network_message &message) {
+	std::vector<rpc_binary::t_request> requests;
+	try {
+		requests = rpc_binary::decode_requests(message.data);
+	} catch (const std::exception &err) {
+		_dbg1("bad binary RPC frame: " << err.what());
+		return;
+	}
+	const std::string address_ip = message.address_ip;
+	const unsigned short port = message.port;
+	for (auto &request : requests) { // each request of the batch runs as separate job, so they can run at once
+		auto function = find_function(request.m_command);
+		if (!function) {
+			_dbg1("not found function " << request.m_command);
+			send_reply(address_ip, port, rpc_binary::t_response{ request.m_id, rpc_binary::e_status_error,
+				rpc_binary::t_args{ rpc_binary::t_value(std::string("unknown command")) } });
+			continue;
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		auto shared_request = std::make_shared<rpc_binary::t_request>(std::move(request));
+		m_handler_service.post([this, function, shared_request, address_ip, port]() {
+			const auto id = shared_request->m_id;
+			c_rpc_reply_stream reply([this, id, &address_ip, port](const rpc_binary::t_args &part) {
+				send_reply(address_ip, port, rpc_binary::t_response{ id, rpc_binary::e_status_partial, part });
+			});
+			rpc_binary::t_response response{ id, rpc_binary::e_status_done, rpc_binary::t_args() };
+			try {
+				response.m_values = function(shared_request->m_args, reply); // call command function
+			} catch (const std::exception &err) {
+				_warn("RPC function failed: " << err.what());
+				response.m_status = rpc_binary::e_status_error;
+				response.m_values = rpc_binary::t_args{ rpc_binary::t_value(std::string(err.what())) };
+			}
+			send_reply(address_ip, port, response);
+		});
+	}
+}
+
+t_rpc_typed_function c_rpc_server::find_function(const std::string &command) {
+	std::lock_guard<std::mutex> lg(m_command_map_mtx);
+	auto found = m_command_map.find(command);
+	if (found == m_command_map.end()) return t_rpc_typed_function();
+	return found->second; // copy, so we can run it without the lock
+}
+
+void c_rpc_server::send_reply(const std::string &address_ip, unsigned short port, const std::string &request_id,
+	const std::string &result)
+{
+	c_network_message reply;
+	reply.address_ip = address_ip;
+	reply.port = port;
+	reply.data = '#' + request_id + ';' + result;
+	try {
+		m_connection_node->send(std::move(reply)); // on the connection that request came from
+	} catch (const std::exception &err) {
+		_dbg1("Can not send RPC reply: " << err.what());
+	}
+}
+
+void c_rpc_server::send_reply(const std::string &address_ip, unsigned short port, const rpc_binary::t_response &response) {
+	c_network_message reply;
+	reply.address_ip = address_ip;
+	reply.port = port;
+	reply.data = rpc_binary::encode_responses( std::vector<rpc_binary::t_response>{ response } );
+	try {
+		m_connection_node->send(std::move(reply)); // on the connection that request came from
+	} catch (const std::exception &err) {
+		_dbg1("Can not send RPC reply: " << err.what());
 	}
 }
 
-c_rpc_server::c_rpc_server(const unsigned int port)
+c_rpc_server::c_rpc_server(const unsigned int port, const unsigned int handler_threads)
 :
 	m_connection_node(std::make_unique<c_tcp_asio_node>(port)),
 	m_stop_flag(false),
-	m_work_thread(std::make_unique<std::thread>(&c_rpc_server::main_loop, this))
+	m_handler_service(),
+	m_handler_work(std::make_unique<boost::asio::io_service::work>(m_handler_service)),
+	m_handler_threads()
 {
+	for (unsigned int i = 0; i < std::max(handler_threads, 1U); ++i) {
+		m_handler_threads.emplace_back([this]() { m_handler_service.run(); });
+	}
+	m_work_thread = std::make_unique<std::thread>(&c_rpc_server::main_loop, this);
 }
 
 void c_rpc_server::register_function(const std::string &command_name, std::function<bool (const std::string &)> function) {
+	register_function(command_name, [function](const rpc_binary::t_args &arguments, c_rpc_reply_stream &) {
+		return rpc_binary::t_args{ rpc_binary::t_value( function(rpc_binary::to_text(arguments)) ) };
+	});
+}
+
+void c_rpc_server::register_function(const std::string &command_name, t_rpc_typed_function function) {
 	std::lock_guard<std::mutex> lg(m_command_map_mtx);
-	m_command_map.insert(std::pair<std::string, std::function<bool (std::string)>>(command_name, function));
+	m_command_map.insert(std::make_pair(command_name, function));
 }
 
 c_rpc_server::~c_rpc_server() {
 	m_stop_flag = true;
+	m_connection_node->wakeup_receive();
 	m_work_thread->join();
+	m_handler_work.reset(); // handler threads end after running already posted functions
+	for (auto &thread : m_handler_threads) thread.join();
 }
 
 bool rpc_example_function(const std::string &arguments) {
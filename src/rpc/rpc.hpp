@@ -4,33 +4,68 @@
 #define RPC_HPP
 
 #include "c_tcp_asio_node.hpp"
-#include <boost/any.hpp>
+#include "c_rpc_client.hpp"
+#include "rpc_binary.hpp"
+
+/**
+ * Given to the typed RPC function, so it can send parts of the result before it returns (e.g. parts of a long list).
+ * [protocol] each part is a response with e_status_partial (see rpc_binary); the value returned by the function is the last part.
+ */
+class c_rpc_reply_stream final {
+	public:
+		explicit c_rpc_reply_stream(std::function<void(const rpc_binary::t_args &)> send_partial);
+		void send_partial(const rpc_binary::t_args &values); ///< sends at once (or collects it, for text requests)
+	private:
+		std::function<void(const rpc_binary::t_args &)> m_send_partial;
+};
+
+/// typed RPC function: gets the arguments, returns the (last part of) result; it can throw to report error
+typedef std::function<rpc_binary::t_args(const rpc_binary::t_args &, c_rpc_reply_stream &)> t_rpc_typed_function;
 
 /**
  * @brief The c_rpc_server class
  * Wait for RPC command from tcp. Receive message format:
- * command_name;argument1;argument2;argument3 ...
+ * command_name;arguments (all the rest, e.g. argument1;argument2 with any spaces)
+ * or with request id (any string without ';', e.g. a number): #ID;command_name;arguments
+ * and then the reply is sent back on same connection: #ID;result
+ * where result is "1" or "0" as returned by the function, or "!" and the error (see c_rpc_client)
+ * For typed function the result is rpc_binary::to_text() of all its parts.
+ * Or the binary format (see rpc_binary): batch of requests with typed arguments, each replied with its responses.
  */
 class c_rpc_server final {
 	private:
 		std::unique_ptr<c_connection_base> m_connection_node;
 		std::atomic<bool> m_stop_flag; // TODO atomic_falg ?
+
+		boost::asio::io_service m_handler_service; ///< runs the command functions, in m_handler_threads
+		std::unique_ptr<boost::asio::io_service::work> m_handler_work; ///< keeps m_handler_threads running untill we stop
+		std::vector<std::thread> m_handler_threads;
+
 		std::unique_ptr<std::thread> m_work_thread;
-		void main_loop(); ///< loop run in m_work_thread
+		void main_loop(); ///< loop run in m_work_thread: waits for requests, and gives them to m_handler_service
+		void send_reply(const std::string &address_ip, unsigned short port, const std::string &request_id, const std::string &result);
+		void send_reply(const std::string &address_ip, unsigned short port, const rpc_binary::t_response &response);
+		void handle_text(c_network_message &&message);
+		void handle_binary(const c_network_message &message);
+		t_rpc_typed_function find_function(const std::string &command); ///< empty if not registered
 		/**
 		 * @brief m_command_map
-		 * Functions stored in this map will be invoked in m_work_thread and should be thread safe
-		 * command name => function
+		 * Functions stored in this map will be invoked in m_handler_threads, possibly few at once, and should be thread safe
+		 * command name => function (text functions are wrapped, see register_function())
 		 */
-		std::map<std::string, std::function<bool(const std::string &)>> m_command_map;
-		std::mutex m_command_map_mtx;
+		std::map<std::string, t_rpc_typed_function> m_command_map;
+		std::mutex m_command_map_mtx; ///< only for access to map, not held while the function runs
 	public:
-		c_rpc_server(const unsigned int port);
+		c_rpc_server(const unsigned int port, const unsigned int handler_threads = 2);
+		/// text function, gets the arguments as text (from binary request: rpc_binary::to_text() of them), result is bool
 		void register_function(const std::string &command_name, std::function<bool(const std::string &)> function);
+		/// typed function; from text request it gets one bytes argument with all the arguments text
+		void register_function(const std::string &command_name, t_rpc_typed_function function);
 		~c_rpc_server();
 
 };
 
+/// sends "command;arguments" without waiting for reply; uses one c_rpc_client for all calls (so keeps the connections)
 void send_tcp_msg(const std::string &msg, const std::string addr = "127.0.0.1", int port = 9040);
 void rpc_demo();
 bool rpc_example_function(const std::string &arguments);
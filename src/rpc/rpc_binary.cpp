@@ -0,0 +1,164 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "rpc_binary.hpp"
+
+using namespace trivialserialize;
+
+namespace rpc_binary {
+
+namespace {
+
+class c_value_writer final : public boost::static_visitor<> {
+	public:
+		explicit c_value_writer(generator &gen) : m_gen(gen) { }
+		void operator()(bool value) const {
+			m_gen.push_byte_u(e_value_bool);
+			m_gen.push_byte_u(value ? 1 : 0);
+		}
+		void operator()(int64_t value) const {
+			m_gen.push_byte_u(e_value_int);
+			m_gen.push_integer_uvarint( (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63) ); // zigzag
+		}
+		void operator()(uint64_t value) const {
+			m_gen.push_byte_u(e_value_uint);
+			m_gen.push_integer_uvarint(value);
+		}
+		void operator()(const std::string &value) const {
+			m_gen.push_byte_u(e_value_bytes);
+			m_gen.push_varstring(value);
+		}
+		void operator()(const std::vector<std::string> &value) const {
+			m_gen.push_byte_u(e_value_list);
+			m_gen.push_vector_string(value);
+		}
+	private:
+		generator &m_gen;
+};
+
+class c_value_text final : public boost::static_visitor<std::string> {
+	public:
+		std::string operator()(bool value) const { return value ? "1" : "0"; }
+		std::string operator()(int64_t value) const { return std::to_string(value); }
+		std::string operator()(uint64_t value) const { return std::to_string(value); }
+		std::string operator()(const std::string &value) const { return value; }
+		std::string operator()(const std::vector<std::string> &value) const {
+			std::string ret;
+			for (const auto &item : value) { if (!ret.empty()) ret += ','; ret += item; }
+			return ret;
+		}
+};
+
+void push_args(generator &gen, const t_args &args) {
+	gen.push_integer_uvarint(args.size());
+	for (const auto &value : args) boost::apply_visitor(c_value_writer(gen), value);
+}
+
+t_args pop_args(parser &parser) {
+	const auto count = parser.pop_integer_uvarint();
+	t_args args; // no reserve(count): count is not trusted, each value reads at least 1 octet (or throws)
+	for (uint64_t i=0; i<count; ++i) {
+		const auto type = parser.pop_byte_u();
+		switch (type) {
+			case e_value_bool: {
+				const auto octet = parser.pop_byte_u();
+				if (octet > 1) throw format_error_read_badformat();
+				args.emplace_back( octet == 1 );
+			} break;
+			case e_value_int: {
+				const uint64_t zigzag = parser.pop_integer_uvarint();
+				args.emplace_back( static_cast<int64_t>( (zigzag >> 1) ^ (~(zigzag & 1) + 1) ) );
+			} break;
+			case e_value_uint: args.emplace_back( parser.pop_integer_uvarint() ); break;
+			case e_value_bytes: args.emplace_back( parser.pop_varstring() ); break;
+			case e_value_list: args.emplace_back( parser.pop_vector_string() ); break;
+			default: throw format_error_read_badformat();
+		}
+	}
+	return args;
+}
+
+void pop_header(parser &parser, t_frame_kind kind) {
+	if (parser.pop_byte_u() != frame_marker) throw format_error_read_badformat();
+	if (parser.pop_byte_u() != kind) throw format_error_read_badformat();
+}
+
+} // namespace
+
+bool is_binary_frame(const std::string &frame) {
+	return (!frame.empty()) && (static_cast<unsigned char>(frame.front()) == frame_marker);
+}
+
+std::string encode_requests(const std::vector<t_request> &requests) {
+	generator gen(64);
+	gen.push_byte_u(frame_marker);
+	gen.push_byte_u(e_frame_requests);
+	gen.push_integer_uvarint(requests.size());
+	for (const auto &request : requests) {
+		gen.push_integer_uvarint(request.m_id);
+		gen.push_varstring(request.m_command);
+		push_args(gen, request.m_args);
+	}
+	return gen.str_move();
+}
+
+std::string encode_responses(const std::vector<t_response> &responses) {
+	generator gen(64);
+	gen.push_byte_u(frame_marker);
+	gen.push_byte_u(e_frame_responses);
+	gen.push_integer_uvarint(responses.size());
+	for (const auto &response : responses) {
+		gen.push_integer_uvarint(response.m_id);
+		gen.push_byte_u(response.m_status);
+		push_args(gen, response.m_values);
+	}
+	return gen.str_move();
+}
+
+std::vector<t_request> decode_requests(const std::string &frame) {
+	parser parser(parser::tag_caller_must_keep_this_string_valid(), frame);
+	pop_header(parser, e_frame_requests);
+	const auto count = parser.pop_integer_uvarint();
+	std::vector<t_request> requests;
+	for (uint64_t i=0; i<count; ++i) {
+		t_request request;
+		request.m_id = parser.pop_integer_uvarint();
+		request.m_command = parser.pop_varstring();
+		request.m_args = pop_args(parser);
+		requests.push_back(std::move(request));
+	}
+	if (!parser.is_end()) throw format_error_read_badformat();
+	return requests;
+}
+
+std::vector<t_response> decode_responses(const std::string &frame) {
+	parser parser(parser::tag_caller_must_keep_this_string_valid(), frame);
+	pop_header(parser, e_frame_responses);
+	const auto count = parser.pop_integer_uvarint();
+	std::vector<t_response> responses;
+	for (uint64_t i=0; i<count; ++i) {
+		t_response response;
+		response.m_id = parser.pop_integer_uvarint();
+		const auto status = parser.pop_byte_u();
+		if (status > e_status_error) throw format_error_read_badformat();
+		response.m_status = static_cast<t_status>(status);
+		response.m_values = pop_args(parser);
+		responses.push_back(std::move(response));
+	}
+	if (!parser.is_end()) throw format_error_read_badformat();
+	return responses;
+}
+
+std::string to_text(const t_value &value) {
+	return boost::apply_visitor(c_value_text(), value);
+}
+
+std::string to_text(const t_args &values) {
+	std::string ret;
+	for (size_t i=0; i<values.size(); ++i) {
+		if (i) ret += ';';
+		ret += to_text(values.at(i));
+	}
+	return ret;
+}
+
+} // namespace
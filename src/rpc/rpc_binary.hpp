@@ -0,0 +1,75 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#ifndef RPC_BINARY_HPP
+#define RPC_BINARY_HPP
+
+#include "../trivialserialize.hpp"
+
+#include <boost/variant.hpp>
+
+/**
+ * @brief Binary format of RPC (see c_rpc_server, c_rpc_client), written with trivialserialize.
+ * [protocol] binary frame is sent as data of the normal TCP frame (size and data, see c_connection::send()), and
+ * starts with octet frame_marker (that text requests never start with), so both formats work on same connection:
+ * frame:    frame_marker, kind (1 octet, t_frame_kind), count (uvarint), and count times request or response
+ * request:  id (uvarint), command (varstring), arguments
+ * response: id (uvarint), status (1 octet, t_status), values (as arguments)
+ * arguments: count (uvarint), and count times value: type (1 octet, t_value_type) and then:
+ *   bool: 1 octet (0 or 1); int: uvarint of zigzag encoding; uint: uvarint; bytes: varstring; list: vector_string
+ * One request can get many responses: first with e_status_partial, the last one with e_status_done or e_status_error.
+ * On error the values are one bytes value with the error message.
+ */
+namespace rpc_binary {
+
+const unsigned char frame_marker = 0x00; ///< [protocol] first octet of binary frame
+
+enum t_frame_kind : unsigned char { ///< [protocol]
+	e_frame_requests = 1,
+	e_frame_responses = 2,
+};
+
+enum t_status : unsigned char { ///< [protocol]
+	e_status_partial = 0, ///< part of result, more responses will follow
+	e_status_done = 1, ///< last part of result
+	e_status_error = 2, ///< failed (also after some partial ones)
+};
+
+enum t_value_type : unsigned char { ///< [protocol]
+	e_value_bool = 1,
+	e_value_int = 2,
+	e_value_uint = 3,
+	e_value_bytes = 4,
+	e_value_list = 5,
+};
+
+/// one typed argument (or result), the which() is: 0 bool, 1 int, 2 uint, 3 bytes/string, 4 list of strings
+typedef boost::variant<bool, int64_t, uint64_t, std::string, std::vector<std::string>> t_value;
+typedef std::vector<t_value> t_args;
+
+struct t_request {
+	uint64_t m_id;
+	std::string m_command;
+	t_args m_args;
+};
+
+struct t_response {
+	uint64_t m_id;
+	t_status m_status;
+	t_args m_values;
+};
+
+bool is_binary_frame(const std::string &frame); ///< true if it starts with frame_marker (else it is text request/reply)
+
+std::string encode_requests(const std::vector<t_request> &requests); ///< one frame with all the requests (a batch)
+std::string encode_responses(const std::vector<t_response> &responses);
+/// @throw trivialserialize::format_error if frame is invalid, or is not requests
+std::vector<t_request> decode_requests(const std::string &frame);
+/// @throw trivialserialize::format_error if frame is invalid, or is not responses
+std::vector<t_response> decode_responses(const std::string &frame);
+
+std::string to_text(const t_value &value); ///< e.g. for text replies and debug: "1"/"0", number, the bytes, or list joined with ','
+std::string to_text(const t_args &values); ///< values joined with ';'
+
+} // namespace
+
+#endif // RPC_BINARY_HPP
@@ -5,9 +5,14 @@
 
 
 void send_rpc_request(const std::string &command_name, const std::string &arguments) {
-	std::string request = command_name + ';' + arguments;
-	_dbg1("request: " << request);
-	send_tcp_msg(request, "127.0.0.1", 42000);
+	_dbg1("request: " << command_name << ';' << arguments);
+	asio_node::c_rpc_client client;
+	auto reply = client.call("127.0.0.1", 42000, command_name, arguments);
+	if (reply.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+		std::cout << "no reply" << std::endl;
+		return;
+	}
+	std::cout << "reply: " << reply.get() << std::endl;
 }
 
 int main(int argc, char **argv) {
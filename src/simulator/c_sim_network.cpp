@@ -0,0 +1,203 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_sim_network.hpp"
+
+#include "../protocol.hpp"
+
+namespace {
+
+constexpr uint32_t sim_addr_first = 0x0A000001; ///< 10.0.0.1 is node 0
+constexpr uint32_t sim_addr_last = 0x0AFFFFFE;
+constexpr int sim_port = 9042;
+
+} // namespace
+
+t_sim_link_params::t_sim_link_params()
+	: latency(std::chrono::milliseconds(10)), loss(0), bandwidth_bps(0)
+{ }
+
+t_sim_link_params::t_sim_link_params(std::chrono::microseconds latency, double loss, uint64_t bandwidth_bps)
+	: latency(latency), loss(loss), bandwidth_bps(bandwidth_bps)
+{ }
+
+c_sim_network::t_stats::t_stats()
+	: sent(0), sent_bytes(0), lost(0), no_link(0), delivered(0)
+{ }
+
+// ------------------------------------------------------------------
+
+c_sim_network::c_sim_network(uint32_t seed)
+	: m_seq(0), m_random(seed)
+{ }
+
+c_sim_network::t_node c_sim_network::add_node() {
+	_check( sim_addr_first + m_inbox.size() <= sim_addr_last );
+	m_inbox.emplace_back();
+	return m_inbox.size() - 1;
+}
+
+size_t c_sim_network::get_node_count() const { return m_inbox.size(); }
+
+c_ip46_addr c_sim_network::get_node_addr(t_node node) {
+	sockaddr_in in4{};
+	in4.sin_family = AF_INET;
+	in4.sin_port = htons(sim_port);
+	in4.sin_addr.s_addr = htonl( static_cast<uint32_t>( sim_addr_first + node ) );
+	c_ip46_addr addr;
+	addr.set_ip4(in4);
+	return addr;
+}
+
+bool c_sim_network::get_node_by_addr(const c_ip46_addr & addr, t_node & node) {
+	if (addr.get_ip_type() != c_ip46_addr::t_tag::tag_ipv4) return false;
+	const uint32_t ip = ntohl( addr.get_ip4().sin_addr.s_addr );
+	if ((ip < sim_addr_first) || (ip > sim_addr_last)) return false;
+	node = ip - sim_addr_first;
+	return true;
+}
+
+void c_sim_network::add_link(t_node a, t_node b, const t_sim_link_params & params) {
+	_check( (a < m_inbox.size()) && (b < m_inbox.size()) && (a != b) );
+	_check( (params.loss >= 0) && (params.loss <= 1) );
+	t_link link{ params , t_clock::time_point() };
+	m_link[ std::make_pair(a,b) ] = link;
+	m_link[ std::make_pair(b,a) ] = link;
+}
+
+bool c_sim_network::is_link(t_node a, t_node b) const {
+	return m_link.count( std::make_pair(a,b) ) > 0;
+}
+
+void c_sim_network::send(t_node src, const c_ip46_addr & dst, const char * data, size_t size) {
+	++m_stats.sent;
+	m_stats.sent_bytes += size;
+	++m_stats.sent_by_cmd[ (size >= 2) ? static_cast<int>( static_cast<unsigned char>(data[1]) ) : -1 ]; // [protocol] VERSION CMD
+
+	t_node dst_node = 0;
+	auto find = m_link.end();
+	if (get_node_by_addr(dst, dst_node)) find = m_link.find( std::make_pair(src, dst_node) );
+	if (find == m_link.end()) {
+		++m_stats.no_link;
+		_dbg1("Simulated network: no link from node " << src << " to " << dst << ", datagram dropped");
+		return;
+	}
+	t_link & link = find->second;
+	if ((link.m_params.loss > 0) && std::bernoulli_distribution( link.m_params.loss )( m_random )) {
+		++m_stats.lost;
+		return;
+	}
+
+	const auto now = c_program_clock::now();
+	auto sent_time = now; // when the last bit leaves us
+	if (link.m_params.bandwidth_bps) {
+		const auto transmit = std::chrono::nanoseconds( size * 8 * 1000000000ULL / link.m_params.bandwidth_bps );
+		sent_time = std::max( now , link.m_busy_until ) + std::chrono::duration_cast<t_clock::duration>( transmit );
+		link.m_busy_until = sent_time;
+	}
+	t_datagram datagram{ sent_time + link.m_params.latency , m_seq++ , src , dst_node , std::string(data, size) };
+	m_travelling.push( std::move(datagram) );
+}
+
+std::vector<c_sim_network::t_node> c_sim_network::deliver_due(t_clock::time_point now) {
+	std::vector<t_node> nodes;
+	while ( (! m_travelling.empty()) && (m_travelling.top().m_arrival <= now) ) {
+		const t_datagram & top = m_travelling.top();
+		auto & inbox = m_inbox.at( top.m_dst );
+		if (inbox.empty()) nodes.push_back( top.m_dst );
+		inbox.push_back( top ); // top() is const, so copy
+		m_travelling.pop();
+		++m_stats.delivered;
+	}
+	return nodes;
+}
+
+bool c_sim_network::get_next_delivery_time(t_clock::time_point & time) const {
+	if (m_travelling.empty()) return false;
+	time = m_travelling.top().m_arrival;
+	return true;
+}
+
+bool c_sim_network::is_inbox_pending(t_node node) const {
+	return ! m_inbox.at(node).empty();
+}
+
+size_t c_sim_network::receive(t_node node, void * buf, size_t buf_size, c_ip46_addr & from) {
+	auto & inbox = m_inbox.at(node);
+	if (inbox.empty()) return 0;
+	const t_datagram & datagram = inbox.front();
+	const size_t size = std::min( buf_size , datagram.m_data.size() );
+	std::copy( datagram.m_data.begin() , datagram.m_data.begin() + size , static_cast<char*>(buf) );
+	from = get_node_addr( datagram.m_src );
+	inbox.pop_front();
+	return size;
+}
+
+const c_sim_network::t_stats & c_sim_network::get_stats() const { return m_stats; }
+
+bool c_sim_network::t_datagram_later::operator()(const t_datagram & a, const t_datagram & b) const {
+	if (a.m_arrival != b.m_arrival) return a.m_arrival > b.m_arrival;
+	return a.m_seq > b.m_seq;
+}
+
+// ------------------------------------------------------------------
+
+c_tun_device_sim::c_tun_device_sim(t_on_write on_write)
+	: m_on_write(on_write), m_address()
+{ }
+
+void c_tun_device_sim::set_ipv6_address(const std::array<uint8_t, 16> &binary_address, int prefixLen) {
+	_UNUSED(prefixLen);
+	m_address = binary_address;
+}
+
+void c_tun_device_sim::set_mtu(uint32_t mtu) { _UNUSED(mtu); }
+
+bool c_tun_device_sim::incomming_message_form_tun() { return ! m_inbox.empty(); }
+
+size_t c_tun_device_sim::read_from_tun(void *buf, size_t count) {
+	if (m_inbox.empty()) return 0;
+	const std::string & packet = m_inbox.front();
+	const size_t size = std::min( count , packet.size() );
+	std::copy( packet.begin() , packet.begin() + size , static_cast<char*>(buf) );
+	m_inbox.pop_front();
+	return size;
+}
+
+size_t c_tun_device_sim::write_to_tun(const void *buf, size_t count) {
+	if (m_on_write) m_on_write( static_cast<const char*>(buf) , count );
+	return count;
+}
+
+void c_tun_device_sim::push_from_system(std::string && packet) { m_inbox.push_back( std::move(packet) ); }
+
+const std::array<uint8_t, 16> & c_tun_device_sim::get_ipv6_address() const { return m_address; }
+
+// ------------------------------------------------------------------
+
+c_udp_wrapper_sim::c_udp_wrapper_sim(c_sim_network & network, c_sim_network::t_node node)
+	: m_network(network), m_node(node)
+{ }
+
+void c_udp_wrapper_sim::send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) {
+	m_network.send( m_node , dst_address , static_cast<const char*>(data) , size_of_data );
+}
+
+size_t c_udp_wrapper_sim::receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) {
+	return m_network.receive( m_node , data_buf , data_buf_size , from_address );
+}
+
+bool c_udp_wrapper_sim::is_pending() const { return m_network.is_inbox_pending( m_node ); }
+
+// ------------------------------------------------------------------
+
+c_event_manager_sim::c_event_manager_sim(c_tun_device_sim &tun_device, c_udp_wrapper_sim &udp_wrapper)
+	: m_tun_device(tun_device), m_udp_device(udp_wrapper)
+{ }
+
+void c_event_manager_sim::wait_for_event(std::chrono::microseconds timeout) { _UNUSED(timeout); }
+
+bool c_event_manager_sim::receive_udp_paket() { return m_udp_device.is_pending(); }
+
+bool c_event_manager_sim::get_tun_packet() { return m_tun_device.incomming_message_form_tun(); }
+
@@ -0,0 +1,141 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_sim_network_hpp
+#define include_c_sim_network_hpp
+
+#include "../libs1.hpp"
+#include "../c_program_clock.hpp"
+#include "../c_tun_device.hpp"
+#include "../c_udp_wrapper.hpp"
+#include "../c_event_manager.hpp"
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <random>
+
+/***
+@file In-memory network for the simulator: nodes are numbered 0..N-1, each has IPv4 10.x.y.z (node+1) on port 9042,
+and datagrams travel only over links added by add_link(), with their latency, loss and bandwidth.
+Time is the c_program_clock (virtual in simulator); the caller moves it and calls deliver_due().
+The c_tun_device_sim, c_udp_wrapper_sim and c_event_manager_sim are the devices of one c_tunserver on such network.
+*/
+
+struct t_sim_link_params { ///< one direction of a link (add_link() uses it for both)
+	std::chrono::microseconds latency; ///< propagation delay
+	double loss; ///< probability 0..1 that a datagram is lost
+	uint64_t bandwidth_bps; ///< bits per second, datagrams wait in queue for the link; 0 is unlimited
+
+	t_sim_link_params();
+	t_sim_link_params(std::chrono::microseconds latency, double loss, uint64_t bandwidth_bps);
+};
+
+class c_sim_network {
+	public:
+		typedef c_program_clock::t_clock t_clock;
+		typedef size_t t_node; ///< index of node
+
+		struct t_stats {
+			uint64_t sent; ///< datagrams given to send()
+			uint64_t sent_bytes;
+			uint64_t lost; ///< dropped by loss of link
+			uint64_t no_link; ///< dropped because there is no link to destination
+			uint64_t delivered; ///< put into inbox of destination
+			std::map<int, uint64_t> sent_by_cmd; ///< sent, by the [protocol] CMD octet (-1 if datagram was too short)
+			t_stats();
+		};
+
+		explicit c_sim_network(uint32_t seed); ///< seed for the random losses
+
+		t_node add_node(); ///< returns the new node
+		size_t get_node_count() const;
+		static c_ip46_addr get_node_addr(t_node node);
+		static bool get_node_by_addr(const c_ip46_addr & addr, t_node & node); ///< false if address is not of our network
+
+		void add_link(t_node a, t_node b, const t_sim_link_params & params); ///< both directions, each with own bandwidth queue
+		bool is_link(t_node a, t_node b) const;
+
+		void send(t_node src, const c_ip46_addr & dst, const char * data, size_t size); ///< sent now (c_program_clock::now)
+		std::vector<t_node> deliver_due(t_clock::time_point now); ///< moves arrived datagrams to inboxes, returns the nodes that got any
+		bool get_next_delivery_time(t_clock::time_point & time) const; ///< false if nothing is travelling
+
+		bool is_inbox_pending(t_node node) const;
+		size_t receive(t_node node, void * buf, size_t buf_size, c_ip46_addr & from); ///< from inbox; 0 if empty. Too big is truncated
+
+		const t_stats & get_stats() const;
+
+	private:
+		struct t_link {
+			t_sim_link_params m_params;
+			t_clock::time_point m_busy_until; ///< the previous datagram still uses the bandwidth till then
+		};
+		struct t_datagram {
+			t_clock::time_point m_arrival;
+			uint64_t m_seq; ///< so datagrams arriving at same time keep the order
+			t_node m_src, m_dst;
+			std::string m_data;
+		};
+		struct t_datagram_later { ///< for min-heap by arrival
+			bool operator()(const t_datagram & a, const t_datagram & b) const;
+		};
+
+		std::vector< std::deque<t_datagram> > m_inbox; ///< by node
+		std::map< std::pair<t_node,t_node> , t_link > m_link; ///< by (from, to)
+		std::priority_queue< t_datagram, std::vector<t_datagram>, t_datagram_later > m_travelling;
+		uint64_t m_seq;
+		std::mt19937 m_random;
+		t_stats m_stats;
+};
+
+// ------------------------------------------------------------------
+
+class c_tun_device_sim final : public c_tun_device { ///< TUN of simulated node: the "system" side is the simulator
+	public:
+		typedef std::function<void(const char * data, size_t size)> t_on_write;
+
+		explicit c_tun_device_sim(t_on_write on_write); ///< on_write gets packets that node writes to its TUN
+		void set_ipv6_address(const std::array<uint8_t, 16> &binary_address, int prefixLen) override;
+		void set_mtu(uint32_t mtu) override;
+		bool incomming_message_form_tun() override;
+		size_t read_from_tun(void *buf, size_t count) override;
+		size_t write_to_tun(const void *buf, size_t count) override;
+
+		void push_from_system(std::string && packet); ///< as if some program of this node sent that packet to TUN
+		const std::array<uint8_t, 16> & get_ipv6_address() const;
+
+	private:
+		t_on_write m_on_write;
+		std::deque<std::string> m_inbox;
+		std::array<uint8_t, 16> m_address;
+};
+
+class c_udp_wrapper_sim final : public c_udp_wrapper { ///< UDP of simulated node
+	public:
+		c_udp_wrapper_sim(c_sim_network & network, c_sim_network::t_node node);
+		void send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) override;
+		size_t receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) override;
+		bool is_pending() const;
+
+	private:
+		c_sim_network & m_network;
+		const c_sim_network::t_node m_node;
+};
+
+class c_event_manager_sim final : public c_event_manager { ///< never blocks, the simulator moves the time instead
+	public:
+		c_event_manager_sim(c_tun_device_sim &tun_device, c_udp_wrapper_sim &udp_wrapper);
+		void wait_for_event(std::chrono::microseconds timeout) override;
+		bool receive_udp_paket() override;
+		bool get_tun_packet() override;
+
+	private:
+		c_tun_device_sim & m_tun_device;
+		c_udp_wrapper_sim & m_udp_device;
+};
+
+#endif
+
@@ -0,0 +1,298 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#include "c_simulator.hpp"
+
+#include <cmath>
+#include <iomanip>
+
+namespace {
+
+const char sim_payload_magic[4] = { 'S', 'I', 'M', '1' }; ///< payload of flow packet: MAGIC(4) FLOW_INDEX(4)
+constexpr size_t sim_payload_size = 8;
+constexpr size_t sim_ipv6_header_size = 40;
+constexpr size_t sim_steps_per_node_max = 100000; ///< in one go; more would mean the node is looping on its own data
+
+const char * cmd_name(int cmd) { ///< short name of [protocol] command, for the report
+	switch (cmd) {
+		case c_protocol::e_proto_cmd_tunneled_data: return "tunneled_data";
+		case c_protocol::e_proto_cmd_public_hi: return "public_hi";
+		case c_protocol::e_proto_cmd_public_ping_request: return "ping_request";
+		case c_protocol::e_proto_cmd_public_ping_reply: return "ping_reply";
+		case c_protocol::e_proto_cmd_tunneled_data_flow_setup: return "tunneled_data_flow_setup";
+		case c_protocol::e_proto_cmd_tunneled_data_flow: return "tunneled_data_flow";
+		case c_protocol::e_proto_cmd_tunneled_data_flow_reset: return "tunneled_data_flow_reset";
+		case c_protocol::e_proto_cmd_aggregated: return "aggregated";
+		case c_protocol::e_proto_cmd_findhip_query: return "findhip_query";
+		case c_protocol::e_proto_cmd_findhip_reply: return "findhip_reply";
+	}
+	return "other";
+}
+
+bool cmd_is_data(int cmd) {
+	return (cmd == c_protocol::e_proto_cmd_tunneled_data) || (cmd == c_protocol::e_proto_cmd_tunneled_data_flow_setup)
+		|| (cmd == c_protocol::e_proto_cmd_tunneled_data_flow) || (cmd == c_protocol::e_proto_cmd_aggregated);
+}
+
+double to_ms(c_program_clock::t_clock::duration duration) {
+	return std::chrono::duration<double, std::milli>( duration ).count();
+}
+
+} // namespace
+
+t_sim_options::t_sim_options()
+	: nodes(10), topology("line"), degree(4), link(), flows(10),
+	duration(std::chrono::seconds(30)), traffic_start(std::chrono::seconds(2)), traffic_interval(std::chrono::milliseconds(100)),
+	packet_size(100), tick(std::chrono::milliseconds(100)), seed(42)
+{ }
+
+c_simulator::t_flow::t_flow()
+	: m_src(0), m_dst(0), m_sent(0), m_delivered(0), m_converged(false), m_convergence_time(0)
+{ }
+
+// ------------------------------------------------------------------
+
+c_simulator::c_simulator(const t_sim_options & options)
+	: m_options(options), m_network(options.seed), m_random(options.seed), m_links(0),
+	m_steps(0), m_tun_written(0), m_tun_written_wrong(0), m_node_errors(0),
+	m_wall_time_build(0), m_wall_time_run(0)
+{
+	if (m_options.nodes < 2) _throw_error( std::invalid_argument("Simulator needs at least 2 nodes") );
+	if (! m_options.tick.count()) _throw_error( std::invalid_argument("Simulator tick can not be zero") );
+	if (! m_options.traffic_interval.count()) _throw_error( std::invalid_argument("Simulator traffic interval can not be zero") );
+}
+
+void c_simulator::build() {
+	const auto wall_start = std::chrono::steady_clock::now();
+	m_time_start = t_clock::time_point( std::chrono::hours(1) ); // any, but not zero (e.g. as "never" in some timers)
+	c_program_clock::set_virtual_time( m_time_start );
+
+	_note("Simulator: creating " << m_options.nodes << " nodes");
+	m_node.reserve( m_options.nodes );
+	for (size_t i=0; i<m_options.nodes; ++i) {
+		const auto index = m_network.add_node();
+		_check( index == i );
+		auto tun_device = make_unique<c_tun_device_sim>( [this, index](const char * data, size_t size) { on_tun_write(index, data, size); } );
+		auto udp_device = make_unique<c_udp_wrapper_sim>( m_network , index );
+		auto event_manager = make_unique<c_event_manager_sim>( * tun_device , * udp_device );
+
+		t_node node;
+		node.m_tun_device = tun_device.get();
+		node.m_tunserver = make_unique<c_tunserver>( std::move(tun_device) , std::move(udp_device) , std::move(event_manager) );
+		node.m_tunserver->set_my_name( "sim-" + std::to_string(i) );
+		antinet_crypto::c_multikeys_PAIR my_IDI; // new identity, not saved anywhere
+		my_IDI.generate( antinet_crypto::e_crypto_system_type_Ed25519 , 1 );
+		node.m_tunserver->configure_mykey( my_IDI );
+		node.m_hip_dot = node.m_tunserver->get_my_ipv6_nice();
+		node.m_hip = c_haship_addr( c_haship_addr::tag_constr_by_addr_dot() , node.m_hip_dot );
+		m_node.push_back( std::move(node) );
+	}
+
+	build_topology();
+
+	_note("Simulator: creating " << m_options.flows << " flows");
+	const size_t packet_size = std::max( m_options.packet_size , sim_ipv6_header_size + sim_payload_size );
+	std::uniform_int_distribution<size_t> random_node(0, m_options.nodes - 1);
+	for (size_t i=0; i<m_options.flows; ++i) {
+		t_flow flow;
+		flow.m_src = random_node(m_random);
+		do { flow.m_dst = random_node(m_random); } while (flow.m_dst == flow.m_src);
+
+		const size_t ipv6_pos = g_tuntap::TUN_with_PI::header_position_of_ipv6;
+		std::string & packet = flow.m_packet;
+		packet.assign( ipv6_pos + packet_size , 0 );
+		packet[2] = static_cast<char>(0x86); packet[3] = static_cast<char>(0xDD); // PI: protocol is IPv6
+		char * ipv6 = & packet[ipv6_pos];
+		ipv6[0] = 0x60; // version 6
+		const size_t payload_size = packet_size - sim_ipv6_header_size;
+		ipv6[4] = static_cast<char>( (payload_size >> 8) & 0xFF ); ipv6[5] = static_cast<char>( payload_size & 0xFF );
+		ipv6[6] = 59; // no next header
+		ipv6[7] = 64; // hop limit
+		const auto & src_hip = m_node.at(flow.m_src).m_hip , & dst_hip = m_node.at(flow.m_dst).m_hip;
+		std::copy( src_hip.begin() , src_hip.end() , ipv6 + g_ipv6_rfc::header_position_of_src );
+		std::copy( dst_hip.begin() , dst_hip.end() , ipv6 + g_ipv6_rfc::header_position_of_dst );
+		char * payload = ipv6 + sim_ipv6_header_size;
+		std::copy( sim_payload_magic , sim_payload_magic + sizeof(sim_payload_magic) , payload );
+		for (int octet=0; octet<4; ++octet) payload[4+octet] = static_cast<char>( (i >> (8*(3-octet))) & 0xFF );
+
+		m_flow.push_back( std::move(flow) );
+	}
+	m_wall_time_build = std::chrono::steady_clock::now() - wall_start;
+}
+
+void c_simulator::build_topology() {
+	const size_t n = m_options.nodes;
+	const auto & topology = m_options.topology;
+	_note("Simulator: topology " << topology);
+	if (topology == "line" || topology == "ring") {
+		for (size_t i=0; i+1<n; ++i) add_link(i, i+1);
+		if ((topology == "ring") && (n > 2)) add_link(n-1, 0);
+	}
+	else if (topology == "grid") { // rows of side nodes, last row can be shorter
+		const size_t side = static_cast<size_t>( std::ceil( std::sqrt( static_cast<double>(n) ) ) );
+		for (size_t i=0; i<n; ++i) {
+			if ((i % side != side-1) && (i+1 < n)) add_link(i, i+1);
+			if (i + side < n) add_link(i, i+side);
+		}
+	}
+	else if (topology == "random") { // random tree (so it is connected), then random links up to the average degree
+		std::vector<size_t> order(n);
+		for (size_t i=0; i<n; ++i) order[i] = i;
+		std::shuffle( order.begin() , order.end() , m_random );
+		for (size_t i=1; i<n; ++i) {
+			std::uniform_int_distribution<size_t> random_earlier(0, i-1);
+			add_link( order[i] , order[ random_earlier(m_random) ] );
+		}
+		const size_t links_wanted = std::min( n * m_options.degree / 2 , n*(n-1)/2 );
+		std::uniform_int_distribution<size_t> random_node(0, n-1);
+		size_t links = n-1;
+		for (size_t tries=0; (links < links_wanted) && (tries < links_wanted*10); ++tries) {
+			const size_t a = random_node(m_random), b = random_node(m_random);
+			if ((a == b) || m_network.is_link(a, b)) continue;
+			add_link(a, b);
+			++links;
+		}
+	}
+	else _throw_error( std::invalid_argument("Unknown topology: " + topology) );
+}
+
+void c_simulator::add_link(size_t a, size_t b) {
+	m_network.add_link(a, b, m_options.link);
+	m_node.at(a).m_tunserver->add_peer( t_peering_reference( c_sim_network::get_node_addr(b) , m_node.at(b).m_hip_dot ) );
+	m_node.at(b).m_tunserver->add_peer( t_peering_reference( c_sim_network::get_node_addr(a) , m_node.at(a).m_hip_dot ) );
+	++m_links;
+}
+
+void c_simulator::run() {
+	const auto wall_start = std::chrono::steady_clock::now();
+	const auto time_end = m_time_start + m_options.duration;
+	auto time_now = m_time_start;
+	c_program_clock::set_virtual_time( time_now );
+	for (auto & node : m_node) node.m_tunserver->run_start();
+
+	auto next_tick = m_time_start;
+	auto next_traffic = m_time_start + m_options.traffic_start;
+	std::vector<char> is_active( m_node.size() , false ); // should step now
+	std::vector<size_t> active;
+	auto activate = [&](size_t node) { if (! is_active[node]) { is_active[node] = true; active.push_back(node); } };
+
+	_note("Simulator: running for " << m_options.duration.count() << " ms of virtual time");
+	while (time_now <= time_end) {
+		c_program_clock::set_virtual_time( time_now );
+		if (time_now >= next_tick) {
+			for (size_t i=0; i<m_node.size(); ++i) activate(i);
+			next_tick += m_options.tick;
+		}
+		if (time_now >= next_traffic) {
+			for (auto & flow : m_flow) {
+				if (! flow.m_sent) flow.m_first_sent = time_now;
+				++flow.m_sent;
+				m_node.at(flow.m_src).m_tun_device->push_from_system( std::string(flow.m_packet) );
+				activate(flow.m_src);
+			}
+			next_traffic += m_options.traffic_interval;
+		}
+		for (auto node : m_network.deliver_due(time_now)) activate(node);
+
+		while (! active.empty()) { // until nothing more happens at this time (e.g. with links of zero latency)
+			std::vector<size_t> stepping;
+			stepping.swap(active);
+			for (auto node : stepping) is_active[node] = false;
+			for (auto node : stepping) step_node(node);
+			for (auto node : m_network.deliver_due(time_now)) activate(node);
+		}
+
+		auto time_next = std::min( next_tick , next_traffic );
+		t_clock::time_point time_delivery;
+		if (m_network.get_next_delivery_time(time_delivery)) time_next = std::min( time_next , time_delivery );
+		time_now = time_next;
+	}
+	m_time_end = time_now;
+	m_wall_time_run = std::chrono::steady_clock::now() - wall_start;
+}
+
+void c_simulator::step_node(size_t node) {
+	auto & tunserver = * m_node.at(node).m_tunserver;
+	try {
+		for (size_t steps=0; steps<sim_steps_per_node_max; ++steps) {
+			++m_steps;
+			if (! tunserver.run_step()) return;
+		}
+		_warn("Simulator: node " << node << " still has input after " << sim_steps_per_node_max << " steps, leaving it for later");
+	}
+	catch (const std::exception & ex) {
+		++m_node_errors;
+		_warn("Simulator: node " << node << " failed in step: " << ex.what());
+	}
+}
+
+void c_simulator::on_tun_write(size_t node, const char * data, size_t size) {
+	++m_tun_written;
+	const size_t payload_pos = g_tuntap::TUN_with_PI::header_position_of_ipv6 + sim_ipv6_header_size;
+	if ((size < payload_pos + sim_payload_size) || (! std::equal( sim_payload_magic , sim_payload_magic + sizeof(sim_payload_magic) , data + payload_pos))) {
+		++m_tun_written_wrong;
+		return;
+	}
+	size_t index = 0;
+	for (int octet=0; octet<4; ++octet) index = (index << 8) | static_cast<unsigned char>( data[payload_pos + 4 + octet] );
+	if ((index >= m_flow.size()) || (m_flow[index].m_dst != node)) {
+		++m_tun_written_wrong;
+		return;
+	}
+	auto & flow = m_flow[index];
+	++flow.m_delivered;
+	if (! flow.m_converged) {
+		flow.m_converged = true;
+		flow.m_convergence_time = c_program_clock::now() - flow.m_first_sent;
+	}
+}
+
+void c_simulator::print_report(std::ostream & ostr) const {
+	const auto & stats = m_network.get_stats();
+	const double virtual_s = std::chrono::duration<double>( m_time_end - m_time_start ).count();
+	const double wall_s = m_wall_time_run.count();
+	auto per_s = [](uint64_t count, double seconds) { return (seconds > 0) ? (count / seconds) : 0.; };
+
+	ostr << std::fixed << std::setprecision(1);
+	ostr << "Simulated " << m_node.size() << " nodes, topology " << m_options.topology << ", " << m_links << " links"
+		<< " (latency " << m_options.link.latency.count() / 1000. << " ms, loss " << m_options.link.loss*100 << " %, bandwidth "
+		<< (m_options.link.bandwidth_bps ? std::to_string(m_options.link.bandwidth_bps) + " bit/s" : std::string("unlimited")) << ")\n";
+	ostr << "Time: " << virtual_s << " s virtual, " << std::setprecision(3) << wall_s << " s real (plus "
+		<< m_wall_time_build.count() << " s to build), " << m_steps << " node steps\n";
+
+	std::vector<double> convergence_ms;
+	uint64_t sent=0, delivered=0;
+	for (const auto & flow : m_flow) {
+		sent += flow.m_sent;
+		delivered += flow.m_delivered;
+		if (flow.m_converged) convergence_ms.push_back( to_ms( flow.m_convergence_time ) );
+	}
+	std::sort( convergence_ms.begin() , convergence_ms.end() );
+	ostr << std::setprecision(1);
+	ostr << "Route convergence: " << convergence_ms.size() << " of " << m_flow.size() << " flows";
+	if (convergence_ms.size()) {
+		double sum = 0;
+		for (auto ms : convergence_ms) sum += ms;
+		ostr << ", time to first delivered packet: avg " << sum / convergence_ms.size() << " ms"
+			<< ", median " << convergence_ms.at( convergence_ms.size()/2 ) << " ms"
+			<< ", p90 " << convergence_ms.at( convergence_ms.size()*9/10 ) << " ms"
+			<< ", max " << convergence_ms.back() << " ms";
+	}
+	ostr << '\n';
+	ostr << "Flow packets: " << sent << " sent, " << delivered << " delivered, "
+		<< m_tun_written_wrong << " other packets written to TUN, " << m_node_errors << " node errors\n";
+
+	uint64_t control = 0;
+	ostr << "Datagrams: " << stats.sent << " sent (" << stats.sent_bytes << " bytes), " << stats.delivered << " delivered, "
+		<< stats.lost << " lost, " << stats.no_link << " without link\n";
+	for (const auto & cmd : stats.sent_by_cmd) {
+		ostr << "  cmd " << cmd.first << " " << cmd_name(cmd.first) << ": " << cmd.second << '\n';
+		if (! cmd_is_data(cmd.first)) control += cmd.second;
+	}
+	ostr << "Control messages: " << control << " (" << per_s(control, virtual_s) / m_node.size() << " per node per virtual second)\n";
+	ostr << "Packets per second (real time): " << per_s(stats.sent, wall_s) << " datagrams, "
+		<< per_s(delivered, wall_s) << " flow packets delivered\n";
+	ostr << "Packets per second (virtual time): " << per_s(stats.sent, virtual_s) << " datagrams, "
+		<< per_s(delivered, virtual_s) << " flow packets delivered\n";
+}
+
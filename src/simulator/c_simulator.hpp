@@ -0,0 +1,82 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+
+#pragma once
+#ifndef include_c_simulator_hpp
+#define include_c_simulator_hpp
+
+#include "c_sim_network.hpp"
+#include "../tunserver.hpp"
+
+/***
+@file Many c_tunserver nodes in one process, on c_sim_network, in virtual time (c_program_clock).
+Flows of test packets are sent between random pairs of nodes (from their TUN), and we measure how long it takes until
+each flow gets its first packet delivered (route convergence), how many control messages were needed, and how fast
+the simulation goes (packets per second of real time).
+*/
+
+struct t_sim_options {
+	size_t nodes;
+	std::string topology; ///< "line", "ring", "grid", "random" (random graph with given average degree, always connected)
+	size_t degree; ///< for "random" topology
+	t_sim_link_params link; ///< of all links
+	size_t flows; ///< how many flows of test packets (between random pairs of different nodes)
+	std::chrono::milliseconds duration; ///< of virtual time
+	std::chrono::milliseconds traffic_start; ///< when flows start sending (e.g. after first pings)
+	std::chrono::milliseconds traffic_interval; ///< each flow sends one packet this often
+	size_t packet_size; ///< size of IPv6 packet of a flow
+	std::chrono::milliseconds tick; ///< all nodes run their loop (e.g. to ping peers) at least this often
+	uint32_t seed;
+
+	t_sim_options();
+};
+
+class c_simulator {
+	public:
+		typedef c_program_clock::t_clock t_clock;
+
+		explicit c_simulator(const t_sim_options & options);
+
+		void build(); ///< creates the nodes and links
+		void run(); ///< in virtual time, for options.duration
+		void print_report(std::ostream & ostr) const;
+
+	private:
+		struct t_node { ///< one simulated computer
+			c_tun_device_sim * m_tun_device; ///< owned by m_tunserver
+			unique_ptr<c_tunserver> m_tunserver;
+			c_haship_addr m_hip;
+			std::string m_hip_dot; ///< the same as m_hip
+		};
+		struct t_flow {
+			c_sim_network::t_node m_src, m_dst;
+			std::string m_packet; ///< the TUN packet it sends, with flow index in payload
+			uint64_t m_sent, m_delivered;
+			t_clock::time_point m_first_sent;
+			bool m_converged; ///< was any packet delivered yet
+			t_clock::duration m_convergence_time; ///< from first sent packet to first delivered one
+			t_flow();
+		};
+
+		void build_topology();
+		void add_link(size_t a, size_t b);
+		void on_tun_write(size_t node, const char * data, size_t size); ///< the node delivered a packet to its TUN
+		void step_node(size_t node);
+
+		const t_sim_options m_options;
+		c_sim_network m_network;
+		std::vector<t_node> m_node;
+		std::vector<t_flow> m_flow;
+		std::mt19937 m_random;
+
+		size_t m_links;
+		t_clock::time_point m_time_start, m_time_end; ///< virtual
+		uint64_t m_steps; ///< run_step() calls of all nodes
+		uint64_t m_tun_written; ///< packets nodes delivered to TUN
+		uint64_t m_tun_written_wrong; ///< ...of them, to wrong node (not the destination of their flow) or not of any flow
+		uint64_t m_node_errors; ///< exceptions from node steps
+		std::chrono::duration<double> m_wall_time_build, m_wall_time_run;
+};
+
+#endif
+
@@ -0,0 +1,68 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include <boost/program_options.hpp>
+
+#include "c_simulator.hpp"
+
+/***
+@file Simulator (simulator.elf): many nodes in one process, on simulated network, in virtual time.
+Run e.g.: ./simulator.elf --nodes 1000 --topology random --degree 4 --latency-ms 20 --loss 0.01 --flows 100
+see doc/hacking.md
+*/
+
+int main(int argc, char **argv) {
+	namespace po = boost::program_options;
+	t_sim_options options;
+	double latency_ms = 10, duration_s = 30, traffic_start_s = 2;
+	long int traffic_interval_ms = 100, tick_ms = 100;
+	int debug_level = 200;
+
+	po::options_description desc("Simulator options");
+	desc.add_options()
+		("help", "show help")
+		("nodes", po::value<size_t>(&options.nodes)->default_value(options.nodes), "number of nodes")
+		("topology", po::value<std::string>(&options.topology)->default_value(options.topology), "line, ring, grid or random")
+		("degree", po::value<size_t>(&options.degree)->default_value(options.degree), "average number of peers, for random topology")
+		("latency-ms", po::value<double>(&latency_ms)->default_value(latency_ms), "latency of each link")
+		("loss", po::value<double>(&options.link.loss)->default_value(options.link.loss), "loss of each link, 0..1")
+		("bandwidth-bps", po::value<uint64_t>(&options.link.bandwidth_bps)->default_value(options.link.bandwidth_bps),
+			"bandwidth of each link in bits per second, 0 is unlimited")
+		("flows", po::value<size_t>(&options.flows)->default_value(options.flows), "number of flows of test packets between random nodes")
+		("packet-size", po::value<size_t>(&options.packet_size)->default_value(options.packet_size), "size of IPv6 packets of flows")
+		("traffic-start-s", po::value<double>(&traffic_start_s)->default_value(traffic_start_s), "when flows start sending")
+		("traffic-interval-ms", po::value<long int>(&traffic_interval_ms)->default_value(traffic_interval_ms), "each flow sends a packet this often")
+		("duration-s", po::value<double>(&duration_s)->default_value(duration_s), "virtual time to simulate")
+		("tick-ms", po::value<long int>(&tick_ms)->default_value(tick_ms), "all nodes run their main loop at least this often")
+		("seed", po::value<uint32_t>(&options.seed)->default_value(options.seed), "seed for topology, flows and losses")
+		("debug", po::value<int>(&debug_level)->default_value(debug_level), "debug level of nodes (lower shows more)")
+	;
+
+	try {
+		po::variables_map argm;
+		po::store( po::parse_command_line(argc, argv, desc) , argm );
+		po::notify(argm);
+		if (argm.count("help")) { std::cout << desc << std::endl; return 0; }
+
+		options.link.latency = std::chrono::microseconds( static_cast<long int>( latency_ms * 1000 ) );
+		options.duration = std::chrono::milliseconds( static_cast<long int>( duration_s * 1000 ) );
+		options.traffic_start = std::chrono::milliseconds( static_cast<long int>( traffic_start_s * 1000 ) );
+		options.traffic_interval = std::chrono::milliseconds( traffic_interval_ms );
+		options.tick = std::chrono::milliseconds( tick_ms );
+		g_dbg_level_set(debug_level, "Simulator: logs of all nodes would be too many, and slow");
+
+		c_simulator simulator(options);
+		std::streambuf * cout_buf = std::cout.rdbuf(); // nodes also print user messages (ui::action_info_ok) to cout, hide them
+		if (debug_level >= 200) std::cout.rdbuf(nullptr);
+		simulator.build();
+		simulator.run();
+		std::cout.rdbuf(cout_buf);
+		std::cout.clear();
+		simulator.print_report(std::cout);
+	}
+	catch (const std::exception & ex) {
+		std::cerr << "Simulator error: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
+
@@ -7,6 +7,10 @@
 
 #include "libs0.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // ==================================================================
 
 string_as_hex::string_as_hex(const std::string & s) : data(s) { }
@@ -19,16 +23,7 @@ string_as_hex::string_as_hex(const string_as_bin & in) {
 	assert( in_size < (in_size_max1-1) ); // make sure no issue with ending C-string NULL
 	size_t retsize = in_size*size_mul; // this will be size of output
 	data.resize(retsize);
-
-	size_t pos=0, outpos=0;
-	for( ; pos<in_size; ++pos) {
-		unsigned char byte = in.bytes.at(pos), bh=byte/16, bl=byte%16;
-		data.at(outpos) = int2hexchar(bh);
-		++outpos;
-		data.at(outpos) = int2hexchar(bl);
-		++outpos;
-	}
-	assert(outpos == retsize); // all expected out data was written
+	hex_encode( in.bytes.data() , in_size , & data[0] );
 }
 
 const std::string & string_as_hex::get() const { return data; }
@@ -42,18 +37,145 @@ bool operator==( const string_as_hex &a, const string_as_hex &b) {
 // ==================================================================
 
 
+namespace {
+
+const char g_hexchars[] = "0123456789abcdef";
+
+/// value of hex char, or -1 if invalid. Only lowercase, as in hexchar2int()
+struct c_hex_decode_table {
+	signed char value[256];
+	c_hex_decode_table() {
+		for (auto & v : value) v = -1;
+		for (int i=0; i<16; ++i) value[ static_cast<unsigned char>(g_hexchars[i]) ] = i;
+	}
+};
+const c_hex_decode_table g_hex_decode_table;
+
+/// the 2 hex chars of each octet
+struct c_hex_encode_table {
+	char pair[256][2];
+	c_hex_encode_table() {
+		for (int i=0; i<256; ++i) { pair[i][0] = g_hexchars[i/16]; pair[i][1] = g_hexchars[i%16]; }
+	}
+};
+const c_hex_encode_table g_hex_encode_table;
+
+} // namespace
+
 unsigned char int2hexchar(unsigned char i) {
-	if (i<=9) return '0'+i;
-	if (i<=15) return 'a'+(i-10);
+	if (i<=15) return g_hexchars[i];
 	_throw_error( std::invalid_argument(  string("Invalid hex value:")+std::to_string(i) ) );
 }
 
 unsigned char hexchar2int(char c) {
-	if ((c>='0')&&(c<='9')) return c-'0';
-	if ((c>='a')&&(c<='f')) return c-'a' +10;
+	const signed char v = g_hex_decode_table.value[ static_cast<unsigned char>(c) ];
+	if (v >= 0) return v;
 	_throw_error( std::invalid_argument(  string("Invalid character (")+string(1,c)+string(") in parsing hex number")  ) );
 }
 
+void hex_encode(const char * in, size_t in_size, char * out) {
+	size_t pos=0;
+	#ifdef __SSE2__
+	// 16 octets -> 32 chars: split into nibbles, nibble+'0' plus ('a'-'0'-10) where nibble>9, interleave high,low
+	const __m128i mask_nibble = _mm_set1_epi8(0x0F);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i char_0 = _mm_set1_epi8('0');
+	const __m128i char_a_offset = _mm_set1_epi8('a'-'0'-10);
+	for ( ; pos+16 <= in_size ; pos+=16, out+=32) {
+		const __m128i octets = _mm_loadu_si128( reinterpret_cast<const __m128i*>(in+pos) );
+		const __m128i high = _mm_and_si128( _mm_srli_epi16(octets, 4) , mask_nibble );
+		const __m128i low = _mm_and_si128( octets , mask_nibble );
+		const __m128i high_chars = _mm_add_epi8( _mm_add_epi8(high, char_0) , _mm_and_si128( _mm_cmpgt_epi8(high, nine) , char_a_offset ) );
+		const __m128i low_chars = _mm_add_epi8( _mm_add_epi8(low, char_0) , _mm_and_si128( _mm_cmpgt_epi8(low, nine) , char_a_offset ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(out) , _mm_unpacklo_epi8(high_chars, low_chars) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(out+16) , _mm_unpackhi_epi8(high_chars, low_chars) );
+	}
+	#endif
+	for ( ; pos<in_size ; ++pos, out+=2) {
+		const char * pair = g_hex_encode_table.pair[ static_cast<unsigned char>(in[pos]) ];
+		out[0] = pair[0];
+		out[1] = pair[1];
+	}
+}
+
+bool hex_decode(const char * in, size_t in_size, char * out) {
+	assert( 0 == (in_size % 2) );
+	size_t pos=0;
+	#ifdef __SSE2__
+	// 32 chars -> 16 octets. Signed compares are fine: chars >127 are negative so they fail both ranges
+	const __m128i before_0 = _mm_set1_epi8('0'-1), after_9 = _mm_set1_epi8('9'+1);
+	const __m128i before_a = _mm_set1_epi8('a'-1), after_f = _mm_set1_epi8('f'+1);
+	const __m128i char_0 = _mm_set1_epi8('0');
+	const __m128i char_a_offset = _mm_set1_epi8('a'-10);
+	const __m128i mask_low_octet = _mm_set1_epi16(0x00FF);
+	auto decode16 = [&](const char * chars, __m128i & values) -> bool { // 16 chars -> 8 octets in low half of values
+		const __m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>(chars) );
+		const __m128i is_digit = _mm_and_si128( _mm_cmpgt_epi8(c, before_0) , _mm_cmplt_epi8(c, after_9) );
+		const __m128i is_letter = _mm_and_si128( _mm_cmpgt_epi8(c, before_a) , _mm_cmplt_epi8(c, after_f) );
+		if (_mm_movemask_epi8( _mm_or_si128(is_digit, is_letter) ) != 0xFFFF) return false;
+		const __m128i nibbles = _mm_or_si128(
+			_mm_and_si128( is_digit , _mm_sub_epi8(c, char_0) ) ,
+			_mm_and_si128( is_letter , _mm_sub_epi8(c, char_a_offset) ) );
+		// each 16-bit lane is { high nibble char , low nibble char } (little endian: high one is in the lower octet)
+		const __m128i high = _mm_and_si128( nibbles , mask_low_octet );
+		const __m128i low = _mm_srli_epi16( nibbles , 8 );
+		values = _mm_or_si128( _mm_slli_epi16(high, 4) , low );
+		return true;
+	};
+	for ( ; pos+32 <= in_size ; pos+=32, out+=16) {
+		__m128i values1, values2;
+		if (! decode16(in+pos, values1)) return false;
+		if (! decode16(in+pos+16, values2)) return false;
+		_mm_storeu_si128( reinterpret_cast<__m128i*>(out) , _mm_packus_epi16(values1, values2) );
+	}
+	#endif
+	for ( ; pos<in_size ; pos+=2, ++out) {
+		const signed char high = g_hex_decode_table.value[ static_cast<unsigned char>(in[pos]) ];
+		const signed char low = g_hex_decode_table.value[ static_cast<unsigned char>(in[pos+1]) ];
+		if ((high|low) < 0) return false;
+		*out = static_cast<char>( (high<<4) | low );
+	}
+	return true;
+}
+
+void hex_benchmark(size_t seconds_for_test_case) {
+	_mark("hex_benchmark");
+	const std::vector<size_t> data_sizes = { 16 , 1280 };
+	for (size_t data_size : data_sizes) {
+		std::string data(data_size, 0);
+		for (size_t i=0; i<data_size; ++i) data[i] = static_cast<char>(i*7);
+		std::string encoded(data_size*2, 0);
+		std::string decoded(data_size, 0);
+
+		auto run = [&](const char * name, std::function<void()> func) {
+			size_t count = 0;
+			auto start_point = std::chrono::steady_clock::now();
+			while (std::chrono::steady_clock::now() - start_point < std::chrono::seconds(seconds_for_test_case)) {
+				for (int i=0; i<100; ++i) func();
+				count += 100;
+			}
+			auto stop_point = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration_cast<std::chrono::milliseconds>(stop_point - start_point).count();
+			_info(name << " of " << data_size << " B: " << count / ms * 1000 << " per second, "
+				<< (count * data_size) / ms / 1000 << " MB/s");
+		};
+
+		run("hex_encode (per char, old code)", [&]() {
+			for (size_t pos=0; pos<data_size; ++pos) {
+				unsigned char byte = data[pos];
+				encoded[pos*2] = int2hexchar(byte/16);
+				encoded[pos*2+1] = int2hexchar(byte%16);
+			}
+		} );
+		run("hex_encode", [&]() { hex_encode(data.data(), data_size, & encoded[0]); } );
+		run("hex_decode", [&]() { hex_decode(encoded.data(), encoded.size(), & decoded[0]); } );
+		_check( decoded == data );
+		run("string_as_hex", [&]() { string_as_hex hex{ string_as_bin( data ) }; } );
+		run("to_debug", [&]() { to_debug( data ); } );
+		run("to_debug_b", [&]() { to_debug_b( data ); } );
+	}
+}
+
 unsigned char doublehexchar2int(string s) {
 	if (s.size()!=2) _throw_error( std::invalid_argument("Invalid double-hex string: '"+s+"'") );
 	unsigned char h = s.at(0);
@@ -75,7 +197,7 @@ string_as_bin::string_as_bin(const string_as_hex & encoded) {
 try {
 	// "ff020a" = ff , 02 , 0a
 	//   "020a" = 02 , 0a
-	//    "20a" = 02 , 0a
+	//    "20a" = 20 , 0a (last single char is the low nibble)
 	const auto es = encoded.data.size();
 	if (!es) return; // empty string encoded --> empty binary string
 
@@ -85,24 +207,12 @@ try {
 	assert( (retsize < es)   ||   ((retsize==1)&&(es==1)) ); // binary string is smaller  -or-  both are ==1 for e.g. encoded "a" means "0a" so it should result in ---> a 1-byte binary string
 	bytes.resize(retsize);
 
-	size_t pos=0, out=0; // position of input, and output
-	for( ; pos<es ; pos+=2, ++out) {
-		// _info("pos="<<pos<<" out="<<out<<" encoded="<<encoded.data);
-		// "02" -> cl="2" ch="0"
-		//  "2" -> cl="2" ch="0"
-		char cl,ch;
-		if (pos+1 < es) { // pos and pos+1 are valid positions in string
-			ch = encoded.data.at(pos);
-			cl = encoded.data.at(pos+1);
-		} else {
-			ch = '0';
-			cl = encoded.data.at(pos);
-		}
-		unsigned char octet = hexchar2int(ch)*16 + hexchar2int(cl);
-		bytes.at(out) = octet;
+	const size_t es_even = es - (es % 2);
+	if (! hex_decode( encoded.data.data() , es_even , & bytes[0] )) {
+		for (char c : encoded.data) hexchar2int(c); // find the invalid char, and throw error about it
+		_check(false); // kernel rejected valid data?
 	}
-
-	assert( out == retsize ); // all expected positions of data allocated above in .resize() were written
+	if (es != es_even) bytes.back() = hexchar2int( encoded.data.back() ); // "a" is as "0a"
 } catch(std::exception &e) { _erro("Failed to parse string [" << encoded.data <<"]"); _throw_error_rethrow(  ); }
 }
 
@@ -142,11 +252,9 @@ bool operator<( const string_as_bin &a, const string_as_bin &b) {
 // ==================================================================
 
 std::string chardbg(char c) {
-	// this is quite slow
-	std::ostringstream oss;
 	string_as_dbg s;
-	s.print(oss,c);
-	return oss.str();
+	s.append(c);
+	return s.dbg;
 }
 
 // ==================================================================
@@ -156,9 +264,28 @@ string_as_dbg::string_as_dbg(const string_as_bin & bin, t_debug_style style)
 { }
 
 string_as_dbg::string_as_dbg(const char * data, size_t data_size, t_debug_style style)
-	: string_as_dbg( string_as_bin( std::string(data,data_size) ) , style )
+	: string_as_dbg( data , data+data_size , style )
 { }
 
+void string_as_dbg::append(char v) {
+	// same format as print()
+	unsigned char uc = static_cast<unsigned char>(v);
+	if (uc<=9) {
+		const char txt[3] = { '0' , 'x' , static_cast<char>('0'+uc) };
+		dbg.append(txt, 3);
+		return;
+	}
+	if ((uc>=32) && (uc<=127)) { dbg += v; return; } // normal
+	// escape it as 0xHH=DD or 0xHH=DDD
+	const char hex_upper[] = "0123456789ABCDEF";
+	char txt[8] = { '0' , 'x' , hex_upper[uc/16] , hex_upper[uc%16] , '=' };
+	size_t len = 5;
+	if (uc>127) txt[len++] = static_cast<char>('0' + uc/100);
+	txt[len++] = static_cast<char>('0' + (uc/10)%10);
+	txt[len++] = static_cast<char>('0' + uc%10);
+	dbg.append(txt, len);
+}
+
 void string_as_dbg::print(std::ostream & os, char v, t_debug_style style)
 {
 	UNUSED(style); // TODONOW
@@ -195,7 +322,7 @@ const std::string & string_as_dbg::get() const {
 }
 
 std::string to_debug(const std::string & data, t_debug_style style) {
-	return string_as_dbg( string_as_bin( data ) , style ).get();
+	return std::move( string_as_dbg( data.begin() , data.end() , style ).dbg );
 }
 
 std::string to_debug(char data, t_debug_style style) {
@@ -203,7 +330,7 @@ std::string to_debug(char data, t_debug_style style) {
 }
 
 std::string to_debug(const string_as_bin & data, t_debug_style style) {
-	return to_debug( data.bytes , style );
+	return std::move( string_as_dbg( data , style ).dbg );
 }
 
 
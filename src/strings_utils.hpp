@@ -6,6 +6,7 @@
 #include "libs0.hpp"
 
 #include <boost/any.hpp>
+#include <boost/utility/string_ref.hpp>
 
 
 enum t_debug_style {
@@ -17,6 +18,8 @@ enum t_debug_style {
 
 struct string_as_bin;
 
+typedef boost::string_ref t_bytes_view; ///< non-owning view of binary data (e.g. part of received packet) TODO std::string_view in C++17
+
 struct string_as_hex {
 	std::string data; ///< e.g.: "1fab"
 
@@ -35,6 +38,13 @@ unsigned char int2hexchar(unsigned char i); // 15 -> 'f'
 
 unsigned char doublehexchar2int(string s); // "fd" -> 253
 
+/// bulk hex kernels (SSE2 when available, else table based), used by string_as_hex / string_as_bin and debug printing
+/// @{
+void hex_encode(const char * in, size_t in_size, char * out); ///< writes 2*in_size lowercase hex chars to out (no NUL)
+bool hex_decode(const char * in, size_t in_size, char * out); ///< in_size even; writes in_size/2 octets; false on invalid char (then out is undefined)
+void hex_benchmark(size_t seconds_for_test_case); ///< prints speed of the hex and debug printing code
+/// @}
+
 
 struct string_as_bin {
 	std::string bytes;
@@ -85,32 +95,28 @@ struct string_as_dbg {
 		template<class T>
 		explicit string_as_dbg( T it_begin , T it_end, t_debug_style style=e_debug_style_short_devel )
 		{
-			std::ostringstream oss;
-			oss << std::distance(it_begin, it_end) << ':';
-			if (style==e_debug_style_crypto_devel) oss << "{hash=0x" << debug_simple_hash(std::string(it_begin, it_end)) << "}";
-			oss<<'[';
-			bool first=1;
-			size_t size = it_end - it_begin;
+			const size_t size = std::distance(it_begin, it_end);
 			size_t size1 = 8;
 			size_t size2 = 4;
 			if (style==e_debug_style_big) { size1=8192; size2=128; }
+			dbg.reserve( 32 + std::min(size, size1+size2) * 8 ); // enough for most of data without growing
+			dbg += std::to_string(size);
+			dbg += ':';
+			if (style==e_debug_style_crypto_devel) {
+				dbg += "{hash=0x";
+				dbg += debug_simple_hash(std::string(it_begin, it_end));
+				dbg += '}';
+			}
+			dbg += '[';
 			// TODO assert/review pointer operations
 			if (size <= size1+size2) {
-				for (auto it = it_begin ; it!=it_end ; ++it) { if (!first) oss << ','; print(oss,*it);  first=0;  }
+				append_range(it_begin, it_end);
 			} else {
-				{
-					auto b = it_begin, e = std::min(it_end, it_begin+size1);
-					for (auto it = b ; it!=e ; ++it) { if (!first) oss << ','; print(oss,*it);  first=0;  }
-				}
-				oss<<" ... ";
-				first=1;
-				{
-					auto b = std::max(it_begin, it_end - size2), e = it_end;
-					for (auto it = b ; it!=e ; ++it) { if (!first) oss << ','; print(oss,*it);  first=0;  }
-				}
+				append_range(it_begin, std::next(it_begin, size1));
+				dbg += " ... ";
+				append_range(std::next(it_begin, size-size2), it_end);
 			}
-			oss<<']';
-			this->dbg = oss.str();
+			dbg += ']';
 		}
 
 		template<class T, std::size_t N> explicit string_as_dbg( const  typename std::array<T,N> & obj ) : string_as_dbg( obj.begin() , obj.end() ) { }
@@ -119,12 +125,19 @@ struct string_as_dbg {
 		const std::string & get() const;
 
 	private:
-		// print functions side affect: can modify flags of the stream os, e.g. setfill flag
-
-		template<class T>	void print(std::ostream & os, const T & v) { os<<v; }
+		template<class T> void append_range(T b, T e) {
+			bool first=1;
+			for (auto it = b ; it!=e ; ++it) { if (!first) dbg += ','; append(*it);  first=0;  }
+		}
 
+		template<class T> void append(const T & v) { std::ostringstream oss; oss<<v; dbg += oss.str(); } ///< slow, for other types
 
 	public: // for chardbg.  TODO move to class & make friend class
+		void append(char v); ///< appends to dbg one character in debug format, fast - without ostream
+		void append(unsigned char v) { append(static_cast<char>(v)); }
+		void append(signed char v) { append(static_cast<char>(v)); }
+
+		// print functions side affect: can modify flags of the stream os, e.g. setfill flag
 		void print(std::ostream & os, unsigned char v, t_debug_style style=e_debug_style_short_devel );
 		void print(std::ostream & os, signed char v, t_debug_style style=e_debug_style_short_devel );
 		void print(std::ostream & os, char v, t_debug_style style=e_debug_style_short_devel );
@@ -0,0 +1,39 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_cpu_affinity.hpp"
+
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+TEST(cpu_affinity, parse_cpu_list) {
+	EXPECT_EQ( c_cpu_affinity::parse_cpu_list("3") , std::vector<int>({3}) );
+	EXPECT_EQ( c_cpu_affinity::parse_cpu_list("2,3") , std::vector<int>({2,3}) );
+	EXPECT_EQ( c_cpu_affinity::parse_cpu_list("0-3,8") , std::vector<int>({0,1,2,3,8}) );
+	for (const char * bad : { "", "x", "3x", "-1", "3-1", "1-", "1,,2", "5000" }) {
+		EXPECT_THROW( c_cpu_affinity::parse_cpu_list(bad) , std::invalid_argument ) << "for \"" << bad << "\"";
+	}
+}
+
+#ifdef __linux__
+TEST(cpu_affinity, pin_this_thread) {
+	cpu_set_t allowed;
+	ASSERT_EQ( sched_getaffinity(0, sizeof(allowed), &allowed) , 0 );
+	int cpu = 0;
+	while (! CPU_ISSET(cpu, &allowed)) ++cpu; // one that we can use
+
+	std::thread thread([cpu]() { // not to pin the thread of tests
+		EXPECT_TRUE( c_cpu_affinity::pin_this_thread({cpu}) );
+		EXPECT_EQ( sched_getcpu() , cpu );
+		const int node = c_cpu_affinity::get_current_numa_node();
+		if (c_cpu_affinity::get_numa_node_of_cpu(cpu) >= 0) EXPECT_EQ( node , c_cpu_affinity::get_numa_node_of_cpu(cpu) );
+	});
+	thread.join();
+	EXPECT_EQ( c_cpu_affinity::get_numa_node_of_cpu(c_cpu_affinity::cpu_count_max) , -1 );
+}
+#endif
+
@@ -0,0 +1,97 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_flow_compression.hpp"
+
+namespace {
+
+c_haship_addr make_hip(unsigned char last) {
+	c_haship_addr hip;
+	hip.at(0)=0xFD; hip.at(1)=0x42; hip.at(15)=last;
+	return hip;
+}
+
+t_flow_nonce make_nonce(unsigned char prefix, uint64_t counter) {
+	t_flow_nonce nonce;
+	nonce.fill(prefix);
+	flow_compression::nonce_set_counter(nonce, counter);
+	return nonce;
+}
+
+} // namespace
+
+TEST(flow_compression, counter_from_low16) {
+	using flow_compression::counter_from_low16;
+	EXPECT_EQ( counter_from_low16(5, 6) , 6u );
+	EXPECT_EQ( counter_from_low16(5, 3) , 3u ); // a bit reordered
+	EXPECT_EQ( counter_from_low16(0xFFFF, 0x0001) , 0x10001u ); // wrapped low bits
+	EXPECT_EQ( counter_from_low16(0x10001, 0xFFFF) , 0xFFFFu ); // reordered across the wrap
+	EXPECT_EQ( counter_from_low16(0x123450000, 0x0002) , 0x123450002u );
+}
+
+TEST(flow_compression, setup_then_compact_and_decode) {
+	c_flow_tx tx;
+	tx.set_enabled(true);
+	c_flow_rx rx;
+	const auto src = make_hip(1), dst = make_hip(2);
+	const unsigned char ttl = 5;
+
+	for (uint64_t counter = 0xFFF0; counter < 0x10020; ++counter) { // also across the 16 bit wrap
+		const auto nonce = make_nonce(7, counter);
+		t_flow_id flow_id = 0;
+		auto kind = tx.prepare(src, dst, ttl, nonce, flow_id);
+		EXPECT_NE( flow_id , 0 );
+		if (counter < 0xFFF0 + c_flow_tx::setups_to_send) {
+			EXPECT_EQ( kind , c_flow_tx::e_frame_setup );
+			rx.on_setup(flow_id, src, dst, ttl, nonce);
+		} else {
+			EXPECT_EQ( kind , c_flow_tx::e_frame_compact );
+			c_haship_addr src2, dst2; unsigned char ttl2=0; t_flow_nonce nonce2;
+			EXPECT_TRUE( rx.decode(flow_id, counter & 0xFFFF, src2, dst2, ttl2, nonce2) );
+			EXPECT_EQ( src2 , src );
+			EXPECT_EQ( dst2 , dst );
+			EXPECT_EQ( ttl2 , ttl );
+			EXPECT_EQ( nonce2 , nonce );
+		}
+	}
+	EXPECT_EQ( tx.get_flows_count() , 1u );
+}
+
+TEST(flow_compression, resync) {
+	c_flow_tx tx;
+	tx.set_enabled(true);
+	const auto src = make_hip(1), dst = make_hip(2);
+	t_flow_id flow_id = 0;
+	uint64_t counter = 1;
+	for (unsigned int i=0; i<c_flow_tx::setups_to_send; ++i) tx.prepare(src, dst, 5, make_nonce(7, counter++), flow_id);
+	EXPECT_EQ( tx.prepare(src, dst, 5, make_nonce(7, counter++), flow_id) , c_flow_tx::e_frame_compact );
+
+	EXPECT_EQ( tx.prepare(src, dst, 4, make_nonce(7, counter++), flow_id) , c_flow_tx::e_frame_setup ); // TTL changed
+	tx.reset(flow_id); // the receiver lost it
+	EXPECT_EQ( tx.prepare(src, dst, 4, make_nonce(7, counter++), flow_id) , c_flow_tx::e_frame_setup );
+
+	c_flow_rx rx;
+	c_haship_addr src2, dst2; unsigned char ttl2=0; t_flow_nonce nonce2;
+	EXPECT_FALSE( rx.decode(flow_id, 1, src2, dst2, ttl2, nonce2) ); // unknown flow
+
+	c_flow_tx tx_off; // until we know that the peer can decode them
+	EXPECT_EQ( tx_off.prepare(src, dst, 5, make_nonce(7, 1), flow_id) , c_flow_tx::e_frame_full );
+
+	tx.set_enabled(false); // e.g. peer was replaced by older version
+	EXPECT_EQ( tx.prepare(src, dst, 4, make_nonce(7, counter++), flow_id) , c_flow_tx::e_frame_full );
+	EXPECT_EQ( tx.get_flows_count() , 0u );
+	tx.set_enabled(true);
+	EXPECT_EQ( tx.prepare(src, dst, 4, make_nonce(7, counter++), flow_id) , c_flow_tx::e_frame_setup ); // starts again
+}
+
+TEST(flow_compression, new_nonce_prefix_or_jump_needs_setup) {
+	c_flow_tx tx;
+	tx.set_enabled(true);
+	const auto src = make_hip(1), dst = make_hip(2);
+	t_flow_id flow_id = 0;
+	uint64_t counter = 1;
+	for (unsigned int i=0; i<c_flow_tx::setups_to_send; ++i) tx.prepare(src, dst, 5, make_nonce(7, counter++), flow_id);
+	EXPECT_EQ( tx.prepare(src, dst, 5, make_nonce(8, counter++), flow_id) , c_flow_tx::e_frame_setup ); // other tunnel
+	for (unsigned int i=0; i<c_flow_tx::setups_to_send; ++i) tx.prepare(src, dst, 5, make_nonce(8, counter++), flow_id);
+	EXPECT_EQ( tx.prepare(src, dst, 5, make_nonce(8, counter + 0x9000), flow_id) , c_flow_tx::e_frame_setup ); // too far
+}
@@ -0,0 +1,152 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_io_uring.hpp"
+#include "../c_metrics.hpp"
+
+#if IO_URING_AVAILABLE
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace {
+
+int make_udp_socket(unsigned short port) {
+	const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) { close(sock); return -1; }
+	return sock;
+}
+
+void send_to_port(int sock, unsigned short port, const std::string & data) {
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sendto(sock, data.data(), data.size(), 0, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+}
+
+/// waits (at most about 1 s) for next datagram, and takes it
+std::string receive_one(c_io_uring_queue & queue, sockaddr_in6 & from, socklen_t & from_size) {
+	for (int i=0; (i<100) && (!queue.has_udp()); ++i) queue.wait( std::chrono::milliseconds(10) );
+	if (!queue.has_udp()) return "(nothing)";
+	char buf[65536];
+	char control[CMSG_SPACE(sizeof(int))];
+	iovec iov{ buf , sizeof(buf) };
+	msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &from;
+	msg.msg_namelen = sizeof(from);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	const auto size = queue.recvmsg_udp(msg);
+	from_size = msg.msg_namelen;
+	if (size < 0) return "(error)";
+	return std::string(buf, size);
+}
+
+/// io_uring can be missing (old kernel, or forbidden e.g. by seccomp), then there is nothing to test
+std::unique_ptr<c_io_uring_queue> make_queue(int tun_fd, int udp_socket) {
+	try {
+		return std::unique_ptr<c_io_uring_queue>( new c_io_uring_queue(tun_fd, udp_socket) );
+	} catch(const std::runtime_error & ex) {
+		std::cout << "io_uring not available here: " << ex.what() << std::endl;
+		return nullptr;
+	}
+}
+
+} // namespace
+
+TEST(io_uring, tun_reads_keep_packets) {
+	int fds[2]; // packet socket pair (keeps packet boundaries like TUN does) as the TUN
+	ASSERT_EQ( socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) , 0 );
+	const int udp_socket = make_udp_socket(42041);
+	ASSERT_GE(udp_socket, 0);
+	{
+		auto queue = make_queue(fds[0], udp_socket);
+		if (queue) {
+			const size_t packets_count = c_io_uring_queue::tun_reads_count * 3; // each read buffer is used again
+			for (size_t i=0; i<packets_count; ++i) {
+				const std::string packet(100 + i, static_cast<char>('a' + i));
+				ASSERT_EQ( write(fds[1], packet.data(), packet.size()) , static_cast<ssize_t>(packet.size()) );
+				for (int w=0; (w<100) && (!queue->has_tun()); ++w) queue->wait( std::chrono::milliseconds(10) );
+				ASSERT_TRUE( queue->has_tun() );
+				char buf[1000];
+				const auto size = queue->read_tun(buf, sizeof(buf));
+				EXPECT_EQ( std::string(buf, size) , packet );
+			}
+			EXPECT_FALSE( queue->has_tun() );
+			EXPECT_EQ( queue->read_tun(nullptr, 0) , -1 ); // nothing
+		}
+	}
+	close(fds[0]);
+	close(fds[1]);
+	close(udp_socket);
+}
+
+TEST(io_uring, tun_read_too_big_is_counted) {
+	int fds[2];
+	ASSERT_EQ( socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) , 0 );
+	const int udp_socket = make_udp_socket(42044);
+	ASSERT_GE(udp_socket, 0);
+	{
+		auto queue = make_queue(fds[0], udp_socket);
+		if (queue) {
+			auto & truncated = c_metrics::get_instance().get_counter("galaxy_tun_read_truncated_total", "");
+			const auto truncated_before = truncated.get();
+			const std::string packet(300, 'x');
+			ASSERT_EQ( write(fds[1], packet.data(), packet.size()) , static_cast<ssize_t>(packet.size()) );
+			for (int w=0; (w<100) && (!queue->has_tun()); ++w) queue->wait( std::chrono::milliseconds(10) );
+			ASSERT_TRUE( queue->has_tun() );
+			char buf[100];
+			EXPECT_EQ( queue->read_tun(buf, sizeof(buf)) , static_cast<ssize_t>(sizeof(buf)) );
+			EXPECT_EQ( truncated.get() , truncated_before + 1 );
+		}
+	}
+	close(fds[0]);
+	close(fds[1]);
+	close(udp_socket);
+}
+
+TEST(io_uring, udp_more_datagrams_then_buffers) {
+	int fds[2];
+	ASSERT_EQ( socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) , 0 );
+	const int udp_socket = make_udp_socket(42042);
+	const int sender = make_udp_socket(42043);
+	ASSERT_GE(udp_socket, 0);
+	ASSERT_GE(sender, 0);
+	{
+		auto queue = make_queue(fds[0], udp_socket);
+		if (queue) {
+			const size_t count = c_io_uring_queue::udp_buffers_count + 10; // receiving stops when buffers run out, then goes on
+			for (size_t i=0; i<count; ++i) send_to_port(sender, 42042, "datagram " + std::to_string(i));
+			for (size_t i=0; i<count; ++i) {
+				sockaddr_in6 from;
+				socklen_t from_size = 0;
+				EXPECT_EQ( receive_one(*queue, from, from_size) , "datagram " + std::to_string(i) );
+				ASSERT_EQ( from_size , sizeof(sockaddr_in) );
+				EXPECT_EQ( ntohs( reinterpret_cast<sockaddr_in*>(&from)->sin_port ) , 42043 );
+			}
+			send_to_port(sender, 42042, std::string(60000, 'x')); // big one
+			sockaddr_in6 from;
+			socklen_t from_size = 0;
+			EXPECT_EQ( receive_one(*queue, from, from_size) , std::string(60000, 'x') );
+		}
+	}
+	close(fds[0]);
+	close(fds[1]);
+	close(udp_socket);
+	close(sender);
+}
+
+#endif // IO_URING_AVAILABLE
@@ -0,0 +1,147 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_keepalive.hpp"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+
+c_keepalive::t_config get_config_without_jitter() {
+	c_keepalive::t_config config;
+	config.m_jitter = 0;
+	return config;
+}
+
+/// polls it when it is due, till given time; returns the actions
+std::vector<c_keepalive::t_action> run_till(c_keepalive & keepalive, c_keepalive::t_clock::time_point & now,
+	c_keepalive::t_clock::time_point end, bool answer_pings)
+{
+	std::vector<c_keepalive::t_action> actions;
+	while (keepalive.get_due_time() <= end) {
+		now = std::max( now , keepalive.get_due_time() );
+		actions.push_back( keepalive.poll(now, true) );
+		if (answer_pings && (actions.back() != c_keepalive::e_action_none)) keepalive.on_ping_reply();
+	}
+	now = end;
+	return actions;
+}
+
+} // namespace
+
+TEST(keepalive, start_then_back_off) {
+	c_keepalive keepalive(1, get_config_without_jitter());
+	auto now = c_keepalive::t_clock::now();
+	EXPECT_EQ( keepalive.poll(now, false) , c_keepalive::e_action_hello ); // due at once
+	EXPECT_EQ( keepalive.poll(now, false) , c_keepalive::e_action_none ); // not due yet
+	EXPECT_EQ( keepalive.get_due_time() , now + seconds(1) );
+
+	now += seconds(1);
+	EXPECT_EQ( keepalive.poll(now, false) , c_keepalive::e_action_hello ); // we do not have his key yet
+	now += seconds(1);
+	EXPECT_EQ( keepalive.poll(now, false) , c_keepalive::e_action_hello );
+	EXPECT_EQ( keepalive.get_interval() , seconds(3) ); // not backing off without his key
+
+	keepalive.on_ping_reply();
+	now += seconds(3);
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping ); // identities known: only small ping now
+	EXPECT_EQ( keepalive.get_interval() , seconds(6) );
+	const auto actions = run_till(keepalive, now, now + seconds(100), true);
+	EXPECT_EQ( keepalive.get_interval() , c_keepalive::t_config().m_interval_max );
+	EXPECT_LE( actions.size() , 7u ); // 12, 24, 25, 25, 25...
+}
+
+TEST(keepalive, lost_ping_and_traffic) {
+	auto config = get_config_without_jitter();
+	config.m_hello_refresh = hours(1);
+	c_keepalive keepalive(1, config);
+	auto now = c_keepalive::t_clock::now();
+	run_till(keepalive, now, now + seconds(60), true);
+	EXPECT_EQ( keepalive.get_interval() , seconds(25) );
+
+	now = keepalive.get_due_time();
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping ); // this one is lost
+	now = keepalive.get_due_time();
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping );
+	EXPECT_EQ( keepalive.get_interval() , seconds(3) ); // probe fast again
+
+	for (int i=0; i<3; ++i) { // he sends us traffic all the time: nothing to send (and link is alive)
+		keepalive.on_received();
+		now = keepalive.get_due_time();
+		EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_none );
+	}
+	EXPECT_EQ( keepalive.get_interval() , seconds(24) );
+	keepalive.on_received();
+	now = keepalive.get_due_time();
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping ); // but measure the link sometimes
+}
+
+TEST(keepalive, hello_answer_and_refresh) {
+	c_keepalive keepalive(1, get_config_without_jitter());
+	auto now = c_keepalive::t_clock::now();
+	auto actions = run_till(keepalive, now, now + seconds(30), true);
+	EXPECT_EQ( std::count(actions.begin(), actions.end(), c_keepalive::e_action_hello) , 2 );
+
+	const auto planned = keepalive.get_due_time();
+	keepalive.on_hello_received(now); // he restarted
+	EXPECT_EQ( keepalive.get_due_time() , now );
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_hello );
+	EXPECT_EQ( keepalive.get_due_time() , planned ); // the plan stays
+	keepalive.on_hello_received(now + milliseconds(500)); // his hello crossed ours
+	EXPECT_EQ( keepalive.get_due_time() , planned );
+
+	actions = run_till(keepalive, now, now + seconds(150), true);
+	EXPECT_EQ( std::count(actions.begin(), actions.end(), c_keepalive::e_action_hello) , 1 ); // refresh
+}
+
+TEST(keepalive, hello_answer_is_a_ping) {
+	c_keepalive keepalive(1, get_config_without_jitter());
+	auto now = c_keepalive::t_clock::now();
+	run_till(keepalive, now, now + seconds(60), true);
+	EXPECT_EQ( keepalive.get_interval() , c_keepalive::t_config().m_interval_max );
+
+	keepalive.on_hello_received(now);
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_hello ); // with ping, that is not answered
+	now = keepalive.get_due_time();
+	keepalive.poll(now, true);
+	EXPECT_EQ( keepalive.get_interval() , c_keepalive::t_config().m_interval_min ); // it was lost
+}
+
+TEST(keepalive, lost_ping_is_sent_again_at_once) {
+	auto config = get_config_without_jitter();
+	config.m_hello_refresh = hours(1);
+	c_keepalive keepalive(1, config);
+	auto now = c_keepalive::t_clock::now();
+	run_till(keepalive, now, now + seconds(120), true); // backed off
+	EXPECT_EQ( keepalive.get_interval() , c_keepalive::t_config().m_interval_max );
+	keepalive.on_received(); // he sends us traffic, so we would not ping him
+	now += milliseconds(100);
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_none ); // not due
+
+	now = keepalive.get_due_time();
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping ); // measures the link now and then
+	now += milliseconds(200);
+	keepalive.on_received();
+	keepalive.on_ping_lost(now); // e.g. c_link_quality::get_rto() passed
+	EXPECT_EQ( keepalive.get_due_time() , now );
+	EXPECT_EQ( keepalive.poll(now, true) , c_keepalive::e_action_ping );
+	EXPECT_EQ( keepalive.get_interval() , c_keepalive::t_config().m_interval_min );
+}
+
+TEST(keepalive, jitter) {
+	const auto now = c_keepalive::t_clock::now();
+	std::set<c_keepalive::t_clock::time_point> due;
+	for (uint32_t seed=1; seed<=20; ++seed) {
+		c_keepalive keepalive(seed);
+		keepalive.poll(now, true);
+		EXPECT_GE( keepalive.get_due_time() , now + milliseconds(800) );
+		EXPECT_LE( keepalive.get_due_time() , now + milliseconds(1200) );
+		due.insert( keepalive.get_due_time() );
+	}
+	EXPECT_GT( due.size() , 10u ); // not all at once
+}
+
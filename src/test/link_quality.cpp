@@ -0,0 +1,95 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_link_quality.hpp"
+
+using namespace std::chrono;
+
+TEST(link_quality, not_measured_costs_one_hop) {
+	c_link_quality link;
+	EXPECT_FALSE( link.is_measured() );
+	EXPECT_EQ( link.get_route_cost() , c_link_quality::cost_per_hop );
+}
+
+TEST(link_quality, rtt_and_jitter) {
+	c_link_quality link;
+	auto now = c_link_quality::t_clock::now();
+	for (int i=0; i<50; ++i) {
+		auto sent = now;
+		auto seq = link.on_ping_sent(sent);
+		now += milliseconds(100);
+		EXPECT_TRUE( link.on_ping_reply(seq, sent, now) );
+		now += seconds(1);
+	}
+	EXPECT_TRUE( link.is_measured() );
+	EXPECT_NEAR( link.get_rtt_ms() , 100 , 1 );
+	EXPECT_LT( link.get_jitter_ms() , 1 );
+	EXPECT_NEAR( link.get_loss() , 0 , 0.001 );
+	EXPECT_EQ( link.get_route_cost() , c_link_quality::cost_per_hop + 100 / c_link_quality::cost_per_rtt_ms_div );
+}
+
+TEST(link_quality, slower_and_lossy_link_costs_more) {
+	c_link_quality fast, slow, lossy;
+	auto now = c_link_quality::t_clock::now();
+	for (int i=0; i<50; ++i) {
+		auto sent = now;
+		auto seq_fast = fast.on_ping_sent(sent);
+		auto seq_slow = slow.on_ping_sent(sent);
+		auto seq_lossy = lossy.on_ping_sent(sent);
+		EXPECT_TRUE( fast.on_ping_reply(seq_fast, sent, now + milliseconds(5)) );
+		EXPECT_TRUE( slow.on_ping_reply(seq_slow, sent, now + milliseconds(300)) );
+		if (i%3) { EXPECT_TRUE( lossy.on_ping_reply(seq_lossy, sent, now + milliseconds(5)) ); }
+		now += seconds(3); // previous not answered pings are timed out now
+	}
+	EXPECT_LT( fast.get_route_cost() , slow.get_route_cost() );
+	EXPECT_LT( fast.get_route_cost() , lossy.get_route_cost() );
+	EXPECT_GT( lossy.get_loss() , 0.2 );
+	EXPECT_LE( slow.get_route_cost() , c_link_quality::cost_max );
+}
+
+TEST(link_quality, ignores_unexpected_replies) {
+	c_link_quality link;
+	auto now = c_link_quality::t_clock::now();
+	auto seq = link.on_ping_sent(now);
+	EXPECT_FALSE( link.on_ping_reply(seq+1, now, now + milliseconds(10)) ); // not sent
+	EXPECT_FALSE( link.on_ping_reply(seq, now - milliseconds(1), now + milliseconds(10)) ); // bad timestamp
+	EXPECT_TRUE( link.on_ping_reply(seq, now, now + milliseconds(10)) );
+	EXPECT_FALSE( link.on_ping_reply(seq, now, now + milliseconds(10)) ); // duplicate
+}
+
+TEST(link_quality, down_after_lost_pings_in_row) {
+	c_link_quality link;
+	auto now = c_link_quality::t_clock::now();
+	EXPECT_TRUE( link.is_up() );
+	for (unsigned int i=0; i<c_link_quality::lost_in_row_down; ++i) { // not answered
+		EXPECT_TRUE( link.is_up() );
+		link.on_ping_sent(now);
+		now += seconds(3);
+	}
+	auto seq = link.on_ping_sent(now); // the last one is counted as lost now
+	EXPECT_FALSE( link.is_up() );
+	EXPECT_TRUE( link.on_ping_reply(seq, now, now + milliseconds(10)) );
+	EXPECT_TRUE( link.is_up() ); // one answer is enough
+}
+
+TEST(link_quality, ping_lost_after_rto) {
+	c_link_quality link;
+	auto now = c_link_quality::t_clock::now();
+	EXPECT_EQ( link.get_rto() , seconds(2) ); // not measured yet
+	EXPECT_EQ( link.get_due_time() , c_link_quality::t_clock::time_point::max() );
+	for (int i=0; i<20; ++i) {
+		auto seq = link.on_ping_sent(now);
+		EXPECT_TRUE( link.on_ping_reply(seq, now, now + milliseconds(50)) );
+		now += seconds(1);
+	}
+	EXPECT_GE( link.get_rto() , milliseconds(50) );
+	EXPECT_LE( link.get_rto() , milliseconds(c_link_quality::rto_min_ms) ); // stable RTT, so the minimum
+
+	const auto sent = now;
+	link.on_ping_sent(sent);
+	EXPECT_EQ( link.get_due_time() , sent + link.get_rto() );
+	EXPECT_FALSE( link.on_timer( link.get_due_time() - milliseconds(1) ) );
+	EXPECT_TRUE( link.on_timer( link.get_due_time() ) ); // lost without waiting for the next ping
+	EXPECT_EQ( link.get_due_time() , c_link_quality::t_clock::time_point::max() );
+	EXPECT_GT( link.get_loss() , 0.1 );
+}
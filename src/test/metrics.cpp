@@ -0,0 +1,98 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_metrics.hpp"
+
+#include <thread>
+
+TEST(metrics, counter_many_threads) {
+	c_metric_counter counter;
+	const int threads_count = 12, count = 100000; // more threads then slots
+	std::vector<std::thread> threads;
+	for (int t=0; t<threads_count; ++t) threads.emplace_back([&counter]() { for (int i=0; i<count; ++i) counter.add(); });
+	for (auto & thread : threads) thread.join();
+	EXPECT_EQ( counter.get() , static_cast<uint64_t>(threads_count) * count );
+	counter.add(5);
+	EXPECT_EQ( counter.get() , static_cast<uint64_t>(threads_count) * count + 5 );
+}
+
+TEST(metrics, histogram_buckets) {
+	size_t index_prev = 0;
+	for (uint64_t value=0; value < (1ULL << 20); value += 1 + value/50) {
+		const auto index = c_metric_histogram::get_bucket_index(value);
+		ASSERT_LT( index , c_metric_histogram::buckets_count );
+		EXPECT_GE( index , index_prev ); // buckets are in order
+		EXPECT_LE( value , c_metric_histogram::get_bucket_max(index) );
+		if (index) EXPECT_GT( value , c_metric_histogram::get_bucket_max(index - 1) );
+		EXPECT_LE( c_metric_histogram::get_bucket_max(index) , value + value / c_metric_histogram::sub_buckets_count ); // HDR: relative error
+		index_prev = index;
+	}
+	EXPECT_EQ( c_metric_histogram::get_bucket_index(1ULL << 40) , c_metric_histogram::overflow_bucket );
+	EXPECT_EQ( c_metric_histogram::get_bucket_index(1ULL << 32) , c_metric_histogram::overflow_bucket );
+	EXPECT_LT( c_metric_histogram::get_bucket_index((1ULL << 32) - 1) , c_metric_histogram::overflow_bucket ); // the last normal one
+	EXPECT_EQ( c_metric_histogram::get_bucket_max( c_metric_histogram::get_bucket_index((1ULL << 32) - 1) ) , (1ULL << 32) - 1 );
+
+	c_metric_histogram histogram;
+	histogram.add( std::chrono::microseconds(3) );
+	histogram.add( std::chrono::milliseconds(20) );
+	histogram.add( std::chrono::microseconds(-1) ); // counted as 0
+	EXPECT_EQ( histogram.get_count() , 3u );
+	EXPECT_EQ( histogram.get_sum_us() , 20003u );
+	EXPECT_EQ( histogram.get_bucket_count( c_metric_histogram::get_bucket_index(20000) ) , 1u );
+}
+
+TEST(metrics, export_prometheus) {
+	c_metrics metrics;
+	metrics.get_counter("test_packets_total", "Packets", c_metrics::t_labels{ {"peer","a\"b"} }).add(3);
+	auto & counter = metrics.get_counter("test_packets_total", "(ignored)", c_metrics::t_labels{ {"peer","c"} });
+	EXPECT_EQ( & counter , & metrics.get_counter("test_packets_total", "", c_metrics::t_labels{ {"peer","c"} }) ); // the same one
+	metrics.get_gauge("test_peers", "Peers").set(-2);
+	metrics.get_histogram("test_time_seconds", "Time").add( std::chrono::microseconds(1500) );
+	EXPECT_THROW( metrics.get_gauge("test_packets_total", ""), std::invalid_argument );
+
+	const std::string text = metrics.export_prometheus();
+	auto has = [&text](const std::string & line) { return text.find(line + '\n') != std::string::npos; };
+	EXPECT_TRUE( has("# HELP test_packets_total Packets") );
+	EXPECT_TRUE( has("# TYPE test_packets_total counter") );
+	EXPECT_TRUE( has("test_packets_total{peer=\"a\\\"b\"} 3") );
+	EXPECT_TRUE( has("test_packets_total{peer=\"c\"} 0") );
+	EXPECT_TRUE( has("# TYPE test_peers gauge") );
+	EXPECT_TRUE( has("test_peers -2") );
+	EXPECT_TRUE( has("# TYPE test_time_seconds histogram") );
+	EXPECT_TRUE( has("test_time_seconds_bucket{le=\"0.001408\"} 0") );
+	EXPECT_TRUE( has("test_time_seconds_bucket{le=\"0.001536\"} 1") );
+	EXPECT_TRUE( has("test_time_seconds_bucket{le=\"+Inf\"} 1") );
+	EXPECT_TRUE( has("test_time_seconds_sum 0.001500") );
+	EXPECT_TRUE( has("test_time_seconds_count 1") );
+}
+
+TEST(metrics, histogram_overflow_in_export) {
+	c_metrics metrics;
+	auto & histogram = metrics.get_histogram("test_time_seconds", "Time");
+	histogram.add( std::chrono::hours(2) ); // over 2^32 us
+	EXPECT_EQ( histogram.get_bucket_count( c_metric_histogram::overflow_bucket ) , 1u );
+	const std::string text = metrics.export_prometheus();
+	auto has = [&text](const std::string & line) { return text.find(line + '\n') != std::string::npos; };
+	EXPECT_TRUE( has("test_time_seconds_bucket{le=\"4294.967296\"} 0") ); // the last normal bucket
+	EXPECT_TRUE( has("test_time_seconds_bucket{le=\"+Inf\"} 1") );
+	EXPECT_TRUE( has("test_time_seconds_count 1") );
+}
+
+TEST(metrics, remove_labeled) {
+	c_metrics metrics;
+	const c_metrics::t_labels peer_a{ {"peer","a"} , {"addr","1.2.3.4:9042"} };
+	metrics.get_counter("test_packets_total", "Packets", peer_a).add(3);
+	metrics.get_gauge("test_mtu", "MTU", peer_a).set(1400);
+	metrics.get_counter("test_packets_total", "Packets", c_metrics::t_labels{ {"peer","ab"} , {"addr","1.2.3.5:9042"} }).add(4);
+	metrics.get_counter("test_dropped_total", "Dropped", c_metrics::t_labels{ {"addr","1.2.3.4:9042"} , {"class","data"} }).add(5);
+	metrics.get_counter("test_other_total", "Other", c_metrics::t_labels{ {"reason","a"} }).add(6); // other label, same value
+
+	EXPECT_EQ( metrics.remove_labeled("peer", "a") , 2u );
+	EXPECT_EQ( metrics.remove_labeled("addr", "1.2.3.4:9042") , 1u );
+	EXPECT_EQ( metrics.remove_labeled("peer", "a") , 0u );
+	const std::string text = metrics.export_prometheus();
+	EXPECT_EQ( text.find("peer=\"a\"") , std::string::npos );
+	EXPECT_EQ( text.find("1.2.3.4") , std::string::npos );
+	EXPECT_NE( text.find("test_packets_total{peer=\"ab\",addr=\"1.2.3.5:9042\"} 4") , std::string::npos );
+	EXPECT_NE( text.find("test_other_total{reason=\"a\"} 6") , std::string::npos );
+}
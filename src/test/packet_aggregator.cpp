@@ -0,0 +1,93 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_packet_aggregator.hpp"
+
+namespace {
+
+std::string make_frame(size_t size, char fill) {
+	std::string frame(size, fill);
+	frame.at(0) = c_protocol::current_version;
+	frame.at(1) = c_protocol::e_proto_cmd_tunneled_data;
+	return frame;
+}
+
+std::vector<std::string> split_to_strings(const std::string & datagram) {
+	std::vector<std::string> frames;
+	for (const auto & frame : c_packet_aggregator::split( datagram.data() , datagram.size() )) {
+		frames.push_back( datagram.substr( frame.m_offset , frame.m_size ) );
+	}
+	return frames;
+}
+
+} // namespace
+
+TEST(packet_aggregator, disabled_by_default) {
+	c_packet_aggregator aggregator;
+	std::string ready;
+	const auto frame = make_frame(50, 'a');
+	EXPECT_FALSE( aggregator.add( frame.data() , frame.size() , c_packet_aggregator::t_clock::now() , ready ) );
+	EXPECT_FALSE( aggregator.is_pending() );
+}
+
+TEST(packet_aggregator, packs_and_splits) {
+	c_packet_aggregator aggregator;
+	aggregator.set_max_delay( std::chrono::microseconds(200) );
+	const auto now = c_packet_aggregator::t_clock::now();
+	std::vector<std::string> frames{ make_frame(50,'a') , make_frame(2,'b') , make_frame(100,'c') };
+	std::string ready;
+	for (const auto & frame : frames) {
+		EXPECT_TRUE( aggregator.add( frame.data() , frame.size() , now , ready ) );
+		EXPECT_TRUE( ready.empty() );
+	}
+	EXPECT_TRUE( aggregator.is_pending() );
+	EXPECT_FALSE( aggregator.is_due( now + std::chrono::microseconds(199) ) );
+	EXPECT_TRUE( aggregator.is_due( now + std::chrono::microseconds(200) ) );
+
+	const auto datagram = aggregator.flush();
+	EXPECT_FALSE( aggregator.is_pending() );
+	EXPECT_EQ( datagram.at(1) , c_protocol::e_proto_cmd_aggregated );
+	EXPECT_EQ( split_to_strings( datagram ) , frames );
+	const auto views = c_packet_aggregator::split( datagram.data() , datagram.size() );
+	ASSERT_EQ( views.size() , frames.size() );
+	EXPECT_EQ( views.at(0).m_offset , c_packet_aggregator::header_size + c_packet_aggregator::frame_header_size ); // in place, not copied
+	EXPECT_EQ( views.at(1).m_offset , views.at(0).m_offset + views.at(0).m_size + c_packet_aggregator::frame_header_size );
+	EXPECT_TRUE( aggregator.flush().empty() );
+}
+
+TEST(packet_aggregator, single_frame_is_sent_as_it_is) {
+	c_packet_aggregator aggregator;
+	aggregator.set_max_delay( std::chrono::microseconds(100) );
+	const auto frame = make_frame(60, 'x');
+	std::string ready;
+	EXPECT_TRUE( aggregator.add( frame.data() , frame.size() , c_packet_aggregator::t_clock::now() , ready ) );
+	EXPECT_EQ( aggregator.flush() , frame );
+}
+
+TEST(packet_aggregator, full_datagram_is_given_back) {
+	c_packet_aggregator aggregator;
+	aggregator.set_max_delay( std::chrono::microseconds(100) );
+	aggregator.set_datagram_size_max( 300 );
+	const auto now = c_packet_aggregator::t_clock::now();
+	const auto frame = make_frame(100, 'x');
+	std::string ready;
+	EXPECT_TRUE( aggregator.add( frame.data() , frame.size() , now , ready ) );
+	EXPECT_TRUE( aggregator.add( frame.data() , frame.size() , now , ready ) );
+	EXPECT_TRUE( ready.empty() );
+	EXPECT_TRUE( aggregator.add( frame.data() , frame.size() , now , ready ) ); // does not fit, previous two are ready
+	EXPECT_LE( ready.size() , 300u );
+	EXPECT_EQ( c_packet_aggregator::split( ready.data() , ready.size() ).size() , 2u );
+	EXPECT_EQ( aggregator.flush() , frame );
+
+	const auto frame_big = make_frame(200, 'y');
+	EXPECT_FALSE( aggregator.add( frame_big.data() , frame_big.size() , now , ready ) ); // big frames go alone
+}
+
+TEST(packet_aggregator, split_rejects_bad_data) {
+	std::string datagram{ c_protocol::current_version , c_protocol::e_proto_cmd_aggregated , 0 , 10 , 1 , 2 };
+	EXPECT_ANY_THROW( c_packet_aggregator::split( datagram.data() , datagram.size() ) ); // truncated
+
+	std::string nested{ c_protocol::current_version , c_protocol::e_proto_cmd_aggregated , 0 , 2 ,
+		c_protocol::current_version , c_protocol::e_proto_cmd_aggregated };
+	EXPECT_ANY_THROW( c_packet_aggregator::split( nested.data() , nested.size() ) );
+}
@@ -0,0 +1,71 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_path_mtu.hpp"
+
+using namespace std::chrono;
+
+namespace {
+
+/// runs probes over a path that passes datagrams up to path_size, for given time; returns count of probes sent
+size_t run_path(c_path_mtu & pmtu, c_path_mtu::t_clock::time_point & now, size_t path_size, c_path_mtu::t_clock::duration time) {
+	size_t probes = 0;
+	const auto end = now + time;
+	for (; now < end; now += milliseconds(100)) {
+		size_t size = 0;
+		while (pmtu.get_probe(now, size)) {
+			++probes;
+			if (size <= path_size) pmtu.on_probe_reply(size, now + milliseconds(50));
+			else break; // lost, will be retried after timeout
+		}
+	}
+	return probes;
+}
+
+} // namespace
+
+TEST(path_mtu, finds_the_size) {
+	auto now = c_path_mtu::t_clock::now();
+	c_path_mtu full;
+	EXPECT_EQ( full.get_size() , c_path_mtu::size_base ); // before we know
+	EXPECT_EQ( run_path(full, now, 1500, seconds(5)) , 1u ); // the biggest one passed at once
+	EXPECT_EQ( full.get_size() , c_path_mtu::size_max_default );
+	EXPECT_FALSE( full.is_searching() );
+
+	c_path_mtu lte; // e.g. LTE link with tunnels inside
+	run_path(lte, now, 1400, seconds(60));
+	EXPECT_LE( lte.get_size() , 1400u );
+	EXPECT_GT( lte.get_size() + c_path_mtu::size_step , 1400u );
+	EXPECT_FALSE( lte.is_searching() );
+
+	c_path_mtu small;
+	run_path(small, now, 1000, seconds(60)); // less then minimum: we can not do better then the base
+	EXPECT_EQ( small.get_size() , c_path_mtu::size_base );
+
+	c_path_mtu off(c_path_mtu::size_base); // nothing to probe
+	EXPECT_EQ( run_path(off, now, 1500, seconds(5)) , 0u );
+}
+
+TEST(path_mtu, revalidate_and_too_big) {
+	auto now = c_path_mtu::t_clock::now();
+	c_path_mtu pmtu;
+	run_path(pmtu, now, 1500, seconds(5));
+	EXPECT_EQ( pmtu.get_size() , c_path_mtu::size_max_default );
+
+	run_path(pmtu, now, 1300, minutes(11)); // path changed: found at revalidation
+	EXPECT_LE( pmtu.get_size() , 1300u );
+	EXPECT_GT( pmtu.get_size() + c_path_mtu::size_step , 1300u );
+
+	run_path(pmtu, now, 1500, minutes(11)); // and back
+	EXPECT_EQ( pmtu.get_size() , c_path_mtu::size_max_default );
+
+	c_path_mtu local;
+	size_t size = 0;
+	ASSERT_TRUE( local.get_probe(now, size) );
+	EXPECT_FALSE( local.on_probe_too_big(size, now) ); // size stays the base
+	ASSERT_TRUE( local.get_probe(now, size) ); // next one at once
+	EXPECT_LT( size , c_path_mtu::size_max_default );
+	EXPECT_TRUE( local.on_probe_reply(size, now) );
+	EXPECT_EQ( local.get_size() , size );
+}
+
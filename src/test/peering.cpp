@@ -0,0 +1,141 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_peering.hpp"
+#include "../c_program_clock.hpp"
+#include "../protocol_messages.hpp"
+#include "../trivialserialize.hpp"
+
+namespace {
+
+class c_udp_wrapper_record final : public c_udp_wrapper { ///< remembers what was sent, and as which flow
+	public:
+		struct t_sent {
+			std::string m_data;
+			c_send_scheduler::t_flow m_flow;
+		};
+		std::vector<t_sent> m_sent;
+
+		void send_data(const c_ip46_addr &dst_address, const void *data, size_t size_of_data) override {
+			send_data_scheduled(dst_address, data, size_of_data, c_send_scheduler::e_class_data, 0);
+		}
+		void send_data_scheduled(const c_ip46_addr &dst_address, const void *data, size_t size_of_data,
+			c_send_scheduler::t_class send_class, c_send_scheduler::t_flow flow) override
+		{
+			UNUSED(dst_address); UNUSED(send_class);
+			m_sent.push_back( t_sent{ std::string( static_cast<const char*>(data) , size_of_data ) , flow } );
+		}
+		size_t receive_data(void *data_buf, const size_t data_buf_size, c_ip46_addr &from_address) override {
+			UNUSED(data_buf); UNUSED(data_buf_size); UNUSED(from_address);
+			return 0;
+		}
+};
+
+std::string make_frame(size_t size, char fill) {
+	std::string frame(size, fill);
+	frame.at(0) = static_cast<char>( c_protocol::current_version );
+	frame.at(1) = static_cast<char>( c_protocol::e_proto_cmd_tunneled_data );
+	return frame;
+}
+
+c_haship_addr make_hip(unsigned char last) {
+	c_haship_addr hip;
+	hip.at(0)=0xFD; hip.at(1)=0x42; hip.at(15)=last;
+	return hip;
+}
+
+std::string make_flow_frame(t_flow_id flow_id, uint16_t nonce_low, const std::string & blob) { ///< e_proto_cmd_tunneled_data_flow
+	typedef protocol_messages::tunneled_data_flow t_msg;
+	trivialserialize::generator gen(100);
+	gen.push_byte_u( c_protocol::current_version );
+	gen.push_byte_u( c_protocol::e_proto_cmd_tunneled_data_flow );
+	t_msg::encode( gen , t_msg::t_values( flow_id , nonce_low , t_bytes_view(blob) ) );
+	return gen.str_move();
+}
+
+bool is_aggregated(const c_udp_wrapper_record::t_sent & sent) {
+	return static_cast<unsigned char>( sent.m_data.at(1) ) == c_protocol::e_proto_cmd_aggregated;
+}
+
+} // namespace
+
+TEST(peering, aggregated_frames_are_not_overtaken_by_their_flow) {
+	c_udp_wrapper_record udp;
+	c_peering_udp peer( t_peering_reference( c_ip46_addr::create_ipv4("127.0.0.1", 9042) , "fd42::1" ) , udp );
+	peer.set_aggregation_delay( std::chrono::milliseconds(10) );
+	peer.set_protocol_version( c_protocol::current_version );
+
+	const std::string small = make_frame(100, 'a'), big = make_frame(800, 'b'); // big one is not aggregated
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	peer.send_data_udp_frame( small.data() , small.size() , 8 );
+	EXPECT_TRUE( udp.m_sent.empty() ); // they wait for more
+
+	peer.send_data_udp_frame( big.data() , big.size() , 8 ); // the waiting ones go before it, in the queue of its flow
+	ASSERT_EQ( udp.m_sent.size() , 2u );
+	EXPECT_TRUE( is_aggregated( udp.m_sent.at(0) ) );
+	EXPECT_EQ( udp.m_sent.at(0).m_flow , 8u );
+	EXPECT_EQ( udp.m_sent.at(1).m_data , big );
+	EXPECT_EQ( udp.m_sent.at(1).m_flow , 8u );
+
+	peer.send_data_udp_frame( small.data() , small.size() , 9 );
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	peer.aggregation_flush_if_due( c_program_clock::now() + std::chrono::seconds(1) );
+	ASSERT_EQ( udp.m_sent.size() , 3u );
+	EXPECT_TRUE( is_aggregated( udp.m_sent.at(2) ) );
+	EXPECT_EQ( udp.m_sent.at(2).m_flow , 9u ); // as its first frame
+}
+
+TEST(peering, aggregated_frames_only_to_peer_that_can_split_them) {
+	c_udp_wrapper_record udp;
+	c_peering_udp peer( t_peering_reference( c_ip46_addr::create_ipv4("127.0.0.1", 9042) , "fd42::1" ) , udp );
+	peer.set_aggregation_delay( std::chrono::milliseconds(10) );
+
+	const std::string small = make_frame(100, 'a');
+	peer.send_data_udp_frame( small.data() , small.size() , 7 ); // we did not hear from him yet
+	peer.set_protocol_version( 1 );
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	ASSERT_EQ( udp.m_sent.size() , 2u );
+	EXPECT_EQ( udp.m_sent.at(0).m_data , small );
+	EXPECT_EQ( udp.m_sent.at(1).m_data , small );
+
+	peer.set_protocol_version( c_protocol::version_min_compact_frames );
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	EXPECT_EQ( udp.m_sent.size() , 2u ); // they wait for more
+	peer.set_protocol_version( 1 ); // replaced by older node: nothing is left waiting
+	ASSERT_EQ( udp.m_sent.size() , 3u );
+	peer.send_data_udp_frame( small.data() , small.size() , 7 );
+	ASSERT_EQ( udp.m_sent.size() , 4u );
+	EXPECT_EQ( udp.m_sent.at(3).m_data , small );
+}
+
+TEST(peering, relayed_compact_frames_only_get_our_flow_id) {
+	typedef protocol_messages::tunneled_data_flow t_msg;
+	c_udp_wrapper_record udp;
+	c_peering_udp nexthop( t_peering_reference( c_ip46_addr::create_ipv4("127.0.0.1", 9042) , "fd42::1" ) , udp );
+	nexthop.set_protocol_version( c_protocol::current_version );
+	const auto src = make_hip(1), dst = make_hip(2);
+	const std::string blob = "encrypted-packet";
+	t_flow_nonce nonce;
+	nonce.fill(7);
+
+	for (uint64_t counter = 1; counter <= c_flow_tx::setups_to_send + 3; ++counter) {
+		flow_compression::nonce_set_counter(nonce, counter);
+		std::string frame = make_flow_frame( 77 , static_cast<uint16_t>(counter) , blob ); // as the relay got it (his flow id)
+		const std::string frame_received = frame;
+		nexthop.send_data_udp_relayed( & frame.at(0) , frame.size() , t_bytes_view(blob) , src , dst , 4 , nonce , 5 );
+		ASSERT_EQ( udp.m_sent.size() , counter );
+		const std::string & sent = udp.m_sent.back().m_data;
+		if (counter <= c_flow_tx::setups_to_send) { // the next hop must learn our flow first
+			EXPECT_EQ( static_cast<unsigned char>( sent.at(1) ) , c_protocol::e_proto_cmd_tunneled_data_flow_setup );
+			continue;
+		}
+		ASSERT_EQ( sent.size() , frame_received.size() ); // fast path: the same frame...
+		EXPECT_EQ( sent.substr(4) , frame_received.substr(4) );
+		t_msg::t_values msg;
+		ASSERT_TRUE( t_msg::decode( sent.data() + 2 , sent.size() - 2 , msg ) );
+		EXPECT_NE( std::get<t_msg::e_flow_id>(msg) , 77 ); // ...with flow id of ours (to the next hop)
+		EXPECT_EQ( std::get<t_msg::e_nonce_low>(msg) , counter );
+	}
+}
+
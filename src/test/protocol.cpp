@@ -0,0 +1,19 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../protocol.hpp"
+
+TEST(protocol, command_is_valid_in_version) {
+	for (auto cmd : { c_protocol::e_proto_cmd_tunneled_data_flow_setup , c_protocol::e_proto_cmd_tunneled_data_flow ,
+		c_protocol::e_proto_cmd_tunneled_data_flow_reset , c_protocol::e_proto_cmd_aggregated ,
+		c_protocol::e_proto_cmd_findhip_query , c_protocol::e_proto_cmd_findhip_reply })
+	{
+		EXPECT_FALSE( c_protocol::command_is_valid_in_version( cmd , 1 ) ) << "command " << static_cast<int>(cmd);
+		EXPECT_TRUE( c_protocol::command_is_valid_in_version( cmd , 2 ) ) << "command " << static_cast<int>(cmd);
+	}
+	EXPECT_TRUE( c_protocol::command_is_valid_in_version( c_protocol::e_proto_cmd_tunneled_data , 1 ) );
+	EXPECT_TRUE( c_protocol::command_is_valid_in_version( c_protocol::e_proto_cmd_public_ping_request , 1 ) );
+	EXPECT_FALSE( c_protocol::command_is_valid_in_version( c_protocol::e_proto_cmd_tunneled_data , 0 ) );
+	EXPECT_FALSE( c_protocol::command_is_valid_in_version( c_protocol::e_proto_cmd_tunneled_data , c_protocol::current_version + 1 ) );
+}
+
@@ -0,0 +1,248 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../tunserver.hpp"
+
+namespace {
+
+class c_galaxy_node_no_peers : public c_galaxy_node { ///< node without direct peers, so only the learned routes are used
+	public:
+		void nodep2p_foreach_cmd( c_protocol::t_proto_cmd cmd, string_as_bin data ) override { UNUSED(cmd); UNUSED(data); }
+		const c_peering & get_peer_with_hip( c_haship_addr addr , bool require_pubkey ) override {
+			UNUSED(addr); UNUSED(require_pubkey);
+			_throw_error( expected_not_found() );
+		}
+};
+
+c_haship_addr make_hip(unsigned char last) {
+	c_haship_addr hip;
+	hip.at(0)=0xFD; hip.at(1)=0x42; hip.at(15)=last;
+	return hip;
+}
+
+c_routing_manager::c_route_reason make_reason() {
+	return c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet );
+}
+
+} // namespace
+
+TEST(routing, multipath_spreads_flows_and_keeps_them_stable) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(10) , 2 , c_haship_pubkey() ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(11) , 2 , c_haship_pubkey() ) );
+
+	std::map<c_haship_addr, int> used;
+	for (c_routing_manager::t_flow_hash flow=0; flow<200; ++flow) {
+		auto via = routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop;
+		EXPECT_EQ( via , routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop ); // same flow, same path
+		++used[via];
+	}
+	EXPECT_EQ( used.size() , 2u );
+}
+
+TEST(routing, multipath_failover_moves_only_flows_of_dead_path) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	for (unsigned char i=10; i<13; ++i) {
+		routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(i) , 3 , c_haship_pubkey() ) );
+	}
+
+	std::map<c_routing_manager::t_flow_hash, c_haship_addr> before;
+	for (c_routing_manager::t_flow_hash flow=0; flow<200; ++flow) {
+		before[flow] = routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop;
+	}
+
+	routing.set_nexthop_state( make_hip(11) , c_routing_manager::e_route_state_dead );
+	for (const auto & flow_path : before) {
+		auto via = routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow_path.first).m_nexthop;
+		EXPECT_NE( via , make_hip(11) );
+		if (flow_path.second != make_hip(11)) { EXPECT_EQ( via , flow_path.second ); }
+	}
+
+	routing.set_nexthop_state( make_hip(10) , c_routing_manager::e_route_state_dead );
+	routing.set_nexthop_state( make_hip(12) , c_routing_manager::e_route_state_dead );
+	EXPECT_THROW( routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, 0) , std::runtime_error );
+
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(12) , 3 , c_haship_pubkey() ) ); // path is back
+	EXPECT_EQ( routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, 0).m_nexthop , make_hip(12) );
+}
+
+TEST(routing, failover_by_link_liveness) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(10) , 3 , c_haship_pubkey() ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(11) , 3 , c_haship_pubkey() ) );
+	auto via = [&](c_routing_manager::t_flow_hash flow) {
+		return routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop;
+	};
+	c_routing_manager::t_flow_hash flow_via_10 = 0;
+	while (via(flow_via_10) != make_hip(10)) ++flow_via_10;
+
+	c_link_quality link; // to next hop 10, that stops answering (as c_tunserver::peering_link_state_update() does)
+	auto now = c_link_quality::t_clock::now();
+	while (link.is_up()) {
+		link.on_ping_sent(now);
+		now += std::chrono::seconds(3);
+		routing.set_nexthop_link_up( make_hip(10) , link.is_up() );
+	}
+	for (c_routing_manager::t_flow_hash flow=0; flow<50; ++flow) EXPECT_EQ( via(flow) , make_hip(11) ); // all on surviving path
+	EXPECT_FALSE( routing.set_nexthop_link_up( make_hip(10) , false ) ); // no change
+
+	routing.add_route_info_and_return( make_hip(2) , c_routing_manager::c_route_info( make_hip(10) , 3 , c_haship_pubkey() ) );
+	EXPECT_FALSE( routing.m_route_nexthop.at( make_hip(2) ).is_any_alive() ); // learned via the dead link: not used
+
+	auto seq = link.on_ping_sent(now);
+	EXPECT_TRUE( link.on_ping_reply(seq, now, now + std::chrono::milliseconds(10)) );
+	EXPECT_TRUE( routing.set_nexthop_link_up( make_hip(10) , link.is_up() ) );
+	EXPECT_EQ( via(flow_via_10) , make_hip(10) ); // the flow is back
+	EXPECT_TRUE( routing.m_route_nexthop.at( make_hip(2) ).is_any_alive() );
+}
+
+TEST(routing, failover_within_rto_of_lost_pings) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(10) , 3 , c_haship_pubkey() ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(11) , 3 , c_haship_pubkey() ) );
+	auto via = [&](c_routing_manager::t_flow_hash flow) {
+		return routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop;
+	};
+	c_routing_manager::t_flow_hash flow_via_10 = 0;
+	while (via(flow_via_10) != make_hip(10)) ++flow_via_10;
+
+	c_link_quality link; // to next hop 10
+	auto now = c_link_quality::t_clock::now();
+	for (int i=0; i<10; ++i) { // answered, RTT 10ms
+		auto seq = link.on_ping_sent(now);
+		EXPECT_TRUE( link.on_ping_reply(seq, now, now + std::chrono::milliseconds(10)) );
+		now += std::chrono::seconds(25);
+	}
+	const auto rto = link.get_rto();
+	EXPECT_EQ( rto , std::chrono::milliseconds(c_link_quality::rto_min_ms) );
+
+	const auto stopped = now; // it stops answering; as c_tunserver::peering_keepalive() does:
+	link.on_ping_sent(now);
+	while (link.is_up()) {
+		now = link.get_due_time(); // no reply within RTO
+		ASSERT_TRUE( link.on_timer(now) );
+		routing.set_nexthop_link_up( make_hip(10) , link.is_up() );
+		if (link.is_up()) link.on_ping_sent(now); // c_keepalive::on_ping_lost(): ping again at once
+	}
+	EXPECT_LE( now - stopped , rto * c_link_quality::lost_in_row_down ); // not after seconds of keepalive interval
+	EXPECT_EQ( via(flow_via_10) , make_hip(11) ); // the flow moved
+}
+
+TEST(routing, multipath_keeps_only_best_paths) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	for (unsigned char i=0; i<c_routing_manager::route_nexthop_max+2; ++i) {
+		routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(20+i) , 100 - 10*i , c_haship_pubkey() ) );
+	}
+	const auto & paths = routing.m_route_nexthop.at(dst).m_route;
+	EXPECT_EQ( paths.size() , c_routing_manager::route_nexthop_max );
+	for (const auto & path : paths) EXPECT_LE( path->get_cost() , 100 - 10*2 );
+
+	// cheapest path wins for all flows, when other paths cost more
+	const auto cheapest = make_hip( 20 + c_routing_manager::route_nexthop_max + 1 );
+	for (c_routing_manager::t_flow_hash flow=0; flow<50; ++flow) {
+		EXPECT_EQ( routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop , cheapest );
+	}
+}
+
+TEST(routing, fast_path_chooses_the_same_nexthop) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(10) , 3 , c_haship_pubkey() ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(11) , 4 , c_haship_pubkey() ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(12) , 9 , c_haship_pubkey() ) ); // too costly
+
+	auto expect_same = [&]() { // as c_tunserver::forward_transit_fast() chooses from its forwarding table
+		const auto nexthops = routing.get_nexthops_for_flows( dst );
+		ASSERT_FALSE( nexthops.empty() );
+		for (c_routing_manager::t_flow_hash flow=0; flow<200; ++flow) {
+			EXPECT_EQ( nexthops.at( c_routing_manager::choose_nexthop_for_flow( nexthops , flow * 7919 ) ) ,
+				routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow * 7919).m_nexthop );
+		}
+	};
+	EXPECT_EQ( routing.get_nexthops_for_flows( dst ).size() , 2u );
+	expect_same();
+	routing.set_nexthop_state( make_hip(10) , c_routing_manager::e_route_state_dead );
+	expect_same(); // now 11 and 12 are used
+	EXPECT_EQ( routing.get_nexthops_for_flows( dst ).size() , 2u );
+	EXPECT_TRUE( routing.get_nexthops_for_flows( make_hip(2) ).empty() );
+}
+
+TEST(routing, small_cost_changes_do_not_change_generation) {
+	c_routing_manager routing;
+	const auto peer = make_hip(10);
+	routing.add_route_info_and_return( peer , c_routing_manager::c_route_info( peer , 20 , c_haship_pubkey() ) );
+	const auto generation = routing.get_generation();
+	for (int cost : { 21, 19, 22, 20 }) { // as direct peer is looked up with cost from RTT that jitters
+		routing.add_route_info_and_return( peer , c_routing_manager::c_route_info( peer , cost , c_haship_pubkey() ) );
+		EXPECT_FALSE( routing.set_nexthop_link_cost( peer , cost ) );
+	}
+	EXPECT_EQ( routing.get_generation() , generation );
+
+	routing.add_route_info_and_return( peer , c_routing_manager::c_route_info( peer , 20 + c_routing_manager::route_cost_hysteresis , c_haship_pubkey() ) );
+	EXPECT_NE( routing.get_generation() , generation );
+}
+
+TEST(routing, learned_routes_follow_cost_of_link) {
+	c_galaxy_node_no_peers node;
+	c_routing_manager routing;
+	const auto dst = make_hip(1);
+	// learned from two peers (as from findhip reply): their cost 10, plus link to them
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(10) , 10+10 , c_haship_pubkey() , 10 ) );
+	routing.add_route_info_and_return( dst , c_routing_manager::c_route_info( make_hip(11) , 10+11 , c_haship_pubkey() , 11 ) );
+	EXPECT_EQ( routing.get_nexthops_for_flows( dst ).size() , 2u );
+
+	const auto generation = routing.get_generation();
+	EXPECT_TRUE( routing.set_nexthop_link_cost( make_hip(10) , 30 ) ); // link to 10 got slow
+	EXPECT_NE( routing.get_generation() , generation );
+	EXPECT_EQ( routing.get_nexthops_for_flows( dst ) , std::vector<c_haship_addr>({ make_hip(11) }) );
+	for (c_routing_manager::t_flow_hash flow=0; flow<50; ++flow) {
+		EXPECT_EQ( routing.get_route_or_maybe_search(node, dst, make_reason(), false, 0, flow).m_nexthop , make_hip(11) );
+	}
+
+	EXPECT_TRUE( routing.set_nexthop_link_cost( make_hip(10) , 10 ) ); // and fast again
+	EXPECT_EQ( routing.get_nexthops_for_flows( dst ).size() , 2u );
+}
+
+TEST(routing, adding_path_moves_only_flows_to_it) {
+	std::vector<c_haship_addr> nexthops{ make_hip(10) , make_hip(11) };
+	std::vector<c_haship_addr> before;
+	for (c_routing_manager::t_flow_hash flow=0; flow<300; ++flow) {
+		before.push_back( nexthops.at( c_routing_manager::choose_nexthop_for_flow( nexthops , flow ) ) );
+	}
+	nexthops.insert( nexthops.begin() , make_hip(12) ); // also the order of next hops does not matter
+	size_t moved = 0;
+	for (c_routing_manager::t_flow_hash flow=0; flow<300; ++flow) {
+		const auto via = nexthops.at( c_routing_manager::choose_nexthop_for_flow( nexthops , flow ) );
+		if (via != before.at(flow)) { EXPECT_EQ( via , make_hip(12) ); ++moved; }
+	}
+	EXPECT_GT( moved , 50u ); // about 1/3 of them
+	EXPECT_LT( moved , 150u );
+}
+
+TEST(routing, flow_hash_of_ipv6) {
+	std::string packet(48, '\0');
+	packet.at(0) = 0x60;  packet.at(6) = 17; // UDP
+	packet.at(8) = static_cast<char>(0xFD);  packet.at(24) = static_cast<char>(0xFD);
+	packet.at(43) = 53; // dst port
+	auto hash1 = c_routing_manager::flow_hash_of_ipv6( packet.data() , packet.size() );
+	EXPECT_EQ( hash1 , c_routing_manager::flow_hash_of_ipv6( packet.data() , packet.size() ) );
+
+	packet.at(45) = 1; // payload is not part of the flow
+	EXPECT_EQ( hash1 , c_routing_manager::flow_hash_of_ipv6( packet.data() , packet.size() ) );
+
+	packet.at(41) = 7; // other source port - other flow
+	EXPECT_NE( hash1 , c_routing_manager::flow_hash_of_ipv6( packet.data() , packet.size() ) );
+
+	EXPECT_NO_THROW( c_routing_manager::flow_hash_of_ipv6( packet.data() , 3 ) ); // short packet
+}
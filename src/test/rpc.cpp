@@ -0,0 +1,204 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../rpc/rpc.hpp"
+#include "../rpc/c_mpsc_queue.hpp"
+
+#include <condition_variable>
+#include <limits>
+#include <thread>
+
+TEST(rpc, mpsc_queue_many_producers) {
+	c_mpsc_queue<std::pair<int,int>> queue; // (producer, number)
+	const int producers = 4, count = 20000;
+	std::vector<std::thread> threads;
+	for (int p=0; p<producers; ++p) {
+		threads.emplace_back([&queue, p]() { for (int i=0; i<count; ++i) queue.push( std::make_pair(p, i) ); });
+	}
+	std::vector<int> next(producers, 0); // order of each producer is kept
+	int received = 0;
+	while (received < producers*count) {
+		std::pair<int,int> value;
+		if (! queue.pop_wait(value, std::chrono::seconds(10))) break;
+		EXPECT_EQ( value.second , next.at(value.first) );
+		next.at(value.first) = value.second + 1;
+		++received;
+	}
+	for (auto & thread : threads) thread.join();
+	EXPECT_EQ( received , producers*count );
+	EXPECT_TRUE( queue.empty() );
+}
+
+TEST(rpc, mpsc_queue_wait) {
+	c_mpsc_queue<std::string> queue;
+	std::string value;
+	const auto start = std::chrono::steady_clock::now();
+	EXPECT_FALSE( queue.pop_wait(value, std::chrono::milliseconds(20)) );
+	EXPECT_GE( std::chrono::steady_clock::now() - start , std::chrono::milliseconds(20) );
+
+	std::thread waker([&queue]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); queue.wakeup(); });
+	EXPECT_FALSE( queue.pop_wait(value, std::chrono::seconds(10)) ); // woken up much sooner
+	waker.join();
+	EXPECT_LT( std::chrono::steady_clock::now() - start , std::chrono::seconds(5) );
+
+	std::thread pusher([&queue]() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); queue.push("abc"); });
+	EXPECT_TRUE( queue.pop_wait(value, std::chrono::seconds(10)) );
+	EXPECT_EQ( value , "abc" );
+	pusher.join();
+}
+
+TEST(rpc, server_runs_handlers_at_once) {
+	std::mutex mtx;
+	std::condition_variable cv;
+	int running = 0, finished = 0;
+	auto handler = [&](const std::string &) { // returns only when other one is running too
+		std::unique_lock<std::mutex> lg(mtx);
+		++running;
+		cv.notify_all();
+		const bool both = cv.wait_for(lg, std::chrono::seconds(10), [&]{ return running >= 2; });
+		++finished;
+		cv.notify_all();
+		return both;
+	};
+	{
+		c_rpc_server rpc_server(42010, 2);
+		rpc_server.register_function("block", handler);
+		send_tcp_msg("block;a", "127.0.0.1", 42010);
+		send_tcp_msg("block;b", "127.0.0.1", 42010);
+		std::unique_lock<std::mutex> lg(mtx);
+		EXPECT_TRUE( cv.wait_for(lg, std::chrono::seconds(20), [&]{ return finished == 2; }) );
+	}
+	EXPECT_EQ( running , 2 );
+}
+
+TEST(rpc, client_pipelined_calls_on_one_connection) {
+	c_rpc_server rpc_server(42011, 4);
+	rpc_server.register_function("is_even", [](const std::string &arguments) { return std::stoi(arguments) % 2 == 0; });
+	asio_node::c_rpc_client client;
+	std::vector<std::future<std::string>> replies;
+	for (int i=0; i<200; ++i) replies.push_back( client.call("127.0.0.1", 42011, "is_even", std::to_string(i)) ); // not waiting
+	for (int i=0; i<200; ++i) {
+		ASSERT_EQ( replies.at(i).wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+		EXPECT_EQ( replies.at(i).get() , (i%2 == 0) ? "1" : "0" ); // matched to its request, though handlers run in any order
+	}
+	EXPECT_EQ( client.get_connection_count() , 1u );
+
+	auto unknown = client.call("127.0.0.1", 42011, "no_such_function", "");
+	ASSERT_EQ( unknown.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_EQ( unknown.get() , "!unknown command" );
+}
+
+TEST(rpc, client_connection_failed) {
+	asio_node::c_rpc_client client;
+	EXPECT_ANY_THROW( client.call("127.0.0.1", 42012, "x", "") ); // nobody listens
+	EXPECT_ANY_THROW( client.call("not-an-ip", 42012, "x", "") );
+	EXPECT_EQ( client.get_connection_count() , 0u );
+}
+TEST(rpc, client_over_ipv6) {
+	c_rpc_server rpc_server(42014, 1);
+	rpc_server.register_function("is_even", [](const std::string &arguments) { return std::stoi(arguments) % 2 == 0; });
+	asio_node::c_rpc_client client;
+	std::future<std::string> reply;
+	try {
+		reply = client.call("::1", 42014, "is_even", "4");
+	} catch (const std::exception &err) { // e.g. IPv6 is disabled here
+		std::cout << "IPv6 not available here: " << err.what() << std::endl;
+		return;
+	}
+	ASSERT_EQ( reply.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_EQ( reply.get() , "1" );
+	auto reply_ipv4 = client.call("127.0.0.1", 42014, "is_even", "3"); // the server takes both
+	ASSERT_EQ( reply_ipv4.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_EQ( reply_ipv4.get() , "0" );
+}
+
+TEST(rpc, client_refuses_too_big_reply) {
+	boost::asio::io_service io_service;
+	boost::asio::ip::tcp::acceptor acceptor(io_service,
+		boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 42015));
+	std::thread server([&acceptor, &io_service]() { // says that reply has 4 GB
+		boost::asio::ip::tcp::socket socket(io_service);
+		acceptor.accept(socket);
+		const uint32_t size = std::numeric_limits<uint32_t>::max();
+		boost::asio::write(socket, boost::asio::buffer(&size, sizeof(size)));
+		char request[100];
+		boost::system::error_code ignored;
+		while (socket.read_some(boost::asio::buffer(request), ignored) > 0) { } // till the client closes
+	});
+	asio_node::c_rpc_client client;
+	auto reply = client.call("127.0.0.1", 42015, "x", "");
+	ASSERT_EQ( reply.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_ANY_THROW( reply.get() );
+	EXPECT_EQ( client.get_connection_count() , 0u ); // closed
+	server.join();
+}
+
+TEST(rpc, binary_frame_round_trip) {
+	using namespace rpc_binary;
+	const t_args args{ t_value(true), t_value(int64_t(-5)), t_value(std::numeric_limits<int64_t>::min()), t_value(uint64_t(300)),
+		t_value(std::string("a b;\0c", 6)), t_value(std::vector<std::string>{ "x", "", "y z" }) };
+	const auto frame = encode_requests( std::vector<t_request>{ t_request{ 7, "cmd", args }, t_request{ 1000000, "", t_args() } } );
+	EXPECT_TRUE( is_binary_frame(frame) );
+	const auto requests = decode_requests(frame);
+	ASSERT_EQ( requests.size() , 2u );
+	EXPECT_EQ( requests.at(0).m_id , 7u );
+	EXPECT_EQ( requests.at(0).m_command , "cmd" );
+	EXPECT_TRUE( requests.at(0).m_args == args );
+	EXPECT_EQ( requests.at(1).m_id , 1000000u );
+	EXPECT_TRUE( requests.at(1).m_args.empty() );
+	EXPECT_EQ( to_text(args.at(1)) , "-5" );
+	EXPECT_EQ( to_text(args.at(5)) , "x,,y z" );
+
+	EXPECT_ANY_THROW( decode_responses(frame) ); // other kind
+	EXPECT_ANY_THROW( decode_requests(frame.substr(0, frame.size() - 1)) );
+	EXPECT_ANY_THROW( decode_requests(frame + 'x') );
+	EXPECT_FALSE( is_binary_frame("#1;cmd;") );
+
+	const auto responses = decode_responses( encode_responses( std::vector<t_response>{ t_response{ 3, e_status_partial, args } } ) );
+	ASSERT_EQ( responses.size() , 1u );
+	EXPECT_EQ( responses.at(0).m_status , e_status_partial );
+	EXPECT_TRUE( responses.at(0).m_values == args );
+}
+
+TEST(rpc, client_batch_and_streamed_result) {
+	using namespace rpc_binary;
+	c_rpc_server rpc_server(42013, 2);
+	rpc_server.register_function("sum", [](const t_args &arguments, c_rpc_reply_stream &) {
+		int64_t sum = 0;
+		for (const auto &value : arguments) sum += boost::get<int64_t>(value); // throws if other type
+		return t_args{ t_value(sum) };
+	});
+	rpc_server.register_function("count", [](const t_args &arguments, c_rpc_reply_stream &reply) {
+		const auto count = boost::get<uint64_t>(arguments.at(0));
+		for (uint64_t i=0; i<count; ++i) reply.send_partial( t_args{ t_value(std::to_string(i)) } );
+		return t_args{ t_value(std::string("end")) };
+	});
+	rpc_server.register_function("echo", [](const std::string &arguments) { return arguments == "a b;c d"; }); // text function
+
+	asio_node::c_rpc_client client;
+	std::vector<std::string> parts;
+	auto replies = client.call_batch("127.0.0.1", 42013, std::vector<asio_node::c_rpc_client::t_call>{
+		{ "sum", t_args{ t_value(int64_t(-3)), t_value(int64_t(10)) }, nullptr },
+		{ "count", t_args{ t_value(uint64_t(100)) }, [&parts](const t_args &part) { parts.push_back(to_text(part)); } },
+		{ "echo", t_args{ t_value(std::string("a b")), t_value(std::string("c d")) }, nullptr },
+		{ "sum", t_args{ t_value(std::string("x")) }, nullptr },
+		{ "no_such_function", t_args(), nullptr },
+	});
+	ASSERT_EQ( replies.size() , 5u );
+	for (auto &reply : replies) ASSERT_EQ( reply.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_TRUE( replies.at(0).get() == t_args{ t_value(int64_t(7)) } );
+	EXPECT_TRUE( replies.at(1).get() == t_args{ t_value(std::string("end")) } );
+	ASSERT_EQ( parts.size() , 100u ); // all parts came before the end, in order
+	for (size_t i=0; i<parts.size(); ++i) EXPECT_EQ( parts.at(i) , std::to_string(i) );
+	EXPECT_TRUE( replies.at(2).get() == t_args{ t_value(true) } );
+	EXPECT_ANY_THROW( replies.at(3).get() );
+	EXPECT_ANY_THROW( replies.at(4).get() );
+
+	auto text = client.call("127.0.0.1", 42013, "echo", "a b;c d"); // text request keeps the spaces too
+	ASSERT_EQ( text.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_EQ( text.get() , "1" );
+	auto text_streamed = client.call("127.0.0.1", 42013, "count", ""); // typed function gets bytes, so it fails
+	ASSERT_EQ( text_streamed.wait_for(std::chrono::seconds(10)) , std::future_status::ready );
+	EXPECT_EQ( text_streamed.get().at(0) , '!' );
+	EXPECT_EQ( client.get_connection_count() , 1u );
+}
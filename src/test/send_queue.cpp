@@ -0,0 +1,70 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_send_queue.hpp"
+
+using std::chrono::milliseconds;
+
+TEST(send_queue, tail_drop) {
+	c_send_queue::t_limits limits;
+	limits.m_packets_max = 3;
+	limits.m_bytes_max = 1000;
+	limits.m_policy = c_send_queue::e_drop_tail;
+	c_send_queue queue(limits);
+	const auto now = c_send_queue::t_clock::now();
+	EXPECT_TRUE( queue.push("a", 0, now) );
+	EXPECT_TRUE( queue.push("b", 0, now) );
+	EXPECT_TRUE( queue.push("c", 0, now) );
+	EXPECT_FALSE( queue.push("d", 0, now) ); // too many
+	EXPECT_EQ( queue.get_dropped_tail() , 1u );
+	EXPECT_EQ( queue.size() , 3u );
+	EXPECT_EQ( queue.get_bytes() , 3u );
+
+	const auto later = now + std::chrono::seconds(10); // tail drop does not care how long they wait
+	for (const std::string expected : { "a", "b", "c" }) {
+		auto item = queue.front(later);
+		ASSERT_NE(item, nullptr);
+		EXPECT_EQ(item->m_data, expected);
+		queue.pop();
+	}
+	EXPECT_EQ( queue.front(later) , nullptr );
+	EXPECT_TRUE( queue.push(std::string(999, 'x'), 0, later) );
+	EXPECT_FALSE( queue.push("yy", 0, later) ); // too many bytes
+	EXPECT_EQ( queue.get_dropped_tail() , 2u );
+	EXPECT_EQ( queue.get_dropped_codel() , 0u );
+}
+
+TEST(send_queue, codel_drops_standing_queue) {
+	c_send_queue::t_limits limits; // CoDel, 5 ms target, 100 ms interval
+	c_send_queue queue(limits);
+	auto now = c_send_queue::t_clock::now();
+	for (int i=0; i<100; ++i) queue.push(std::to_string(i), 0, now);
+
+	// delay over target, but not yet for whole interval: nothing is dropped
+	now += milliseconds(10);
+	ASSERT_NE( queue.front(now) , nullptr );
+	now += milliseconds(50);
+	ASSERT_NE( queue.front(now) , nullptr );
+	EXPECT_EQ( queue.get_dropped_codel() , 0u );
+	EXPECT_EQ( queue.size() , 100u );
+
+	now += milliseconds(60); // over target for more then interval: drops
+	ASSERT_NE( queue.front(now) , nullptr );
+	EXPECT_EQ( queue.get_dropped_codel() , 1u );
+	EXPECT_EQ( queue.front(now)->m_data , "1" ); // from head
+	EXPECT_EQ( queue.get_dropped_codel() , 1u ); // next drop only after interval/sqrt(count)
+
+	for (int i=0; i<10; ++i) { now += milliseconds(100); queue.front(now); } // goes on, faster and faster
+	const auto dropped = queue.get_dropped_codel();
+	EXPECT_GT( dropped , 10u );
+	EXPECT_EQ( queue.size() , 100u - dropped );
+
+	// fresh datagrams (short delay) stop the dropping
+	while (!queue.empty()) queue.pop();
+	queue.push("new", 0, now);
+	queue.push("new2", 0, now);
+	now += milliseconds(1);
+	ASSERT_NE( queue.front(now) , nullptr );
+	EXPECT_EQ( queue.get_dropped_codel() , dropped );
+	EXPECT_EQ( queue.front(now)->m_data , "new" );
+}
@@ -0,0 +1,120 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_send_scheduler.hpp"
+
+#include <map>
+
+namespace {
+
+std::string send_next(c_send_scheduler & scheduler, c_send_scheduler::t_clock::time_point now, c_ip46_addr & address) {
+	auto item = scheduler.front(now, address);
+	if (item == nullptr) return "";
+	std::string data = item->m_data;
+	scheduler.pop();
+	return data;
+}
+
+} // namespace
+
+TEST(send_scheduler, control_goes_first) {
+	c_send_scheduler scheduler;
+	const auto now = c_send_scheduler::t_clock::now();
+	const auto peer1 = c_ip46_addr::create_ipv4("192.168.1.1", 9042);
+	const auto peer2 = c_ip46_addr::create_ipv4("192.168.1.2", 9042);
+	for (int i=0; i<10; ++i) scheduler.push(c_send_scheduler::e_class_data, peer1, 1, std::string(1000, 'd'), 0, now);
+	scheduler.push(c_send_scheduler::e_class_control, peer2, 0, "hello", 0, now);
+	scheduler.push(c_send_scheduler::e_class_control, peer1, 0, "ping", 0, now);
+	EXPECT_EQ( scheduler.get_queued(c_send_scheduler::e_class_data) , 10u );
+	EXPECT_EQ( scheduler.get_queued(c_send_scheduler::e_class_control) , 2u );
+
+	c_ip46_addr address;
+	EXPECT_EQ( send_next(scheduler, now, address) , "hello" ); // before all the data, and in its order
+	EXPECT_EQ( address.get_assign_port() , 9042 );
+	EXPECT_FALSE( address < peer2 || peer2 < address );
+	EXPECT_EQ( send_next(scheduler, now, address) , "ping" );
+	EXPECT_EQ( send_next(scheduler, now, address).size() , 1000u );
+	scheduler.push(c_send_scheduler::e_class_control, peer1, 0, "reply", 0, now); // also when data is being sent already
+	EXPECT_EQ( send_next(scheduler, now, address) , "reply" );
+
+	while (! send_next(scheduler, now, address).empty()) { }
+	EXPECT_TRUE( scheduler.empty() );
+	const auto & stats = scheduler.get_stats();
+	EXPECT_EQ( stats.m_sent[c_send_scheduler::e_class_control] , 3u );
+	EXPECT_EQ( stats.m_sent[c_send_scheduler::e_class_data] , 10u );
+	EXPECT_EQ( stats.m_queued_bytes[c_send_scheduler::e_class_data] , 0u );
+}
+
+TEST(send_scheduler, data_is_shared_fairly) {
+	c_send_scheduler::t_limits limits;
+	limits.m_data.m_policy = c_send_queue::e_drop_tail;
+	limits.m_quantum = 1000;
+	c_send_scheduler scheduler(limits);
+	const auto now = c_send_scheduler::t_clock::now();
+	const auto bulk = c_ip46_addr::create_ipv4("10.0.0.1", 9042);
+	const auto other = c_ip46_addr::create_ipv4("10.0.0.1", 9043); // same IP, other port: other destination
+	for (int i=0; i<100; ++i) scheduler.push(c_send_scheduler::e_class_data, bulk, 7, std::string(1000, 'b'), 0, now);
+	for (int i=0; i<10; ++i) scheduler.push(c_send_scheduler::e_class_data, other, 7, std::string(500, 'o'), 0, now);
+
+	std::map<int, size_t> bytes; // by port
+	c_ip46_addr address;
+	for (int i=0; i<12; ++i) {
+		const size_t size = send_next(scheduler, now, address).size();
+		bytes[ address.get_assign_port() ] += size;
+	}
+	EXPECT_EQ( bytes[9042] , 4000u ); // equal bytes: 1000 in each round for each, though "bulk" has much more waiting
+	EXPECT_EQ( bytes[9043] , 4000u );
+
+	// flows of one destination share it fairly too
+	c_send_scheduler flows(limits);
+	for (int i=0; i<50; ++i) flows.push(c_send_scheduler::e_class_data, bulk, 1, std::string(500, 'a'), 0, now);
+	for (int i=0; i<50; ++i) flows.push(c_send_scheduler::e_class_data, bulk, 2, std::string(500, 'b'), 0, now);
+	flows.push(c_send_scheduler::e_class_data, bulk, 3, std::string(500, 'c'), 0, now);
+	std::string order;
+	for (int i=0; i<7; ++i) order += send_next(flows, now, address).at(0);
+	EXPECT_EQ( order , "aabbcaa" ); // the new small flow does not wait behind the others
+}
+
+TEST(send_scheduler, limits) {
+	c_send_scheduler::t_limits limits;
+	limits.m_data.m_packets_max = 3;
+	limits.m_control_packets_max = 1;
+	c_send_scheduler scheduler(limits);
+	size_t dropped_seen = 0;
+	scheduler.set_on_drop( [&](const c_ip46_addr &, c_send_scheduler::t_class, c_send_scheduler::t_drop_reason reason, uint64_t count) {
+		EXPECT_EQ( reason , c_send_scheduler::e_drop_tail );
+		dropped_seen += count;
+	} );
+	const auto now = c_send_scheduler::t_clock::now();
+	const auto peer1 = c_ip46_addr::create_ipv4("10.0.0.1", 9042);
+	const auto peer2 = c_ip46_addr::create_ipv4("10.0.0.2", 9042);
+	for (int flow=0; flow<4; ++flow) scheduler.push(c_send_scheduler::e_class_data, peer1, flow, "x", 0, now); // limit is for all flows
+	EXPECT_TRUE( scheduler.push(c_send_scheduler::e_class_data, peer2, 0, "y", 0, now) ); // other peer has own limit
+	EXPECT_TRUE( scheduler.push(c_send_scheduler::e_class_control, peer2, 0, "c", 0, now) );
+	EXPECT_FALSE( scheduler.push(c_send_scheduler::e_class_control, peer2, 0, "c", 0, now) );
+	EXPECT_EQ( dropped_seen , 2u );
+	EXPECT_EQ( scheduler.get_stats().m_dropped_tail[c_send_scheduler::e_class_data] , 1u );
+	EXPECT_EQ( scheduler.get_stats().m_dropped_tail[c_send_scheduler::e_class_control] , 1u );
+	EXPECT_EQ( scheduler.get_queued(c_send_scheduler::e_class_data) , 4u );
+}
+
+TEST(send_scheduler, split_gso_batch_stays_first) {
+	c_send_scheduler scheduler;
+	const auto now = c_send_scheduler::t_clock::now();
+	const auto peer1 = c_ip46_addr::create_ipv4("192.168.1.1", 9042);
+	scheduler.push(c_send_scheduler::e_class_data, peer1, 1, "aaabbbcc", 3, now); // GSO batch of 3 datagrams
+	scheduler.push(c_send_scheduler::e_class_data, peer1, 1, "next", 0, now);
+
+	c_ip46_addr address;
+	auto item = scheduler.front(now, address);
+	ASSERT_NE( item , nullptr );
+	EXPECT_EQ( item->m_segment_size , 3u );
+	scheduler.split_front(); // e.g. GSO failed, and socket is full now: nothing of it is lost
+	EXPECT_EQ( scheduler.get_queued(c_send_scheduler::e_class_data) , 4u );
+	EXPECT_EQ( send_next(scheduler, now, address) , "aaa" );
+	EXPECT_EQ( send_next(scheduler, now, address) , "bbb" );
+	EXPECT_EQ( send_next(scheduler, now, address) , "cc" );
+	EXPECT_EQ( send_next(scheduler, now, address) , "next" );
+	EXPECT_TRUE( scheduler.empty() );
+	EXPECT_EQ( scheduler.get_stats().m_queued_bytes[c_send_scheduler::e_class_data] , 0u );
+}
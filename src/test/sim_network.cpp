@@ -0,0 +1,84 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../simulator/c_sim_network.hpp"
+
+namespace {
+
+typedef c_program_clock::t_clock t_clock;
+
+const t_clock::time_point time_start( std::chrono::hours(1) );
+
+std::string receive_all(c_sim_network & network, c_sim_network::t_node node) { ///< concatenated data of all waiting datagrams
+	std::string ret;
+	char buf[100];
+	c_ip46_addr from;
+	while (network.is_inbox_pending(node)) {
+		auto size = network.receive(node, buf, sizeof(buf), from);
+		ret.append(buf, size);
+	}
+	return ret;
+}
+
+} // namespace
+
+TEST(sim_network, latency_and_order) {
+	c_program_clock::set_virtual_time( time_start );
+	c_sim_network network(1);
+	auto a = network.add_node(), b = network.add_node(), c = network.add_node();
+	network.add_link(a, b, t_sim_link_params( std::chrono::milliseconds(10) , 0 , 0 ));
+
+	network.send(a, c_sim_network::get_node_addr(b), "xy", 2);
+	network.send(a, c_sim_network::get_node_addr(b), "z", 1);
+	network.send(a, c_sim_network::get_node_addr(c), "no", 2); // no link a-c
+	EXPECT_EQ( network.get_stats().no_link , 1u );
+
+	t_clock::time_point next;
+	ASSERT_TRUE( network.get_next_delivery_time(next) );
+	EXPECT_EQ( next , time_start + std::chrono::milliseconds(10) );
+	EXPECT_TRUE( network.deliver_due( time_start + std::chrono::milliseconds(9) ).empty() );
+	EXPECT_EQ( network.deliver_due( next ) , std::vector<c_sim_network::t_node>{ b } );
+	EXPECT_EQ( receive_all(network, b) , "xyz" );
+	EXPECT_FALSE( network.get_next_delivery_time(next) );
+
+	c_sim_network::t_node node = 0;
+	EXPECT_TRUE( c_sim_network::get_node_by_addr( c_sim_network::get_node_addr(c) , node ) );
+	EXPECT_EQ( node , c );
+	c_program_clock::set_real_time();
+}
+
+TEST(sim_network, bandwidth_queues) {
+	c_program_clock::set_virtual_time( time_start );
+	c_sim_network network(1);
+	auto a = network.add_node(), b = network.add_node();
+	network.add_link(a, b, t_sim_link_params( std::chrono::milliseconds(0) , 0 , 8000 )); // 1000 octets per second
+	const std::string data(100, 'x'); // so 100 ms each
+	network.send(a, c_sim_network::get_node_addr(b), data.data(), data.size());
+	network.send(a, c_sim_network::get_node_addr(b), data.data(), data.size());
+	network.send(b, c_sim_network::get_node_addr(a), data.data(), data.size()); // other direction has own bandwidth
+
+	t_clock::time_point next;
+	ASSERT_TRUE( network.get_next_delivery_time(next) );
+	EXPECT_EQ( next , time_start + std::chrono::milliseconds(100) );
+	EXPECT_EQ( network.deliver_due( next ).size() , 2u );
+	ASSERT_TRUE( network.get_next_delivery_time(next) );
+	EXPECT_EQ( next , time_start + std::chrono::milliseconds(200) ); // waited for the first one
+	c_program_clock::set_real_time();
+}
+
+TEST(sim_network, loss) {
+	c_program_clock::set_virtual_time( time_start );
+	c_sim_network network(1);
+	auto a = network.add_node(), b = network.add_node();
+	network.add_link(a, b, t_sim_link_params( std::chrono::milliseconds(1) , 0.25 , 0 ));
+	const int count = 4000;
+	for (int i=0; i<count; ++i) network.send(a, c_sim_network::get_node_addr(b), "x", 1);
+	const auto lost = network.get_stats().lost;
+	EXPECT_GT( lost , count * 0.2 );
+	EXPECT_LT( lost , count * 0.3 );
+	network.deliver_due( time_start + std::chrono::seconds(1) );
+	EXPECT_EQ( receive_all(network, b).size() , count - lost );
+	EXPECT_EQ( network.get_stats().sent_by_cmd.at(-1) , static_cast<uint64_t>(count) ); // too short for CMD
+	c_program_clock::set_real_time();
+}
+
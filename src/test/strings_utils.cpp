@@ -0,0 +1,75 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../strings_utils.hpp"
+
+namespace {
+
+std::string all_octets(size_t size) { ///< data with every octet value, of given size
+	std::string data(size, 0);
+	for (size_t i=0; i<size; ++i) data[i] = static_cast<char>(i*37 + 11);
+	return data;
+}
+
+std::string hex_per_char(const std::string & data) { ///< simple reference implementation
+	std::string ret;
+	for (unsigned char c : data) { ret += "0123456789abcdef"[c/16]; ret += "0123456789abcdef"[c%16]; }
+	return ret;
+}
+
+} // namespace
+
+TEST(strings_utils, hex_encode_decode_all_sizes) {
+	for (size_t size=0; size<300; ++size) { // covers the vector part and the tail
+		const std::string data = all_octets(size);
+		const std::string hex = string_as_hex( string_as_bin(data) ).get();
+		EXPECT_EQ( hex , hex_per_char(data) );
+		EXPECT_EQ( string_as_bin( string_as_hex(hex) ).bytes , data );
+	}
+}
+
+TEST(strings_utils, hex_decode_invalid) {
+	std::string hex = hex_per_char( all_octets(64) );
+	std::string out(64, 0);
+	EXPECT_TRUE( hex_decode(hex.data(), hex.size(), & out[0]) );
+	for (size_t pos : { size_t{0}, size_t{17}, size_t{40}, size_t{127} }) {
+		for (char bad : { 'g', 'A', 'F', '/', ':', '`', '\x80', '\xff', '\0' }) {
+			std::string wrong = hex;
+			wrong[pos] = bad;
+			EXPECT_FALSE( hex_decode(wrong.data(), wrong.size(), & out[0]) );
+			EXPECT_THROW( string_as_bin( string_as_hex(wrong) ) , std::invalid_argument );
+		}
+	}
+}
+
+TEST(strings_utils, hex_odd_length) {
+	EXPECT_EQ( string_as_bin( string_as_hex("a") ).bytes , std::string("\x0a") );
+	EXPECT_EQ( string_as_bin( string_as_hex("20a") ).bytes , std::string("\x20\x0a") );
+	EXPECT_THROW( string_as_bin( string_as_hex("20g") ) , std::invalid_argument );
+	EXPECT_EQ( hexchar2int('f') , 15 );
+	EXPECT_EQ( int2hexchar(10) , 'a' );
+	EXPECT_THROW( int2hexchar(16) , std::invalid_argument );
+}
+
+TEST(strings_utils, debug_format) {
+	EXPECT_EQ( chardbg('a') , "a" );
+	EXPECT_EQ( chardbg('\0') , "0x0" );
+	EXPECT_EQ( chardbg('\x09') , "0x9" );
+	EXPECT_EQ( chardbg('\x0a') , "0x0A=10" );
+	EXPECT_EQ( chardbg('\x1f') , "0x1F=31" );
+	EXPECT_EQ( chardbg('\x7f') , "\x7f" );
+	EXPECT_EQ( chardbg('\x80') , "0x80=128" );
+	EXPECT_EQ( chardbg('\xff') , "0xFF=255" );
+
+	EXPECT_EQ( to_debug(std::string("ab\x01")) , "3:[a,b,0x1]" );
+	EXPECT_EQ( to_debug(std::string("")) , "0:[]" );
+	EXPECT_EQ( to_debug(std::string("abcdefghijkl")) , "12:[a,b,c,d,e,f,g,h,i,j,k,l]" );
+	EXPECT_EQ( to_debug(std::string("abcdefghijklm")) , "13:[a,b,c,d,e,f,g,h ... j,k,l,m]" );
+	const std::string big(200, 'x');
+	const std::string big_dbg = to_debug_b(big);
+	EXPECT_EQ( big_dbg.substr(0,12) , "200:{hash=0x" ); // big style is also the crypto style
+	EXPECT_EQ( big_dbg.find(" ... ") , std::string::npos );
+	EXPECT_EQ( big_dbg.substr( big_dbg.size()-5 ) , ",x,x]" );
+	const char data[] = { 'x', '\x10' };
+	EXPECT_EQ( string_as_dbg(data, sizeof(data)).get() , "2:[x,0x10=16]" );
+}
@@ -0,0 +1,70 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_token_bucket.hpp"
+
+using namespace std::chrono;
+
+TEST(token_bucket, no_limit) {
+	c_token_bucket bucket;
+	const auto now = c_token_bucket::t_clock::now();
+	EXPECT_FALSE( bucket.is_limited() );
+	for (int i=0; i<1000; ++i) EXPECT_TRUE( bucket.take(1000, now) );
+}
+
+TEST(token_bucket, rate_and_burst) {
+	c_token_bucket bucket;
+	auto now = c_token_bucket::t_clock::now();
+	bucket.set_rate(100, 10, now); // 100 per second, 10 at once
+	EXPECT_TRUE( bucket.is_limited() );
+	for (int i=0; i<10; ++i) EXPECT_TRUE( bucket.take(1, now) ); // the burst
+	EXPECT_FALSE( bucket.take(1, now) );
+
+	now += milliseconds(50); // 5 more came
+	for (int i=0; i<5; ++i) EXPECT_TRUE( bucket.take(1, now) );
+	EXPECT_FALSE( bucket.take(1, now) );
+
+	now += seconds(10); // never more then burst
+	int taken = 0;
+	while (bucket.take(1, now)) ++taken;
+	EXPECT_EQ( taken , 10 );
+
+	EXPECT_FALSE( bucket.take(3, now + milliseconds(20)) ); // 2 came, not enough for 3, and nothing is taken
+	EXPECT_TRUE( bucket.take(2, now + milliseconds(20)) );
+}
+
+TEST(token_bucket, extra_tokens) {
+	c_token_bucket bucket;
+	auto now = c_token_bucket::t_clock::now();
+	bucket.set_rate(1, 1, now);
+	EXPECT_TRUE( bucket.take(1, now) );
+	bucket.add(1000); // e.g. given by RPC: kept over the burst
+	now += seconds(5);
+	int taken = 0;
+	while (bucket.take(1, now)) ++taken;
+	EXPECT_EQ( taken , 1000 );
+
+	bucket.set_rate(2000, 0, now); // burst 0 is one second of rate
+	EXPECT_DOUBLE_EQ( bucket.get_tokens() , 2000 );
+	EXPECT_FALSE( bucket.take(2001, now) );
+}
+
+TEST(rate_limit, bytes_burst_fits_datagram) {
+	t_rate_limit limit;
+	limit.m_bytes_per_second = 1000;
+	limit.m_bytes_burst = 1500; // smaller then datagram would drop all of them
+	EXPECT_DOUBLE_EQ( limit.get_bytes_burst() , t_rate_limit::bytes_burst_min );
+	limit.m_bytes_burst = 0; // one second of rate, still too small
+	EXPECT_DOUBLE_EQ( limit.get_bytes_burst() , t_rate_limit::bytes_burst_min );
+	limit.m_bytes_per_second = 1000000;
+	EXPECT_DOUBLE_EQ( limit.get_bytes_burst() , 1000000 );
+	limit.m_bytes_burst = 200000;
+	EXPECT_DOUBLE_EQ( limit.get_bytes_burst() , 200000 );
+}
+
+TEST(rate_limit, print) {
+	t_rate_limit limit;
+	std::ostringstream oss;
+	oss << limit;
+	EXPECT_EQ( oss.str() , "any packets/s, any bytes/s" );
+}
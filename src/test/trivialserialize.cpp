@@ -130,3 +130,56 @@ TEST(serialize, empty_element_as_first) {
 		ASSERT_EQ(input.at(i), output.at(i));
 	}
 }
+
+TEST(serialize, views_point_into_buffer) {
+	generator gen(1);
+	gen.push_bytes_n(3, "abc");
+	gen.push_varstring("hello world");
+	gen.push_varstring("");
+	const std::string data = gen.str();
+
+	trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_string_valid() , data );
+	t_bytes_view bytes = parser.pop_bytes_n_view(3);
+	EXPECT_EQ( bytes.to_string() , "abc" );
+	EXPECT_EQ( bytes.data() , data.data() ); // no copy
+	t_bytes_view str = parser.pop_varstring_view();
+	EXPECT_EQ( str.to_string() , "hello world" );
+	EXPECT_TRUE( (str.data() > data.data()) && (str.data() + str.size() <= data.data() + data.size()) );
+	EXPECT_TRUE( parser.pop_varstring_view().empty() );
+	EXPECT_TRUE( parser.is_end() );
+	EXPECT_THROW( parser.pop_bytes_n_view(1) , std::exception );
+}
+
+namespace {
+void generate_example(generator & gen) {
+	gen.push_byte_u(42);
+	gen.push_integer_u<2>(1000u);
+	gen.push_varstring("some text");
+	gen.push_varstring( std::string(300,'x') ); // 3 octets of size
+	gen.push_vector_string( { "a" , "bb" } );
+}
+} // namespace
+
+TEST(serialize, generator_measure_and_caller_buffer) {
+	generator gen_string(1);
+	generate_example(gen_string);
+
+	generator gen_measure( generator::tag_measure_only{} );
+	generate_example(gen_measure);
+	EXPECT_EQ( gen_measure.get_size() , gen_string.str().size() );
+
+	std::vector<char> buff( gen_measure.get_size() );
+	generator gen_buff( generator::tag_caller_must_keep_this_buffer_valid{} , buff.data() , buff.size() );
+	generate_example(gen_buff);
+	EXPECT_EQ( gen_buff.get_size() , buff.size() );
+	EXPECT_EQ( std::string(buff.begin(), buff.end()) , gen_string.str() );
+}
+
+TEST(serialize, generator_caller_buffer_overflow) {
+	std::string buff(5, '.');
+	generator gen( generator::tag_caller_must_keep_this_buffer_valid{} , & buff[0] , 4 );
+	gen.push_integer_u<2>(0x4142u);
+	EXPECT_THROW( gen.push_varstring("abc") , format_error_write_buffer_full );
+	EXPECT_LE( gen.get_size() , 4u );
+	EXPECT_EQ( buff.at(4) , '.' ); // nothing written after capacity
+}
@@ -0,0 +1,86 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../trivialserialize_schema.hpp"
+
+using namespace trivialserialize;
+
+namespace {
+
+struct msg_fixed : schema::message< schema::field_u<1> , schema::field_u<4> , schema::field_bytes<3> > {
+	enum { e_a , e_b , e_c };
+};
+
+struct msg_var : schema::message< schema::field_u<2> , schema::field_varstring<300> , schema::field_u<1> > {
+	enum { e_a , e_text , e_b };
+};
+
+} // namespace
+
+TEST(serialize_schema, sizes) {
+	EXPECT_EQ( msg_fixed::size_min , 8u );
+	EXPECT_EQ( msg_fixed::size_max , 8u );
+	EXPECT_TRUE( msg_fixed::is_fixed_size );
+	EXPECT_EQ( msg_var::size_min , 2u + 1 + 1 );
+	EXPECT_EQ( msg_var::size_max , 2u + 3 + 300 + 1 );
+	EXPECT_FALSE( msg_var::is_fixed_size );
+}
+
+TEST(serialize_schema, same_format_as_generator_and_parser) {
+	generator gen(10);
+	msg_var::encode( gen , msg_var::t_values( 1000 , "hello" , 7 ) );
+
+	parser parser( parser::tag_caller_must_keep_this_string_valid() , gen.str() );
+	EXPECT_EQ( (parser.pop_integer_u<2,uint16_t>()) , 1000 );
+	EXPECT_EQ( parser.pop_varstring() , "hello" );
+	EXPECT_EQ( parser.pop_byte_u() , 7 );
+	EXPECT_TRUE( parser.is_end() );
+}
+
+TEST(serialize_schema, encode_decode) {
+	generator gen(10);
+	msg_fixed::encode( gen , msg_fixed::t_values( 200 , 0x01020304 , "abc" ) );
+	const std::string data = gen.str();
+	ASSERT_EQ( data.size() , msg_fixed::size_max );
+	msg_fixed::t_values values;
+	ASSERT_TRUE( msg_fixed::decode( data.data() , data.size() , values ) );
+	EXPECT_EQ( std::get<msg_fixed::e_a>(values) , 200 );
+	EXPECT_EQ( std::get<msg_fixed::e_b>(values) , 0x01020304u );
+	EXPECT_EQ( std::get<msg_fixed::e_c>(values).to_string() , "abc" );
+	EXPECT_EQ( std::get<msg_fixed::e_c>(values).data() , data.data() + 5 ); // view into data
+
+	const std::string text(300, 'x');
+	generator gen2(10);
+	msg_var::encode( gen2 , msg_var::t_values( 1 , text , 2 ) );
+	msg_var::t_values values2;
+	ASSERT_TRUE( msg_var::decode( gen2.str().data() , gen2.str().size() , values2 ) );
+	EXPECT_EQ( std::get<msg_var::e_text>(values2).to_string() , text );
+	EXPECT_EQ( std::get<msg_var::e_b>(values2) , 2 );
+}
+
+TEST(serialize_schema, decode_rejects_bad_data) {
+	generator gen(10);
+	msg_var::encode( gen , msg_var::t_values( 1 , "hello" , 2 ) );
+	const std::string good = gen.str();
+	msg_var::t_values values;
+	for (size_t size=0; size<good.size(); ++size) { // every truncation
+		EXPECT_FALSE( msg_var::decode( good.data() , size , values ) );
+	}
+	EXPECT_FALSE( msg_var::decode( (good + "x").data() , good.size()+1 , values ) ); // garbage after it
+
+	std::string too_long = good;
+	too_long.at(2) = static_cast<char>(0xFD); too_long.insert(3, std::string("\x01\x2D", 2)); // size 301 > max 300
+	EXPECT_FALSE( msg_var::decode( too_long.data() , too_long.size() , values ) );
+
+	std::string huge_size( "\x00\x01\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF" "a" , 12 );
+	EXPECT_FALSE( msg_var::decode( huge_size.data() , huge_size.size() , values ) );
+
+	msg_fixed::t_values values_fixed;
+	EXPECT_FALSE( msg_fixed::decode( good.data() , msg_fixed::size_max - 1 , values_fixed ) );
+}
+
+TEST(serialize_schema, encode_checks_sizes) {
+	generator gen(10);
+	EXPECT_THROW( msg_fixed::encode( gen , msg_fixed::t_values( 1 , 2 , "toolong" ) ) , format_error_write );
+	EXPECT_THROW( msg_var::encode( gen , msg_var::t_values( 1 , std::string(301,'x') , 2 ) ) , format_error_write_too_long );
+}
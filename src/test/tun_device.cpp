@@ -0,0 +1,51 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_tun_device.hpp"
+
+#ifdef __linux__
+
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+std::string make_ipv6_packet(unsigned char version, unsigned char dst0, unsigned char dst1) {
+	std::string packet(40, '\0');
+	packet[0] = static_cast<char>(version << 4);
+	packet[6] = 58; // ICMPv6
+	packet[24] = static_cast<char>(dst0);
+	packet[25] = static_cast<char>(dst1);
+	return packet;
+}
+
+} // namespace
+
+TEST(tun_device, filter_galaxy_only) {
+	// kernel runs the filter of a unix datagram socket on each datagram sent to it (from its first octet, like on TUN)
+	int sockets[2];
+	ASSERT_EQ( socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) , 0 );
+	auto filter = c_tun_device_linux::get_filter_galaxy_only();
+	sock_fprog program{ static_cast<unsigned short>( filter.size() ) , filter.data() };
+	ASSERT_EQ( setsockopt(sockets[1], SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) , 0 );
+
+	auto passes = [&sockets](const std::string & packet) {
+		EXPECT_EQ( send(sockets[0], packet.data(), packet.size(), 0) , static_cast<ssize_t>(packet.size()) );
+		char buf[100];
+		const ssize_t size = recv(sockets[1], buf, sizeof(buf), MSG_DONTWAIT);
+		if (size >= 0) EXPECT_EQ( size , static_cast<ssize_t>(packet.size()) ); // not cut
+		return size >= 0;
+	};
+	EXPECT_TRUE( passes( make_ipv6_packet(6, 0xFD, 0x42) ) );
+	EXPECT_FALSE( passes( make_ipv6_packet(6, 0xFF, 0x02) ) ); // multicast, e.g. router solicitation
+	EXPECT_FALSE( passes( make_ipv6_packet(6, 0xFE, 0x80) ) ); // link-local
+	EXPECT_FALSE( passes( make_ipv6_packet(6, 0xFD, 0x43) ) );
+	EXPECT_FALSE( passes( make_ipv6_packet(4, 0xFD, 0x42) ) );
+	EXPECT_FALSE( passes( make_ipv6_packet(6, 0xFD, 0x42).substr(0, 20) ) ); // too short
+	close(sockets[0]);
+	close(sockets[1]);
+}
+
+#endif
+
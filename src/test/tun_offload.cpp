@@ -0,0 +1,116 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_tun_offload.hpp"
+
+namespace {
+
+/// IPv6 + TCP (20 octets header) packet with data_size octets of data, checksum not set
+std::string make_tcp6(size_t data_size, uint32_t seq, unsigned char flags) {
+	std::string packet(c_tun_offload::ipv6_header_size + 20 + data_size, '\0');
+	packet[0] = 0x60;
+	const size_t payload = packet.size() - c_tun_offload::ipv6_header_size;
+	packet[4] = static_cast<char>(payload >> 8);  packet[5] = static_cast<char>(payload);
+	packet[6] = 6; // TCP
+	packet[7] = 64;
+	packet[8] = static_cast<char>(0xfd);  packet[9] = 0x42;  packet[23] = 1; // src fd42::1
+	packet[24] = static_cast<char>(0xfd);  packet[25] = 0x42;  packet[39] = 2; // dst fd42::2
+	const size_t tcp = c_tun_offload::ipv6_header_size;
+	packet[tcp+0] = 0x12;  packet[tcp+1] = 0x34;  packet[tcp+2] = 0x00;  packet[tcp+3] = 0x50; // ports
+	for (int i=0; i<4; ++i) packet[tcp+4+i] = static_cast<char>(seq >> (24 - 8*i));
+	packet[tcp+12] = 5 << 4; // data offset: 5 words
+	packet[tcp+13] = static_cast<char>(flags);
+	for (size_t i=0; i<data_size; ++i) packet[tcp+20+i] = static_cast<char>(i % 251);
+	return packet;
+}
+
+bool is_tcp6_checksum_valid(const std::string & packet) { ///< sum with the checksum in it must be 0xFFFF
+	const auto data = reinterpret_cast<const unsigned char*>(packet.data());
+	const size_t tcp_size = packet.size() - c_tun_offload::ipv6_header_size;
+	const unsigned char pseudo_tail[8] = { 0, 0, static_cast<unsigned char>(tcp_size >> 8), static_cast<unsigned char>(tcp_size), 0, 0, 0, 6 };
+	uint32_t sum = c_tun_offload::checksum_add(0, data + 8, 32);
+	sum = c_tun_offload::checksum_add(sum, pseudo_tail, sizeof(pseudo_tail));
+	sum = c_tun_offload::checksum_add(sum, data + c_tun_offload::ipv6_header_size, tcp_size);
+	return c_tun_offload::checksum_fold(sum) == 0;
+}
+
+uint32_t get_seq(const std::string & packet) {
+	const auto data = reinterpret_cast<const unsigned char*>(packet.data()) + c_tun_offload::ipv6_header_size + 4;
+	return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+}
+
+} // namespace
+
+TEST(tun_offload, segment_tcp6) {
+	const unsigned char flags = 0x80 | 0x10 | 0x08 | 0x01; // CWR ACK PSH FIN
+	const uint32_t seq = 0xFFFFF000; // wraps around
+	const std::string big = make_tcp6(3000, seq, flags);
+	const auto segments = c_tun_offload::segment_tcp6( reinterpret_cast<const unsigned char*>(big.data()), big.size(),
+		c_tun_offload::ipv6_header_size, 1220 );
+	ASSERT_EQ(segments.size(), 3u);
+	const size_t headers = c_tun_offload::ipv6_header_size + 20;
+	std::string data_joined;
+	for (size_t i=0; i<segments.size(); ++i) {
+		const std::string & segment = segments.at(i);
+		const size_t data_size = (i < 2) ? 1220 : 560;
+		ASSERT_EQ(segment.size(), headers + data_size);
+		EXPECT_EQ( (static_cast<unsigned char>(segment[4]) << 8) | static_cast<unsigned char>(segment[5]) , segment.size() - 40 );
+		EXPECT_EQ( get_seq(segment) , seq + static_cast<uint32_t>(i * 1220) );
+		const unsigned char segment_flags = segment[headers - 20 + 13];
+		EXPECT_EQ( segment_flags & 0x10 , 0x10 ); // ACK always
+		EXPECT_EQ( (segment_flags & 0x80) != 0 , i == 0 ); // CWR only first
+		EXPECT_EQ( (segment_flags & 0x09) != 0 , i == 2 ); // PSH FIN only last
+		EXPECT_TRUE( is_tcp6_checksum_valid(segment) );
+		EXPECT_EQ( segment.substr(8, 32) , big.substr(8, 32) );
+		data_joined += segment.substr(headers);
+	}
+	EXPECT_EQ( data_joined , big.substr(headers) );
+
+	const std::string small = make_tcp6(100, seq, flags); // fits: just gets checksum
+	const auto one = c_tun_offload::segment_tcp6( reinterpret_cast<const unsigned char*>(small.data()), small.size(), 40, 1220 );
+	ASSERT_EQ(one.size(), 1u);
+	EXPECT_EQ( one.at(0)[headers - 20 + 13] , static_cast<char>(flags) );
+	EXPECT_TRUE( is_tcp6_checksum_valid(one.at(0)) );
+
+	const std::string truncated = big.substr(0, 50);
+	EXPECT_THROW( c_tun_offload::segment_tcp6( reinterpret_cast<const unsigned char*>(truncated.data()), truncated.size(), 40, 1220 ),
+		std::invalid_argument );
+}
+
+TEST(tun_offload, complete_checksum) {
+	std::string packet = make_tcp6(1001, 1, 0x10); // odd size
+	const size_t tcp_size = packet.size() - c_tun_offload::ipv6_header_size;
+	const unsigned char pseudo_tail[8] = { 0, 0, static_cast<unsigned char>(tcp_size >> 8), static_cast<unsigned char>(tcp_size), 0, 0, 0, 6 };
+	auto data = reinterpret_cast<unsigned char*>(&packet[0]);
+	uint32_t pseudo = c_tun_offload::checksum_add(0, data + 8, 32);
+	pseudo = c_tun_offload::checksum_add(pseudo, pseudo_tail, sizeof(pseudo_tail));
+	const uint16_t pseudo_folded = ~c_tun_offload::checksum_fold(pseudo); // as kernel leaves it: sum, not negated
+	data[40+16] = pseudo_folded >> 8;  data[40+17] = pseudo_folded & 0xFF;
+	EXPECT_FALSE( is_tcp6_checksum_valid(packet) );
+	c_tun_offload::complete_checksum(data, packet.size(), 40, 16);
+	EXPECT_TRUE( is_tcp6_checksum_valid(packet) );
+	EXPECT_THROW( c_tun_offload::complete_checksum(data, packet.size(), packet.size() - 1, 16), std::invalid_argument );
+}
+
+TEST(tun_offload, packet_too_big6) {
+	const std::string packet = make_tcp6(1400, 1, 0x10);
+	const auto data = reinterpret_cast<const unsigned char*>(packet.data());
+	const std::string reply = c_tun_offload::packet_too_big6(data, packet.size(), 1390);
+	ASSERT_EQ( reply.size() , 1280u ); // as much of packet as fits
+	const auto out = reinterpret_cast<const unsigned char*>(reply.data());
+	EXPECT_EQ( out[6] , 58 ); // ICMPv6
+	EXPECT_EQ( reply.substr(8, 16) , packet.substr(24, 16) ); // from his destination
+	EXPECT_EQ( reply.substr(24, 16) , packet.substr(8, 16) ); // to him
+	EXPECT_EQ( out[40] , 2 ); // Packet Too Big
+	EXPECT_EQ( (out[44] << 24) | (out[45] << 16) | (out[46] << 8) | out[47] , 1390 );
+	EXPECT_EQ( reply.substr(48) , packet.substr(0, 1280 - 48) );
+	const size_t icmp_size = reply.size() - c_tun_offload::ipv6_header_size;
+	const unsigned char pseudo_tail[8] = { 0, 0, static_cast<unsigned char>(icmp_size >> 8), static_cast<unsigned char>(icmp_size), 0, 0, 0, 58 };
+	uint32_t sum = c_tun_offload::checksum_add(0, out + 8, 32);
+	sum = c_tun_offload::checksum_add(sum, pseudo_tail, sizeof(pseudo_tail));
+	sum = c_tun_offload::checksum_add(sum, out + 40, icmp_size);
+	EXPECT_EQ( c_tun_offload::checksum_fold(sum) , 0 );
+
+	EXPECT_TRUE( c_tun_offload::packet_too_big6(out, reply.size(), 1390).empty() ); // never for ICMPv6 error
+	EXPECT_TRUE( c_tun_offload::packet_too_big6(data, 20, 1390).empty() );
+}
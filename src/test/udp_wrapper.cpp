@@ -0,0 +1,59 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+#include "gtest/gtest.h"
+#include "../c_udp_wrapper.hpp"
+
+#ifdef __linux__
+
+#include <poll.h>
+
+namespace {
+
+std::vector<std::string> receive_all(c_udp_wrapper_linux & udp, size_t count) { ///< waits at most 1 s for each
+	std::vector<std::string> ret;
+	char buf[65536];
+	while (ret.size() < count) {
+		if (!udp.is_receive_pending()) {
+			pollfd fd{ udp.get_socket() , POLLIN , 0 };
+			if (poll(&fd, 1, 1000) != 1) break;
+		}
+		c_ip46_addr from;
+		const auto size = udp.receive_data(buf, sizeof(buf), from);
+		EXPECT_EQ( from.get_assign_port() , 42031 );
+		ret.emplace_back(buf, size);
+	}
+	return ret;
+}
+
+std::string make_datagram(size_t size, int number) { return std::string(size, static_cast<char>('a' + number % 26)); }
+
+} // namespace
+
+TEST(udp_wrapper, same_size_datagrams_sent_together) {
+	c_udp_wrapper_linux sender(42031), receiver(42032);
+	const auto receiver_addr = c_ip46_addr::create_ipv4("127.0.0.1", 42032);
+	std::vector<std::string> sent;
+	for (int i=0; i<20; ++i) sent.push_back( make_datagram(1200, i) );
+	sent.push_back( make_datagram(300, 20) ); // shorter one ends the batch
+	sent.push_back( make_datagram(1200, 21) );
+	sent.push_back( make_datagram(1400, 22) ); // bigger one can not join
+	for (const auto & datagram : sent) sender.send_data(receiver_addr, datagram.data(), datagram.size());
+	EXPECT_EQ( sender.is_send_pending() , sender.is_gso_enabled() ); // the last one waits for more
+	sender.flush();
+	EXPECT_FALSE( sender.is_send_pending() );
+	EXPECT_EQ( receive_all(receiver, sent.size()) , sent ); // each one as it was sent, in order (also if GRO joined them)
+	EXPECT_FALSE( receiver.is_receive_pending() );
+}
+
+TEST(udp_wrapper, without_gso) {
+	c_udp_wrapper_linux sender(42031), receiver(42032);
+	sender.set_gso_enabled(false);
+	const auto receiver_addr = c_ip46_addr::create_ipv4("127.0.0.1", 42032);
+	std::vector<std::string> sent;
+	for (int i=0; i<5; ++i) sent.push_back( make_datagram(1000, i) );
+	for (const auto & datagram : sent) sender.send_data(receiver_addr, datagram.data(), datagram.size());
+	EXPECT_FALSE( sender.is_send_pending() ); // sent at once
+	EXPECT_EQ( receive_all(receiver, sent.size()) , sent );
+}
+
+#endif
@@ -31,6 +31,9 @@ const char * format_error_write_too_long::what() const noexcept {
 	return "format-error in trivialserialize while writting, the given data can not be serialized - "
 	"because data is too long (e.g. binary string)"; }
 
+const char * format_error_write_buffer_full::what() const noexcept {
+	return "format-error in trivialserialize while writting - the data does not fit into the given buffer"; }
+
 const char * format_error_write_value_too_big::what() const noexcept {
 	return "format-error in trivialserialize while writing - value was too big over limit"; }
 
@@ -40,18 +43,45 @@ const char * format_error_read_invalid_version::what() const noexcept {
 
 
 generator::generator(size_t suggested_size)
-	: m_str()
+	: m_mode(e_mode_string), m_str(), m_buff(nullptr), m_buff_capacity(0), m_size(0)
 {
 	m_str.reserve( suggested_size );
 }
 
-void generator::push_byte_u(unsigned char c) { 	m_str += c; }
-void generator::push_byte_s(signed char c) {	m_str += c; }
+generator::generator(tag_caller_must_keep_this_buffer_valid, char * buff, size_t capacity)
+	: m_mode(e_mode_caller_buffer), m_str(), m_buff(buff), m_buff_capacity(capacity), m_size(0)
+{
+	_check( (buff != nullptr) || (capacity == 0) );
+}
+
+generator::generator(tag_measure_only)
+	: m_mode(e_mode_measure), m_str(), m_buff(nullptr), m_buff_capacity(0), m_size(0)
+{ }
+
+void generator::write_bytes(const char * data, size_t size) {
+	switch (m_mode) {
+		case e_mode_string: m_str.append( data , size ); break;
+		case e_mode_caller_buffer:
+			if (size > m_buff_capacity - m_size) _throw_error( format_error_write_buffer_full() ); // (m_size <= capacity always)
+			std::copy( data , data + size , m_buff + m_size );
+			m_size += size;
+		break;
+		case e_mode_measure: m_size += size; break;
+	}
+}
+
+void generator::push_byte_u(unsigned char c) { 	const char b = c; write_bytes( &b , 1 ); }
+void generator::push_byte_s(signed char c) {	const char b = c; write_bytes( &b , 1 ); }
 
 
 void generator::push_bytes_n(size_t size, const std::string & data) {
 	assert(size == data.size()); // is the size of data the same as size that we think should go here
-	m_str += data;
+	write_bytes( data.data() , data.size() );
+}
+
+void generator::push_bytes_n_from_buff(size_t size, const char * buff) {
+	assert( (buff != nullptr) || (size == 0) );
+	write_bytes( buff , size );
 }
 
 void generator::push_integer_uvarint(uint64_t val) {
@@ -67,6 +97,11 @@ void generator::push_varstring(const std::string &data) {
 	push_bytes_n(data.size(),data); // save the data
 }
 
+void generator::push_varstring(const char * buff, size_t size) {
+	push_integer_uvarint(size);
+	push_bytes_n_from_buff(size, buff);
+}
+
 void generator::push_vector_string(const vector<string> & data) {
 	const auto size = data.size();
 	assert(size <= std::numeric_limits<uint64_t>::max());
@@ -74,11 +109,16 @@ void generator::push_vector_string(const vector<string> & data) {
 	for (std::remove_cv<decltype(size)>::type i = 0; i<size; ++i) push_varstring(data.at(i));
 }
 
-const std::string & generator::str() const { return m_str; }
+const std::string & generator::str() const { _check( m_mode == e_mode_string ); return m_str; }
 
-std::string && generator::str_move() { return std::move(m_str); }
+std::string && generator::str_move() { _check( m_mode == e_mode_string ); return std::move(m_str); }
 
-const std::string & generator::get_buffer() const { return m_str; }
+const std::string & generator::get_buffer() const { _check( m_mode == e_mode_string ); return m_str; }
+
+size_t generator::get_size() const {
+	if (m_mode == e_mode_string) return m_str.size();
+	return m_size;
+}
 
 // ==================================================================
 
@@ -116,7 +156,11 @@ void parser::pop_byte_skip(char c) { // read expected character (e.g. a delimite
 }
 
 std::string parser::pop_bytes_n(size_t size) {
-	if (!size) return string("");
+	return pop_bytes_n_view(size).to_string();
+}
+
+t_bytes_view parser::pop_bytes_n_view(size_t size) {
+	if (!size) return t_bytes_view();
 	if (! (m_data_now < m_data_end) ) _throw_error( format_error_read() ); // we run outside of string
 	// casting below is ok, because std::ptrdiff_t is 64 bits signed value, and size_t is 64 bits unsigned value.
 	// and we are sure that this ptrdiff > 0 because of earlier above condition
@@ -125,7 +169,7 @@ std::string parser::pop_bytes_n(size_t size) {
 	assert( (m_data_now + size <= m_data_end) );
 	auto from = m_data_now;
 	m_data_now += size; // *** move
-	return std::string( from , size );
+	return t_bytes_view( from , size );
 }
 
 void parser::skip_bytes_n(size_t size) {
@@ -171,6 +215,12 @@ std::string parser::pop_varstring() { ///< Decode string of any length saved by
 	return pop_bytes_n(size);
 }
 
+t_bytes_view parser::pop_varstring_view() {
+	size_t size = pop_integer_uvarint();
+	assert( size <= SANE_MAX_SIZE_FOR_STRING );
+	return pop_bytes_n_view(size);
+}
+
 void parser::skip_varstring() {
 	size_t size = pop_integer_uvarint();
 	assert( size <= SANE_MAX_SIZE_FOR_STRING );
@@ -51,6 +51,8 @@ class format_error_write : public format_error { public:	const char * what() con
 
 class format_error_write_too_long : public format_error_write { public:	const char * what() const noexcept override; };
 
+class format_error_write_buffer_full : public format_error_write { public:	const char * what() const noexcept override; };
+
 class format_error_write_value_too_big : public format_error { public:	const char * what() const noexcept override; };
 
 class format_error_read_invalid_version : public format_error { public:	const char * what() const noexcept override; };
@@ -72,10 +74,22 @@ class format_error_read_invalid_version : public format_error { public:	const ch
  * always there is wasted space (e.g. of 1 byte) in the serialized format.
  * - varstring: we COULD have one that uses 4 bytes to encode length when it is long, but uses just 1 byte when it is e.g. 250; bitcoin uses such mechanism. Not implemented (yet?).
  * - cstring: we COULD have null-delimited string. Not implemented (yet?).
+ * @note Normally it generates into own string, but it can also write into caller's fixed buffer (e.g. in front of data
+ * that is already there), or just measure the size that the data would take (e.g. to then allocate exactly that size).
  */
 class generator {
 	protected:
-		std::string m_str; ///< the generated data so far
+		enum t_mode {
+			e_mode_string, ///< into own m_str
+			e_mode_caller_buffer, ///< into m_buff
+			e_mode_measure, ///< nowhere, just count the size
+		};
+		const t_mode m_mode;
+
+		std::string m_str; ///< the generated data so far (in e_mode_string)
+		char * const m_buff; ///< caller's buffer (in e_mode_caller_buffer)
+		const size_t m_buff_capacity; ///< size of m_buff
+		size_t m_size; ///< how many octets we generated so far (in other modes then e_mode_string)
 
 		// powers of two for different number of bytes (8-bit - octets):
 		constexpr static size_t bytesize0 = 1;
@@ -85,7 +99,14 @@ class generator {
 		constexpr static size_t bytesize4minus1 = (1LL << (8*4)) -1; // typical 4 octet bigger word, but -1 (so it fits in size_t), we need other comparsion when using it (<=).
 
 	public:
+		struct tag_caller_must_keep_this_buffer_valid {} ;
+		struct tag_measure_only {} ;
+
 		generator(size_t suggested_size);
+		///! write into buffer [buff .. buff+capacity) instead, throws format_error_write_buffer_full if it would not fit
+		///(then the part of data that did fit, e.g. the size of varstring, could be written already)
+		generator(tag_caller_must_keep_this_buffer_valid x, char * buff, size_t capacity);
+		generator(tag_measure_only x); ///< do not write anything, just count the size, see get_size()
 
 		/** @name Static Interface
 		 * Description: you need to specify exact (or maximum) data size youself
@@ -105,6 +126,7 @@ class generator {
 		 * @param data - the string of binary data
 		 */
 		void push_bytes_n(size_t size, const std::string & data);
+		void push_bytes_n_from_buff(size_t size, const char * buff); ///< as push_bytes_n(), but reads [buff .. buff+size)
 
 		/**
 		 * @brief writes octetsvarstr (see class notes).
@@ -126,6 +148,7 @@ class generator {
 		void push_integer_uvarint(uint64_t val); ///< Encode unsigned int dynamically on 1,3,5,9 octets like Bitcoin's CompactSize
 
 		void push_varstring(const std::string &data); ///< Encode entire string of any length (but < max uint64) in dynamic format.
+		void push_varstring(const char * buff, size_t size); ///< as push_varstring(), but from [buff .. buff+size)
 		///@}
 
 		/** @name High level Interface
@@ -162,6 +185,9 @@ class generator {
 
 		std::string && str_move(); ///< gives up the stream of generated data.
 		///< You should not use this object after using this function because it can be incosistent.
+		///< str() and str_move() are only for the normal mode (not for caller buffer, nor for measure).
+
+		size_t get_size() const; ///< how many octets were generated (or would be, when measuring) so far
 
 		///@}
 
@@ -180,6 +206,8 @@ class generator {
 	protected:
 		/// give number of octets of actuall-data-size, give the max_size that is just asserted, and the data
 		void push_bytes_octets_and_size(unsigned char octets, size_t max_size, const std::string & data);
+
+		void write_bytes(const char * data, size_t size); ///< all writes go here, depending on m_mode
 };
 
 
@@ -267,10 +295,8 @@ template <int S, typename T> void generator::push_integer_u(T value) {
 	static_assert( S>0 , "S must be > 0");
 	static_assert( S<=8 , "S must be <= 8");
 
-	if (S==8) {
-		if ( value >= 0xFFFFFFFFFFFFFFFF ) _throw_error( format_error_write_value_too_big() );
-	} else {
-		if ( value >= get_max_value_of_S_octet_uint<S>() ) _throw_error( format_error_write_value_too_big() );
+	if (S<8) { // the max value itself still fits
+		if ( value > get_max_value_of_S_octet_uint<S>() ) _throw_error( format_error_write_value_too_big() );
 	}
 
 	// TODO use proper type, depending on S
@@ -299,7 +325,7 @@ template <int S> void generator::push_bytes_sizeoctets(const std::string & data)
 		"Try using 1,2,3 or 4.");
 	const auto size = data.size();
 	push_integer_u<S>(size);
-	m_str += data; // write the actuall data
+	write_bytes( data.data() , data.size() ); // write the actuall data
 }
 
 
@@ -349,6 +375,8 @@ class parser {
 
 		std::string pop_bytes_n(size_t size); //< Read and return binary string of exactly N characters always,
 		///< that was saved using push_bytes_n(). N can be 0.
+		t_bytes_view pop_bytes_n_view(size_t size); ///< as pop_bytes_n() but does not copy: returns view into the parsed buffer
+		///< that is valid as long as the caller keeps that buffer valid (as he promised when creating us)
 		void skip_bytes_n(size_t size); ///< as pop_bytes_n() but just skips the data
 		void pop_bytes_n_into_buff(size_t size, char *buff); ///< in this version we read directly into
 		///< memory buff - that must be valid block of size 'size', so [ buff .. buff+size ) must be valid memory to write into.
@@ -363,6 +391,7 @@ class parser {
 		///@{
 		uint64_t pop_integer_uvarint(); ///< Decode unsigned int of 1,3,5,9 octets saved by push_integer_uvarint
 		std::string pop_varstring(); ///< Decode string of any length saved by push_varstring()
+		t_bytes_view pop_varstring_view(); ///< as pop_varstring() but returns view, like pop_bytes_n_view()
 		void skip_varstring(); ///< as pop_varstring() but skips the data
 		///@}
 
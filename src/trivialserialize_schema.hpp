@@ -0,0 +1,188 @@
+// Copyrighted (C) 2015-2016 Antinet.org team, see file LICENCE-by-Antinet.txt
+
+/** @file
+ *  trivialserialize_schema.hpp -- messages described once as a list of fields, with generated encode/decode
+ */
+
+#pragma once
+#ifndef include_trivialserialize_schema_hpp
+#define include_trivialserialize_schema_hpp
+
+#include "trivialserialize.hpp"
+
+#include <tuple>
+#include <utility>
+#include <initializer_list>
+
+namespace trivialserialize {
+
+/**
+ * @defgroup trivialserialize_schema Schema of messages
+ * @ingroup trivialserialize
+ * @brief A message is declared once as a list of fields, e.g. message< field_u<1>, field_bytes<16>, field_varstring<100> >
+ * and then gets:
+ * - encode() into any generator (own string, caller's buffer, or measure)
+ * - decode() that is bounds-checked, does not allocate, does not throw, and gives t_bytes_view pointing into the data
+ * - static size_min, size_max; messages with only fixed-size fields check the size once and then just copy the fields.
+ * The encoding is the same as the one of generator/parser functions: push_integer_u, push_bytes_n, push_varstring.
+ * @{
+ */
+namespace schema {
+
+template <int S> struct uint_for_octets { typedef uint64_t type; };
+template <> struct uint_for_octets<1> { typedef uint8_t type; };
+template <> struct uint_for_octets<2> { typedef uint16_t type; };
+template <> struct uint_for_octets<3> { typedef uint32_t type; };
+template <> struct uint_for_octets<4> { typedef uint32_t type; };
+
+constexpr size_t uvarint_size(uint64_t value) { ///< as written by push_integer_uvarint()
+	return (value < 0xFD) ? 1 : (value < 0xFFFF) ? 3 : (value < 0xFFFFFFFF) ? 5 : 9;
+}
+
+constexpr size_t sum(std::initializer_list<size_t> values) {
+	size_t ret = 0;
+	for (auto value : values) ret += value;
+	return ret;
+}
+
+/// unsigned integer, big-endian, of S octets (as push_integer_u<S>)
+template <int S> struct field_u {
+	static_assert( (S>=1) && (S<=8) , "S must be 1..8");
+	typedef typename uint_for_octets<S>::type t_value;
+	constexpr static size_t size_min = S;
+	constexpr static size_t size_max = S;
+
+	static void encode(generator & gen, t_value value) { gen.push_integer_u<S>(value); }
+	static void decode_unchecked(const char * & pos, t_value & value) {
+		uint64_t ret = 0;
+		for (int i=0; i<S; ++i) ret = (ret << 8) | static_cast<unsigned char>( pos[i] );
+		value = static_cast<t_value>(ret);
+		pos += S;
+	}
+	static bool decode(const char * & pos, const char * end, t_value & value) {
+		if (static_cast<size_t>(end - pos) < size_max) return false;
+		decode_unchecked(pos, value);
+		return true;
+	}
+};
+
+/// exactly N octets (as push_bytes_n)
+template <size_t N> struct field_bytes {
+	typedef t_bytes_view t_value;
+	constexpr static size_t size_min = N;
+	constexpr static size_t size_max = N;
+
+	static void encode(generator & gen, t_value value) {
+		if (value.size() != N) _throw_error( format_error_write() );
+		gen.push_bytes_n_from_buff(N, value.data());
+	}
+	static void decode_unchecked(const char * & pos, t_value & value) {
+		value = t_value(pos, N);
+		pos += N;
+	}
+	static bool decode(const char * & pos, const char * end, t_value & value) {
+		if (static_cast<size_t>(end - pos) < size_max) return false;
+		decode_unchecked(pos, value);
+		return true;
+	}
+};
+
+/// string of 0..MaxSize octets (as push_varstring)
+template <size_t MaxSize> struct field_varstring {
+	static_assert( MaxSize > 0 , "Use field_bytes for always empty string");
+	typedef t_bytes_view t_value;
+	constexpr static size_t size_min = 1;
+	constexpr static size_t size_max = uvarint_size(MaxSize) + MaxSize;
+
+	static void encode(generator & gen, t_value value) {
+		if (value.size() > MaxSize) _throw_error( format_error_write_too_long() );
+		gen.push_varstring(value.data(), value.size());
+	}
+	static void decode_unchecked(const char * & pos, t_value & value) = delete; // never of fixed size
+	static bool decode(const char * & pos, const char * end, t_value & value) {
+		const char * now = pos;
+		uint64_t size = 0;
+		if (now == end) return false;
+		const unsigned char first = static_cast<unsigned char>( *now );
+		++now;
+		if (first < 0xFD) size = first;
+		else {
+			const size_t octets = (first == 0xFD) ? 2 : (first == 0xFE) ? 4 : 8;
+			if (static_cast<size_t>(end - now) < octets) return false;
+			for (size_t i=0; i<octets; ++i) size = (size << 8) | static_cast<unsigned char>( now[i] );
+			now += octets;
+		}
+		if (size > MaxSize) return false;
+		if (static_cast<size_t>(end - now) < size) return false;
+		value = t_value(now, size);
+		pos = now + size;
+		return true;
+	}
+};
+
+/**
+ * @brief The message made of fields TFields. Values are in t_values tuple, in the same order.
+ * @note Derive from it, and name the fields with an enum, e.g. enum { e_ttl, e_hip }; then std::get<e_hip>(values).
+ */
+template <typename... TFields> class message {
+	public:
+		typedef std::tuple<typename TFields::t_value...> t_values;
+		constexpr static size_t size_min = sum({ TFields::size_min... });
+		constexpr static size_t size_max = sum({ TFields::size_max... });
+		constexpr static bool is_fixed_size = (size_min == size_max);
+
+		static void encode(generator & gen, const t_values & values) {
+			encode_fields(gen, values, std::index_sequence_for<TFields...>());
+		}
+
+		/// decode message that is entire [data .. data+size). Returns false if data is invalid; then values are undefined
+		static bool decode(const char * data, size_t size, t_values & values) {
+			return decode_fields(data, size, values, std::integral_constant<bool, is_fixed_size>());
+		}
+
+	private:
+		template <size_t... I> static void encode_fields(generator & gen, const t_values & values, std::index_sequence<I...>) {
+			using expand = int[];
+			(void)expand{ 0, ( TFields::encode(gen, std::get<I>(values)) , 0 )... };
+		}
+
+		static bool decode_fields(const char * data, size_t size, t_values & values, std::true_type) { // fixed size
+			if (size != size_max) return false;
+			const char * pos = data;
+			decode_fields_unchecked(pos, values, std::index_sequence_for<TFields...>());
+			return true;
+		}
+		template <size_t... I> static void decode_fields_unchecked(const char * & pos, t_values & values, std::index_sequence<I...>) {
+			using expand = int[];
+			(void)expand{ 0, ( TFields::decode_unchecked(pos, std::get<I>(values)) , 0 )... };
+		}
+
+		static bool decode_fields(const char * data, size_t size, t_values & values, std::false_type) {
+			if ((size < size_min) || (size > size_max)) return false;
+			const char * pos = data;
+			const char * const end = data + size;
+			if (! decode_fields_checked(pos, end, values, std::index_sequence_for<TFields...>())) return false;
+			return pos == end; // no garbage after it
+		}
+		template <size_t... I> static bool decode_fields_checked(const char * & pos, const char * end, t_values & values,
+			std::index_sequence<I...>)
+		{
+			bool ok = true;
+			using expand = int[];
+			(void)expand{ 0, ( ok = ok && TFields::decode(pos, end, std::get<I>(values)) , 0 )... };
+			return ok;
+		}
+};
+
+template <typename... TFields> constexpr size_t message<TFields...>::size_min;
+template <typename... TFields> constexpr size_t message<TFields...>::size_max;
+template <typename... TFields> constexpr bool message<TFields...>::is_fixed_size;
+
+} // namespace schema
+
+/// @}
+
+} // namespace trivialserialize
+
+#endif
+
@@ -82,7 +82,10 @@ const char * g_demoname_default = "route_dij";
 #include "ui.hpp"
 #include "datastore.hpp"
 #include "trivialserialize.hpp"
-#include "counter.hpp"
+#include "protocol_messages.hpp"
+#include "c_program_clock.hpp"
+#include "c_tun_offload.hpp"
+#include "c_cpu_affinity.hpp"
 #include "generate_crypto.hpp"
 
 
@@ -93,6 +96,7 @@ const char * g_demoname_default = "route_dij";
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <deque>
 
 #include <fcntl.h> // O_RDWRO_RDWR
 #include <sys/ioctl.h>
@@ -171,7 +175,7 @@ std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::t_search
 
 std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_info & obj) {
 	return ostr << "{ROUTE: next_hop=" << obj.m_nexthop
-		<< " cost=" << obj.m_cost << " time=" << obj.m_time << "}";
+		<< " cost=" << obj.m_cost << " time=" << obj.m_time << (obj.is_alive() ? "" : " DEAD") << "}";
 }
 
 std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_reason & obj) {
@@ -195,13 +199,123 @@ std::ostream & operator<<(std::ostream & ostr, const c_routing_manager::c_route_
 
 
 c_routing_manager::c_route_info::c_route_info(c_haship_addr nexthop, int cost, const c_haship_pubkey & pubkey)
+	: c_route_info(nexthop, cost, pubkey, cost)
+{ }
+
+c_routing_manager::c_route_info::c_route_info(c_haship_addr nexthop, int cost, const c_haship_pubkey & pubkey, int cost_of_link)
 	: m_state(e_route_state_found), m_nexthop(nexthop)
 	, m_pubkey(pubkey)
-	, m_cost(cost), m_time(  std::chrono::steady_clock::now() )
+	, m_cost(cost), m_cost_of_link(cost_of_link), m_time(  c_program_clock::now() )
 { }
 
 int c_routing_manager::c_route_info::get_cost() const { return m_cost; }
 
+bool c_routing_manager::c_route_info::is_alive() const { return m_state != e_route_state_dead; }
+
+namespace {
+
+uint32_t hash_mix_u32(uint32_t h) { // final mix (avalanche) from murmur3
+	h ^= h >> 16;  h *= 0x85ebca6bU;
+	h ^= h >> 13;  h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+uint32_t hash_fnv1a_u32(const unsigned char * data, size_t size, uint32_t h = 2166136261U) {
+	for (size_t i=0; i<size; ++i) { h ^= data[i];  h *= 16777619U; }
+	return h;
+}
+
+} // namespace
+
+const c_routing_manager::c_route_info & c_routing_manager::c_route_multipath::add_or_update(const c_route_info & route_info) {
+	for (auto & route : m_route) {
+		if (route->m_nexthop == route_info.m_nexthop) { // we already know path via this next hop - refresh it
+			_info("Updating route via same next hop, old: " << (*route) << " new: " << route_info);
+			*route = route_info;
+			return *route;
+		}
+	}
+
+	if (m_route.size() < route_nexthop_max) {
+		_info("Adding route as one more path (now paths=" << (m_route.size()+1) << ")");
+		m_route.push_back( make_unique<c_route_info>(route_info) );
+		return * m_route.back();
+	}
+
+	// full - replace the worst one (dead ones are worst of all), if the new one is better
+	auto worst = std::max_element( m_route.begin() , m_route.end() ,
+		[](const unique_ptr<c_route_info> & a, const unique_ptr<c_route_info> & b) {
+			if (a->is_alive() != b->is_alive()) return a->is_alive(); // dead is "bigger"
+			return a->get_cost() < b->get_cost();
+		} );
+	if ( (! (*worst)->is_alive()) || (route_info.get_cost() < (*worst)->get_cost()) ) {
+		_info("Replacing worst path " << (**worst) << " with " << route_info);
+		**worst = route_info;
+		return **worst;
+	}
+	_info("Ignoring route " << route_info << " - we know enough better paths already");
+	_throw_error( expected_not_found() );
+}
+
+std::vector<const c_routing_manager::c_route_info*> c_routing_manager::c_route_multipath::get_routes_for_flows() const {
+	std::vector<const c_route_info*> routes;
+	const c_route_info * best_cost_route = nullptr;
+	for (const auto & route : m_route) {
+		if (! route->is_alive()) continue;
+		if ((best_cost_route == nullptr) || (route->get_cost() < best_cost_route->get_cost())) best_cost_route = route.get();
+	}
+	if (best_cost_route == nullptr) return routes; // all paths are dead
+	const int cost_limit = best_cost_route->get_cost() + route_multipath_cost_slack; // [confroute]
+	for (const auto & route : m_route) {
+		if (route->is_alive() && (route->get_cost() <= cost_limit)) routes.push_back( route.get() );
+	}
+	return routes;
+}
+
+const c_routing_manager::c_route_info & c_routing_manager::c_route_multipath::get_route_for_flow(t_flow_hash flow_hash) const {
+	const auto routes = get_routes_for_flows();
+	if (routes.empty()) _throw_error( expected_not_found() ); // all paths are dead
+	std::vector<c_haship_addr> nexthops;
+	for (const auto * route : routes) nexthops.push_back( route->m_nexthop );
+	return * routes.at( choose_nexthop_for_flow( nexthops , flow_hash ) );
+}
+
+bool c_routing_manager::c_route_multipath::set_state_by_nexthop(c_haship_addr nexthop, t_route_state state) {
+	bool found = false;
+	for (auto & route : m_route) {
+		if (route->m_nexthop == nexthop) { route->m_state = state; found = true; }
+	}
+	return found;
+}
+
+bool c_routing_manager::c_route_multipath::is_any_alive() const {
+	for (const auto & route : m_route) if (route->is_alive()) return true;
+	return false;
+}
+
+c_routing_manager::t_flow_hash c_routing_manager::flow_hash_of_ipv6(const char *buff, size_t buff_size) {
+	// [confroute] the flow is: src, dst, next-header, and for TCP/UDP/SCTP also the ports (extension headers are not followed)
+	const unsigned char * data = reinterpret_cast<const unsigned char *>(buff);
+	const size_t pos_nexthdr = 6, pos_ports = 40, len_ports = 4;
+	uint32_t h = 2166136261U;
+	if (buff_size > pos_nexthdr) h = hash_fnv1a_u32( data + pos_nexthdr , 1 , h );
+	if (buff_size >= g_ipv6_rfc::header_position_of_dst + g_ipv6_rfc::header_length_of_dst) {
+		h = hash_fnv1a_u32( data + g_ipv6_rfc::header_position_of_src , g_ipv6_rfc::header_length_of_src + g_ipv6_rfc::header_length_of_dst , h );
+	}
+	if (buff_size >= pos_ports + len_ports) {
+		const unsigned char nexthdr = data[pos_nexthdr];
+		if ((nexthdr==6) || (nexthdr==17) || (nexthdr==132)) h = hash_fnv1a_u32( data + pos_ports , len_ports , h ); // TCP, UDP, SCTP
+	}
+	return hash_mix_u32(h);
+}
+
+c_routing_manager::t_flow_hash c_routing_manager::flow_hash_of_hips(c_haship_addr src_hip, c_haship_addr dst_hip) {
+	uint32_t h = hash_fnv1a_u32( src_hip.data() , src_hip.size() );
+	h = hash_fnv1a_u32( dst_hip.data() , dst_hip.size() , h );
+	return hash_mix_u32(h);
+}
+
 c_routing_manager::c_route_reason_detail::c_route_reason_detail( t_route_time when , int ttl )
 	: m_when(when) , m_ttl ( ttl )
 { }
@@ -209,14 +323,14 @@ c_routing_manager::c_route_reason_detail::c_route_reason_detail( t_route_time wh
 void c_routing_manager::c_route_search::add_request(c_routing_manager::c_route_reason reason , int ttl) {
 	auto found = m_request.find( reason );
 	if (found == m_request.end()) { // new reason for search
-		c_route_reason_detail reason_detail( std::chrono::steady_clock::now() , ttl );
+		c_route_reason_detail reason_detail( c_program_clock::now() , ttl );
 		_info("Adding new reason for search: " << reason << " details: " << reason_detail);
 		m_request.emplace(reason, reason_detail);
 	}
 	else {
 		auto & detail = found->second;
 		_info("Updating reason of search: " << reason << " old detail: " << detail );
-		detail.m_when = std::chrono::steady_clock::now();
+		detail.m_when = c_program_clock::now();
 		detail.m_ttl = std::max( detail.m_ttl , ttl ); // use the bigger TTL [confroute]
 		_info("Updating reason of search: " << reason << " new detail: " << detail );
 	}
@@ -251,29 +365,94 @@ c_routing_manager::c_route_search::c_route_search(c_haship_addr addr, int basic_
 	_info("NEW router SEARCH: " << (*this));
 }
 
+c_routing_manager::c_routing_manager()
+	: m_generation(0)
+{ }
+
+uint64_t c_routing_manager::get_generation() const { return m_generation; }
+
+std::vector<c_haship_addr> c_routing_manager::get_nexthops_for_flows(c_haship_addr dst) const {
+	std::vector<c_haship_addr> nexthops;
+	auto found = m_route_nexthop.find( dst );
+	if (found == m_route_nexthop.end()) return nexthops;
+	for (const auto * route : found->second.get_routes_for_flows()) nexthops.push_back( route->m_nexthop );
+	return nexthops;
+}
+
+size_t c_routing_manager::choose_nexthop_for_flow(const std::vector<c_haship_addr> & nexthops, t_flow_hash flow_hash) {
+	// rendezvous hashing: each flow goes to path with highest weight(flow,nexthop), so losing (or adding) one path moves only its flows
+	_check( ! nexthops.empty() );
+	size_t chosen = 0;
+	uint32_t chosen_weight = 0;
+	for (size_t i=0; i<nexthops.size(); ++i) {
+		const uint32_t weight = hash_mix_u32( hash_fnv1a_u32( nexthops[i].data() , nexthops[i].size() , flow_hash ) );
+		if ((i == 0) || (weight > chosen_weight)) { chosen = i; chosen_weight = weight; }
+	}
+	return chosen;
+}
+
 const c_routing_manager::c_route_info & c_routing_manager::add_route_info_and_return(c_haship_addr target, c_route_info route_info) {
-	// TODO(r): refactor out the create-or-update idiom
-	auto it = m_route_nexthop.find( target );
-	if (it == m_route_nexthop.end()) { // new one
-		_info("This is NEW route information." << route_info);
-		auto new_obj = make_unique<c_route_info>( route_info ); // TODO(rob): std::move it here - optimization?
-		auto emplace = m_route_nexthop.emplace( std::move(target) , std::move(new_obj) );
-		assert(emplace.second == true); // inserted new
-		return * emplace.first->second; // reference to object stored in member we own
-	} else {
-		_info("This is UPDATED route information." << route_info);
-		// TODO(r) TODONEXT pick optimal path?
-		return * it->second;
+	auto & multipath = m_route_nexthop[ target ]; // create-or-update
+	if (m_nexthop_dead.count( route_info.m_nexthop )) route_info.m_state = e_route_state_dead; // till his link is up again
+	_info("Route information for target=" << target << " (known paths=" << multipath.m_route.size() << "): " << route_info);
+	for (auto & route : multipath.m_route) { // just refreshing the same information? (e.g. direct peer at each lookup, with cost changed by jitter)
+		if ((route->m_nexthop == route_info.m_nexthop) && (route->m_state == route_info.m_state)
+			&& (std::abs( route->get_cost() - route_info.get_cost() ) < route_cost_hysteresis))
+		{
+			route->m_time = route_info.m_time;
+			return *route;
+		}
+	}
+	++m_generation;
+	try {
+		return multipath.add_or_update( route_info ); // reference to object stored in member we own
+	} catch(const expected_not_found &) { }
+	return multipath.get_route_for_flow(0); // not stored - return one of the (better) routes that we keep
+}
+
+void c_routing_manager::set_nexthop_state(c_haship_addr nexthop, t_route_state state) {
+	if (state == e_route_state_dead) m_nexthop_dead.insert(nexthop);
+	else m_nexthop_dead.erase(nexthop);
+	++m_generation;
+	for (auto & dst_routes : m_route_nexthop) {
+		if (dst_routes.second.set_state_by_nexthop(nexthop, state)) {
+			_info("Route to " << dst_routes.first << " via next hop " << nexthop << " is now " << (state==e_route_state_dead ? "DEAD" : "alive"));
+		}
+	}
+}
+
+bool c_routing_manager::set_nexthop_link_up(c_haship_addr nexthop, bool up) {
+	const bool dead = m_nexthop_dead.count(nexthop);
+	if (up != dead) return false; // no change
+	set_nexthop_state(nexthop, up ? e_route_state_found : e_route_state_dead);
+	return true;
+}
+
+bool c_routing_manager::set_nexthop_link_cost(c_haship_addr nexthop, int link_cost) {
+	bool changed = false;
+	for (auto & dst_routes : m_route_nexthop) {
+		for (auto & route : dst_routes.second.m_route) {
+			if (route->m_nexthop != nexthop) continue;
+			if (std::abs( link_cost - route->m_cost_of_link ) < route_cost_hysteresis) continue;
+			route->m_cost += link_cost - route->m_cost_of_link; // keeps the part that next hop told us
+			route->m_cost_of_link = link_cost;
+			_info("Route to " << dst_routes.first << " re-costed, as link to next hop changed: " << (*route));
+			changed = true;
+		}
 	}
+	if (changed) ++m_generation;
+	return changed;
 }
 
-const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_search(c_galaxy_node & galaxy_node, c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search , int search_ttl) {
-	_info("ROUTING-MANAGER: find: " << dst << ", for reason: " << reason );
+const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_search(c_galaxy_node & galaxy_node, c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search , int search_ttl,
+	t_flow_hash flow_hash)
+{
+	_info("ROUTING-MANAGER: find: " << dst << ", for reason: " << reason << " flow=" << flow_hash );
 
 	try {
 		const auto & peer = galaxy_node.get_peer_with_hip(dst,false); // no need for PK now, caller will do this on his own usually
 		_info("We have that peer directly: " << peer );
-		const int cost = 1; // direct peer. In future we can add connection cost or take into account congestion/lag...
+		const int cost = peer.get_link_quality().get_route_cost(); // direct peer, cost from measured RTT/jitter/loss
 		c_route_info route_info( peer.get_hip() , cost , * peer.get_pub() );
 		_info("Direct route: " << route_info);
 		const auto & route_info_ref_we_own = this -> add_route_info_and_return( dst , route_info ); // store it, so that we own this object
@@ -283,10 +462,10 @@ const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_se
 	catch(expected_not_found) { _dbg1("We do not have that dst="<<dst<<" in peers at all"); } // not found in direct peers
 
 	auto found = m_route_nexthop.find( dst ); // <--- search what we know
-	if (found != m_route_nexthop.end()) { // found
-		const auto & route = found->second;
-		_info("ROUTING-MANAGER: found route: " << (*route));
-		return *route; // <--- warning: refrerence to this-owned object that is easily invalidatd
+	if ((found != m_route_nexthop.end()) && (found->second.is_any_alive())) { // found
+		const auto & route = found->second.get_route_for_flow( flow_hash );
+		_info("ROUTING-MANAGER: found route: " << route << " (one of " << found->second.m_route.size() << " paths)");
+		return route; // <--- warning: refrerence to this-owned object that is easily invalidatd
 	}
 	else { // don't have a planned route to him
 		if (!start_search) {
@@ -300,6 +479,9 @@ const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_se
 			if (search_iter == m_search.end()) {
 				created_now=true;
 				_info("STARTED SEARCH (created brand new search record) for route to dst="<<dst);
+				static c_metric_counter & searches_count = c_metrics::get_instance().get_counter("galaxy_route_searches_total",
+					"Searches for route (and key) to a node, that we started");
+				searches_count.add();
 				auto new_search = make_unique<c_route_search>(dst, search_ttl); // start a new search, at this TTL
 				new_search->add_request( reason , search_ttl ); // add a first reason (it also sets TTL)
 				auto search_emplace = m_search.emplace( std::move(dst) , std::move(new_search) );
@@ -321,19 +503,16 @@ const c_routing_manager::c_route_info & c_routing_manager::get_route_or_maybe_se
 
 void  c_routing_manager::c_route_search::execute( c_galaxy_node & galaxy_node ) {
 	_info("Sending QUERY for HIP, with m_ttl_should_use=" << m_ttl_should_use);
-	string_as_bin data; // [protocol] for search query - format is: HIP_BINARY;TTL_BINARY;
-
-	data += string_as_bin(m_addr);
-	data += string(";");
-
 	unsigned char byte_highest_ttl = m_ttl_should_use;  assert( m_ttl_should_use == byte_highest_ttl ); // TODO(r) asserted narrowing
-	data += string(1, static_cast<char>(byte_highest_ttl) );
-	data += string(";");
 
-	galaxy_node.nodep2p_foreach_cmd( c_protocol::e_proto_cmd_findhip_query , data );
+	trivialserialize::generator gen( protocol_messages::findhip_query::size_max );
+	protocol_messages::findhip_query::encode( gen , protocol_messages::findhip_query::t_values(
+		t_bytes_view( reinterpret_cast<const char*>( m_addr.data() ) , m_addr.size() ) , byte_highest_ttl ) );
+
+	galaxy_node.nodep2p_foreach_cmd( c_protocol::e_proto_cmd_findhip_query , string_as_bin( gen.str_move() ) );
 
 	m_ttl_used = byte_highest_ttl;
-	m_ask_time = std::chrono::steady_clock::now();
+	m_ask_time = c_program_clock::now();
 }
 
 // ------------------------------------------------------------------
@@ -375,15 +554,74 @@ void c_tunserver::add_peer_simplestring(const string & simple) {
 }
 
 c_tunserver::c_tunserver()
+:
+	#ifdef __linux__
+	c_tunserver( make_unique<c_tun_device_linux>() , make_unique<c_udp_wrapper_linux>(9042) , nullptr ) //TODO port
+	#endif
+	#if defined(_WIN32) || defined(__CYGWIN__)
+	c_tunserver( make_unique<c_tun_device_windows>() , make_unique<c_udp_wrapper_windows>(9042) , nullptr ) //TODO port
+	#endif
+{
+	#ifdef __linux__
+	auto & tun_device = dynamic_cast<c_tun_device_linux&>( * m_tun_device );
+	auto & udp_device = dynamic_cast<c_udp_wrapper_linux&>( * m_udp_device );
+	_assert(udp_device.get_socket() >= 0);
+	m_event_manager = make_unique<c_event_manager_linux>( tun_device , udp_device );
+	#endif
+	#if defined(_WIN32) || defined(__CYGWIN__)
+	m_event_manager = make_unique<c_event_manager_windows>( dynamic_cast<c_tun_device_windows&>( * m_tun_device ) ,
+		dynamic_cast<c_udp_wrapper_windows&>( * m_udp_device ) );
+	#endif
+}
+
+c_tunserver::c_tunserver(unique_ptr<c_tun_device> && tun_device, unique_ptr<c_udp_wrapper> && udp_device,
+	unique_ptr<c_event_manager> && event_manager)
 :
 	m_my_name("unnamed-tunserver")
-	,m_udp_device(9042) //TODO port
-	,m_event_manager(m_tun_device, m_udp_device)
-	,m_tun_header_offset_ipv6(0) //, m_rpc_server(42000)
+	,m_tun_device(std::move(tun_device))
+	,m_udp_device(std::move(udp_device))
+	,m_event_manager(std::move(event_manager))
+	,m_tun_header_offset_ipv6(0)
+	,m_forwarding_table_dirty(true)
+	,m_forwarding_table_generation(0)
+	,m_aggregation_delay(0)
+	,m_flow_compression(true)
+	,m_io_uring_requested(false)
+	,m_busy_poll(0)
+	,m_path_mtu_max(c_path_mtu::size_max_default)
+	,m_tun_mtu(0)
+	,m_loop_keepalive_due( std::chrono::steady_clock::time_point::min() )
+	,m_loop_udp_frames_pending_sender_peer(nullptr)
+	,m_loop_was_connected(false)
+	,m_loop_was_anything_sent_from_TUN(false)
+	,m_loop_was_anything_sent_to_TUN(false)
+	,m_loop_send_kept_steps(0)
+	,m_rate_limit_changed(false)
+	,m_rate_limit_pending_set(false)
+	,m_delete_peer_changed(false)
+	,m_metric_handshake_time( c_metrics::get_instance().get_histogram("galaxy_tunnel_handshake_seconds",
+		"Time from needing an end2end tunnel to a node, to having it (finding his key)") )
+	,m_metric_peers( c_metrics::get_instance().get_gauge("galaxy_peers", "Direct peers") )
+	,m_metric_tunnels( c_metrics::get_instance().get_gauge("galaxy_tunnels", "End2end tunnels") )
+	,m_metric_transit_fast( c_metrics::get_instance().get_counter("galaxy_transit_fast_path_total",
+		"Transit frames relayed by the fast path (without parsing the blob)") )
 {
-//	m_rpc_server.register_function(
-//		"add_limit_points",
-//		std::bind(&c_tunserver::rpc_add_limit_points, this, std::placeholders::_1));
+	const char * const drop_reason_name[e_drop_reasons_count] = { "tun_not_galaxy", "no_tunnel", "invalid", "unknown_flow",
+		"ttl_expired", "next_hop_is_sender", "limit_points", "limit_unknown", "no_route", "unknown_command", "too_big", "version", "exception" };
+	for (int i=0; i<e_drop_reasons_count; ++i) {
+		m_metric_dropped.at(i) = & c_metrics::get_instance().get_counter("galaxy_dropped_packets_total",
+			"Packets (frames) dropped, by reason", c_metrics::t_labels{ {"reason", drop_reason_name[i]} });
+	}
+	m_metric_command_packets.fill(nullptr);
+	m_metric_command_bytes.fill(nullptr);
+	for (auto action : { c_keepalive::e_action_none , c_keepalive::e_action_ping , c_keepalive::e_action_hello }) {
+		m_metric_keepalive.at(action) = & c_metrics::get_instance().get_counter("galaxy_keepalive_total",
+			"Keepalive decisions for peers that were due (none: he sent us traffic recently)",
+			c_metrics::t_labels{ {"action", c_keepalive::action_name(action)} });
+	}
+	const auto now = c_program_clock::now();
+	m_limit_unknown_points.set_rate( limit_unknown_packets_per_second , 0 , now );
+	m_limit_unknown_bytes.set_rate( limit_unknown_bytes_per_second , 0 , now );
 }
 
 void c_tunserver::set_desc(shared_ptr< boost::program_options::options_description > desc) {
@@ -392,6 +630,213 @@ void c_tunserver::set_desc(shared_ptr< boost::program_options::options_descripti
 
 void c_tunserver::set_my_name(const string & name) {  m_my_name = name; _note("This node is now named: " << m_my_name);  }
 
+void c_tunserver::set_aggregation_delay(std::chrono::microseconds max_delay) {
+	m_aggregation_delay = max_delay;
+	_note("Aggregation of small data frames: max delay " << m_aggregation_delay.count() << " us" << (max_delay.count() ? "" : " (disabled)"));
+	for (auto & peer : m_peer) dynamic_cast<c_peering_udp&>( * peer.second ).set_aggregation_delay( m_aggregation_delay );
+}
+
+void c_tunserver::set_flow_compression(bool enabled) {
+	m_flow_compression = enabled;
+	_note("Compressed headers of tunneled data (to peers of protocol version "
+		<< static_cast<int>(c_protocol::version_min_compact_frames) << "+): " << (enabled ? "enabled" : "disabled"));
+	for (auto & peer : m_peer) dynamic_cast<c_peering_udp&>( * peer.second ).set_flow_compression( m_flow_compression );
+}
+
+void c_tunserver::set_send_scheduler_limits(const c_send_scheduler::t_limits & limits, int send_buffer_size) {
+	_note("Send queues: data of each peer max " << limits.m_data.m_packets_max << " datagrams, "
+		<< (limits.m_data.m_policy == c_send_queue::e_drop_codel ? "CoDel" : "tail drop")
+		<< ", shared fairly (quantum " << limits.m_quantum << " bytes); control (first) max " << limits.m_control_packets_max
+		<< "; UDP send buffer " << (send_buffer_size ? std::to_string(send_buffer_size) : std::string("default")));
+	#ifdef __linux__
+		auto & udp_device = dynamic_cast<c_udp_wrapper_linux&>( * m_udp_device );
+		udp_device.set_send_scheduler_limits(limits);
+		udp_device.set_send_buffer_size(send_buffer_size);
+	#else
+		_warn("Send queues are not used on this platform");
+	#endif
+}
+
+void c_tunserver::set_path_mtu_max(size_t size) {
+	m_path_mtu_max = std::max( size , c_path_mtu::size_base );
+	_note("Path MTU discovery: " << ((m_path_mtu_max > c_path_mtu::size_base) ? ("up to " + std::to_string(m_path_mtu_max)) : "disabled"));
+}
+
+void c_tunserver::set_io_uring(bool enabled) {
+	m_io_uring_requested = enabled;
+}
+
+void c_tunserver::set_event_loop_cpus(const std::vector<int> & cpus) {
+	m_event_loop_cpus = cpus;
+}
+
+void c_tunserver::set_busy_poll(std::chrono::microseconds time) {
+	m_busy_poll = time;
+	_note("Busy poll: " << (m_busy_poll.count() ? (std::to_string(m_busy_poll.count()) + " us before blocking") : "disabled"));
+}
+
+void c_tunserver::set_tun_offload(bool enabled) {
+	_note("TUN offloads (big TCP packets from kernel, cut by us): " << (enabled ? "requested" : "disabled"));
+	m_tun_device->set_offload(enabled);
+}
+
+void c_tunserver::start_rpc_server(unsigned short port) {
+	m_rpc_server = make_unique<c_rpc_server>(port);
+	m_rpc_server->register_function("metrics", [](const rpc_binary::t_args &, c_rpc_reply_stream &) {
+		return rpc_binary::t_args{ rpc_binary::t_value( c_metrics::get_instance().export_prometheus() ) };
+	});
+	m_rpc_server->register_function("add_limit_points", std::bind(&c_tunserver::rpc_add_limit_points, this, std::placeholders::_1));
+	m_rpc_server->register_function("set_rate_limit", std::bind(&c_tunserver::rpc_set_rate_limit, this, std::placeholders::_1));
+	m_rpc_server->register_function("delete_peer", std::bind(&c_tunserver::rpc_delete_peer, this, std::placeholders::_1));
+	_note("RPC server listens on TCP port " << port);
+}
+
+void c_tunserver::set_rate_limit(const t_rate_limit & limit) {
+	if ((limit.m_bytes_per_second > 0) && (limit.get_bytes_burst() != limit.m_bytes_burst)) {
+		_note("Rate limit: burst of bytes will be " << limit.get_bytes_burst() << " (it must fit the biggest datagram)");
+	}
+	std::lock_guard<std::mutex> lock(m_rate_limit_mutex);
+	m_rate_limit_pending = limit;
+	m_rate_limit_pending_set = true;
+	m_rate_limit_changed = true;
+}
+
+void c_tunserver::rate_limit_apply_pending() {
+	std::lock_guard<std::mutex> lock(m_rate_limit_mutex);
+	if (m_rate_limit_pending_set) {
+		m_rate_limit = m_rate_limit_pending;
+		m_rate_limit_pending_set = false;
+		_note("Rate limit of each peer: " << m_rate_limit);
+		for (auto & peer : m_peer) peer.second->set_rate_limit( m_rate_limit );
+	}
+	for (const auto & points : m_limit_points_pending) {
+		auto found = m_peer.find( points.first );
+		if (found == m_peer.end()) { _warn("Can not add limit points, not found peer " << points.first); continue; }
+		found->second->add_limit_points( points.second );
+		_info("Added " << points.second << " limit points to peer " << points.first);
+	}
+	m_limit_points_pending.clear();
+	m_rate_limit_changed = false;
+}
+
+bool c_tunserver::unknown_sender_allow(size_t size) {
+	const auto now = c_program_clock::now();
+	if (m_limit_unknown_points.take(1, now)) {
+		if (m_limit_unknown_bytes.take(size, now)) return true;
+		m_limit_unknown_points.add(1); // not used after all
+	}
+	return false;
+}
+
+bool c_tunserver::rpc_add_limit_points(const string &args) {
+	std::istringstream iss(args);
+	std::string peer_ip;
+	long int points = 1000;
+	iss >> peer_ip;
+	if (! (iss >> points)) points = 1000; // not given
+	try {
+		c_haship_addr peer_hip(c_haship_addr::tag_constr_by_addr_dot(), peer_ip);
+		std::lock_guard<std::mutex> lock(m_rate_limit_mutex);
+		m_limit_points_pending.emplace_back( peer_hip , points );
+		m_rate_limit_changed = true;
+	}
+	catch (const std::exception &e) {
+		_warn("Invalid peer address for add_limit_points: " << peer_ip << " " << e.what());
+		return false;
+	}
+	return true;
+}
+
+bool c_tunserver::rpc_set_rate_limit(const string &args) {
+	std::istringstream iss(args);
+	t_rate_limit limit;
+	if (! (iss >> limit.m_packets_per_second >> limit.m_packets_burst >> limit.m_bytes_per_second >> limit.m_bytes_burst)) {
+		_warn("Invalid arguments for set_rate_limit: " << args);
+		return false;
+	}
+	if ((limit.m_packets_per_second < 0) || (limit.m_packets_burst < 0) || (limit.m_bytes_per_second < 0) || (limit.m_bytes_burst < 0)) {
+		_warn("Negative rate limit: " << args);
+		return false;
+	}
+	set_rate_limit(limit);
+	return true;
+}
+
+bool c_tunserver::rpc_delete_peer(const string &args) {
+	std::istringstream iss(args);
+	std::string peer_ip;
+	iss >> peer_ip;
+	try {
+		c_haship_addr peer_hip(c_haship_addr::tag_constr_by_addr_dot(), peer_ip);
+		std::lock_guard<std::mutex> lock(m_delete_peer_mutex);
+		m_delete_peer_pending.push_back( peer_hip );
+		m_delete_peer_changed = true;
+	}
+	catch (const std::exception &e) {
+		_warn("Invalid peer address for delete_peer: " << peer_ip << " " << e.what());
+		return false;
+	}
+	return true;
+}
+
+void c_tunserver::delete_peer_apply_pending() {
+	std::vector<c_haship_addr> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_delete_peer_mutex);
+		pending.swap( m_delete_peer_pending );
+		m_delete_peer_changed = false;
+	}
+	for (const auto & hip : pending) delete_peer( hip );
+}
+
+void c_tunserver::metrics_drop(t_drop_reason reason) {
+	m_metric_dropped.at(reason)->add();
+}
+
+void c_tunserver::metrics_command_received(c_protocol::t_proto_cmd cmd, size_t size) {
+	const unsigned char index = static_cast<unsigned char>(cmd);
+	if (m_metric_command_packets.at(index) == nullptr) {
+		const c_metrics::t_labels labels{ {"cmd", std::to_string(index)} };
+		m_metric_command_packets.at(index) = & c_metrics::get_instance().get_counter("galaxy_command_received_packets_total",
+			"Frames received from peers, by protocol command", labels);
+		m_metric_command_bytes.at(index) = & c_metrics::get_instance().get_counter("galaxy_command_received_bytes_total",
+			"Bytes of frames received from peers, by protocol command", labels);
+	}
+	m_metric_command_packets.at(index)->add();
+	m_metric_command_bytes.at(index)->add(size);
+}
+
+void c_tunserver::metrics_tunnel(const c_haship_addr & hip, bool sent, size_t size) {
+	auto found = m_metric_tunnel.find(hip);
+	if (found == m_metric_tunnel.end()) {
+		const c_metrics::t_labels labels{ {"node", STR(hip)} };
+		auto & metrics = c_metrics::get_instance();
+		t_tunnel_metrics tunnel_metrics;
+		tunnel_metrics.m_sent_packets = & metrics.get_counter("galaxy_tunnel_sent_packets_total",
+			"Our packets (from TUN) sent in end2end tunnel to the node", labels);
+		tunnel_metrics.m_sent_bytes = & metrics.get_counter("galaxy_tunnel_sent_bytes_total",
+			"Bytes of our packets (from TUN) sent in end2end tunnel to the node", labels);
+		tunnel_metrics.m_received_packets = & metrics.get_counter("galaxy_tunnel_received_packets_total",
+			"Packets (to TUN) received in end2end tunnel from the node", labels);
+		tunnel_metrics.m_received_bytes = & metrics.get_counter("galaxy_tunnel_received_bytes_total",
+			"Bytes of packets (to TUN) received in end2end tunnel from the node", labels);
+		found = m_metric_tunnel.emplace(hip, tunnel_metrics).first;
+	}
+	if (sent) {
+		found->second.m_sent_packets->add();
+		found->second.m_sent_bytes->add(size);
+	} else {
+		found->second.m_received_packets->add();
+		found->second.m_received_bytes->add(size);
+	}
+}
+
+void c_tunserver::metrics_handshake_started(const c_haship_addr & hip) {
+	const size_t pending_max = 1000; // do not remember more nodes that we never reach
+	if (m_metric_handshake_start.size() >= pending_max) return;
+	m_metric_handshake_start.emplace(hip, c_program_clock::now()); // keeps the older time if already there
+}
+
 const antinet_crypto::c_multikeys_pub & c_tunserver::read_my_IDP_pub() const {
 	return m_my_IDI_pub;
 }
@@ -422,9 +867,17 @@ void c_tunserver::configure_mykey() {
 	std::unique_ptr<antinet_crypto::c_multikeys_PAIR> my_IDI;
 	my_IDI = std::make_unique<antinet_crypto::c_multikeys_PAIR>();
 	my_IDI->datastore_load_PRV_and_pub(IDI_name);
+	configure_mykey( * my_IDI );
+
+	// remove IDP from RAM
+	// (use of locked_string should take care of actually shreding memory)
+	my_IDI.reset(nullptr);
+}
+
+void c_tunserver::configure_mykey(antinet_crypto::c_multikeys_PAIR & my_IDI) {
 	// getting HIP from IDI
-	auto IDI_ip_bin = my_IDI->get_ipv6_string_bin() ;
-	auto IDI_ip_hexdot = my_IDI->get_ipv6_string_hexdot() ;
+	auto IDI_ip_bin = my_IDI.get_ipv6_string_bin() ;
+	auto IDI_ip_hexdot = my_IDI.get_ipv6_string_hexdot() ;
 	// IDI_hexdot.at(0)='z'; // for testing
 	try {
 		std::ostringstream oss; oss<<"Your Hash-IP address looks not valid (not a Galaxy42 address?)"
@@ -444,19 +897,15 @@ void c_tunserver::configure_mykey() {
 	my_IDC.generate(antinet_crypto::e_crypto_system_type_X25519,1);
 	// signing it by IDI
 	std::string IDC_pub_to_sign = my_IDC.m_pub.serialize_bin();
-	antinet_crypto::c_multisign IDC_IDI_signature = my_IDI->multi_sign(IDC_pub_to_sign);
+	antinet_crypto::c_multisign IDC_IDI_signature = my_IDI.multi_sign(IDC_pub_to_sign);
 
 	// example veryifying
-	antinet_crypto::c_multikeys_pub::multi_sign_verify(IDC_IDI_signature, IDC_pub_to_sign, my_IDI->m_pub);
+	antinet_crypto::c_multikeys_pub::multi_sign_verify(IDC_IDI_signature, IDC_pub_to_sign, my_IDI.m_pub);
 
 	// save signature and IDI publickey in tunserver
-	m_my_IDI_pub = my_IDI->m_pub;
+	m_my_IDI_pub = my_IDI.m_pub;
 	m_IDI_IDC_sig = IDC_IDI_signature;
 
-	// remove IDP from RAM
-	// (use of locked_string should take care of actually shreding memory)
-	my_IDI.reset(nullptr);
-
 	// for debug, hip from IDC
 	auto IDC_ip_hexdot = my_IDC.get_ipv6_string_hexdot() ;
 
@@ -480,9 +929,18 @@ void c_tunserver::configure_mykey() {
 // add peer
 void c_tunserver::add_peer(const t_peering_reference & peer_ref) { ///< add this as peer
 	UNUSED(peer_ref);
-	auto peering_ptr = make_unique<c_peering_udp>(peer_ref, m_udp_device);
+	auto peering_ptr = make_unique<c_peering_udp>(peer_ref, * m_udp_device);
+	peering_ptr->set_aggregation_delay( m_aggregation_delay );
+	peering_ptr->set_flow_compression( m_flow_compression );
+	peering_ptr->set_rate_limit( m_rate_limit );
+	peering_ptr->m_path_mtu.set_size_max( m_udp_device->can_send_unfragmented() ? m_path_mtu_max : c_path_mtu::size_base );
 	// key is unique in map
-	m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) );
+	auto inserted = m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) );
+	if (inserted.second) m_peer_by_pip[ peer_ref.peering_addr ] = inserted.first->second.get();
+	m_routing_manager.set_nexthop_link_up( peer_ref.haship_addr , true ); // e.g. marked dead before he was our peer
+	m_forwarding_table_dirty = true;
+	m_loop_keepalive_due = std::chrono::steady_clock::time_point::min(); // he is due at once
+	m_metric_peers.set( m_peer.size() );
 }
 
 void c_tunserver::add_peer_append_pubkey(const t_peering_reference & peer_ref,
@@ -490,9 +948,19 @@ unique_ptr<c_haship_pubkey> && pubkey)
 {
 	auto find = m_peer.find( peer_ref.haship_addr );
 	if (find == m_peer.end()) { // no such peer yet
-		auto peering_ptr = make_unique<c_peering_udp>(peer_ref, m_udp_device);
+		auto peering_ptr = make_unique<c_peering_udp>(peer_ref, * m_udp_device);
+		peering_ptr->set_aggregation_delay( m_aggregation_delay );
+		peering_ptr->set_flow_compression( m_flow_compression );
+	peering_ptr->set_flow_compression( m_flow_compression );
+		peering_ptr->set_rate_limit( m_rate_limit );
+		peering_ptr->m_path_mtu.set_size_max( m_udp_device->can_send_unfragmented() ? m_path_mtu_max : c_path_mtu::size_base );
 		peering_ptr->set_pubkey(std::move(pubkey));
-		m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) );
+		auto inserted = m_peer.emplace( std::make_pair( peer_ref.haship_addr ,  std::move(peering_ptr) ) );
+		m_peer_by_pip[ peer_ref.peering_addr ] = inserted.first->second.get();
+		m_routing_manager.set_nexthop_link_up( peer_ref.haship_addr , true ); // e.g. marked dead before he was our peer
+		m_forwarding_table_dirty = true;
+		m_loop_keepalive_due = std::chrono::steady_clock::time_point::min(); // he is due at once
+		m_metric_peers.set( m_peer.size() );
 	} else { // update existing
 		auto & peering_ptr = find->second;
 		peering_ptr->set_pubkey(std::move(pubkey));
@@ -500,6 +968,33 @@ unique_ptr<c_haship_pubkey> && pubkey)
 }
 
 
+void c_tunserver::delete_peer(const c_haship_addr & hip) {
+	auto found = m_peer.find( hip );
+	if (found == m_peer.end()) { _warn("Can not delete peer, not found: " << hip); return; }
+	const c_ip46_addr pip = found->second->get_pip();
+	if (m_loop_udp_frames_pending_sender_peer == found->second.get()) { // rest of his aggregated datagram
+		m_loop_udp_frames_pending.clear();
+		m_loop_udp_frames_pending_sender_peer = nullptr;
+	}
+	m_peer.erase( found );
+	m_forwarding_table_dirty = true; // it has pointers into m_peer
+	m_routing_manager.set_nexthop_link_up( hip , false ); // flows move to other paths
+	m_metric_peers.set( m_peer.size() );
+
+	c_peering * peer_same_pip = nullptr; // other peer at the same IP and port (e.g. added again with other HIP)
+	const c_send_scheduler::t_address_less less;
+	for (auto & peer : m_peer) {
+		if ((! less( peer.second->get_pip() , pip )) && (! less( pip , peer.second->get_pip() ))) peer_same_pip = peer.second.get();
+	}
+	if (peer_same_pip) m_peer_by_pip[ pip ] = peer_same_pip;
+	else m_peer_by_pip.erase( pip );
+
+	auto & metrics = c_metrics::get_instance(); // his series would stay forever (c_peering metrics are labeled by peer and addr)
+	size_t metrics_removed = metrics.remove_labeled( "peer" , STR(hip) );
+	if (! peer_same_pip) metrics_removed += metrics.remove_labeled( "addr" , STR(pip) ); // e.g. of send queue
+	_note("Deleted peer " << hip << " at " << pip << " (and " << metrics_removed << " metrics of him)");
+}
+
 void c_tunserver::add_tunnel_to_pubkey(const c_haship_pubkey & pubkey)
 {
 	_dbg1("add pubkey: " << pubkey.get_ipv6_string_hexdot());
@@ -511,6 +1006,12 @@ void c_tunserver::add_tunnel_to_pubkey(const c_haship_pubkey & pubkey)
 		// TODO nicer name?
 		auto ct = make_unique< c_tunnel_use >( m_my_IDC , pubkey , "Tunnel" );
 		m_tunnel[ hip ] = std::move(ct);
+		m_metric_tunnels.set( m_tunnel.size() );
+		auto handshake = m_metric_handshake_start.find(hip);
+		if (handshake != m_metric_handshake_start.end()) {
+			m_metric_handshake_time.add( std::chrono::duration_cast<std::chrono::microseconds>( c_program_clock::now() - handshake->second ) );
+			m_metric_handshake_start.erase(handshake);
+		}
 	} else {
 		_dbg2("Tunnel already is created for HIP="<<hip);
 	}
@@ -535,34 +1036,55 @@ void c_tunserver::prepare_socket() {
 		// ...to the device to which we are setting IP address here:
 		assert(address[0] == 0xFD);
 		assert(address[1] == 0x42);
-		m_tun_device.set_ipv6_address(address, 16);
+		m_tun_device->set_ipv6_address(address, 16);
 	}
-
-#ifdef __linux__
-	_assert(m_udp_device.get_socket() >= 0);
-#endif
-
+	prepare_cpu_placement(); // first, so the packet memory (e.g. of io_uring) is allocated on our NUMA node
+	prepare_io_uring();
+	if (m_event_manager) m_event_manager->set_busy_poll( m_busy_poll );
+	#ifdef __linux__
+		if (auto * udp_device = dynamic_cast<c_udp_wrapper_linux*>( m_udp_device.get() )) {
+			udp_device->set_busy_poll( static_cast<int>( m_busy_poll.count() ) );
+		}
+	#endif
 }
-#ifdef __linux__
-
-void c_tunserver::wait_for_fd_event() { // wait for fd event
-	_info("Selecting");
-	// set the wait for read events:
-	FD_ZERO(& m_fd_set_data);
-	FD_SET(m_udp_device.get_socket(), &m_fd_set_data);
 
-	auto fd_max = m_udp_device.get_socket(); // = std::max(m_tun_fd, m_udp_device.get_socket());
-	_assert(fd_max < std::numeric_limits<decltype(fd_max)>::max() -1); // to be more safe, <= would be enough too
-	_assert(fd_max >= 1);
-
-	timeval timeout { 0 , 500 }; // http://pubs.opengroup.org/onlinepubs/007908775/xsh/systime.h.html
+void c_tunserver::prepare_cpu_placement() {
+	if (m_event_loop_cpus.empty()) return;
+	if (! c_cpu_affinity::pin_this_thread( m_event_loop_cpus )) return;
+	std::ostringstream cpus_text;
+	for (int cpu : m_event_loop_cpus) cpus_text << (cpus_text.tellp() ? "," : "") << cpu;
+	const int node = c_cpu_affinity::get_numa_node_of_cpu( m_event_loop_cpus.front() );
+	_note("Event loop runs on CPUs " << cpus_text.str() << ", NUMA node " << (node >= 0 ? std::to_string(node) : "unknown"));
+	if (node >= 0) { // its memory should be there too
+		for (int cpu : m_event_loop_cpus) {
+			if (c_cpu_affinity::get_numa_node_of_cpu( cpu ) != node) {
+				_warn("CPUs of event loop are on different NUMA nodes, memory access from some of them will be slower");
+				break;
+			}
+		}
+	}
+}
 
-	auto select_result = select( fd_max+1, &m_fd_set_data, NULL, NULL, & timeout); // <--- blocks
-	_assert(select_result >= 0);
+void c_tunserver::prepare_io_uring() {
+	if (! m_io_uring_requested) return;
+	#if defined(__linux__) && IO_URING_AVAILABLE
+		auto tun_device = dynamic_cast<c_tun_device_linux*>( m_tun_device.get() );
+		auto udp_device = dynamic_cast<c_udp_wrapper_linux*>( m_udp_device.get() );
+		if ((tun_device == nullptr) || (udp_device == nullptr)) { // e.g. devices of the simulator
+			_warn("Can not use io_uring: TUN or UDP is not the device of this system; keeping the current event manager");
+			return;
+		}
+		try {
+			auto event_manager = make_unique<c_event_manager_uring>( * tun_device , * udp_device ); // takes over the devices
+			m_event_manager = std::move( event_manager ); // only now, when it works
+			_note("Using io_uring for TUN and UDP");
+		} catch(const std::runtime_error & ex) {
+			_warn("Can not use io_uring (" << ex.what() << "), keeping the current event manager");
+		}
+	#else
+		_warn("This build has no io_uring, using select()");
+	#endif
 }
-#else
-	//void c_tunserver::prepare_socket(){}
-#endif
 
 std::pair<c_haship_addr,c_haship_addr> c_tunserver::parse_tun_ip_src_dst(const char *buff, size_t buff_size) { ///< the same, but with ipv6_offset that matches our current TUN
 	return parse_tun_ip_src_dst(buff,buff_size, m_tun_header_offset_ipv6 );
@@ -608,30 +1130,136 @@ std::pair<c_haship_addr,c_haship_addr> c_tunserver::parse_tun_ip_src_dst(const c
 	return std::make_pair( ret_src , ret_dst );
 }
 
-void c_tunserver::peering_ping_all_peers() {
-	auto & peers = m_peer;
-	_info("Sending ping to all peers (count=" << peers.size() << ")");
-	for(auto & v : m_peer) { // to each peer
-		auto & target_peer = v.second;
-		auto peer_udp = unique_cast_ptr<c_peering_udp>( target_peer ); // upcast to UDP peer derived
+std::chrono::microseconds c_tunserver::peering_flush_aggregated(std::chrono::steady_clock::time_point now) {
+	std::chrono::microseconds wait_max = std::chrono::seconds(3); // when nothing is waiting
+	if (! m_aggregation_delay.count()) return wait_max;
+	for (auto & peer : m_peer) {
+		auto & peer_udp = dynamic_cast<c_peering_udp&>( * peer.second );
+		peer_udp.aggregation_flush_if_due( now );
+		std::chrono::steady_clock::time_point due;
+		if (peer_udp.get_aggregation_due_time( due )) {
+			wait_max = std::min( wait_max , std::chrono::duration_cast<std::chrono::microseconds>( due - now ) );
+		}
+	}
+	return std::max( wait_max , std::chrono::microseconds(0) );
+}
+
+std::chrono::microseconds c_tunserver::peering_keepalive(std::chrono::steady_clock::time_point now) {
+	if (now < m_loop_keepalive_due) return std::chrono::duration_cast<std::chrono::microseconds>( m_loop_keepalive_due - now );
+	auto due_min = std::chrono::steady_clock::time_point::max();
+	for (auto & v : m_peer) {
+		auto & peer_udp = dynamic_cast<c_peering_udp&>( * v.second );
+		if (now >= peer_udp.m_link_quality.get_due_time()) { // our ping was not answered within RTO
+			peer_udp.m_link_quality.on_timer( now );
+			if (peer_udp.m_link_quality.is_up()) peer_udp.m_keepalive.on_ping_lost( now ); // once more, so dead link is found soon
+			peering_link_state_update( peer_udp );
+		}
+		if (now >= peer_udp.m_keepalive.get_due_time()) {
+			const auto action = peer_udp.m_keepalive.poll( now , peer_udp.is_pubkey() );
+			_dbg1("Keepalive to " << peer_udp.get_hip() << ": " << c_keepalive::action_name(action) << ", " << peer_udp.m_keepalive);
+			m_metric_keepalive.at(action)->add();
+			if (action == c_keepalive::e_action_hello) peering_send_hello( peer_udp );
+			if (action != c_keepalive::e_action_none) peering_send_ping( peer_udp );
+		}
+		// older node would not echo the probes: then it is not known, so he keeps c_path_mtu::size_base (also till we hear from him)
+		const bool probing = peer_udp.get_protocol_version() >= c_protocol::version_min_ping_reply;
+		if (probing && (now >= peer_udp.m_path_mtu.get_due_time())) {
+			const size_t path_mtu_before = peer_udp.m_path_mtu.get_size();
+			size_t probe_size = 0;
+			if (peer_udp.m_path_mtu.get_probe( now , probe_size )) peering_send_probe( peer_udp , probe_size );
+			if (peer_udp.m_path_mtu.get_size() != path_mtu_before) peering_path_mtu_changed( peer_udp ); // e.g. probes were lost
+		}
+		due_min = std::min({ due_min , peer_udp.m_keepalive.get_due_time() , peer_udp.m_link_quality.get_due_time() ,
+			probing ? peer_udp.m_path_mtu.get_due_time() : std::chrono::steady_clock::time_point::max() });
+	}
+	m_loop_keepalive_due = due_min;
+	if (due_min == std::chrono::steady_clock::time_point::max()) return std::chrono::seconds(3); // no peers
+	return std::chrono::duration_cast<std::chrono::microseconds>( std::max( due_min , now ) - now );
+}
+
+void c_tunserver::peering_send_hello(c_peering_udp & peer) {
+	// [protocol] build raw
+	trivialserialize::generator gen(8000);
+	gen.push_varstring( m_my_IDC.get_serialize_bin_pubkey() );
+	gen.push_varstring( m_my_IDI_pub.serialize_bin());
+	gen.push_varstring( m_IDI_IDC_sig.serialize_bin());
+	string_as_bin cmd_data( gen.str_move() );
+	peer.send_data_udp_cmd(c_protocol::e_proto_cmd_public_hi, cmd_data, -1);
+}
+
+void c_tunserver::peering_send_ping(c_peering_udp & peer) {
+	// [protocol] timestamped ping, he echoes it back, so we measure the link: SEQ(4) TIMESTAMP_US(8), see c_protocol::public_ping_size
+	auto now = std::chrono::time_point_cast<std::chrono::microseconds>( c_program_clock::now() );
+	const int version = peer.get_protocol_version();
+	const bool counted = (version == 0) || (version >= c_protocol::version_min_ping_reply); // older node would not answer it
+	auto seq = counted ? peer.m_link_quality.on_ping_sent( now ) : c_link_quality::t_ping_seq(0); // SEQ 0 is not counted
+	trivialserialize::generator gen_ping(12);
+	gen_ping.push_integer_u<4>( seq );
+	gen_ping.push_integer_u<8>( static_cast<uint64_t>( now.time_since_epoch().count() ) );
+	peer.send_data_udp_cmd(c_protocol::e_proto_cmd_public_ping_request, string_as_bin( gen_ping.str_move() ), -1);
+	if (counted) peering_link_state_update( peer ); // sending it counted the pings that were not answered
+}
 
-		// [protocol] build raw
-		trivialserialize::generator gen(8000);
-		gen.push_varstring( m_my_IDC.get_serialize_bin_pubkey() );
-		gen.push_varstring( m_my_IDI_pub.serialize_bin());
-		gen.push_varstring( m_IDI_IDC_sig.serialize_bin());
-		string_as_bin cmd_data( gen.str_move() );
-		// TODONOW
-		peer_udp->send_data_udp_cmd(c_protocol::e_proto_cmd_public_hi, cmd_data, m_udp_device.get_socket());
+void c_tunserver::peering_link_state_update(const c_peering & peer) {
+	m_routing_manager.set_nexthop_link_cost( peer.get_hip() , peer.get_link_quality().get_route_cost() );
+	const bool up = peer.get_link_quality().is_up();
+	if (! m_routing_manager.set_nexthop_link_up( peer.get_hip() , up )) return;
+	if (up) _note("Link to peer " << peer.get_hip() << " is up again, routes via him are used");
+	else _warn("Link to peer " << peer.get_hip() << " is down (pings not answered), flows move to other paths");
+}
+
+void c_tunserver::peering_send_probe(c_peering_udp & peer, size_t size) {
+	// [protocol] ping with SEQ 0 (so it is not counted in c_link_quality), padded with zeros; he echoes it whole
+	auto now = std::chrono::time_point_cast<std::chrono::microseconds>( c_program_clock::now() );
+	trivialserialize::generator gen(size);
+	gen.push_byte_u( c_protocol::current_version );
+	gen.push_byte_u( c_protocol::e_proto_cmd_public_ping_request );
+	gen.push_integer_u<4>( uint32_t(0) );
+	gen.push_integer_u<8>( static_cast<uint64_t>( now.time_since_epoch().count() ) );
+	std::string probe = gen.str_move();
+	probe.resize( std::max( size , probe.size() ) , '\0' );
+	_dbg1("Path MTU probe of " << probe.size() << " octets to " << peer.get_hip());
+	if (! m_udp_device->send_data_unfragmented( peer.get_pip() , probe.data() , probe.size() )) { // not even our own link takes it
+		if (peer.m_path_mtu.on_probe_too_big( size , now )) peering_path_mtu_changed( peer );
 	}
 }
 
+void c_tunserver::peering_path_mtu_changed(c_peering_udp & peer) {
+	_note("Path MTU to peer " << peer.get_hip() << " is now " << peer.get_path_mtu().get_size()
+		<< ", packets from TUN up to " << get_inner_mtu(peer));
+	peer.on_path_mtu_changed();
+	m_forwarding_table_dirty = true; // inner MTU of destinations via him
+	tun_mtu_update();
+}
+
+size_t c_tunserver::get_inner_mtu(const c_peering & peer) const {
+	const size_t ipv6_mtu_min = 1280; // smaller link is not allowed in IPv6: then datagrams are fragmented, as before
+	const size_t overhead = c_protocol::tunneled_data_overhead + m_tun_header_offset_ipv6; // the TUN header is sent too
+	const size_t path_mtu = peer.get_path_mtu().get_size();
+	return (path_mtu > ipv6_mtu_min + overhead) ? (path_mtu - overhead) : ipv6_mtu_min;
+}
+
+size_t c_tunserver::get_inner_mtu_to(const c_haship_addr & dst_hip) {
+	if (m_forwarding_table_dirty || (m_forwarding_table_generation != m_routing_manager.get_generation())) forwarding_table_rebuild();
+	auto found = m_forwarding_table.find( dst_hip );
+	if (found == m_forwarding_table.end()) return 0;
+	return found->second.m_inner_mtu; // for each packet from TUN, so it is computed in forwarding_table_rebuild()
+}
+
+void c_tunserver::tun_mtu_update() {
+	size_t mtu = 1280;
+	for (const auto & peer : m_peer) mtu = std::max( mtu , get_inner_mtu( * peer.second ) );
+	if (mtu == m_tun_mtu) return;
+	m_tun_mtu = mtu;
+	m_tun_device->set_mtu( m_tun_mtu );
+}
+
 void c_tunserver::nodep2p_foreach_cmd(c_protocol::t_proto_cmd cmd, string_as_bin data) {
 	_info("Sending a COMMAND to peers:");
 	for(auto & v : m_peer) { // to each peer
 		auto & target_peer = v.second;
 		auto peer_udp = unique_cast_ptr<c_peering_udp>( target_peer ); // upcast to UDP peer derived
-		peer_udp->send_data_udp_cmd(cmd, data, m_udp_device.get_socket());
+		peer_udp->send_data_udp_cmd(cmd, data, -1);
 	}
 }
 
@@ -658,7 +1286,8 @@ bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method
 	c_haship_addr src_hip, c_haship_addr dst_hip,
 	c_haship_addr next_hip,
 	c_routing_manager::c_route_reason reason,
-	int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used)
+	int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+	c_routing_manager::t_flow_hash flow_hash)
 {
 	// --- choose next hop in peering ---
 
@@ -672,6 +1301,7 @@ bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method
 		_info("ROUTE: can not find in direct peers next_hip="<<next_hip);
 		if (recurse_level>1) {
 			_warn("DROP: Recruse level too big in choosing peer");
+			metrics_drop(e_drop_no_route);
 			return false; // <---
 		}
 
@@ -679,14 +1309,18 @@ bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method
 		try {
 			_info("Trying to find a route to it");
 			const int default_ttl = c_protocol::ttl_max_accepted; // for this case [confroute]
-			const auto & route = m_routing_manager.get_route_or_maybe_search(*this, next_hip , reason , true, default_ttl);
+			const auto & route = m_routing_manager.get_route_or_maybe_search(*this, next_hip , reason , true, default_ttl, flow_hash);
 			_info("Found route: " << route);
 			via_hip = route.m_nexthop;
-		} catch(...) { _info("ROUTE MANAGER: can not find route at all"); return false; }
+		} catch(...) { _info("ROUTE MANAGER: can not find route at all"); metrics_drop(e_drop_no_route); return false; }
 		_info("Route found via hip: via_hip = " << via_hip);
 		bool ok = this->route_tun_data_to_its_destination_detail(method, buff, buff_size,
-			src_hip, dst_hip, via_hip, reason, recurse_level+1, data_route_ttl, nonce_used);
-		if (!ok) { _info("Routing failed"); return false; } // <---
+			src_hip, dst_hip, via_hip, reason, recurse_level+1, data_route_ttl, nonce_used, flow_hash);
+		if (!ok) {
+			_info("Routing failed - marking paths via " << via_hip << " as dead, so next packets use other paths");
+			m_routing_manager.set_nexthop_state(via_hip, c_routing_manager::e_route_state_dead);
+			return false; // <---
+		}
 		_info("Routing seems to succeed");
 	}
 	else { // next_hip is a direct peer, send to it:
@@ -695,7 +1329,7 @@ bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method
 		auto peer_udp = unique_cast_ptr<c_peering_udp>( target_peer ); // upcast to UDP peer derived
 
 		// send it on wire:
-		peer_udp->send_data_udp(buff, buff_size, m_udp_device.get_socket(), src_hip, dst_hip, data_route_ttl, nonce_used); // <--- *** actually send the data
+		peer_udp->send_data_udp(buff, buff_size, -1, src_hip, dst_hip, data_route_ttl, nonce_used, flow_hash); // <--- *** actually send the data
 	}
 	return true;
 }
@@ -703,11 +1337,12 @@ bool c_tunserver::route_tun_data_to_its_destination_detail(t_route_method method
 bool c_tunserver::route_tun_data_to_its_destination_top(t_route_method method,
 	const char *buff, size_t buff_size,
 	c_haship_addr src_hip, c_haship_addr dst_hip,
-	c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used) {
+	c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+	c_routing_manager::t_flow_hash flow_hash) {
 	try {
 		_info("Sending data between end2end " << src_hip <<"--->" << dst_hip);
 		bool ok = this->route_tun_data_to_its_destination_detail(method, buff, buff_size,
-			src_hip, dst_hip, dst_hip, reason, 0, data_route_ttl, nonce_used);
+			src_hip, dst_hip, dst_hip, reason, 0, data_route_ttl, nonce_used, flow_hash);
 		if (!ok) { _info("Routing/sending failed (top level)"); return false; }
 	} catch(std::exception &e) {
 		_warn("Can not send to peer, because:" << e.what()); // TODO more info (which peer, addr, number)
@@ -718,458 +1353,689 @@ bool c_tunserver::route_tun_data_to_its_destination_top(t_route_method method,
 	return true;
 }
 
-c_peering & c_tunserver::find_peer_by_sender_peering_addr( c_ip46_addr ip ) const {
-	for(auto & v : m_peer) { if (v.second->get_pip() == ip) return * v.second.get(); }
-	_throw_error( std::runtime_error("We do not know a peer with such IP=" + STR(ip)) );
+void c_tunserver::forwarding_table_rebuild() {
+	m_forwarding_table.clear();
+	for (auto & v : m_peer) { // direct peers are reached directly
+		auto & entry = m_forwarding_table[ v.first ];
+		entry.m_nexthop.push_back( unique_cast_ptr<c_peering_udp>( v.second ) );
+		entry.m_nexthop_hip.push_back( v.first );
+	}
+	for (const auto & dst_routes : m_routing_manager.m_route_nexthop) {
+		if (m_forwarding_table.count( dst_routes.first )) continue; // direct peer, already done
+		t_forwarding_entry entry;
+		entry.m_nexthop_hip = m_routing_manager.get_nexthops_for_flows( dst_routes.first ); // the same paths as the slow path
+		for (const auto & nexthop_hip : entry.m_nexthop_hip) {
+			auto peer_it = m_peer.find( nexthop_hip );
+			if (peer_it == m_peer.end()) break; // not a direct peer (yet): leave it to slow path, it can route to it
+			entry.m_nexthop.push_back( unique_cast_ptr<c_peering_udp>( peer_it->second ) );
+		}
+		if (entry.m_nexthop_hip.empty() || (entry.m_nexthop.size() != entry.m_nexthop_hip.size())) continue;
+		m_forwarding_table.emplace( dst_routes.first , std::move(entry) );
+	}
+	for (auto & dst_entry : m_forwarding_table) {
+		auto & entry = dst_entry.second;
+		entry.m_inner_mtu = 0;
+		for (const auto * nexthop : entry.m_nexthop) { // any of them can be used, by flow
+			const size_t nexthop_mtu = get_inner_mtu( * nexthop );
+			entry.m_inner_mtu = entry.m_inner_mtu ? std::min( entry.m_inner_mtu , nexthop_mtu ) : nexthop_mtu;
+		}
+	}
+	m_forwarding_table_dirty = false;
+	m_forwarding_table_generation = m_routing_manager.get_generation();
+	_info("Forwarding table rebuilt, destinations: " << m_forwarding_table.size());
 }
 
-//bool c_tunserver::rpc_add_limit_points(const string &peer_ip) {
-//	c_haship_addr peer_hip(c_haship_addr::tag_constr_by_addr_dot(), peer_ip);
-//	try {
-//		m_peer.at(peer_hip)->add_limit_points(1000);
-//	}
-//	catch (const std::out_of_range &e) {
-//		_warn("not found peer " << peer_ip);
-//		return false;
-//	}
-//	return true;
-//}
+c_peering_udp * c_tunserver::forward_transit_nexthop(const c_haship_addr & src_hip, const c_haship_addr & dst_hip,
+	const c_peering * sender, unsigned char & ttl, c_send_scheduler::t_flow & flow_hash, bool & dropped)
+{
+	dropped = false;
+	if (dst_hip == m_my_hip) return nullptr; // for us
+
+	if (m_forwarding_table_dirty || (m_forwarding_table_generation != m_routing_manager.get_generation())) forwarding_table_rebuild();
+	auto found = m_forwarding_table.find( dst_hip );
+	if (found == m_forwarding_table.end()) return nullptr; // slow path will search for route
+	const auto & entry = found->second;
+
+	dropped = true;
+	if (ttl <= 1) { _info("DROP transit data to " << dst_hip << ": TTL expired"); metrics_drop(e_drop_ttl_expired); return nullptr; }
+	ttl = std::min<unsigned char>( ttl - 1 , c_protocol::ttl_max_accepted ); // also reduce rude (too high) TTL
+
+	flow_hash = c_routing_manager::flow_hash_of_hips(src_hip, dst_hip);
+	c_peering_udp * nexthop = entry.m_nexthop[ c_routing_manager::choose_nexthop_for_flow( entry.m_nexthop_hip , flow_hash ) ];
+	if (nexthop == sender) {
+		_info("DROP transit data to " << dst_hip << ": next hop is the sender");
+		metrics_drop(e_drop_next_hop_is_sender);
+		return nullptr;
+	}
+	dropped = false;
+	return nexthop;
+}
 
-void c_tunserver::event_loop() {
-	_info("Entering the event loop");
-	c_counter counter(2,true);
-	c_counter counter_big(10,false);
+bool c_tunserver::forward_transit_fast(char *buff, size_t buff_size, const c_peering * sender) {
+	static_assert( c_protocol::tunneled_data_nonce_size == crypto_box_NONCEBYTES , "protocol nonce size");
+	if (buff_size <= c_protocol::tunneled_data_header_size) return false; // let the full parser complain about it
+
+	c_haship_addr src_hip, dst_hip; // [protocol] read directly from the fixed header
+	std::copy_n( buff + c_protocol::tunneled_data_pos_src , src_hip.size() , src_hip.begin() );
+	std::copy_n( buff + c_protocol::tunneled_data_pos_dst , dst_hip.size() , dst_hip.begin() );
+	unsigned char & ttl = reinterpret_cast<unsigned char &>( buff[ c_protocol::tunneled_data_pos_ttl ] ); // decremented in place
+	c_send_scheduler::t_flow flow_hash = 0;
+	bool dropped = false;
+	c_peering_udp * nexthop = forward_transit_nexthop( src_hip , dst_hip , sender , ttl , flow_hash , dropped );
+	if (nexthop == nullptr) return dropped;
+
+	_info("Relaying (fast path) data to " << dst_hip << " via " << nexthop->get_hip() << " ttl=" << static_cast<int>(ttl));
+	nexthop->send_data_udp_frame( buff , buff_size , flow_hash ); // the same buffer, only TTL changed
+	m_metric_transit_fast.add();
+	return true;
+}
 
-	this->peering_ping_all_peers();
-	const auto ping_all_frequency = std::chrono::seconds( 3 ); // how often to ping them
-	const auto ping_all_frequency_low = std::chrono::seconds( 1 ); // how often to ping first few times
-	const long int ping_all_count_low = 2; // how many times send ping fast at first
+bool c_tunserver::forward_transit_fast_flow(char *buff, size_t buff_size, const c_peering * sender, const c_haship_addr & src_hip,
+	const c_haship_addr & dst_hip, unsigned char ttl, const t_flow_nonce & nonce, const t_bytes_view & blob)
+{
+	c_send_scheduler::t_flow flow_hash = 0;
+	bool dropped = false;
+	c_peering_udp * nexthop = forward_transit_nexthop( src_hip , dst_hip , sender , ttl , flow_hash , dropped );
+	if (nexthop == nullptr) return dropped;
+
+	_info("Relaying (fast path) flow data to " << dst_hip << " via " << nexthop->get_hip() << " ttl=" << static_cast<int>(ttl));
+	nexthop->send_data_udp_relayed( buff , buff_size , blob , src_hip , dst_hip , ttl , nonce , flow_hash ); // usually only FLOW_ID changes
+	m_metric_transit_fast.add();
+	return true;
+}
 
-	auto ping_all_time_last = std::chrono::steady_clock::now(); // last time we sent ping to all
-	long int ping_all_count = 0; // how many times did we do that in fact
+c_peering * c_tunserver::find_peer_by_sender_peering_addr_or_null( c_ip46_addr ip ) const {
+	auto found = m_peer_by_pip.find( ip );
+	if (found == m_peer_by_pip.end()) return nullptr;
+	return found->second;
+}
 
+void c_tunserver::event_loop() {
+	_info("Entering the event loop");
 
-	// low level receive buffer
-	const int buf_size=65536;
-	char buf[buf_size];
+	event_loop_start();
+	while (1) {
+		 // std::this_thread::sleep_for( std::chrono::milliseconds(100) ); // was needeed to avoid any self-DoS in case of TTL bugs
+		event_loop_step();
+	}
+}
 
-	bool anything_happened=false; // in given loop iteration, for e.g. debug
+void c_tunserver::event_loop_start() {
+	m_loop_keepalive_due = std::chrono::steady_clock::time_point::min(); // all peers are due in first step
+	tun_mtu_update(); // till path MTU is probed, it is the safe one
 
-	bool was_connected=true;
+	m_loop_udp_frames_pending.clear();
+	m_loop_was_connected=true;
 	if (! m_peer.size()) {
-		was_connected=false;
+		m_loop_was_connected=false;
 		ui::action_info_ok("Now will wait for someone to connect to us...");
 	}
-	bool was_anything_sent_from_TUN=false, was_anything_sent_to_TUN=false;
+	m_loop_was_anything_sent_from_TUN=false;
+	m_loop_was_anything_sent_to_TUN=false;
+}
 
-	while (1) {
-		 // std::this_thread::sleep_for( std::chrono::milliseconds(100) ); // was needeed to avoid any self-DoS in case of TTL bugs
+bool c_tunserver::event_loop_step() {
+	// low level receive buffer
+	const int buf_size=65536;
+	char buf[buf_size];
 
-		if (!was_connected) {
-			if (m_peer.size()) { // event: conntected now
-				was_connected=true;
-				ui::action_info_ok("Ok, we have a peer.");
-			}
-		}
+	bool anything_happened=false; // in this step
 
-		auto time_now = std::chrono::steady_clock::now(); // time now
+	if (m_rate_limit_changed) rate_limit_apply_pending(); // e.g. from RPC
+	if (m_delete_peer_changed) delete_peer_apply_pending(); // e.g. from RPC
 
-		{
-			auto freq = ping_all_frequency;
-			if (ping_all_count < ping_all_count_low) freq = ping_all_frequency_low;
-			if (time_now > ping_all_time_last + freq ) {
-				_note("It's time to ping all peers again (at auto-pinging time frequency=" << std::chrono::duration_cast<std::chrono::seconds>(freq).count() << " seconds)");
-				peering_ping_all_peers(); // TODO(r) later ping only peers that need that
-				ping_all_time_last = std::chrono::steady_clock::now();
-				++ping_all_count;
-			}
+	if (!m_loop_was_connected) {
+		if (m_peer.size()) { // event: conntected now
+			m_loop_was_connected=true;
+			ui::action_info_ok("Ok, we have a peer.");
 		}
+	}
 
-		ostringstream oss;
-		oss <<	" Node " << m_my_name << " hip=" << m_my_hip;
-		const string node_title_bar = oss.str();
-
-
-		if (anything_happened || 1) {
-			debug_peers();
+	auto time_now = c_program_clock::now(); // time now
 
-			string xx(10,'-');
-			_info('\n' << xx << node_title_bar << xx << "\n\n");
-		} // --- print your name ---
+	const auto keepalive_wait = peering_keepalive( time_now ); // ping the peers that need that (see c_keepalive)
 
-		anything_happened=false;
+	ostringstream oss;
+	oss <<	" Node " << m_my_name << " hip=" << m_my_hip;
+	const string node_title_bar = oss.str();
 
-		m_event_manager.wait_for_event();
 
-		// TODO(r): program can be hanged/DoS with bad routing, no TTL field yet
-		// ^--- or not fully checked. need scoring system anyway
+	if (anything_happened || 1) {
+		debug_peers();
 
-		try { // ---
-		if (m_event_manager.get_tun_packet()) { // get packet from tun
-			anything_happened=true;
-			auto size_read = m_tun_device.read_from_tun(buf, sizeof(buf));
-			_info("TTTTTTTTTTTTTTTTTTTTTTTTTT ###### ------> TUN read " << size_read << " bytes: [" << string(buf,size_read)<<"]");
-			const int data_route_ttl = 5; // we want to ask others with this TTL to route data sent actually by our programs
+		string xx(10,'-');
+		_info('\n' << xx << node_title_bar << xx << "\n\n");
+	} // --- print your name ---
 
-			c_haship_addr src_hip, dst_hip;
-			std::tie(src_hip, dst_hip) = parse_tun_ip_src_dst(buf, size_read);
-			// TODO warn if src_hip is not our hip
+	anything_happened=false;
 
-			_note(" is galaxy? dst_hip=" << dst_hip << " is:");
-			if (!addr_is_galaxy(dst_hip)) {
+	const auto wait_timeout = std::min( keepalive_wait , peering_flush_aggregated( time_now ) ); // send the small frames that waited enough already
+	const bool udp_frame_pending = ! m_loop_udp_frames_pending.empty();
+	const bool udp_receive_pending = m_udp_device->is_receive_pending(); // e.g. rest of datagrams coalesced by GRO
+	const bool tun_read_pending = m_tun_device->is_read_pending(); // e.g. rest of packets cut from TCP super-packet (TUN offload)
+	if ((! udp_frame_pending) && (! udp_receive_pending) && (! tun_read_pending)) {
+		bool wait = true;
+		if (m_udp_device->is_send_pending()) { // datagrams kept to be sent together (GSO) - send them before we sleep
+			const long int kept_steps_max = 64; // or if they wait too long (e.g. input goes on, but all of it to other peers)
+			m_event_manager->wait_for_event( std::chrono::microseconds(0) );
+			wait = ! (m_event_manager->get_tun_packet() || m_event_manager->receive_udp_paket()); // more input now, can add more to them
+			if (wait || (++m_loop_send_kept_steps >= kept_steps_max)) {
+				m_udp_device->flush();
+				m_loop_send_kept_steps = 0;
+			}
+		}
+		if (wait) m_event_manager->wait_for_event( wait_timeout );
+	}
+	if (m_udp_device->is_send_blocked() && m_event_manager->udp_writable()) m_udp_device->flush(); // room again for queued datagrams
+
+	// TODO(r): program can be hanged/DoS with bad routing, no TTL field yet
+	// ^--- or not fully checked. need scoring system anyway
+
+	try { // ---
+	if (tun_read_pending || ((! udp_frame_pending) && (! udp_receive_pending) && m_event_manager->get_tun_packet())) { // get packet from tun
+		anything_happened=true;
+		auto size_read = m_tun_device->read_from_tun(buf, sizeof(buf));
+		_info("TTTTTTTTTTTTTTTTTTTTTTTTTT ###### ------> TUN read " << size_read << " bytes: [" << string(buf,size_read)<<"]");
+		const int data_route_ttl = 5; // we want to ask others with this TTL to route data sent actually by our programs
+
+		c_haship_addr src_hip, dst_hip;
+		std::tie(src_hip, dst_hip) = parse_tun_ip_src_dst(buf, size_read);
+		// TODO warn if src_hip is not our hip
+		const auto flow_hash = c_routing_manager::flow_hash_of_ipv6( buf + m_tun_header_offset_ipv6 , size_read - m_tun_header_offset_ipv6 );
+
+		_note(" is galaxy? dst_hip=" << dst_hip << " is:");
+		if (!addr_is_galaxy(dst_hip)) { // usually the TUN filter dropped them already (see c_tun_device_linux::attach_filter)
+			_dbg3("Got data for strange dst_hip="<<dst_hip);
+			metrics_drop(e_drop_tun_not_galaxy);
+			return true; // !
+		}
 
+		{ // packet that would not fit path MTU to next hop: refuse it, like a router would, so the sender sends smaller ones
+			const size_t packet_size = size_read - m_tun_header_offset_ipv6;
+			const size_t mtu = get_inner_mtu_to( dst_hip );
+			if (mtu && (packet_size > mtu)) {
+				_info("Packet of " << packet_size << " octets to " << dst_hip << " is too big for path MTU, sending Packet Too Big " << mtu);
+				const auto packet = reinterpret_cast<const unsigned char*>( buf + m_tun_header_offset_ipv6 );
+				const std::string reply = c_tun_offload::packet_too_big6( packet , packet_size , mtu );
+				if (reply.size()) {
+					std::string reply_tun( buf , m_tun_header_offset_ipv6 ); // the same TUN header
+					reply_tun += reply;
+					m_tun_device->write_to_tun( reply_tun.data() , reply_tun.size() );
+				}
+				metrics_drop(e_drop_too_big);
+				return true;
+			}
+		}
+			
+		auto find_tunnel = m_tunnel.find( dst_hip ); // find end2end tunnel
+		if (find_tunnel == m_tunnel.end()) {
+			_warn("end2end tunnel does not exist, can not send OUR data from TUN to dst_hip="<<dst_hip);
+			metrics_drop(e_drop_no_tunnel);
+			metrics_handshake_started(dst_hip);
+
+			std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
+			_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for " << dst_hip << " so we can SEND THERE");
+			this->route_tun_data_to_its_destination_top(
+				e_route_method_from_me,
+				dump.c_str(), dump.size(),
+				src_hip, dst_hip,
+				c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+				data_route_ttl
+				,antinet_crypto::t_crypto_nonce()
+				,flow_hash
+			); // push the tunneled data to where they belong
+
+		} else {
+			_info("Using CT tunnel to send our own data");
+			auto & ct = * find_tunnel->second;
+			metrics_tunnel(dst_hip, true, size_read);
+			antinet_crypto::t_crypto_nonce nonce_used;
+			std::string data_cleartext(buf, buf+size_read);
+			std::string data_encrypted = ct.box_ab(data_cleartext, nonce_used);
+
+			this->route_tun_data_to_its_destination_top(
+				e_route_method_from_me,
+				data_encrypted.c_str(), data_encrypted.size(), // blob
+				src_hip, dst_hip,
+				c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+				data_route_ttl, nonce_used, flow_hash
+			); // push the tunneled data to where they belong
+		}
 
-				_dbg3("Got data for strange dst_hip="<<dst_hip);
-				continue; // !
+		if (!m_loop_was_anything_sent_from_TUN) {
+			ui::action_info_ok("Ok, we sent a packet of data from our computer through virtual network, sending seems to work.");
+			m_loop_was_anything_sent_from_TUN=true;
+		}
+	}
+	else if(udp_frame_pending || udp_receive_pending || m_event_manager->receive_udp_paket()) { // data incoming on peer (UDP) - will route it or send to our TUN
+		anything_happened=true;
+		c_ip46_addr sender_pip; // peer-IP of peer who sent it
+		c_peering * sender_peer = nullptr; // who that is, if he is our peer (found once for each datagram)
+
+		size_t size_read = 0;
+		if (udp_frame_pending) { // next frame of aggregated datagram
+			const auto & frame = m_loop_udp_frames_pending.front();
+			std::memcpy( buf , m_loop_udp_aggregated.data() + frame.m_offset , frame.m_size ); // frame is smaller then datagram it was in
+			size_read = frame.m_size;
+			sender_pip = m_loop_udp_frames_pending_sender;
+			sender_peer = m_loop_udp_frames_pending_sender_peer;
+			m_loop_udp_frames_pending.pop_front();
+		}
+		else {
+			size_read = m_udp_device->receive_data(buf, sizeof(buf), sender_pip);
+			sender_peer = find_peer_by_sender_peering_addr_or_null( sender_pip );
+		}
+		if (size_read == 0) return true; // XXX ignore empty packets
+		if (! udp_frame_pending) { // [security] limit of the sender, before any parsing (frames of aggregated datagram are counted with it)
+			if ((sender_peer != nullptr) && (! sender_peer->rate_limit_allow(size_read))) {
+				_dbg1("DROP datagram from " << sender_pip << ": over his rate limit");
+				metrics_drop(e_drop_limit_points);
+				return true;
+			}
+			if ((sender_peer == nullptr) && (! unknown_sender_allow(size_read))) { // e.g. flood of hello or ping with spoofed IPs
+				_dbg1("DROP datagram from " << sender_pip << ": not a peer, and non-peers are over their limit");
+				metrics_drop(e_drop_limit_unknown);
+				return true;
 			}
-				
-			auto find_tunnel = m_tunnel.find( dst_hip ); // find end2end tunnel
-			if (find_tunnel == m_tunnel.end()) {
-				_warn("end2end tunnel does not exist, can not send OUR data from TUN to dst_hip="<<dst_hip);
+		}
 
-				std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
-				_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for " << dst_hip << " so we can SEND THERE");
-				this->route_tun_data_to_its_destination_top(
-					e_route_method_from_me,
-					dump.c_str(), dump.size(),
-					src_hip, dst_hip,
-					c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
-					data_route_ttl
-					,antinet_crypto::t_crypto_nonce()
-				); // push the tunneled data to where they belong
+		_mark("UDP Socket read from direct sender_pip = " << sender_pip <<", size " << size_read << " bytes: " << string_as_dbg( string_as_bin(buf,size_read)).get());
+		// ------------------------------------
 
-			} else {
-				_info("Using CT tunnel to send our own data");
-				auto & ct = * find_tunnel->second;
-				antinet_crypto::t_crypto_nonce nonce_used;
-				std::string data_cleartext(buf, buf+size_read);
-				std::string data_encrypted = ct.box_ab(data_cleartext, nonce_used);
+		// parse version and command:
+		if (! (size_read >= 2) ) { _warn("INVALIDA DATA, size_read="<<size_read); metrics_drop(e_drop_invalid); return true; } // !
+		assert( size_read >= 2 ); // buf: reads from position 0..1 are asserted as valid now
 
-				this->route_tun_data_to_its_destination_top(
-					e_route_method_from_me,
-					data_encrypted.c_str(), data_encrypted.size(), // blob
-					src_hip, dst_hip,
-					c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
-					data_route_ttl, nonce_used
-				); // push the tunneled data to where they belong
+		int proto_version = static_cast<int>( static_cast<unsigned char>(buf[0]) ); // TODO
+		c_protocol::t_proto_cmd cmd = static_cast<c_protocol::t_proto_cmd>( buf[1] );
+		if (! c_protocol::command_is_valid_in_version( cmd , proto_version )) { // e.g. findhip from a node older then version 2
+			_info("Ignoring command " << static_cast<int>(cmd) << " of protocol version " << proto_version << " from " << sender_pip
+				<< " (we use version " << static_cast<int>(c_protocol::current_version) << ")");
+			metrics_drop(e_drop_version);
+			return true;
+		}
+		if ((sender_peer != nullptr) && (sender_peer->get_protocol_version() != proto_version)) { // e.g. first frame from him
+			sender_peer->set_protocol_version( proto_version ); // what we can send to him (e.g. compressed flows)
+			if (proto_version < c_protocol::version_min_ping_reply) { // he does not answer pings, so these were not lost
+				sender_peer->m_link_quality = c_link_quality();
+				peering_link_state_update( * sender_peer );
 			}
+		}
 
-			if (!was_anything_sent_from_TUN) {
-				ui::action_info_ok("Ok, we sent a packet of data from our computer through virtual network, sending seems to work.");
-				was_anything_sent_from_TUN=true;
-			}
+		// recognize the peering HIP/CA (cryptoauth is TODO)
+		c_haship_addr sender_hip;
+		c_peering * sender_as_peering_ptr  = nullptr; // TODO(r)-security review usage of this, and is it needed
+		if (! c_protocol::command_is_valid_from_unknown_peer( cmd )) {
+			if (sender_peer == nullptr) _throw_error( std::runtime_error("We do not know a peer with such IP=" + STR(sender_pip)) );
+			c_peering & sender_as_peering = * sender_peer; // warn: returned value depends on m_peer[], do not invalidate that!!!
+			_info("We recognize the sender, as: " << sender_as_peering);
+			sender_hip = sender_as_peering.get_hip(); // this is not yet confirmed/authenticated(!)
+			sender_as_peering_ptr = & sender_as_peering; // pointer to owned-by-us m_peer[] element. But can be invalidated, use with care! TODO(r) check this TODO(r) cast style
+			sender_as_peering.on_received(size_read);
+		}
+		metrics_command_received(cmd, size_read);
+		_info("@@@@@@@@@@@@@@@@@@@@@@@@@@@@@ Command: " << cmd << " from peering ip = " << sender_pip << " -> peer HIP=" << sender_hip);
+
+		if (cmd == c_protocol::e_proto_cmd_aggregated) { // [protocol] few frames in one datagram, see c_packet_aggregator.hpp
+			_check( ! udp_frame_pending ); // split() never gives nested ones
+			const auto frames = c_packet_aggregator::split( buf , size_read );
+			_dbg1("Aggregated datagram with " << frames.size() << " frames");
+			m_loop_udp_aggregated.assign( buf , size_read ); // buf is used for each of them (keeps its capacity, once it grew)
+			m_loop_udp_frames_pending.assign( frames.begin() , frames.end() );
+			m_loop_udp_frames_pending_sender = sender_pip;
+			m_loop_udp_frames_pending_sender_peer = sender_peer;
+			return true; // they will be processed in next loops, as if each was received alone
 		}
-		else if(m_event_manager.receive_udp_paket()) { // data incoming on peer (UDP) - will route it or send to our TUN
-			anything_happened=true;
-			c_ip46_addr sender_pip; // peer-IP of peer who sent it
-
-			size_t size_read = m_udp_device.receive_data(buf, sizeof(buf), sender_pip);
-			if (size_read == 0) continue; // XXX ignore empty packets
-
-			_mark("UDP Socket read from direct sender_pip = " << sender_pip <<", size " << size_read << " bytes: " << string_as_dbg( string_as_bin(buf,size_read)).get());
-			// ------------------------------------
-
-			// parse version and command:
-			if (! (size_read >= 2) ) { _warn("INVALIDA DATA, size_read="<<size_read); continue; } // !
-			assert( size_read >= 2 ); // buf: reads from position 0..1 are asserted as valid now
-
-			int proto_version = static_cast<int>( static_cast<unsigned char>(buf[0]) ); // TODO
-			_assert(proto_version >= c_protocol::current_version ); // let's assume we will be backward compatible (but this will be not the case untill official stable version probably)
-			c_protocol::t_proto_cmd cmd = static_cast<c_protocol::t_proto_cmd>( buf[1] );
-
-			// recognize the peering HIP/CA (cryptoauth is TODO)
-			c_haship_addr sender_hip;
-			c_peering * sender_as_peering_ptr  = nullptr; // TODO(r)-security review usage of this, and is it needed
-			if (! c_protocol::command_is_valid_from_unknown_peer( cmd )) {
-				c_peering & sender_as_peering = find_peer_by_sender_peering_addr( sender_pip ); // warn: returned value depends on m_peer[], do not invalidate that!!!
-				_info("We recognize the sender, as: " << sender_as_peering);
-				sender_hip = sender_as_peering.get_hip(); // this is not yet confirmed/authenticated(!)
-				sender_as_peering_ptr = & sender_as_peering; // pointer to owned-by-us m_peer[] element. But can be invalidated, use with care! TODO(r) check this TODO(r) cast style
+
+		if ((cmd == c_protocol::e_proto_cmd_tunneled_data) || (cmd == c_protocol::e_proto_cmd_tunneled_data_flow_setup)
+			|| (cmd == c_protocol::e_proto_cmd_tunneled_data_flow)) { // [protocol] tunneled data (maybe with compressed header)
+			_dbg1("Tunneled data");
+			if ((cmd == c_protocol::e_proto_cmd_tunneled_data) && forward_transit_fast(buf, size_read, sender_as_peering_ptr)) return true; // relayed (or dropped) without parsing it
+
+			c_haship_addr src_hip, dst_hip;
+			int requested_ttl = 0; // the TTL of data that we are asked to forward
+			string nonce_used_raw;
+			t_bytes_view blob; // points into buf
+			if (cmd == c_protocol::e_proto_cmd_tunneled_data_flow) { // [protocol] compressed header, see c_flow_compression.hpp
+				typedef protocol_messages::tunneled_data_flow t_msg;
+				t_msg::t_values msg;
+				if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid tunneled data (flow), ignoring it"); metrics_drop(e_drop_invalid); return true; }
+				const t_flow_id flow_id = std::get<t_msg::e_flow_id>(msg);
+				unsigned char flow_ttl = 0;
+				t_flow_nonce nonce_flow;
+				if (! sender_as_peering_ptr->m_flow_rx.decode(flow_id, std::get<t_msg::e_nonce_low>(msg), src_hip, dst_hip, flow_ttl, nonce_flow)) {
+					_info("Unknown compressed flow id=" << flow_id << " from " << sender_hip << " - asking him to resync it");
+					metrics_drop(e_drop_unknown_flow);
+					typedef protocol_messages::tunneled_data_flow_reset t_reset;
+					trivialserialize::generator gen( t_reset::size_max );
+					t_reset::encode( gen , t_reset::t_values( flow_id ) );
+					auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+					peer_udp->send_data_udp_cmd(c_protocol::e_proto_cmd_tunneled_data_flow_reset, string_as_bin(gen.str_move()), -1);
+					return true;
+				}
+				if (forward_transit_fast_flow(buf, size_read, sender_as_peering_ptr, src_hip, dst_hip, flow_ttl, nonce_flow,
+					std::get<t_msg::e_blob>(msg))) return true; // relayed (or dropped), usually with only FLOW_ID rewritten
+				requested_ttl = flow_ttl;
+				nonce_used_raw.assign( nonce_flow.begin() , nonce_flow.end() );
+				blob = std::get<t_msg::e_blob>(msg);
+			} else if (cmd == c_protocol::e_proto_cmd_tunneled_data_flow_setup) {
+				typedef protocol_messages::tunneled_data_flow_setup t_msg;
+				t_msg::t_values msg;
+				if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid tunneled data (flow setup), ignoring it"); metrics_drop(e_drop_invalid); return true; }
+				src_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , std::get<t_msg::e_src_hip>(msg) );
+				dst_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , std::get<t_msg::e_dst_hip>(msg) );
+				requested_ttl = std::get<t_msg::e_ttl>(msg);
+				const t_bytes_view nonce_view = std::get<t_msg::e_nonce>(msg);
+				t_flow_nonce nonce_flow;
+				std::copy( nonce_view.begin() , nonce_view.end() , nonce_flow.begin() );
+				sender_as_peering_ptr->m_flow_rx.on_setup(std::get<t_msg::e_flow_id>(msg), src_hip, dst_hip, requested_ttl, nonce_flow);
+				nonce_used_raw = nonce_view.to_string(); // sodiumpp wants it as string anyway
+				blob = std::get<t_msg::e_blob>(msg);
+			} else {
+				typedef protocol_messages::tunneled_data t_msg;
+				t_msg::t_values msg;
+				if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid tunneled data, ignoring it"); metrics_drop(e_drop_invalid); return true; }
+				src_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , std::get<t_msg::e_src_hip>(msg) );
+				dst_hip = c_haship_addr(c_haship_addr::tag_constr_by_addr_bin() , std::get<t_msg::e_dst_hip>(msg) );
+				requested_ttl = std::get<t_msg::e_ttl>(msg);
+				nonce_used_raw = std::get<t_msg::e_nonce>(msg).to_string(); // sodiumpp wants it as string anyway
+				blob = std::get<t_msg::e_blob>(msg);
 			}
-			_info("@@@@@@@@@@@@@@@@@@@@@@@@@@@@@ Command: " << cmd << " from peering ip = " << sender_pip << " -> peer HIP=" << sender_hip);
-
-			if (cmd == c_protocol::e_proto_cmd_tunneled_data) { // [protocol] tunneled data
-				_dbg1("Tunneled data");
-
-				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf, size_read );
-				parser.skip_bytes_n(2);
-				c_haship_addr src_hip(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
-				c_haship_addr dst_hip(c_haship_addr::tag_constr_by_addr_bin() , parser.pop_bytes_n(g_ipv6_rfc::length_of_addr) );
-				int requested_ttl = parser.pop_byte_u(); // the TTL of data that we are asked to forward
-				string nonce_used_raw = parser.pop_bytes_n( crypto_box_NONCEBYTES );
-				_dbg1("nonce_used_raw="<<to_debug(nonce_used_raw));
-				antinet_crypto::t_crypto_nonce nonce_used(
-					sodiumpp::encoded_bytes(nonce_used_raw , sodiumpp::encoding::binary)
-				);
-				_info("Received NONCE=" << antinet_crypto::show_nice_nonce(nonce_used) );
-				string blob =	parser.pop_varstring(); // TODO view-string
+			_dbg1("nonce_used_raw="<<to_debug(nonce_used_raw));
+			antinet_crypto::t_crypto_nonce nonce_used(
+				sodiumpp::encoded_bytes(nonce_used_raw , sodiumpp::encoding::binary)
+			);
+			_info("Received NONCE=" << antinet_crypto::show_nice_nonce(nonce_used) );
 
 /*
-				std::unique_ptr<unsigned char []> decrypted_buf (new unsigned char[size_read + crypto_aead_chacha20poly1305_ABYTES]);
-				unsigned long long decrypted_buf_len;
+			std::unique_ptr<unsigned char []> decrypted_buf (new unsigned char[size_read + crypto_aead_chacha20poly1305_ABYTES]);
+			unsigned long long decrypted_buf_len;
 
-				int ttl_width=1; // the TTL heder width
+			int ttl_width=1; // the TTL heder width
 
-				assert( size_read >= 1+2+ttl_width+1 );  // headers + anything
+			assert( size_read >= 1+2+ttl_width+1 );  // headers + anything
 
-				assert(ttl_width==1); // we can "parse" just that now
-				int requested_ttl = static_cast<char>(buf[1+2]); // the TTL of data that we are asked to forward
+			assert(ttl_width==1); // we can "parse" just that now
+			int requested_ttl = static_cast<char>(buf[1+2]); // the TTL of data that we are asked to forward
 
-				assert(crypto_aead_chacha20poly1305_KEYBYTES <= crypto_generichash_BYTES);
+			assert(crypto_aead_chacha20poly1305_KEYBYTES <= crypto_generichash_BYTES);
 
-				// reinterpret the char from IO as unsigned-char as wanted by crypto code
-				unsigned char * ciphertext_buf = reinterpret_cast<unsigned char*>( buf ) + 2 + ttl_width; // TODO calculate depending on version, command, ...
-				long long ciphertext_buf_len = size_read - 2 - 1; // TODO 2 = header size, and TTL
-				assert( ciphertext_buf_len >= 1 );
+			// reinterpret the char from IO as unsigned-char as wanted by crypto code
+			unsigned char * ciphertext_buf = reinterpret_cast<unsigned char*>( buf ) + 2 + ttl_width; // TODO calculate depending on version, command, ...
+			long long ciphertext_buf_len = size_read - 2 - 1; // TODO 2 = header size, and TTL
+			assert( ciphertext_buf_len >= 1 );
 
-				int r = crypto_aead_chacha20poly1305_decrypt(
-					decrypted_buf.get(), & decrypted_buf_len,
-					nullptr,
-					ciphertext_buf, ciphertext_buf_len,
-					additional_data, additional_data_len,
-					nonce, generated_shared_key);
-				if (r == -1) {
-					_warn("Crypto verification failed!!!");
-	//				continue; // skip this packet (main loop) // TODO
-				}
+			int r = crypto_aead_chacha20poly1305_decrypt(
+				decrypted_buf.get(), & decrypted_buf_len,
+				nullptr,
+				ciphertext_buf, ciphertext_buf_len,
+				additional_data, additional_data_len,
+				nonce, generated_shared_key);
+			if (r == -1) {
+				_warn("Crypto verification failed!!!");
+//				return true; // skip this packet (main loop) // TODO
+			}
 
-				// TODO(r) factor out "reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len"
+			// TODO(r) factor out "reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len"
 
-				// reinterpret for debug
-				_info("UDP received, with cleartext:" << decrypted_buf_len << " bytes: [" << string( reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len)<<"]" );
+			// reinterpret for debug
+			_info("UDP received, with cleartext:" << decrypted_buf_len << " bytes: [" << string( reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len)<<"]" );
 
-				// can't wait till C++17 then with http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2015/p0144r0.pdf
-				// auto { src_hip, dst_hip } = parse_tun_ip_src_dst(.....);
-				c_haship_addr src_hip, dst_hip;
-				std::tie(src_hip, dst_hip) = parse_tun_ip_src_dst(reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len);
+			// can't wait till C++17 then with http://www.open-std.org/jtc1/sc22/wg21/docs/papers/2015/p0144r0.pdf
+			// auto { src_hip, dst_hip } = parse_tun_ip_src_dst(.....);
+			c_haship_addr src_hip, dst_hip;
+			std::tie(src_hip, dst_hip) = parse_tun_ip_src_dst(reinterpret_cast<char*>(decrypted_buf.get()), decrypted_buf_len);
 */
 
-				// TODONOW optimize? make sure the proper binary format is cached:
-				if (dst_hip == m_my_hip) { // received data addresses to us as finall destination:
-					_mark("UDP data is addressed to us as finall dst, sending it to TUN (after decryption) blob="<<to_debug(blob));
-
-					auto find_tunnel = m_tunnel.find( src_hip ); // find end2end tunnel
-					if (find_tunnel == m_tunnel.end()) {
-						_warn("end2end tunnel does not exist, can not DECRYPT this data for us (yet?)...");
-
-						std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
-						_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for "
-							<< dst_hip << " so we can READ DATA from there");
-						this->route_tun_data_to_its_destination_top(
-							e_route_method_from_me,
-							dump.c_str(), dump.size(),
-							dst_hip, src_hip, // return back to sender (from us)
-							c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
-							requested_ttl, // we assume sender is that far away from us, since the data reached us
-							antinet_crypto::t_crypto_nonce() // any nonce - just dummy
-						);
-
-					} else {
-						_note("Using CT tunnel to decrypt data for us");
-						auto & ct = * find_tunnel->second;
-						auto tundata = ct.unbox_ab( blob , nonce_used );
-						_note("<<<====== TUN INPUT: " << to_debug(tundata));
-						auto write_bytes = m_tun_device.write_to_tun(tundata.c_str(), tundata.size());
-						_assert_throw( (write_bytes == tundata.size()) );
-					} // we have CT
-
-					if (!was_anything_sent_to_TUN) {
-						ui::action_info_ok("Ok, we received a packet of data through virtual network, receiving seems to work.");
-						was_anything_sent_to_TUN=true;
-					}
-				}
-				else
-				{ // received data that is addresses to someone else
-#if 0
-					auto data_route_ttl = requested_ttl - 1;
-					const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
-					if (data_route_ttl > limit_incoming_ttl) {
-						_info("We were requested to route (data) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
-						data_route_ttl=limit_incoming_ttl;
-					}
-
-					_info("RRRRRRRRRRRRRRRRRRRRRRRRRRR UDP data is addressed to someone-else as finall dst, ROUTING it, at data_route_ttl="<<data_route_ttl);
-					if (sender_as_peering_ptr != nullptr) {
-						if (sender_as_peering_ptr->get_limit_points() < 0) {
-							_dbg1("drop packet");
-							continue;
-						}
-						// sender_as_peering_ptr->decrement_limit_points();
-					}
-					this->route_tun_data_to_its_destination_top(
-						e_route_method_default,
-						blob.c_str(), blob.size(),
-						src_hip, dst_hip,
-						c_routing_manager::c_route_reason( src_hip , c_routing_manager::e_search_mode_route_other_packet ),
-						data_route_ttl,
-						nonce_used // forward the nonce for blob
-					); // push the tunneled data to where they belong // reinterpret char-signess
-#endif
-				}
+			// TODONOW optimize? make sure the proper binary format is cached:
+			if (dst_hip == m_my_hip) { // received data addresses to us as finall destination:
+				_mark("UDP data is addressed to us as finall dst, sending it to TUN (after decryption) blob="
+					<< string_as_dbg(blob.data(), blob.size()).get());
 
-			} // e_proto_cmd_tunneled_data
-			else if (cmd == c_protocol::e_proto_cmd_public_hi) { // [protocol]
-				_note("hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh --> Command HI received");
-				size_t offset1=2; assert( size_read >= offset1); // skip CMD headers (TODO instead use one parser)
-
-				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() ,
-					buf+offset1 , size_read-offset1);
-
-				// TODONOW: size of pubkey is different, use serialize
-				// if (cmd_data.bytes.at(pos1)!=';') _throw_error( std::runtime_error("Invalid protocol format, missing coma") ); // [protocol]
-				string_as_bin bin_his_IDC_pub( parser.pop_varstring() ); // PARSE
-				string_as_bin bin_his_IDI_pub( parser.pop_varstring() ); // PARSE
-				string_as_bin bin_his_IDI_IDC_sig( parser.pop_varstring() ); // PARSE
-
-				_info("We received IDC pubkey=" << to_debug( bin_his_IDC_pub ) );
-				_info("We received IDI pubkey=" << to_debug( bin_his_IDI_pub ) );
-				_info("We received IDI --> IDC signature=" << to_debug( bin_his_IDI_IDC_sig ) );
-
-			try {
-				antinet_crypto::c_multikeys_pub his_IDI;
-				his_IDI.load_from_bin(bin_his_IDI_pub.bytes);
-				antinet_crypto::c_multisign his_IDI_IDC_sig;
-				his_IDI_IDC_sig.load_from_bin(bin_his_IDI_IDC_sig.bytes);
-				antinet_crypto::c_multikeys_pub::multi_sign_verify(his_IDI_IDC_sig, bin_his_IDC_pub.bytes, his_IDI);
-
-				{ // add peer
-					auto his_pubkey = make_unique<c_haship_pubkey>();
-					his_pubkey->load_from_bin( bin_his_IDI_pub.bytes );
-					_info("Parsed pubkey into: " << his_pubkey->to_debug());
-					t_peering_reference his_ref( sender_pip , his_pubkey->get_ipv6_string_hexdot() );
-					add_peer_append_pubkey( his_ref , std::move( his_pubkey ) );
-				}
+				auto find_tunnel = m_tunnel.find( src_hip ); // find end2end tunnel
+				if (find_tunnel == m_tunnel.end()) {
+					_warn("end2end tunnel does not exist, can not DECRYPT this data for us (yet?)...");
+					metrics_drop(e_drop_no_tunnel);
+					metrics_handshake_started(src_hip);
+
+					std::string dump; // just to trigger a search (for path - and btw for the pubkey!)
+					_note("GET KEYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYYY - will look for key for "
+						<< dst_hip << " so we can READ DATA from there");
+					this->route_tun_data_to_its_destination_top(
+						e_route_method_from_me,
+						dump.c_str(), dump.size(),
+						dst_hip, src_hip, // return back to sender (from us)
+						c_routing_manager::c_route_reason( c_haship_addr() , c_routing_manager::e_search_mode_route_own_packet),
+						requested_ttl, // we assume sender is that far away from us, since the data reached us
+						antinet_crypto::t_crypto_nonce(), // any nonce - just dummy
+						c_routing_manager::flow_hash_of_hips(dst_hip, src_hip)
+					);
 
-				{ // add node
-					c_haship_pubkey his_pubkey;
-					his_pubkey.load_from_bin( bin_his_IDI_pub.bytes );
-					add_tunnel_to_pubkey( his_pubkey );
+				} else {
+					_note("Using CT tunnel to decrypt data for us");
+					auto & ct = * find_tunnel->second;
+					auto tundata = ct.unbox_ab( blob.to_string() , nonce_used ); // TODO unbox from view, when crypto API allows
+					metrics_tunnel(src_hip, false, tundata.size());
+					_note("<<<====== TUN INPUT: " << to_debug(tundata));
+					auto write_bytes = m_tun_device->write_to_tun(tundata.c_str(), tundata.size());
+					_assert_throw( (write_bytes == tundata.size()) );
+				} // we have CT
+
+				if (!m_loop_was_anything_sent_to_TUN) {
+					ui::action_info_ok("Ok, we received a packet of data through virtual network, receiving seems to work.");
+					m_loop_was_anything_sent_to_TUN=true;
 				}
-			} catch (std::invalid_argument &err) {
-				_warn("Fail to verificate his IDC, probably bad public keys or signatures!!!");
-			}
 			}
-			else if (cmd == c_protocol::e_proto_cmd_findhip_query) { // [protocol]
-				_warn("QQQQQQQQQQQQQQQQQQQQQQQ - we are QUERIED to find HIP");
-				// [protocol] for search query - format is: HIP_BINARY;TTL_BINARY;
-				size_t offset1=2; assert( size_read >= offset1);  string_as_bin cmd_data( buf+offset1 , size_read-offset1); // buf -> bin for comfortable use
-
-				auto pos1 = cmd_data.bytes.find_first_of(';',offset1); // [protocol] size of HIP is dynamic  TODO(r)-ERROR XXX ';' is not escaped! will cause mistaken protocol errors
-				decltype (pos1) size_hip = g_haship_addr_size; // possible size of HIP if ipv6
-				if ((pos1==string::npos) || (pos1 != size_hip)) _throw_error( std::runtime_error("Invalid protocol format, wrong size of HIP field") );
-
-				string_as_bin bin_hip( cmd_data.bytes.substr(0,pos1) );
-				c_haship_addr requested_hip( c_haship_addr::tag_constr_by_addr_bin(), bin_hip.bytes ); // *
-
-				string_as_bin bin_ttl( cmd_data.bytes.substr(pos1+1,1) );
-				int requested_ttl = static_cast<int>( bin_ttl.bytes.at(0) ); // char to integer
-
+			else
+			{ // received data that is addresses to someone else (and the fast path does not know route to there yet)
 				auto data_route_ttl = requested_ttl - 1;
 				const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
 				if (data_route_ttl > limit_incoming_ttl) {
-					_info("We were requested to route (help search route) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+					_info("We were requested to route (data) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
 					data_route_ttl=limit_incoming_ttl;
-                    UNUSED(data_route_ttl); // TODO is it should be used?
-                }
-
-				_info("We received request for HIP=" << string_as_hex( bin_hip ) << " = " << requested_hip << " and TTL=" << requested_ttl );
-				if (requested_ttl < 1) {
-					_info("Too low TTL, dropping the request");
-				} else {
-					c_routing_manager::c_route_reason reason( sender_hip , c_routing_manager::e_search_mode_help_find );
-					try {
-						_mark("Searching for the route he asks about");
-						const auto & route = m_routing_manager.get_route_or_maybe_search(*this, requested_hip , reason , true, requested_ttl - 1);
-						_note("We found the route thas he asks about, as: " << route);
-
-						const int reply_ttl = requested_ttl; // will reply as much as needed
-
-						// [protocol] e_proto_cmd_findhip_reply write "TTL;COST:HIP_OF_GOAL"
-						trivialserialize::generator gen(50); // TODO optimal size
-						gen.push_byte_u( reply_ttl );
-						gen.push_byte_u( ';' );
-						gen.push_byte_u( route.get_cost() );
-						gen.push_byte_u( ';' );
-						gen.push_bytes_n( g_haship_addr_size , string_as_bin( requested_hip ).bytes ); // the hip of goal
-						gen.push_byte_u( ';' );
-						gen.push_varstring( route.m_pubkey.serialize_bin() );
-						gen.push_byte_u( ';' );
-
-						auto data = gen.str();
-
-						_info("DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD Will send data to sender_as_peering_ptr="
-							<< sender_as_peering_ptr
-							<< " data: " << to_debug_b( data ) );
-						auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
-						peer_udp->send_data_udp_cmd(c_protocol::e_proto_cmd_findhip_reply, string_as_bin(data), m_udp_device.get_socket()); // <---
-						_note("Send the route reply");
-					} catch(...) {
-						_info("Can not yet reply to that route query.");
-						// a background should be running in background usually
-					}
 				}
+				if (data_route_ttl < 1) { _info("DROP transit data: TTL expired"); metrics_drop(e_drop_ttl_expired); return true; }
 
+				_info("RRRRRRRRRRRRRRRRRRRRRRRRRRR UDP data is addressed to someone-else as finall dst, ROUTING it, at data_route_ttl="<<data_route_ttl);
+				this->route_tun_data_to_its_destination_top(
+					e_route_method_default,
+					blob.data(), blob.size(),
+					src_hip, dst_hip,
+					c_routing_manager::c_route_reason( src_hip , c_routing_manager::e_search_mode_route_other_packet ),
+					data_route_ttl,
+					nonce_used, // forward the nonce for blob
+					c_routing_manager::flow_hash_of_hips(src_hip, dst_hip)
+				); // push the tunneled data to where they belong // reinterpret char-signess
 			}
-			else if (cmd == c_protocol::e_proto_cmd_findhip_reply) { // [protocol]
-				_warn("ROUTE GOT REPLY ggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggg");
-				// TODO-NOW format with hip etc
-				// TODO-NOW here we will parse pubkey probably
-
-				// [protocol] e_proto_cmd_findhip_reply read "TTL;COST:HIP_OF_GOAL"
-				int offset1=2; // version, cmd
-				trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() ,  buf+offset1 , size_read-offset1);
-				int given_ttl = parser.pop_byte_u(); // ttl
-				parser.pop_byte_skip(';');
-				int given_cost = parser.pop_byte_u(); // cost
-				parser.pop_byte_skip(';');
-				c_haship_addr given_goal_hip( c_haship_addr::tag_constr_by_addr_bin(),
-					parser.pop_bytes_n( g_haship_addr_size ) ); // hip
-				parser.pop_byte_skip(';');
-				c_haship_pubkey pubkey; pubkey.load_from_bin( parser.pop_varstring() );
-				parser.pop_byte_skip(';');
-				_info("We have a TTL reply: ttl="<<given_ttl<<" goal="<<given_goal_hip<<" cost="<<given_cost);
-
-				auto data_route_ttl = given_ttl - 1;
-				const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
-				if (data_route_ttl > limit_incoming_ttl) {
-					_info("Got command at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
-					data_route_ttl=limit_incoming_ttl;
-				}
 
-				if (given_ttl < 1) {
-					_info("Too low TTL, dropping the request");
-				} else {
-					_info("GOT CORRECT REPLY - USING IT");
+		} // e_proto_cmd_tunneled_data
+		else if (cmd == c_protocol::e_proto_cmd_public_hi) { // [protocol]
+			_note("hhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhhh --> Command HI received");
+			size_t offset1=2; assert( size_read >= offset1); // skip CMD headers (TODO instead use one parser)
 
-					_warn("Cool, we got there a pubkey.");
-					add_tunnel_to_pubkey( pubkey );
+			trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() ,
+				buf+offset1 , size_read-offset1);
 
-					c_routing_manager::c_route_info route_info( sender_hip , given_cost , pubkey );
-					_info("rrrrrrrrrrrrrrrrrrr route known thanks to peer help:" << route_info);
-					// store it, so that we own this object:
-					const auto & route_info_ref_we_own = m_routing_manager.add_route_info_and_return( given_goal_hip , route_info );
-					UNUSED(route_info_ref_we_own); // TODO TODONOW and reply to others who asked us
-				}
+			// TODONOW: size of pubkey is different, use serialize
+			// if (cmd_data.bytes.at(pos1)!=';') _throw_error( std::runtime_error("Invalid protocol format, missing coma") ); // [protocol]
+			string_as_bin bin_his_IDC_pub( parser.pop_varstring() ); // PARSE
+			string_as_bin bin_his_IDI_pub( parser.pop_varstring() ); // PARSE
+			string_as_bin bin_his_IDI_IDC_sig( parser.pop_varstring() ); // PARSE
+
+			_info("We received IDC pubkey=" << to_debug( bin_his_IDC_pub ) );
+			_info("We received IDI pubkey=" << to_debug( bin_his_IDI_pub ) );
+			_info("We received IDI --> IDC signature=" << to_debug( bin_his_IDI_IDC_sig ) );
+
+		try {
+			antinet_crypto::c_multikeys_pub his_IDI;
+			his_IDI.load_from_bin(bin_his_IDI_pub.bytes);
+			antinet_crypto::c_multisign his_IDI_IDC_sig;
+			his_IDI_IDC_sig.load_from_bin(bin_his_IDI_IDC_sig.bytes);
+			antinet_crypto::c_multikeys_pub::multi_sign_verify(his_IDI_IDC_sig, bin_his_IDC_pub.bytes, his_IDI);
+
+			{ // add peer
+				auto his_pubkey = make_unique<c_haship_pubkey>();
+				his_pubkey->load_from_bin( bin_his_IDI_pub.bytes );
+				_info("Parsed pubkey into: " << his_pubkey->to_debug());
+				t_peering_reference his_ref( sender_pip , his_pubkey->get_ipv6_string_hexdot() );
+				add_peer_append_pubkey( his_ref , std::move( his_pubkey ) );
+				auto & peer = * m_peer.at( his_ref.haship_addr );
+				peer.m_keepalive.on_hello_received( c_program_clock::now() ); // e.g. he restarted, so he needs ours again
+				m_loop_keepalive_due = std::min( m_loop_keepalive_due , peer.m_keepalive.get_due_time() );
 			}
-			else {
-				_warn("??????????????????? Unknown protocol command, cmd="<<cmd);
-				continue; // skip this packet (main loop)
+
+			{ // add node
+				c_haship_pubkey his_pubkey;
+				his_pubkey.load_from_bin( bin_his_IDI_pub.bytes );
+				add_tunnel_to_pubkey( his_pubkey );
+			}
+		} catch (std::invalid_argument &err) {
+			_warn("Fail to verificate his IDC, probably bad public keys or signatures!!!");
+		}
+		}
+		else if (cmd == c_protocol::e_proto_cmd_findhip_query) { // [protocol]
+			_warn("QQQQQQQQQQQQQQQQQQQQQQQ - we are QUERIED to find HIP");
+			typedef protocol_messages::findhip_query t_msg;
+			t_msg::t_values msg;
+			if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid findhip query, ignoring it"); metrics_drop(e_drop_invalid); return true; }
+			c_haship_addr requested_hip( c_haship_addr::tag_constr_by_addr_bin(), std::get<t_msg::e_hip>(msg) );
+			int requested_ttl = std::get<t_msg::e_ttl>(msg);
+
+			auto data_route_ttl = requested_ttl - 1;
+			const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
+			if (data_route_ttl > limit_incoming_ttl) {
+				_info("We were requested to route (help search route) at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+				data_route_ttl=limit_incoming_ttl;
+                    UNUSED(data_route_ttl); // TODO is it should be used?
+                }
+
+			_info("We received request for HIP=" << requested_hip << " and TTL=" << requested_ttl );
+			if (requested_ttl < 1) {
+				_info("Too low TTL, dropping the request");
+			} else {
+				c_routing_manager::c_route_reason reason( sender_hip , c_routing_manager::e_search_mode_help_find );
+				try {
+					_mark("Searching for the route he asks about");
+					const auto & route = m_routing_manager.get_route_or_maybe_search(*this, requested_hip , reason , true, requested_ttl - 1,
+						c_routing_manager::flow_hash_of_hips(sender_hip, requested_hip));
+					_note("We found the route thas he asks about, as: " << route);
+
+					const int reply_ttl = requested_ttl; // will reply as much as needed
+
+					typedef protocol_messages::findhip_reply t_reply;
+					const std::string pubkey_bin = route.m_pubkey.serialize_bin();
+					trivialserialize::generator gen( t_reply::size_min + pubkey_bin.size() + 8 );
+					t_reply::encode( gen , t_reply::t_values(
+						reply_ttl ,
+						std::min( route.get_cost() , 255 ) ,
+						t_bytes_view( reinterpret_cast<const char*>( requested_hip.data() ) , requested_hip.size() ) , // the hip of goal
+						pubkey_bin ) );
+					auto data = gen.str_move();
+
+					_info("DDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDDD Will send data to sender_as_peering_ptr="
+						<< sender_as_peering_ptr
+						<< " data: " << to_debug_b( data ) );
+					auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+					peer_udp->send_data_udp_cmd(c_protocol::e_proto_cmd_findhip_reply, string_as_bin(data), -1); // <---
+					_note("Send the route reply");
+				} catch(...) {
+					_info("Can not yet reply to that route query.");
+					// a background should be running in background usually
+				}
 			}
-			// ------------------------------------
 
 		}
-		else _info("Idle. " << node_title_bar);
+		else if (cmd == c_protocol::e_proto_cmd_findhip_reply) { // [protocol]
+			_warn("ROUTE GOT REPLY ggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggggg");
+			// TODO-NOW format with hip etc
+			// TODO-NOW here we will parse pubkey probably
+
+			typedef protocol_messages::findhip_reply t_msg;
+			t_msg::t_values msg;
+			if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid findhip reply, ignoring it"); metrics_drop(e_drop_invalid); return true; }
+			int given_ttl = std::get<t_msg::e_ttl>(msg);
+			int given_cost = std::get<t_msg::e_cost>(msg);
+			c_haship_addr given_goal_hip( c_haship_addr::tag_constr_by_addr_bin(), std::get<t_msg::e_goal_hip>(msg) );
+			c_haship_pubkey pubkey; pubkey.load_from_bin( std::get<t_msg::e_pubkey>(msg).to_string() );
+			_info("We have a TTL reply: ttl="<<given_ttl<<" goal="<<given_goal_hip<<" cost="<<given_cost);
+
+			auto data_route_ttl = given_ttl - 1;
+			const int limit_incoming_ttl = c_protocol::ttl_max_accepted;
+			if (data_route_ttl > limit_incoming_ttl) {
+				_info("Got command at high TTL (rude) by peer " << sender_hip <<  " - so reducing it.");
+				data_route_ttl=limit_incoming_ttl;
+			}
 
+			if (given_ttl < 1) {
+				_info("Too low TTL, dropping the request");
+			} else {
+				_info("GOT CORRECT REPLY - USING IT");
+
+				_warn("Cool, we got there a pubkey.");
+				add_tunnel_to_pubkey( pubkey );
+
+				const int cost_of_link = sender_as_peering_ptr->get_link_quality().get_route_cost();
+				const int cost = given_cost + cost_of_link; // his cost, plus link to him (re-costed when the link changes)
+				c_routing_manager::c_route_info route_info( sender_hip , cost , pubkey , cost_of_link );
+				_info("rrrrrrrrrrrrrrrrrrr route known thanks to peer help:" << route_info);
+				// store it, so that we own this object:
+				const auto & route_info_ref_we_own = m_routing_manager.add_route_info_and_return( given_goal_hip , route_info );
+				UNUSED(route_info_ref_we_own); // TODO TODONOW and reply to others who asked us
+			}
+		}
+		else if (cmd == c_protocol::e_proto_cmd_tunneled_data_flow_reset) { // [protocol]
+			typedef protocol_messages::tunneled_data_flow_reset t_msg;
+			t_msg::t_values msg;
+			if (! t_msg::decode( buf+2 , size_read-2 , msg )) { _warn("Invalid flow reset, ignoring it"); metrics_drop(e_drop_invalid); return true; }
+			auto peer_udp = dynamic_cast<c_peering_udp*>( sender_as_peering_ptr ); // upcast to UDP peer derived
+			peer_udp->flow_reset( std::get<t_msg::e_flow_id>(msg) );
+		}
+		else if (cmd == c_protocol::e_proto_cmd_public_ping_request) { // [protocol]
+			_info("Ping request from " << sender_pip << " - echoing it back as reply");
+			if (size_read < c_protocol::public_ping_size) { _warn("Invalid ping request, ignoring it"); metrics_drop(e_drop_invalid); return true; }
+			// [security] only his SEQ and TIMESTAMP, so we do not reflect big datagrams (to spoofed IP); padded probe of path MTU
+			// is echoed whole only to our peer, see peering_send_probe()
+			const bool is_probe = (sender_peer != nullptr) && std::all_of( buf+2 , buf+6 , [](char c){ return c == 0; } ); // SEQ 0
+			const size_t reply_size = is_probe ? size_read : c_protocol::public_ping_size;
+			buf[1] = c_protocol::e_proto_cmd_public_ping_reply;
+			m_udp_device->send_data_scheduled(sender_pip, buf, reply_size, c_send_scheduler::e_class_control, 0);
+		}
+		else if (cmd == c_protocol::e_proto_cmd_public_ping_reply) { // [protocol]
+			const auto now = c_program_clock::now();
+			trivialserialize::parser parser( trivialserialize::parser::tag_caller_must_keep_this_buffer_valid() , buf+2 , size_read-2 );
+			auto seq = parser.pop_integer_u<4, c_link_quality::t_ping_seq>();
+			auto sent_time_us = parser.pop_integer_u<8, uint64_t>();
+			const c_link_quality::t_clock::time_point sent_time{ std::chrono::microseconds( sent_time_us ) };
+			if (sender_peer == nullptr) _throw_error( std::runtime_error("Ping reply from unknown peer IP=" + STR(sender_pip)) ); // pings can come from unknown
+			c_peering & peer = * sender_peer;
+			if (seq == 0) { // reply to our probe of path MTU, see peering_send_probe()
+				if (peer.m_path_mtu.on_probe_reply( size_read , now )) peering_path_mtu_changed( dynamic_cast<c_peering_udp&>( peer ) );
+				m_loop_keepalive_due = std::min( m_loop_keepalive_due , peer.m_path_mtu.get_due_time() ); // e.g. next probe at once
+			} else {
+				if (peer.m_link_quality.on_ping_reply( seq , sent_time , now )) {
+					peer.m_keepalive.on_ping_reply();
+					peering_link_state_update( peer );
+				}
+				_info("Ping reply from " << peer.get_hip() << " link is now: " << peer.get_link_quality());
+			}
 		}
-		catch (std::exception &e) {
-			_warn("### !!! ### Parsing network data caused an exception: " << e.what());
+		else {
+			_warn("??????????????????? Unknown protocol command, cmd="<<cmd);
+			metrics_drop(e_drop_unknown_command);
+			return true; // skip this packet (main loop)
 		}
+		// ------------------------------------
+
+	}
+	else _info("Idle. " << node_title_bar);
 
-// stats-TODO(r) counters
-//		int sent=0;
-//		counter.tick(sent, std::cout);
-//		counter_big.tick(sent, std::cout);
 	}
+	catch (std::exception &e) {
+		_warn("### !!! ### Parsing network data caused an exception: " << e.what());
+		metrics_drop(e_drop_exception);
+	}
+
+	return anything_happened;
 }
 
 void c_tunserver::run() {
@@ -1179,6 +2045,15 @@ void c_tunserver::run() {
 	event_loop();
 }
 
+void c_tunserver::run_start() {
+	prepare_socket();
+	event_loop_start();
+}
+
+bool c_tunserver::run_step() {
+	return event_loop_step();
+}
+
 
 void c_tunserver::program_action_set_IDI(const string & keyname) {
 	_note("Action: set IDI");
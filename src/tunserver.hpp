@@ -8,9 +8,13 @@
 #include <iostream>
 #include <stdexcept>
 #include <vector>
+#include <deque>
+#include <set>
 #include <string>
 #include <iomanip>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <streambuf>
 
 #include <stdio.h>
@@ -39,6 +43,8 @@
 #include "c_tun_device.hpp"
 #include "c_udp_wrapper.hpp"
 #include "c_event_manager.hpp"
+#include "c_program_clock.hpp"
+#include "c_metrics.hpp"
 
 // ------------------------------------------------------------------
 
@@ -90,6 +96,12 @@ class c_routing_manager { ///< holds knowledge about routes, and searches for ne
 
 		typedef	std::chrono::steady_clock::time_point t_route_time; ///< type for representing times using in routing search etc
 
+		typedef uint32_t t_flow_hash; ///< stable hash of a flow (e.g. of inner IPv6 5-tuple), to pick same path for all packets of it
+
+		static constexpr size_t route_nexthop_max = 3; ///< [confroute] how many next hops (multipath / ECMP) we remember per destination
+		static constexpr int route_multipath_cost_slack = 2; ///< [confroute] spread flows also over paths that cost up to this much more then the best (see c_link_quality costs)
+		static constexpr int route_cost_hysteresis = 3; ///< [confroute] smaller changes of cost of a route are ignored (e.g. RTT jitter), so routes are not changed all the time
+
 		class c_route_info {
 			public:
 				t_route_state m_state; ///< e.g. e_route_state_found is route is ready to be used
@@ -97,12 +109,34 @@ class c_routing_manager { ///< holds knowledge about routes, and searches for ne
 				c_haship_pubkey m_pubkey;
 
 				int m_cost; ///< some general cost - currently e.g. in number of hops
+				int m_cost_of_link; ///< part of m_cost that is the link to next hop (the rest is what next hop told us); all of it for direct peer
 				t_route_time m_time; ///< age of this route
 				// int m_ttl; ///< at which TTL we got this reply
 
-				c_route_info(c_haship_addr nexthop, int cost, const c_haship_pubkey & pubkey);
+				c_route_info(c_haship_addr nexthop, int cost, const c_haship_pubkey & pubkey); ///< route to the next hop itself (cost is all of the link)
+				c_route_info(c_haship_addr nexthop, int cost, const c_haship_pubkey & pubkey, int cost_of_link);
 
 				int get_cost() const;
+				bool is_alive() const; ///< can this route be used now (e.g. it is not dead)
+		};
+
+		/***
+		@brief All known routes (up to route_nexthop_max) to one destination, each via other next hop.
+		Flows are spread over the alive cheapest routes by a stable hash (rendezvous hashing), so packets of one flow
+		are not reordered, and when one route dies only flows that used it are moved.
+		*/
+		class c_route_multipath {
+			public:
+				std::vector< unique_ptr<c_route_info> > m_route; ///< the routes, at most one per next hop
+
+				///! learn this route (merging by next hop). Returns the stored route, or throws expected_not_found if it was not worth keeping
+				const c_route_info & add_or_update(const c_route_info & route_info);
+				///! pick the route for given flow, from the alive routes. Throws expected_not_found if none is alive
+				const c_route_info & get_route_for_flow(t_flow_hash flow_hash) const;
+				///! the routes that flows are spread over: alive, and not much more costly then the best one (empty if none is alive)
+				std::vector<const c_route_info*> get_routes_for_flows() const;
+				bool set_state_by_nexthop(c_haship_addr nexthop, t_route_state state); ///< returns true if we had route via this next hop
+				bool is_any_alive() const;
 		};
 
 		class c_route_reason {
@@ -152,13 +186,33 @@ class c_routing_manager { ///< holds knowledge about routes, and searches for ne
 		t_route_search_by_dst m_search; ///< running searches
 
 		// known routes:
-		typedef std::map< c_haship_addr, unique_ptr<c_route_info> > t_route_nexthop_by_dst; ///< routes to destinations: the hash-ip of next hop, by hash-ip of finall destination
-		t_route_nexthop_by_dst m_route_nexthop; ///< known routes: the hash-ip of next hop, indexed by hash-ip of finall destination
+		typedef std::map< c_haship_addr, c_route_multipath > t_route_nexthop_by_dst; ///< routes to destinations: the hash-ip of next hops, by hash-ip of finall destination
+		t_route_nexthop_by_dst m_route_nexthop; ///< known routes: the hash-ip of next hops, indexed by hash-ip of finall destination
+
+		const c_route_info & add_route_info_and_return(c_haship_addr target, c_route_info route_info); ///< learn a route to this target. If it exists, then merge it correctly (e.g. keep the better ones)
 
-		const c_route_info & add_route_info_and_return(c_haship_addr target, c_route_info route_info); ///< learn a route to this target. If it exists, then merge it correctly (e.g. pick better one)
+		uint64_t m_generation; ///< changes each time the known routes change (next hops, states, or costs by route_cost_hysteresis), so caches of them can be rebuilt
+		std::set<c_haship_addr> m_nexthop_dead; ///< next hops marked dead by set_nexthop_state(): routes learned via them are dead too
 
 	public:
-		const c_route_info & get_route_or_maybe_search(c_galaxy_node & galaxy_node , c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search, int search_ttl);
+		c_routing_manager();
+
+		const c_route_info & get_route_or_maybe_search(c_galaxy_node & galaxy_node , c_haship_addr dst, c_routing_manager::c_route_reason reason, bool start_search, int search_ttl,
+			t_flow_hash flow_hash);
+		uint64_t get_generation() const; ///< see m_generation
+		///! next hops that flows to dst are spread over, in the order that choose_nexthop_for_flow() expects (empty if none)
+		std::vector<c_haship_addr> get_nexthops_for_flows(c_haship_addr dst) const;
+		///! rendezvous hashing: index of next hop with highest weight(flow,nexthop); also used by the fast path of transit
+		static size_t choose_nexthop_for_flow(const std::vector<c_haship_addr> & nexthops, t_flow_hash flow_hash);
+
+		void set_nexthop_state(c_haship_addr nexthop, t_route_state state); ///< e.g. mark all routes via this next hop as dead (instant failover to other paths)
+		///! link to this next hop (direct peer) is up or down (see c_link_quality::is_up): routes via it are alive or dead; true if it changed
+		bool set_nexthop_link_up(c_haship_addr nexthop, bool up);
+		///! cost of link to this next hop (direct peer) is now link_cost: re-cost all routes via it; true if some changed (by route_cost_hysteresis)
+		bool set_nexthop_link_cost(c_haship_addr nexthop, int link_cost);
+
+		static t_flow_hash flow_hash_of_ipv6(const char *buff, size_t buff_size); ///< flow hash from (inner) IPv6 packet: src, dst, next-header, ports
+		static t_flow_hash flow_hash_of_hips(c_haship_addr src_hip, c_haship_addr dst_hip); ///< flow hash when we see only the end2end HIPs
 };
 
 
@@ -182,11 +236,20 @@ class c_tunnel_use : public antinet_crypto::c_crypto_tunnel {
 
 class c_tunserver : public c_galaxy_node {
 	public:
-		c_tunserver();
+		static constexpr double limit_unknown_packets_per_second = 200; ///< [security] datagrams from all non-peers together (hello, ping)
+		static constexpr double limit_unknown_bytes_per_second = 256 * 1024;
+
+		c_tunserver(); ///< uses the real TUN and UDP of this system
+		///! uses given devices instead, e.g. the in-memory ones of the simulator
+		c_tunserver(unique_ptr<c_tun_device> && tun_device, unique_ptr<c_udp_wrapper> && udp_device,
+			unique_ptr<c_event_manager> && event_manager);
 		void set_desc(shared_ptr< boost::program_options::options_description > desc);
 
 		void configure_mykey(); ///<  load my (this node's) keypair
+		void configure_mykey(antinet_crypto::c_multikeys_PAIR & my_IDI); ///< use this IDI keypair (e.g. not from datastore)
 		void run(); ///< run the main loop
+		void run_start(); ///< instead of run(): prepare to run the main loop by calls to run_step() (e.g. in simulator)
+		bool run_step(); ///< one step of main loop, returns true if some input was processed (so call it again)
 
 		/// @name Functions that execute a program action like creation of key, calculating signature, etc.
 		/// @{
@@ -197,6 +260,22 @@ class c_tunserver : public c_galaxy_node {
 
 
 		void set_my_name(const string & name); ///< set a nice name of this peer (shown in debug for example)
+		void set_aggregation_delay(std::chrono::microseconds max_delay); ///< how long small data frames can wait to be sent together to a peer; zero disables
+		void set_flow_compression(bool enabled); ///< compress headers of tunneled data to peers that can decode it (see c_flow_compression.hpp)
+		/// of queues for datagrams waiting for room in UDP socket; smaller send_buffer_size (SO_SNDBUF, 0 is default) makes them wait there
+		void set_send_scheduler_limits(const c_send_scheduler::t_limits & limits, int send_buffer_size);
+		///! biggest UDP datagram (payload) to probe for in path MTU discovery to each peer (see c_path_mtu), for peers added from now on;
+		///c_path_mtu::size_base disables probing
+		void set_path_mtu_max(size_t size);
+		void set_io_uring(bool enabled); ///< wait and read with io_uring (when TUN is ready in run()), if kernel has it; else select()
+		/// pin the thread that will run the event loop (in run()) to these CPUs, and take its packet memory from their NUMA node
+		void set_event_loop_cpus(const std::vector<int> & cpus);
+		/// spin for events this long before blocking in each wait (see c_event_manager::set_busy_poll), also SO_BUSY_POLL of UDP
+		void set_busy_poll(std::chrono::microseconds time);
+		void set_tun_offload(bool enabled); ///< use TUN offloads if the device has them (see c_tun_device::set_offload); call before run()
+		void start_rpc_server(unsigned short port); ///< start listening for RPC commands (e.g. "metrics") on this TCP port
+		/// limit of what each peer can send to us; thread safe (e.g. from RPC), used from the next step of event loop
+		void set_rate_limit(const t_rate_limit & limit);
 		const antinet_crypto::c_multikeys_pub & read_my_IDP_pub() const; ///< read the pubkey of the (main / permanent) ID of this server
 		string get_my_ipv6_nice() const; ///< returns the main HIP IPv6 of this node in a nice format (e.g. hexdot)
 		int get_my_stats_peers_known_count() const; ///< get the number of currently known peers, for information
@@ -205,6 +284,7 @@ class c_tunserver : public c_galaxy_node {
 		void add_peer_simplestring(const string & simple); ///< add this as peer, from a simple string like "ip-pub" TODO(r) instead move that to ctor of t_peering_reference
 		///! add this user (or append existing user) with his actuall public key data
 		void add_peer_append_pubkey(const t_peering_reference & peer_ref, unique_ptr<c_haship_pubkey> && pubkey);
+		void delete_peer(const c_haship_addr & hip); ///< he is not our peer anymore: routes via him die, his metrics are removed; from event loop
 		void add_tunnel_to_pubkey(const c_haship_pubkey & pubkey);
 
 
@@ -221,17 +301,21 @@ class c_tunserver : public c_galaxy_node {
 
 	protected:
 		void prepare_socket(); ///< make sure that the lower level members of handling the socket are ready to run
+		void prepare_io_uring(); ///< switch m_event_manager to io_uring if requested (and possible); TUN must be configured
+		void prepare_cpu_placement(); ///< pin the calling thread (that runs event loop) as set by set_event_loop_cpus()
 		void event_loop(); ///< the main loop
-		void wait_for_fd_event(); ///< waits for event of I/O being ready, needs valid m_tun_fd and others, saves the fd_set into m_fd_set_data
+		void event_loop_start(); ///< before first event_loop_step()
+		bool event_loop_step(); ///< waits for event (or timeout) and handles it, returns true if some input was processed
 
-		std::pair<c_haship_addr,c_haship_addr> parse_tun_ip_src_dst(const char *buff, size_t buff_size, unsigned char ipv6_offset); ///< from buffer of TUN-format, with ipv6 bytes at ipv6_offset, extract ipv6 (hip) destination
+		static std::pair<c_haship_addr,c_haship_addr> parse_tun_ip_src_dst(const char *buff, size_t buff_size, unsigned char ipv6_offset); ///< from buffer of TUN-format, with ipv6 bytes at ipv6_offset, extract ipv6 (hip) destination
 		std::pair<c_haship_addr,c_haship_addr> parse_tun_ip_src_dst(const char *buff, size_t buff_size); ///< the same, but with ipv6_offset that matches our current TUN
 
 		///@brief push the tunneled data to where they belong. On failure returns false or throws, true if ok.
 		bool route_tun_data_to_its_destination_top(t_route_method method,
 			const char *buff, size_t buff_size,
 			c_haship_addr src_hip, c_haship_addr dst_hip,
-			c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used);
+			c_routing_manager::c_route_reason reason, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+			c_routing_manager::t_flow_hash flow_hash);
 
 		///@brief more advanced version for use in routing
 		bool route_tun_data_to_its_destination_detail(t_route_method method,
@@ -239,41 +323,76 @@ class c_tunserver : public c_galaxy_node {
 			c_haship_addr src_hip, c_haship_addr dst_hip,
 			c_haship_addr next_hip,
 			c_routing_manager::c_route_reason reason,
-			int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used);
-
-		void peering_ping_all_peers();
+			int recurse_level, int data_route_ttl, antinet_crypto::t_crypto_nonce nonce_used,
+			c_routing_manager::t_flow_hash flow_hash);
+
+		///@brief sends keepalive (ping, or our hello) and path MTU probes to peers that are due (see c_keepalive, c_path_mtu),
+		///returns how long we can wait till next ones are due
+		std::chrono::microseconds peering_keepalive(std::chrono::steady_clock::time_point now);
+		void peering_send_hello(c_peering_udp & peer); ///< our public_hi, with our keys [protocol]
+		void peering_send_ping(c_peering_udp & peer); ///< timestamped ping, to measure link (see c_link_quality) [protocol]
+		void peering_link_state_update(const c_peering & peer); ///< routes via him die or come back as his link is down or up, and follow cost of his link
+		void peering_send_probe(c_peering_udp & peer, size_t size); ///< ping padded to size, not fragmented, to probe path MTU [protocol]
+		void peering_path_mtu_changed(c_peering_udp & peer);
+		size_t get_inner_mtu(const c_peering & peer) const; ///< biggest IPv6 packet from TUN that gets to this peer not fragmented (at least 1280)
+		size_t get_inner_mtu_to(const c_haship_addr & dst_hip); ///< get_inner_mtu() of next hops to this destination, 0 if none is known
+		void tun_mtu_update(); ///< MTU of TUN: the biggest get_inner_mtu() of peers (bigger packets to other peers get Packet Too Big)
 		void debug_peers();
 
+		///@brief cut-through relay of tunneled_data frame that is not for us: checks fixed header, decrements TTL in place,
+		///and sends the same buffer to next hop from m_forwarding_table. Does not allocate nor parse the blob.
+		///Returns false if the slow path must handle it (e.g. frame is for us, or we do not know the route yet).
+		bool forward_transit_fast(char *buff, size_t buff_size, const c_peering * sender);
+		///@brief as forward_transit_fast() but for e_proto_cmd_tunneled_data_flow frame, with header as decoded by m_flow_rx of sender:
+		///the next hop gets the same buffer with only FLOW_ID rewritten, if it uses the same flow (see c_peering_udp::send_data_udp_relayed)
+		bool forward_transit_fast_flow(char *buff, size_t buff_size, const c_peering * sender, const c_haship_addr & src_hip,
+			const c_haship_addr & dst_hip, unsigned char ttl, const t_flow_nonce & nonce, const t_bytes_view & blob);
+		///@brief next hop from m_forwarding_table for transit data src->dst, with ttl decremented, and flow_hash of it; nullptr if
+		///it is not for fast path (then dropped=false), or if it was dropped (and counted in metrics, dropped=true)
+		c_peering_udp * forward_transit_nexthop(const c_haship_addr & src_hip, const c_haship_addr & dst_hip,
+			const c_peering * sender, unsigned char & ttl, c_send_scheduler::t_flow & flow_hash, bool & dropped);
+		void forwarding_table_rebuild(); ///< recalculate m_forwarding_table from direct peers and known routes
+		///@brief sends the aggregated data frames that waited long enough, returns how long we can wait for events until next ones are due
+		std::chrono::microseconds peering_flush_aggregated(std::chrono::steady_clock::time_point now);
+
+		typedef enum { ///< why was a packet dropped, for metrics
+			e_drop_tun_not_galaxy=0, ///< data from TUN to address outside of our network
+			e_drop_no_tunnel, ///< no end2end tunnel (yet) to encrypt or decrypt it
+			e_drop_invalid, ///< malformed frame
+			e_drop_unknown_flow, ///< compressed flow that we do not know
+			e_drop_ttl_expired,
+			e_drop_next_hop_is_sender,
+			e_drop_limit_points, ///< sender used up his limit (see c_peering::rate_limit_allow)
+			e_drop_limit_unknown, ///< non-peers together used up their limit (see unknown_sender_allow)
+			e_drop_no_route,
+			e_drop_unknown_command,
+			e_drop_too_big, ///< our packet that would be fragmented on the way (we sent Packet Too Big to TUN)
+			e_drop_version, ///< command in protocol version that we can not parse (see c_protocol::command_is_valid_in_version)
+			e_drop_exception, ///< handling of the frame failed
+			e_drop_reasons_count
+		} t_drop_reason;
+		void metrics_drop(t_drop_reason reason); ///< count the packet dropped now
+		void metrics_command_received(c_protocol::t_proto_cmd cmd, size_t size);
+		void metrics_tunnel(const c_haship_addr & hip, bool sent, size_t size); ///< count our data sent into (or received from) end2end tunnel
+		void metrics_handshake_started(const c_haship_addr & hip); ///< we need tunnel to him, and do not have it yet
+
 
 	private:
 		string m_my_name; ///< a nice name, see set_my_name
 		//int m_tun_fd; ///< fd of TUN file
-		#ifdef __linux__
-		c_tun_device_linux m_tun_device;
-		c_udp_wrapper_linux m_udp_device;
-		c_event_manager_linux m_event_manager;
-		#endif
-		#if defined(_WIN32) || defined(__CYGWIN__)
-		c_tun_device_windows m_tun_device;
-		c_udp_wrapper_windows m_udp_device;
-		c_event_manager_windows m_event_manager;
-		#endif
-
-		//#else
-		//c_tun_device_empty m_tun_device;
-		//c_udp_wrapper_empty m_udp_device;
-		//c_event_manager_empty m_event_manager;
-		//#endif
+		unique_ptr<c_tun_device> m_tun_device;
+		unique_ptr<c_udp_wrapper> m_udp_device;
+		unique_ptr<c_event_manager> m_event_manager; ///< waits for input on m_tun_device and m_udp_device
 		unsigned char m_tun_header_offset_ipv6; ///< current offset in TUN/TAP data to the position of ipv6
 
 		shared_ptr< boost::program_options::options_description > m_desc; ///< The boost program options that I will be using. (Needed for some internal commands)
 
 //		int m_sock_udp; ///< the main network socket (UDP listen, send UDP to each peer)
 
-		fd_set m_fd_set_data; ///< select events e.g. wait for UDP peering or TUN input
-
 		typedef std::map< c_haship_addr, unique_ptr<c_peering> > t_peers_by_haship; ///< peers (we always know their IPv6 - we assume here), indexed by their hash-ip
 		t_peers_by_haship m_peer; ///< my peers, indexed by their hash-ip
+		typedef std::map< c_ip46_addr, c_peering*, c_send_scheduler::t_address_less > t_peers_by_pip; ///< by IP and port (peers can be behind one NAT)
+		t_peers_by_pip m_peer_by_pip; ///< the same peers as m_peer, by their peering address - to find who sent a datagram
 
 		t_peers_by_haship m_nodes; ///< all the nodes that I know about to some degree
 
@@ -285,12 +404,83 @@ class c_tunserver : public c_galaxy_node {
 
 		std::map< c_haship_addr, unique_ptr<c_tunnel_use> > m_tunnel; ///< my crypto tunnels
 
+		struct t_forwarding_entry {
+			std::vector<c_peering_udp*> m_nexthop; ///< direct peers
+			std::vector<c_haship_addr> m_nexthop_hip; ///< the same, for c_routing_manager::choose_nexthop_for_flow()
+			size_t m_inner_mtu; ///< the smallest get_inner_mtu() of m_nexthop (flows can use any of them), see get_inner_mtu_to()
+		};
+		typedef std::map< c_haship_addr, t_forwarding_entry > t_forwarding_table; ///< next hops by final dst hip
+		t_forwarding_table m_forwarding_table; ///< precomputed for forward_transit_fast(), pointers into m_peer
+		bool m_forwarding_table_dirty; ///< set when m_peer (or path MTU of one) changes
+		uint64_t m_forwarding_table_generation; ///< m_routing_manager generation from which the table was built
+
+		std::chrono::microseconds m_aggregation_delay; ///< see set_aggregation_delay()
+		bool m_flow_compression; ///< see set_flow_compression()
+		bool m_io_uring_requested; ///< see set_io_uring()
+		std::vector<int> m_event_loop_cpus; ///< see set_event_loop_cpus(), empty: not pinned
+		std::chrono::microseconds m_busy_poll; ///< see set_busy_poll()
+		size_t m_path_mtu_max; ///< see set_path_mtu_max()
+		uint32_t m_tun_mtu; ///< as set on m_tun_device by tun_mtu_update(), 0 before
+
+		/// @name State of event loop, between its steps
+		/// @{
+		std::chrono::steady_clock::time_point m_loop_keepalive_due; ///< the earliest c_keepalive::get_due_time() of peers; min() when not known
+		std::string m_loop_udp_aggregated; ///< received e_proto_cmd_aggregated datagram, while its frames are pending
+		std::deque<c_packet_aggregator::t_frame_view> m_loop_udp_frames_pending; ///< frames in m_loop_udp_aggregated, to process before reading more
+		c_ip46_addr m_loop_udp_frames_pending_sender; ///< the peer that sent them
+		c_peering * m_loop_udp_frames_pending_sender_peer; ///< the same peer as found for the datagram, nullptr if we do not know him
+		bool m_loop_was_connected;
+		bool m_loop_was_anything_sent_from_TUN, m_loop_was_anything_sent_to_TUN;
+		long int m_loop_send_kept_steps; ///< steps since m_udp_device keeps datagrams to send together
+		/// @}
+
+		/// @name Rate limit of peers; the pending changes come from other threads (RPC), under m_rate_limit_mutex
+		/// @{
+		t_rate_limit m_rate_limit; ///< of each peer
+		std::mutex m_rate_limit_mutex;
+		std::atomic<bool> m_rate_limit_changed; ///< is anything pending
+		bool m_rate_limit_pending_set; ///< is there a new m_rate_limit_pending
+		t_rate_limit m_rate_limit_pending;
+		std::vector< std::pair<c_haship_addr, long int> > m_limit_points_pending; ///< extra points for peers
+		void rate_limit_apply_pending(); ///< in event loop
+		c_token_bucket m_limit_unknown_points; ///< datagrams from all senders that are not our peers (limit_unknown_packets_per_second)
+		c_token_bucket m_limit_unknown_bytes;
+		bool unknown_sender_allow(size_t size); ///< can we take this datagram from non-peer (checked before any parsing)
+		/// @}
+
+		/// @name Peers to delete, from other threads (RPC), under m_delete_peer_mutex
+		/// @{
+		std::mutex m_delete_peer_mutex;
+		std::atomic<bool> m_delete_peer_changed; ///< is anything pending
+		std::vector<c_haship_addr> m_delete_peer_pending;
+		void delete_peer_apply_pending(); ///< in event loop
+		/// @}
+
 //		c_haship_pubkey m_haship_pubkey; ///< pubkey of my IP
 //		c_haship_addr m_haship_addr; ///< my haship addres
 
-		c_peering & find_peer_by_sender_peering_addr( c_ip46_addr ip ) const ;
+		c_peering * find_peer_by_sender_peering_addr_or_null( c_ip46_addr ip ) const ; ///< by IP and port; nullptr if we do not know him
 
 		c_routing_manager m_routing_manager; ///< the routing engine used for most things
+
+		/// @name Metrics (see c_metrics), references to metrics owned by c_metrics
+		/// @{
+		std::array<c_metric_counter *, e_drop_reasons_count> m_metric_dropped; ///< by t_drop_reason
+		std::array<c_metric_counter *, 256> m_metric_command_packets; ///< by command, filled when first used
+		std::array<c_metric_counter *, 256> m_metric_command_bytes;
+		std::array<c_metric_counter *, 3> m_metric_keepalive; ///< by c_keepalive::t_action
+		struct t_tunnel_metrics {
+			c_metric_counter * m_sent_packets, * m_sent_bytes, * m_received_packets, * m_received_bytes;
+		};
+		std::map< c_haship_addr, t_tunnel_metrics > m_metric_tunnel; ///< by the other end of tunnel, filled when first used
+		std::map< c_haship_addr, c_program_clock::t_clock::time_point > m_metric_handshake_start; ///< when we started needing tunnel to him
+		c_metric_histogram & m_metric_handshake_time; ///< from m_metric_handshake_start to having the tunnel
+		c_metric_gauge & m_metric_peers;
+		c_metric_gauge & m_metric_tunnels;
+		c_metric_counter & m_metric_transit_fast; ///< frames relayed by forward_transit_fast*()
+		/// @}
+
+		unique_ptr<c_rpc_server> m_rpc_server; ///< see start_rpc_server()
 		/**
 		 * @param ip_string contain ip address and port, i.e. 127.0.0.1:5000
 		 * @retrun pair with ip string ad first and port as second
@@ -298,12 +488,21 @@ class c_tunserver : public c_galaxy_node {
 		 * Exception safety: strong exception guarantee
 		 */
 		std::pair<string,int> parse_ip_string(const std::string &ip_string);
-//		c_rpc_server m_rpc_server;
-//		/**
-//		 * @brief rpc_add_limit_points
-//		 * @param peer_ip peer hash ip
-//		 */
-//		bool rpc_add_limit_points(const std::string &peer_ip);
+		/**
+		 * @brief rpc_add_limit_points gives extra packets to peer (above his rate limit), from next step of event loop
+		 * @param args peer hash ip, and optionally the number of points (default 1000), e.g. "fd42:... 5000"
+		 */
+		bool rpc_add_limit_points(const std::string &args);
+		/**
+		 * @brief rpc_set_rate_limit sets the limit of each peer (see t_rate_limit), 0 is no limit
+		 * @param args packets per second, packets burst, bytes per second, bytes burst, e.g. "20000 2000 50000000 5000000"
+		 */
+		bool rpc_set_rate_limit(const std::string &args);
+		/**
+		 * @brief rpc_delete_peer deletes the peer (see delete_peer()), from next step of event loop
+		 * @param args peer hash ip, e.g. "fd42:..."
+		 */
+		bool rpc_delete_peer(const std::string &args);
 };
 
 // ------------------------------------------------------------------